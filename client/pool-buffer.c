@@ -56,77 +56,202 @@ static const struct wl_buffer_listener buffer_listener = {
 	.release = buffer_release
 };
 
+static void destroy_buffer_contexts(struct pool_buffer *buffer) {
+	if (buffer->cairo) {
+		cairo_destroy(buffer->cairo);
+		buffer->cairo = NULL;
+	}
+	if (buffer->surface) {
+		cairo_surface_destroy(buffer->surface);
+		buffer->surface = NULL;
+	}
+	if (buffer->pango) {
+		g_object_unref(buffer->pango);
+		buffer->pango = NULL;
+	}
+}
+
+static void create_buffer_contexts(struct buffer_pool *pool,
+		struct pool_buffer *buf) {
+	buf->data = (char *)pool->data + buf->offset;
+	buf->surface = cairo_image_surface_create_for_data(buf->data,
+			CAIRO_FORMAT_ARGB32, buf->width, buf->height, buf->width * 4);
+	buf->cairo = cairo_create(buf->surface);
+	buf->pango = pango_cairo_create_context(buf->cairo);
+}
+
+static void destroy_buffer(struct pool_buffer *buffer) {
+	if (buffer->buffer) {
+		wl_buffer_destroy(buffer->buffer);
+	}
+	destroy_buffer_contexts(buffer);
+	memset(buffer, 0, sizeof(struct pool_buffer));
+}
+
+static bool pool_region_free(struct buffer_pool *pool, size_t offset,
+		size_t size) {
+	for (int i = 0; i < POOL_MAX_BUFFERS; ++i) {
+		struct pool_buffer *buf = &pool->buffers[i];
+		if (buf->buffer && offset < buf->offset + buf->size &&
+				buf->offset < offset + size) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool resize_pool(struct wl_shm *shm, struct buffer_pool *pool,
+		size_t size) {
+	if (!pool->pool) {
+		char *name;
+		int fd = create_pool_file(size, &name);
+		if (fd == -1) {
+			return false;
+		}
+		unlink(name);
+		free(name);
+		void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (data == MAP_FAILED) {
+			close(fd);
+			return false;
+		}
+		pool->fd = fd;
+		pool->data = data;
+		pool->size = size;
+		pool->pool = wl_shm_create_pool(shm, fd, size);
+		return true;
+	}
+
+	void *data;
+	if (ftruncate(pool->fd, size) < 0 || (data = mmap(NULL, size,
+				PROT_READ | PROT_WRITE, MAP_SHARED, pool->fd, 0)) == MAP_FAILED) {
+		return false;
+	}
+	wl_shm_pool_resize(pool->pool, size);
+	munmap(pool->data, pool->size);
+	pool->data = data;
+	pool->size = size;
+
+	// Busy buffers keep their contents, which live in the file
+	for (int i = 0; i < POOL_MAX_BUFFERS; ++i) {
+		struct pool_buffer *buf = &pool->buffers[i];
+		if (buf->buffer) {
+			destroy_buffer_contexts(buf);
+			create_buffer_contexts(pool, buf);
+		}
+	}
+	return true;
+}
+
 static struct pool_buffer *create_buffer(struct wl_shm *shm,
-		struct pool_buffer *buf, int32_t width, int32_t height,
-		uint32_t format) {
+		struct buffer_pool *pool, struct pool_buffer *buf, int32_t width,
+		int32_t height, uint32_t format) {
 	uint32_t stride = width * 4;
 	size_t size = stride * height;
 
-	char *name;
-	int fd = create_pool_file(size, &name);
-	assert(fd != -1);
-	void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-	struct wl_shm_pool *pool = wl_shm_create_pool(shm, fd, size);
-	buf->buffer = wl_shm_pool_create_buffer(pool, 0,
-			width, height, stride, format);
-	wl_shm_pool_destroy(pool);
-	close(fd);
-	unlink(name);
-	free(name);
+	// Use the first gap between the other buffers which fits, or append
+	size_t offset = 0;
+	if (!pool_region_free(pool, offset, size)) {
+		size_t end = 0;
+		for (int i = 0; i < POOL_MAX_BUFFERS; ++i) {
+			struct pool_buffer *other = &pool->buffers[i];
+			if (!other->buffer) {
+				continue;
+			}
+			size_t other_end = other->offset + other->size;
+			if (other_end > end) {
+				end = other_end;
+			}
+			if (other_end + size <= pool->size &&
+					pool_region_free(pool, other_end, size) &&
+					(offset == 0 || other_end < offset)) {
+				offset = other_end;
+			}
+		}
+		if (offset == 0) {
+			offset = end;
+		}
+	}
 
+	int max_buffers = pool->max_buffers > 0 ?
+		pool->max_buffers : POOL_DEFAULT_BUFFERS;
+	if (offset + size > pool->size) {
+		size_t pool_size = offset + size;
+		if (!pool->pool && pool_size < size * max_buffers) {
+			// Leave room for the other buffers at this size
+			pool_size = size * max_buffers;
+		} else if (pool_size < pool->size + pool->size / 2) {
+			pool_size = pool->size + pool->size / 2;
+		}
+		if (!resize_pool(shm, pool, pool_size)) {
+			return NULL;
+		}
+	}
+
+	buf->buffer = wl_shm_pool_create_buffer(pool->pool, offset,
+			width, height, stride, format);
 	buf->size = size;
+	buf->offset = offset;
 	buf->width = width;
 	buf->height = height;
-	buf->data = data;
-	buf->surface = cairo_image_surface_create_for_data(data,
-			CAIRO_FORMAT_ARGB32, width, height, stride);
-	buf->cairo = cairo_create(buf->surface);
-	buf->pango = pango_cairo_create_context(buf->cairo);
+	create_buffer_contexts(pool, buf);
 
 	wl_buffer_add_listener(buf->buffer, &buffer_listener, buf);
 	return buf;
 }
 
-void destroy_buffer(struct pool_buffer *buffer) {
-	if (buffer->buffer) {
-		wl_buffer_destroy(buffer->buffer);
+void finish_buffer_pool(struct buffer_pool *pool) {
+	for (int i = 0; i < POOL_MAX_BUFFERS; ++i) {
+		destroy_buffer(&pool->buffers[i]);
 	}
-	if (buffer->cairo) {
-		cairo_destroy(buffer->cairo);
+	if (pool->pool) {
+		wl_shm_pool_destroy(pool->pool);
+		munmap(pool->data, pool->size);
+		close(pool->fd);
 	}
-	if (buffer->surface) {
-		cairo_surface_destroy(buffer->surface);
-	}
-	if (buffer->pango) {
-		g_object_unref(buffer->pango);
-	}
-	if (buffer->data) {
-		munmap(buffer->data, buffer->size);
-	}
-	memset(buffer, 0, sizeof(struct pool_buffer));
+	memset(pool, 0, sizeof(struct buffer_pool));
 }
 
 struct pool_buffer *get_next_buffer(struct wl_shm *shm,
-		struct pool_buffer pool[static 2], uint32_t width, uint32_t height) {
-	struct pool_buffer *buffer = NULL;
+		struct buffer_pool *pool, uint32_t width, uint32_t height) {
+	int max_buffers = pool->max_buffers > 0 ?
+		pool->max_buffers : POOL_DEFAULT_BUFFERS;
+	if (max_buffers > POOL_MAX_BUFFERS) {
+		max_buffers = POOL_MAX_BUFFERS;
+	}
 
-	for (size_t i = 0; i < 2; ++i) {
-		if (pool[i].busy) {
+	// Prefer an idle buffer of the right size, which needs no setup
+	struct pool_buffer *buffer = NULL;
+	for (int i = 0; i < max_buffers; ++i) {
+		struct pool_buffer *buf = &pool->buffers[i];
+		if (buf->busy) {
 			continue;
 		}
-		buffer = &pool[i];
+		if (buf->buffer && buf->width == width && buf->height == height) {
+			buffer = buf;
+			break;
+		}
+		if (!buffer) {
+			buffer = buf;
+		}
 	}
 
 	if (!buffer) {
 		return NULL;
 	}
 
-	if (buffer->width != width || buffer->height != height) {
-		destroy_buffer(buffer);
-	}
-
-	if (!buffer->buffer) {
-		if (!create_buffer(shm, buffer, width, height,
+	if (!buffer->buffer || buffer->width != width ||
+			buffer->height != height) {
+		// Idle buffers of the old size would be recreated anyway, so free
+		// their space before looking for room for this one
+		for (int i = 0; i < POOL_MAX_BUFFERS; ++i) {
+			struct pool_buffer *buf = &pool->buffers[i];
+			if (!buf->busy && buf->buffer &&
+					(buf->width != width || buf->height != height)) {
+				destroy_buffer(buf);
+			}
+		}
+		if (!create_buffer(shm, pool, buffer, width, height,
 					WL_SHM_FORMAT_ARGB8888)) {
 			return NULL;
 		}
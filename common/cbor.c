@@ -0,0 +1,337 @@
+#define _POSIX_C_SOURCE 200809L
+#include <json.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cbor.h"
+
+// Nesting limit when decoding, matching the tokener depth used by swaybar
+#define CBOR_MAX_DEPTH 256
+
+enum cbor_major_type {
+	CBOR_UNSIGNED = 0,
+	CBOR_NEGATIVE = 1,
+	CBOR_BYTES = 2,
+	CBOR_TEXT = 3,
+	CBOR_ARRAY = 4,
+	CBOR_MAP = 5,
+	CBOR_TAG = 6,
+	CBOR_SIMPLE = 7,
+};
+
+#define CBOR_FALSE 0xf4
+#define CBOR_TRUE 0xf5
+#define CBOR_NULL 0xf6
+#define CBOR_DOUBLE 0xfb
+
+struct cbor_writer {
+	char *data;
+	size_t len;
+	size_t size;
+	bool failed;
+};
+
+static bool writer_reserve(struct cbor_writer *w, size_t len) {
+	if (w->failed) {
+		return false;
+	}
+	if (w->len + len <= w->size) {
+		return true;
+	}
+	size_t size = w->size ? w->size : 256;
+	while (size < w->len + len) {
+		size *= 2;
+	}
+	char *data = realloc(w->data, size);
+	if (!data) {
+		w->failed = true;
+		return false;
+	}
+	w->data = data;
+	w->size = size;
+	return true;
+}
+
+static void write_byte(struct cbor_writer *w, uint8_t byte) {
+	if (writer_reserve(w, 1)) {
+		w->data[w->len++] = byte;
+	}
+}
+
+static void write_bytes(struct cbor_writer *w, const void *data, size_t len) {
+	if (writer_reserve(w, len)) {
+		memcpy(w->data + w->len, data, len);
+		w->len += len;
+	}
+}
+
+static void write_head(struct cbor_writer *w, enum cbor_major_type type,
+		uint64_t value) {
+	uint8_t head[9];
+	size_t n;
+	head[0] = type << 5;
+	if (value < 24) {
+		head[0] |= value;
+		n = 0;
+	} else if (value <= UINT8_MAX) {
+		head[0] |= 24;
+		n = 1;
+	} else if (value <= UINT16_MAX) {
+		head[0] |= 25;
+		n = 2;
+	} else if (value <= UINT32_MAX) {
+		head[0] |= 26;
+		n = 4;
+	} else {
+		head[0] |= 27;
+		n = 8;
+	}
+	for (size_t i = 0; i < n; ++i) {
+		head[n - i] = (value >> (8 * i)) & 0xff;
+	}
+	write_bytes(w, head, n + 1);
+}
+
+static void write_object(struct cbor_writer *w, json_object *obj) {
+	switch (json_object_get_type(obj)) {
+	case json_type_null:
+		write_byte(w, CBOR_NULL);
+		break;
+	case json_type_boolean:
+		write_byte(w, json_object_get_boolean(obj) ? CBOR_TRUE : CBOR_FALSE);
+		break;
+	case json_type_int:;
+		int64_t i = json_object_get_int64(obj);
+		if (i >= 0) {
+			write_head(w, CBOR_UNSIGNED, (uint64_t)i);
+		} else {
+			write_head(w, CBOR_NEGATIVE, (uint64_t)(-1 - i));
+		}
+		break;
+	case json_type_double:;
+		double d = json_object_get_double(obj);
+		uint64_t bits;
+		memcpy(&bits, &d, sizeof(bits));
+		write_byte(w, CBOR_DOUBLE);
+		for (int shift = 56; shift >= 0; shift -= 8) {
+			write_byte(w, (bits >> shift) & 0xff);
+		}
+		break;
+	case json_type_string:;
+		size_t len = json_object_get_string_len(obj);
+		write_head(w, CBOR_TEXT, len);
+		write_bytes(w, json_object_get_string(obj), len);
+		break;
+	case json_type_array:;
+		size_t length = json_object_array_length(obj);
+		write_head(w, CBOR_ARRAY, length);
+		for (size_t j = 0; j < length; ++j) {
+			write_object(w, json_object_array_get_idx(obj, j));
+		}
+		break;
+	case json_type_object:
+		write_head(w, CBOR_MAP, json_object_object_length(obj));
+		json_object_object_foreach(obj, key, value) {
+			size_t key_len = strlen(key);
+			write_head(w, CBOR_TEXT, key_len);
+			write_bytes(w, key, key_len);
+			write_object(w, value);
+		}
+		break;
+	}
+}
+
+char *cbor_encode_json(json_object *obj, size_t *len) {
+	struct cbor_writer w = {0};
+	write_object(&w, obj);
+	if (w.failed) {
+		free(w.data);
+		return NULL;
+	}
+	*len = w.len;
+	return w.data;
+}
+
+struct cbor_reader {
+	const uint8_t *data;
+	size_t len;
+	size_t pos;
+};
+
+static bool read_head(struct cbor_reader *r, uint8_t *type, uint8_t *info,
+		uint64_t *value) {
+	if (r->pos >= r->len) {
+		return false;
+	}
+	uint8_t byte = r->data[r->pos++];
+	*type = byte >> 5;
+	*info = byte & 0x1f;
+	size_t n;
+	if (*info < 24) {
+		*value = *info;
+		return true;
+	} else if (*info == 24) {
+		n = 1;
+	} else if (*info == 25) {
+		n = 2;
+	} else if (*info == 26) {
+		n = 4;
+	} else if (*info == 27) {
+		n = 8;
+	} else {
+		// Reserved values and indefinite lengths
+		return false;
+	}
+	if (r->len - r->pos < n) {
+		return false;
+	}
+	*value = 0;
+	for (size_t i = 0; i < n; ++i) {
+		*value = (*value << 8) | r->data[r->pos++];
+	}
+	return true;
+}
+
+static double decode_half(uint16_t half) {
+	uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+	uint32_t exp = (half >> 10) & 0x1f;
+	uint32_t mant = half & 0x3ff;
+	if (exp == 0) {
+		double value = mant / 16777216.0; // mant * 2^-24
+		return sign ? -value : value;
+	}
+	uint32_t bits = exp == 0x1f ? sign | 0x7f800000 | (mant << 13) :
+		sign | ((exp - 15 + 127) << 23) | (mant << 13);
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+static bool read_string(struct cbor_reader *r, uint64_t len,
+		const char **str) {
+	if (r->len - r->pos < len) {
+		return false;
+	}
+	*str = (const char *)r->data + r->pos;
+	r->pos += len;
+	return true;
+}
+
+static bool read_object(struct cbor_reader *r, json_object **out, int depth) {
+	if (depth > CBOR_MAX_DEPTH) {
+		return false;
+	}
+	uint8_t type, info;
+	uint64_t value;
+	if (!read_head(r, &type, &info, &value)) {
+		return false;
+	}
+
+	*out = NULL;
+	switch (type) {
+	case CBOR_UNSIGNED:
+		*out = value <= INT64_MAX ? json_object_new_int64((int64_t)value) :
+			json_object_new_double((double)value);
+		return *out != NULL;
+	case CBOR_NEGATIVE:
+		*out = value <= INT64_MAX ? json_object_new_int64(-1 - (int64_t)value) :
+			json_object_new_double(-1.0 - (double)value);
+		return *out != NULL;
+	case CBOR_BYTES:
+	case CBOR_TEXT:;
+		const char *str;
+		if (!read_string(r, value, &str)) {
+			return false;
+		}
+		*out = json_object_new_string_len(str, (int)value);
+		return *out != NULL;
+	case CBOR_ARRAY:
+		// Every item takes at least one byte
+		if (value > r->len - r->pos || !(*out = json_object_new_array())) {
+			return false;
+		}
+		for (uint64_t i = 0; i < value; ++i) {
+			json_object *item;
+			if (!read_object(r, &item, depth + 1)) {
+				goto error;
+			}
+			json_object_array_add(*out, item);
+		}
+		return true;
+	case CBOR_MAP:
+		if (value > r->len - r->pos || !(*out = json_object_new_object())) {
+			return false;
+		}
+		for (uint64_t i = 0; i < value; ++i) {
+			uint8_t key_type, key_info;
+			uint64_t key_len;
+			const char *key;
+			if (!read_head(r, &key_type, &key_info, &key_len) ||
+					key_type != CBOR_TEXT ||
+					!read_string(r, key_len, &key)) {
+				goto error;
+			}
+			char *key_str = strndup(key, key_len);
+			json_object *item;
+			if (!key_str || !read_object(r, &item, depth + 1)) {
+				free(key_str);
+				goto error;
+			}
+			json_object_object_add(*out, key_str, item);
+			free(key_str);
+		}
+		return true;
+	case CBOR_TAG:
+		return read_object(r, out, depth + 1);
+	case CBOR_SIMPLE:
+		switch (info) {
+		case 20:
+		case 21:
+			*out = json_object_new_boolean(info == 21);
+			return *out != NULL;
+		case 22: // null
+		case 23: // undefined
+			return true;
+		case 25:
+			*out = json_object_new_double(decode_half((uint16_t)value));
+			return *out != NULL;
+		case 26:;
+			uint32_t bits32 = (uint32_t)value;
+			float f;
+			memcpy(&f, &bits32, sizeof(f));
+			*out = json_object_new_double(f);
+			return *out != NULL;
+		case 27:;
+			double d;
+			memcpy(&d, &value, sizeof(d));
+			*out = json_object_new_double(d);
+			return *out != NULL;
+		default:
+			return false;
+		}
+	}
+	return false;
+
+error:
+	json_object_put(*out);
+	*out = NULL;
+	return false;
+}
+
+bool cbor_decode_json(const char *data, size_t len, json_object **out) {
+	struct cbor_reader r = {
+		.data = (const uint8_t *)data,
+		.len = len,
+	};
+	json_object *obj;
+	if (!read_object(&r, &obj, 0)) {
+		return false;
+	}
+	if (r.pos != r.len) {
+		json_object_put(obj);
+		return false;
+	}
+	*out = obj;
+	return true;
+}
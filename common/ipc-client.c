@@ -1,4 +1,8 @@
 #define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <json.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -6,8 +10,10 @@
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <unistd.h>
+#include "cbor.h"
 #include "ipc-client.h"
 #include "log.h"
+#include "loop.h"
 
 static const char ipc_magic[] = {'i', '3', '-', 'i', 'p', 'c'};
 
@@ -147,3 +153,456 @@ char *ipc_single_command(int socketfd, uint32_t type, const char *payload, uint3
 
 	return response;
 }
+
+bool ipc_set_encoding(int socketfd, enum ipc_encoding encoding) {
+	// Servers which do not know SET_ENCODING do not reply to it, so it is
+	// followed by GET_VERSION, which every server answers. If that reply comes
+	// first, the encoding was not understood and is left unchanged.
+	const char *name = encoding == IPC_ENCODING_CBOR ? "cbor" : "json";
+	uint32_t len = strlen(name);
+	uint32_t types[] = { IPC_SET_ENCODING, IPC_GET_VERSION };
+	uint32_t lens[] = { len, 0 };
+	char data[2 * IPC_HEADER_SIZE + 4];
+	size_t size = 0;
+	for (size_t i = 0; i < 2; ++i) {
+		memcpy(data + size, ipc_magic, sizeof(ipc_magic));
+		memcpy(data + size + sizeof(ipc_magic), &lens[i], sizeof(lens[i]));
+		memcpy(data + size + sizeof(ipc_magic) + sizeof(lens[i]), &types[i],
+				sizeof(types[i]));
+		size += IPC_HEADER_SIZE;
+		if (i == 0) {
+			memcpy(data + size, name, len);
+			size += len;
+		}
+	}
+	if (write(socketfd, data, size) != (ssize_t)size) {
+		sway_abort("Unable to send IPC request");
+	}
+
+	struct ipc_response *resp = ipc_recv_response(socketfd);
+	if (!resp) {
+		return false;
+	}
+	if (resp->type != IPC_SET_ENCODING) {
+		sway_log(SWAY_DEBUG, "IPC server does not support SET_ENCODING");
+		free_ipc_response(resp);
+		return false;
+	}
+	json_object *reply = ipc_parse_payload(resp->payload, resp->size,
+			IPC_ENCODING_JSON);
+	free_ipc_response(resp);
+	json_object *success;
+	bool ret = json_object_object_get_ex(reply, "success", &success) &&
+		json_object_get_boolean(success);
+	json_object_put(reply);
+
+	// Discard the version reply, which is already in the new encoding
+	resp = ipc_recv_response(socketfd);
+	if (resp) {
+		free_ipc_response(resp);
+	}
+	return ret;
+}
+
+json_object *ipc_parse_payload(const char *payload, uint32_t size,
+		enum ipc_encoding encoding) {
+	if (encoding == IPC_ENCODING_CBOR) {
+		json_object *result;
+		if (!cbor_decode_json(payload, size, &result)) {
+			sway_log(SWAY_ERROR, "failed to parse payload as cbor");
+			return NULL;
+		}
+		return result;
+	}
+
+	// The default depth of 32 is too small to represent some nested layouts, but
+	// we can't pass INT_MAX here because json-c (as of this writing) prefaults
+	// all the memory for its stack.
+	json_tokener *tok = json_tokener_new_ex(256);
+	if (!tok) {
+		sway_log_errno(SWAY_ERROR, "failed to create tokener");
+		return NULL;
+	}
+
+	json_object *result = json_tokener_parse_ex(tok, payload, size);
+	enum json_tokener_error err = json_tokener_get_error(tok);
+	json_tokener_free(tok);
+
+	if (err != json_tokener_success) {
+		sway_log(SWAY_ERROR, "failed to parse payload as json: %s",
+				json_tokener_error_desc(err));
+		json_object_put(result);
+		return NULL;
+	}
+	return result;
+}
+
+// Minimum free space in the receive buffer for each read
+#define IPC_CLIENT_READ_SIZE 4096
+
+struct ipc_client_request {
+	ipc_client_func func;
+	void *data;
+};
+
+struct ipc_client {
+	int fd;
+	ipc_client_func event_func;
+	void (*close_func)(struct ipc_client *client, void *data);
+	void *data;
+	struct loop *loop;
+	short events; // as last set in the loop
+
+	// Requests awaiting their reply, oldest first from requests_head
+	struct ipc_client_request *requests;
+	size_t requests_head, requests_len, requests_cap;
+	size_t max_pending;
+
+	char *out; // queued requests, written from out_head
+	size_t out_head, out_len, out_cap;
+	char *in; // received data, starting with an incomplete message
+	size_t in_len, in_cap;
+
+	bool closed;
+	int dispatch_depth;
+	bool destroyed; // while dispatching
+};
+
+static bool buffer_reserve(char **buf, size_t *cap, size_t needed) {
+	if (needed <= *cap) {
+		return true;
+	}
+	size_t new_cap = *cap ? *cap : IPC_CLIENT_READ_SIZE;
+	while (new_cap < needed) {
+		new_cap *= 2;
+	}
+	char *new_buf = realloc(*buf, new_cap);
+	if (!new_buf) {
+		sway_log(SWAY_ERROR, "Unable to allocate IPC client buffer");
+		return false;
+	}
+	*buf = new_buf;
+	*cap = new_cap;
+	return true;
+}
+
+struct ipc_client *ipc_client_create(int socketfd, ipc_client_func event_func,
+		void (*close_func)(struct ipc_client *client, void *data), void *data) {
+	int flags = fcntl(socketfd, F_GETFL);
+	if (flags == -1 || fcntl(socketfd, F_SETFL, flags | O_NONBLOCK) == -1) {
+		sway_log_errno(SWAY_ERROR, "Unable to make IPC socket non-blocking");
+		return NULL;
+	}
+	struct ipc_client *client = calloc(1, sizeof(struct ipc_client));
+	if (!client) {
+		sway_log(SWAY_ERROR, "Unable to allocate IPC client");
+		return NULL;
+	}
+	client->fd = socketfd;
+	client->event_func = event_func;
+	client->close_func = close_func;
+	client->data = data;
+	client->events = POLLIN;
+	return client;
+}
+
+static void client_free(struct ipc_client *client) {
+	close(client->fd);
+	free(client->requests);
+	free(client->out);
+	free(client->in);
+	free(client);
+}
+
+void ipc_client_destroy(struct ipc_client *client) {
+	if (!client) {
+		return;
+	}
+	if (client->loop && !client->closed) {
+		loop_remove_fd(client->loop, client->fd);
+	}
+	client->closed = true;
+	if (client->dispatch_depth > 0) {
+		client->destroyed = true;
+		return;
+	}
+	client_free(client);
+}
+
+int ipc_client_get_fd(struct ipc_client *client) {
+	return client->fd;
+}
+
+short ipc_client_get_events(struct ipc_client *client) {
+	return client->out_head < client->out_len ? POLLIN | POLLOUT : POLLIN;
+}
+
+size_t ipc_client_get_pending(struct ipc_client *client) {
+	return client->requests_len - client->requests_head;
+}
+
+void ipc_client_set_max_pending(struct ipc_client *client, size_t max) {
+	client->max_pending = max;
+}
+
+static void update_events(struct ipc_client *client) {
+	short events = ipc_client_get_events(client);
+	if (client->loop && !client->closed && events != client->events) {
+		loop_set_fd_mask(client->loop, client->fd, events);
+	}
+	client->events = events;
+}
+
+/**
+ * Fails the pending requests and calls close_func. Frees the client if it was
+ * destroyed by a callback and is not being dispatched.
+ */
+static void close_client(struct ipc_client *client) {
+	if (client->closed) {
+		return;
+	}
+	if (client->loop) {
+		loop_remove_fd(client->loop, client->fd);
+	}
+	client->closed = true;
+	client->dispatch_depth++;
+	while (!client->destroyed &&
+			client->requests_head < client->requests_len) {
+		struct ipc_client_request *request =
+			&client->requests[client->requests_head++];
+		if (request->func) {
+			request->func(client, 0, NULL, 0, request->data);
+		}
+	}
+	if (!client->destroyed && client->close_func) {
+		client->close_func(client, client->data);
+	}
+	if (--client->dispatch_depth == 0 && client->destroyed) {
+		client_free(client);
+	}
+}
+
+static bool push_request(struct ipc_client *client,
+		ipc_client_func func, void *data) {
+	if (client->requests_head == client->requests_len) {
+		client->requests_head = client->requests_len = 0;
+	}
+	if (client->requests_len == client->requests_cap) {
+		if (client->requests_head > 0) {
+			client->requests_len -= client->requests_head;
+			memmove(client->requests, client->requests + client->requests_head,
+					client->requests_len * sizeof(*client->requests));
+			client->requests_head = 0;
+		} else {
+			size_t cap = client->requests_cap ? client->requests_cap * 2 : 16;
+			struct ipc_client_request *requests =
+				realloc(client->requests, cap * sizeof(*requests));
+			if (!requests) {
+				sway_log(SWAY_ERROR, "Unable to allocate IPC request");
+				return false;
+			}
+			client->requests = requests;
+			client->requests_cap = cap;
+		}
+	}
+	client->requests[client->requests_len++] =
+		(struct ipc_client_request){ .func = func, .data = data };
+	return true;
+}
+
+static bool write_out(struct ipc_client *client) {
+	while (client->out_head < client->out_len) {
+		ssize_t written = send(client->fd, client->out + client->out_head,
+				client->out_len - client->out_head, MSG_NOSIGNAL);
+		if (written == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				return true;
+			}
+			sway_log_errno(SWAY_ERROR, "Unable to send IPC request");
+			return false;
+		}
+		client->out_head += written;
+	}
+	client->out_head = client->out_len = 0;
+	return true;
+}
+
+bool ipc_client_send(struct ipc_client *client, uint32_t type,
+		const char *payload, uint32_t size, ipc_client_func reply_func,
+		void *data) {
+	if (client->closed || (client->max_pending &&
+				ipc_client_get_pending(client) >= client->max_pending)) {
+		return false;
+	}
+	if (client->out_head > 0) {
+		client->out_len -= client->out_head;
+		memmove(client->out, client->out + client->out_head, client->out_len);
+		client->out_head = 0;
+	}
+	if (!buffer_reserve(&client->out, &client->out_cap,
+				client->out_len + IPC_HEADER_SIZE + size) ||
+			!push_request(client, reply_func, data)) {
+		return false;
+	}
+	char *header = client->out + client->out_len;
+	memcpy(header, ipc_magic, sizeof(ipc_magic));
+	memcpy(header + sizeof(ipc_magic), &size, sizeof(size));
+	memcpy(header + sizeof(ipc_magic) + sizeof(size), &type, sizeof(type));
+	if (size) {
+		memcpy(header + IPC_HEADER_SIZE, payload, size);
+	}
+	client->out_len += IPC_HEADER_SIZE + size;
+
+	if (!write_out(client)) {
+		close_client(client);
+		return true; // the reply callback got NULL
+	}
+	update_events(client);
+	return true;
+}
+
+/**
+ * Reads what is available. Returns false on errors and end of file.
+ */
+static bool read_in(struct ipc_client *client) {
+	// Make room for a whole message once its header is known, and always for
+	// the NUL written after a payload
+	size_t needed = client->in_len + IPC_CLIENT_READ_SIZE;
+	if (client->in_len >= IPC_HEADER_SIZE) {
+		uint32_t size;
+		memcpy(&size, client->in + sizeof(ipc_magic), sizeof(size));
+		if (IPC_HEADER_SIZE + (size_t)size + 1 > needed) {
+			needed = IPC_HEADER_SIZE + (size_t)size + 1;
+		}
+	}
+	if (!buffer_reserve(&client->in, &client->in_cap, needed)) {
+		return false;
+	}
+	ssize_t received;
+	do {
+		received = recv(client->fd, client->in + client->in_len,
+				client->in_cap - client->in_len - 1, 0);
+	} while (received == -1 && errno == EINTR);
+	if (received == -1) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			return true;
+		}
+		sway_log_errno(SWAY_ERROR, "Unable to receive IPC response");
+		return false;
+	}
+	client->in_len += received;
+	return received > 0;
+}
+
+/**
+ * Passes the complete messages in the receive buffer to their callbacks.
+ * Returns false if the data is not an IPC message.
+ */
+static bool dispatch_messages(struct ipc_client *client) {
+	size_t offset = 0;
+	bool valid = true;
+	while (!client->destroyed &&
+			client->in_len - offset >= IPC_HEADER_SIZE) {
+		char *header = client->in + offset;
+		if (memcmp(header, ipc_magic, sizeof(ipc_magic)) != 0) {
+			sway_log(SWAY_ERROR, "Received invalid IPC message");
+			valid = false;
+			break;
+		}
+		uint32_t size, type;
+		memcpy(&size, header + sizeof(ipc_magic), sizeof(size));
+		memcpy(&type, header + sizeof(ipc_magic) + sizeof(size), sizeof(type));
+		if (client->in_len - offset - IPC_HEADER_SIZE < size) {
+			break;
+		}
+		offset += IPC_HEADER_SIZE + size;
+
+		// Terminate the payload, keeping the first byte of the next message
+		char *payload = header + IPC_HEADER_SIZE;
+		char next = payload[size];
+		payload[size] = '\0';
+		if (type & 0x80000000) {
+			if (client->event_func) {
+				client->event_func(client, type, payload, size, client->data);
+			}
+		} else if (client->requests_head < client->requests_len) {
+			struct ipc_client_request *request =
+				&client->requests[client->requests_head++];
+			if (request->func) {
+				request->func(client, type, payload, size, request->data);
+			}
+		} else {
+			sway_log(SWAY_ERROR, "Received unexpected IPC reply");
+		}
+		payload[size] = next;
+	}
+	if (!client->destroyed && offset > 0) {
+		client->in_len -= offset;
+		memmove(client->in, client->in + offset, client->in_len);
+	}
+	return valid;
+}
+
+bool ipc_client_dispatch(struct ipc_client *client, short revents) {
+	if (client->closed) {
+		return false;
+	}
+	client->dispatch_depth++;
+	bool ok = true;
+	if (revents & POLLOUT) {
+		ok = write_out(client);
+	}
+	if (ok && (revents & (POLLIN | POLLHUP | POLLERR))) {
+		ok = read_in(client);
+		// Messages received before the connection was closed still count
+		ok = dispatch_messages(client) && ok;
+	}
+	if (!ok) {
+		close_client(client);
+	}
+	client->dispatch_depth--;
+	if (client->destroyed) {
+		if (client->dispatch_depth == 0) {
+			client_free(client);
+		}
+		return false;
+	}
+	update_events(client);
+	return !client->closed;
+}
+
+static void handle_loop_fd(int fd, short mask, void *data) {
+	ipc_client_dispatch(data, mask);
+}
+
+void ipc_client_add_to_loop(struct ipc_client *client, struct loop *loop) {
+	client->loop = loop;
+	client->events = ipc_client_get_events(client);
+	loop_add_fd(loop, client->fd, client->events, handle_loop_fd, client);
+}
+
+bool ipc_client_roundtrip(struct ipc_client *client) {
+	client->dispatch_depth++;
+	while (!client->closed && ipc_client_get_pending(client) > 0) {
+		struct pollfd pfd = {
+			.fd = client->fd,
+			.events = ipc_client_get_events(client),
+		};
+		if (poll(&pfd, 1, -1) == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			sway_log_errno(SWAY_ERROR, "Unable to poll IPC socket");
+			break;
+		}
+		ipc_client_dispatch(client, pfd.revents);
+	}
+	bool ok = !client->closed && ipc_client_get_pending(client) == 0;
+	if (--client->dispatch_depth == 0 && client->destroyed) {
+		client_free(client);
+	}
+	return ok;
+}
@@ -1,8 +1,11 @@
-#define _POSIX_C_SOURCE 200112L
+#define _POSIX_C_SOURCE 200809L
 #include <signal.h>
 #include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <unistd.h>
 #include "log.h"
@@ -70,17 +73,10 @@ static void init_start_time(void) {
 	clock_gettime(CLOCK_MONOTONIC, &start_time);
 }
 
-static void sway_log_stderr(sway_log_importance_t verbosity, const char *fmt,
-		va_list args) {
-	init_start_time();
-
-	if (verbosity > log_importance) {
-		return;
-	}
-
-	struct timespec ts = {0};
-	clock_gettime(CLOCK_MONOTONIC, &ts);
-	timespec_sub(&ts, &ts, &start_time);
+static void sway_log_stderr(sway_log_importance_t verbosity,
+		const struct timespec *now, const char *fmt, va_list args) {
+	struct timespec ts;
+	timespec_sub(&ts, now, &start_time);
 
 	fprintf(stderr, "%02d:%02d:%02d.%03ld ", (int)(ts.tv_sec / 60 / 60),
 		(int)(ts.tv_sec / 60 % 60), (int)(ts.tv_sec % 60),
@@ -114,13 +110,787 @@ void sway_log_init(sway_log_importance_t verbosity, terminate_callback_t callbac
 	}
 }
 
+/**
+ * The flight recorder keeps the most recent messages in a ring of fixed size
+ * records. Instead of formatting a message, the format string pointer and the
+ * arguments are stored, copying only string arguments, and formatting is done
+ * when the ring is dumped.
+ *
+ * Writers claim a record with an atomic increment and publish it by storing
+ * its sequence number last, so readers can detect records which are being
+ * overwritten while they are copied.
+ */
+#define LOG_RECORD_SIZE 512
+#define LOG_RECORD_COUNT 8192 // 4 MiB
+#define LOG_RECORD_MAX_ARGS 12
+#define LOG_LINE_SIZE 1024
+
+enum log_record_flags {
+	// The format string is stored at the start of the string area
+	LOG_RECORD_FMT_COPY = 1 << 0,
+	// The string area holds the formatted message
+	LOG_RECORD_FORMATTED = 1 << 1,
+	// A string argument was truncated
+	LOG_RECORD_TRUNCATED = 1 << 2,
+};
+
+enum log_arg_type {
+	LOG_ARG_INT,
+	LOG_ARG_UINT,
+	LOG_ARG_DOUBLE,
+	LOG_ARG_POINTER,
+	LOG_ARG_STRING,
+};
+
+union log_arg {
+	intmax_t i;
+	uintmax_t u;
+	double d;
+	const void *p;
+	size_t offset; // into the string area
+};
+
+struct log_record_header {
+	uint64_t seq; // index of the record plus one, 0 while it is written
+	struct timespec time;
+	const char *fmt;
+	uint8_t verbosity;
+	uint8_t flags;
+	uint8_t nargs;
+	uint8_t types[LOG_RECORD_MAX_ARGS];
+	union log_arg args[LOG_RECORD_MAX_ARGS];
+};
+
+#define LOG_RECORD_STRINGS_SIZE \
+	(LOG_RECORD_SIZE - sizeof(struct log_record_header))
+
+struct log_record {
+	struct log_record_header header;
+	char strings[LOG_RECORD_STRINGS_SIZE];
+};
+
+static struct {
+	sway_log_importance_t importance;
+	struct log_record *records;
+	uint64_t next;
+} recorder = { .importance = SWAY_SILENT };
+
+enum log_length {
+	LOG_LENGTH_NONE,
+	LOG_LENGTH_HH,
+	LOG_LENGTH_H,
+	LOG_LENGTH_L,
+	LOG_LENGTH_LL,
+	LOG_LENGTH_J,
+	LOG_LENGTH_Z,
+	LOG_LENGTH_T,
+	LOG_LENGTH_LONG_DOUBLE,
+};
+
+struct log_conversion {
+	const char *flags, *flags_end;
+	bool width_arg;
+	const char *width, *width_end;
+	bool has_precision, precision_arg;
+	const char *precision, *precision_end;
+	enum log_length length;
+	char conversion;
+};
+
+/**
+ * Parses the conversion specification following the '%' at fmt. Returns a
+ * pointer past it, with conv->conversion set to 0 if it is not supported.
+ */
+static const char *parse_conversion(const char *fmt, struct log_conversion *conv) {
+	const char *p = fmt + 1;
+	conv->flags = p;
+	while (*p && strchr("-+ #0'", *p)) {
+		++p;
+	}
+	conv->flags_end = p;
+
+	conv->width_arg = *p == '*';
+	conv->width = p;
+	if (conv->width_arg) {
+		++p;
+	} else {
+		while (*p >= '0' && *p <= '9') {
+			++p;
+		}
+	}
+	conv->width_end = p;
+
+	conv->has_precision = *p == '.';
+	conv->precision_arg = false;
+	if (conv->has_precision) {
+		++p;
+		conv->precision_arg = *p == '*';
+		conv->precision = p;
+		if (conv->precision_arg) {
+			++p;
+		} else {
+			while (*p >= '0' && *p <= '9') {
+				++p;
+			}
+		}
+		conv->precision_end = p;
+	}
+
+	conv->length = LOG_LENGTH_NONE;
+	switch (*p) {
+	case 'h':
+		conv->length = p[1] == 'h' ? LOG_LENGTH_HH : LOG_LENGTH_H;
+		p += p[1] == 'h' ? 2 : 1;
+		break;
+	case 'l':
+		conv->length = p[1] == 'l' ? LOG_LENGTH_LL : LOG_LENGTH_L;
+		p += p[1] == 'l' ? 2 : 1;
+		break;
+	case 'j':
+		conv->length = LOG_LENGTH_J;
+		++p;
+		break;
+	case 'z':
+		conv->length = LOG_LENGTH_Z;
+		++p;
+		break;
+	case 't':
+		conv->length = LOG_LENGTH_T;
+		++p;
+		break;
+	case 'L':
+		conv->length = LOG_LENGTH_LONG_DOUBLE;
+		++p;
+		break;
+	}
+
+	conv->conversion = *p && strchr("diouxXceEfFgGaAsp%", *p) ? *p : 0;
+	return *p ? p + 1 : p;
+}
+
+static bool record_push_arg(struct log_record *rec, enum log_arg_type type,
+		union log_arg arg) {
+	if (rec->header.nargs == LOG_RECORD_MAX_ARGS) {
+		return false;
+	}
+	rec->header.types[rec->header.nargs] = type;
+	rec->header.args[rec->header.nargs++] = arg;
+	return true;
+}
+
+static void record_push_string(struct log_record *rec, size_t *strings_len,
+		const char *str, size_t len) {
+	size_t room = LOG_RECORD_STRINGS_SIZE - *strings_len - 1;
+	if (len > room) {
+		len = room;
+		rec->header.flags |= LOG_RECORD_TRUNCATED;
+	}
+	memcpy(rec->strings + *strings_len, str, len);
+	rec->strings[*strings_len + len] = '\0';
+	*strings_len += len + 1;
+}
+
+/**
+ * Stores the arguments of fmt in the record. Returns false if the format uses
+ * unsupported conversions or too many arguments.
+ */
+static bool record_capture(struct log_record *rec, size_t *strings_len,
+		const char *fmt, va_list args) {
+	for (const char *p = strchr(fmt, '%'); p; p = strchr(p, '%')) {
+		struct log_conversion conv;
+		p = parse_conversion(p, &conv);
+		union log_arg arg;
+		if (conv.width_arg) {
+			arg.i = va_arg(args, int);
+			if (!record_push_arg(rec, LOG_ARG_INT, arg)) {
+				return false;
+			}
+		}
+		int precision = -1;
+		if (conv.precision_arg) {
+			arg.i = precision = va_arg(args, int);
+			if (!record_push_arg(rec, LOG_ARG_INT, arg)) {
+				return false;
+			}
+		} else if (conv.has_precision) {
+			precision = atoi(conv.precision);
+		}
+
+		enum log_arg_type type;
+		switch (conv.conversion) {
+		case '%':
+			continue;
+		case 'd':
+		case 'i':
+			type = LOG_ARG_INT;
+			switch (conv.length) {
+			case LOG_LENGTH_HH:
+				arg.i = (signed char)va_arg(args, int);
+				break;
+			case LOG_LENGTH_H:
+				arg.i = (short)va_arg(args, int);
+				break;
+			case LOG_LENGTH_L:
+				arg.i = va_arg(args, long);
+				break;
+			case LOG_LENGTH_LL:
+				arg.i = va_arg(args, long long);
+				break;
+			case LOG_LENGTH_J:
+				arg.i = va_arg(args, intmax_t);
+				break;
+			case LOG_LENGTH_Z:
+				arg.i = va_arg(args, ssize_t);
+				break;
+			case LOG_LENGTH_T:
+				arg.i = va_arg(args, ptrdiff_t);
+				break;
+			default:
+				arg.i = va_arg(args, int);
+				break;
+			}
+			break;
+		case 'o':
+		case 'u':
+		case 'x':
+		case 'X':
+			type = LOG_ARG_UINT;
+			switch (conv.length) {
+			case LOG_LENGTH_HH:
+				arg.u = (unsigned char)va_arg(args, unsigned int);
+				break;
+			case LOG_LENGTH_H:
+				arg.u = (unsigned short)va_arg(args, unsigned int);
+				break;
+			case LOG_LENGTH_L:
+				arg.u = va_arg(args, unsigned long);
+				break;
+			case LOG_LENGTH_LL:
+				arg.u = va_arg(args, unsigned long long);
+				break;
+			case LOG_LENGTH_J:
+				arg.u = va_arg(args, uintmax_t);
+				break;
+			case LOG_LENGTH_Z:
+				arg.u = va_arg(args, size_t);
+				break;
+			case LOG_LENGTH_T:
+				arg.u = va_arg(args, ptrdiff_t);
+				break;
+			default:
+				arg.u = va_arg(args, unsigned int);
+				break;
+			}
+			break;
+		case 'c':
+			type = LOG_ARG_INT;
+			arg.i = va_arg(args, int);
+			break;
+		case 'e':
+		case 'E':
+		case 'f':
+		case 'F':
+		case 'g':
+		case 'G':
+		case 'a':
+		case 'A':
+			type = LOG_ARG_DOUBLE;
+			if (conv.length == LOG_LENGTH_LONG_DOUBLE) {
+				arg.d = va_arg(args, long double);
+			} else {
+				arg.d = va_arg(args, double);
+			}
+			break;
+		case 'p':
+			type = LOG_ARG_POINTER;
+			arg.p = va_arg(args, void *);
+			break;
+		case 's':;
+			if (conv.length != LOG_LENGTH_NONE) {
+				return false; // wide strings
+			}
+			const char *str = va_arg(args, const char *);
+			if (!str) {
+				str = "(null)";
+			}
+			size_t max = LOG_RECORD_STRINGS_SIZE;
+			if (precision >= 0 && (size_t)precision < max) {
+				max = precision;
+			}
+			type = LOG_ARG_STRING;
+			arg.offset = *strings_len;
+			record_push_string(rec, strings_len, str, strnlen(str, max));
+			break;
+		default:
+			return false;
+		}
+		if (!record_push_arg(rec, type, arg)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void sway_log_record(sway_log_importance_t verbosity,
+		const struct timespec *now, bool copy_fmt, const char *fmt,
+		va_list args) {
+	uint64_t index = __atomic_fetch_add(&recorder.next, 1, __ATOMIC_RELAXED);
+	struct log_record *rec = &recorder.records[index % LOG_RECORD_COUNT];
+	__atomic_store_n(&rec->header.seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	rec->header.time = *now;
+	rec->header.verbosity = verbosity;
+	rec->header.flags = 0;
+	rec->header.nargs = 0;
+	rec->header.fmt = fmt;
+	size_t strings_len = 0;
+	if (copy_fmt) {
+		rec->header.flags |= LOG_RECORD_FMT_COPY;
+		record_push_string(rec, &strings_len, fmt, strlen(fmt));
+	}
+
+	va_list args_copy;
+	va_copy(args_copy, args);
+	bool captured = !(rec->header.flags & LOG_RECORD_TRUNCATED) &&
+		record_capture(rec, &strings_len, fmt, args_copy);
+	va_end(args_copy);
+	if (!captured) {
+		// Fall back to formatting the message right away
+		rec->header.flags = LOG_RECORD_FORMATTED;
+		rec->header.nargs = 0;
+		va_copy(args_copy, args);
+		vsnprintf(rec->strings, LOG_RECORD_STRINGS_SIZE, fmt, args_copy);
+		va_end(args_copy);
+	}
+
+	__atomic_store_n(&rec->header.seq, index + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * The recorded messages are formatted without snprintf, which is not
+ * async-signal-safe, so that they can be written from a crash handler. Only
+ * the conversions which can be recorded are supported; e, g and a conversions
+ * of doubles are approximated.
+ */
+struct log_buf {
+	char *data;
+	size_t size;
+	size_t len;
+};
+
+struct log_spec {
+	bool left, plus, space, alt, zero;
+	int width;
+	int precision; // -1 if not given
+	char conversion;
+};
+
+static void buf_append(struct log_buf *buf, const char *str, size_t len) {
+	size_t room = buf->size - 1 - buf->len;
+	if (len > room) {
+		len = room;
+	}
+	memcpy(buf->data + buf->len, str, len);
+	buf->len += len;
+	buf->data[buf->len] = '\0';
+}
+
+static void buf_pad(struct log_buf *buf, char c, int count) {
+	for (; count > 0; --count) {
+		buf_append(buf, &c, 1);
+	}
+}
+
+static char *format_digits(char *end, uintmax_t value, unsigned base,
+		bool upper) {
+	const char *set = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+	char *p = end;
+	do {
+		*--p = set[value % base];
+		value /= base;
+	} while (value);
+	return p;
+}
+
+static void buf_field(struct log_buf *buf, const struct log_spec *spec,
+		bool zero_pad, const char *prefix, const char *body, size_t body_len,
+		size_t zeros) {
+	size_t prefix_len = strlen(prefix);
+	int pad = spec->width - (int)(prefix_len + zeros + body_len);
+	if (!spec->left && !zero_pad) {
+		buf_pad(buf, ' ', pad);
+	}
+	buf_append(buf, prefix, prefix_len);
+	if (!spec->left && zero_pad) {
+		buf_pad(buf, '0', pad);
+	}
+	buf_pad(buf, '0', zeros);
+	buf_append(buf, body, body_len);
+	if (spec->left) {
+		buf_pad(buf, ' ', pad);
+	}
+}
+
+static const char *sign_prefix(const struct log_spec *spec, bool negative) {
+	return negative ? "-" : spec->plus ? "+" : spec->space ? " " : "";
+}
+
+static void format_int(struct log_buf *buf, const struct log_spec *spec,
+		uintmax_t value, bool is_signed, bool negative) {
+	unsigned base = 10;
+	if (spec->conversion == 'x' || spec->conversion == 'X') {
+		base = 16;
+	} else if (spec->conversion == 'o') {
+		base = 8;
+	}
+	char digits[sizeof(uintmax_t) * 3 + 1];
+	char *end = digits + sizeof(digits);
+	char *p = value == 0 && spec->precision == 0 ? end :
+		format_digits(end, value, base, spec->conversion == 'X');
+	size_t len = end - p;
+	size_t zeros = spec->precision > (int)len ? spec->precision - len : 0;
+
+	const char *prefix = is_signed ? sign_prefix(spec, negative) : "";
+	if (spec->alt && base == 8 && zeros == 0 && (len == 0 || *p != '0')) {
+		zeros = 1;
+	} else if (spec->alt && base == 16 && value != 0) {
+		prefix = spec->conversion == 'X' ? "0X" : "0x";
+	}
+	buf_field(buf, spec, spec->zero && spec->precision < 0, prefix, p, len,
+		zeros);
+}
+
+// Appends value, which must be below 1e19, with precision fraction digits
+static size_t format_fixed(char *out, double value, int precision, bool alt) {
+	uintmax_t scale = 1;
+	for (int i = 0; i < precision; ++i) {
+		scale *= 10;
+	}
+	uintmax_t whole = (uintmax_t)value;
+	double scaled = (value - whole) * scale;
+	uintmax_t frac = (uintmax_t)scaled;
+	// Round half to even, like printf
+	double rest = scaled - frac;
+	bool odd = precision > 0 ? frac & 1 : whole & 1;
+	if (rest > 0.5 || (rest == 0.5 && odd)) {
+		frac++;
+	}
+	if (frac >= scale) {
+		whole++;
+		frac -= scale;
+	}
+	char digits[sizeof(uintmax_t) * 3 + 1];
+	char *end = digits + sizeof(digits);
+	char *p = format_digits(end, whole, 10, false);
+	size_t len = end - p;
+	memcpy(out, p, len);
+	if (precision > 0 || alt) {
+		out[len++] = '.';
+	}
+	if (precision > 0) {
+		p = format_digits(end, frac, 10, false);
+		for (int i = end - p; i < precision; ++i) {
+			out[len++] = '0';
+		}
+		memcpy(out + len, p, end - p);
+		len += end - p;
+	}
+	return len;
+}
+
+static void format_double(struct log_buf *buf, const struct log_spec *spec,
+		double value) {
+	char c = spec->conversion;
+	bool upper = c == 'E' || c == 'F' || c == 'G' || c == 'A';
+	bool negative = value < 0;
+	double mag = negative ? -value : value;
+	const char *prefix = sign_prefix(spec, negative);
+	if (mag != mag || mag > 1.7976931348623157e308) {
+		const char *body = mag != mag ? (upper ? "NAN" : "nan") :
+			(upper ? "INF" : "inf");
+		buf_field(buf, spec, false, prefix, body, 3, 0);
+		return;
+	}
+
+	int precision = spec->precision < 0 ? 6 :
+		spec->precision > 17 ? 17 : spec->precision;
+	int exp = 0;
+	double norm = mag;
+	while (norm >= 10) {
+		norm /= 10;
+		exp++;
+	}
+	while (norm > 0 && norm < 1) {
+		norm *= 10;
+		exp--;
+	}
+
+	bool scientific = c == 'e' || c == 'E' || c == 'a' || c == 'A' ||
+		mag >= 1e19;
+	bool strip = false;
+	if (c == 'g' || c == 'G') {
+		int p = precision == 0 ? 1 : precision;
+		scientific = exp < -4 || exp >= p;
+		precision = scientific ? p - 1 : p - 1 - exp;
+		strip = !spec->alt;
+	}
+
+	char body[64];
+	size_t len;
+	if (scientific) {
+		len = format_fixed(body, norm, precision, spec->alt);
+		if (len > 1 && body[0] == '1' && body[1] == '0') {
+			// rounded up to 10
+			len = format_fixed(body, norm / 10, precision, spec->alt);
+			exp++;
+		}
+	} else {
+		len = format_fixed(body, mag, precision, spec->alt);
+	}
+	if (strip && memchr(body, '.', len)) {
+		while (body[len - 1] == '0') {
+			len--;
+		}
+		if (body[len - 1] == '.') {
+			len--;
+		}
+	}
+	if (scientific) {
+		body[len++] = upper ? 'E' : 'e';
+		body[len++] = exp < 0 ? '-' : '+';
+		int e = exp < 0 ? -exp : exp;
+		if (e >= 100) {
+			body[len++] = '0' + e / 100;
+		}
+		body[len++] = '0' + e / 10 % 10;
+		body[len++] = '0' + e % 10;
+	}
+	buf_field(buf, spec, spec->zero, prefix, body, len, 0);
+}
+
+static int parse_int(const char *start, const char *end) {
+	int value = 0;
+	for (const char *p = start; p < end; ++p) {
+		value = value * 10 + (*p - '0');
+	}
+	return value;
+}
+
+static void format_time(struct log_buf *buf, long value, int digits) {
+	char str[24];
+	char *end = str + sizeof(str);
+	char *p = format_digits(end, value, 10, false);
+	buf_pad(buf, '0', digits - (int)(end - p));
+	buf_append(buf, p, end - p);
+}
+
+static size_t record_format(const struct log_record *rec, char *data,
+		size_t size) {
+	struct log_buf buf = { .data = data, .size = size, .len = 0 };
+	data[0] = '\0';
+
+	struct timespec ts;
+	timespec_sub(&ts, &rec->header.time, &start_time);
+	format_time(&buf, ts.tv_sec / 60 / 60, 2);
+	buf_append(&buf, ":", 1);
+	format_time(&buf, ts.tv_sec / 60 % 60, 2);
+	buf_append(&buf, ":", 1);
+	format_time(&buf, ts.tv_sec % 60, 2);
+	buf_append(&buf, ".", 1);
+	format_time(&buf, ts.tv_nsec / 1000000, 3);
+	unsigned c = (rec->header.verbosity < SWAY_LOG_IMPORTANCE_LAST) ?
+		rec->header.verbosity : SWAY_LOG_IMPORTANCE_LAST - 1;
+	buf_append(&buf, " ", 1);
+	buf_append(&buf, verbosity_headers[c], strlen(verbosity_headers[c]));
+	buf_append(&buf, " ", 1);
+
+	if (rec->header.flags & LOG_RECORD_FORMATTED) {
+		buf_append(&buf, rec->strings, strlen(rec->strings));
+		return buf.len;
+	}
+
+	const char *fmt = rec->header.flags & LOG_RECORD_FMT_COPY ?
+		rec->strings : rec->header.fmt;
+	size_t arg = 0;
+	const char *p = fmt;
+	while (*p && buf.len < size - 1) {
+		const char *percent = strchr(p, '%');
+		buf_append(&buf, p, percent ? (size_t)(percent - p) : strlen(p));
+		if (!percent) {
+			break;
+		}
+
+		struct log_conversion conv;
+		p = parse_conversion(percent, &conv);
+		size_t needed = (conv.width_arg ? 1 : 0) +
+			(conv.precision_arg ? 1 : 0) + 1;
+		if (conv.conversion == 0 || (conv.conversion != '%' &&
+				arg + needed > rec->header.nargs)) {
+			break;
+		}
+		if (conv.conversion == '%') {
+			buf_append(&buf, "%", 1);
+			continue;
+		}
+
+		struct log_spec spec = { .conversion = conv.conversion };
+		for (const char *f = conv.flags; f < conv.flags_end; ++f) {
+			spec.left |= *f == '-';
+			spec.plus |= *f == '+';
+			spec.space |= *f == ' ';
+			spec.alt |= *f == '#';
+			spec.zero |= *f == '0';
+		}
+		if (conv.width_arg) {
+			spec.width = (int)rec->header.args[arg++].i;
+			if (spec.width < 0) {
+				spec.left = true;
+				spec.width = -spec.width;
+			}
+		} else {
+			spec.width = parse_int(conv.width, conv.width_end);
+		}
+		spec.precision = -1;
+		if (conv.precision_arg) {
+			spec.precision = (int)rec->header.args[arg++].i;
+			if (spec.precision < 0) {
+				spec.precision = -1;
+			}
+		} else if (conv.has_precision) {
+			spec.precision = parse_int(conv.precision, conv.precision_end);
+		}
+
+		const union log_arg *value = &rec->header.args[arg++];
+		switch (rec->header.types[arg - 1]) {
+		case LOG_ARG_INT:
+			if (conv.conversion == 'c') {
+				char ch = (unsigned char)value->i;
+				buf_field(&buf, &spec, false, "", &ch, 1, 0);
+			} else {
+				bool negative = value->i < 0;
+				format_int(&buf, &spec, negative ?
+					(uintmax_t)0 - (uintmax_t)value->i : (uintmax_t)value->i,
+					true, negative);
+			}
+			break;
+		case LOG_ARG_UINT:
+			format_int(&buf, &spec, value->u, false, false);
+			break;
+		case LOG_ARG_DOUBLE:
+			format_double(&buf, &spec, value->d);
+			break;
+		case LOG_ARG_POINTER:
+			if (!value->p) {
+				buf_field(&buf, &spec, false, "", "(nil)", 5, 0);
+			} else {
+				spec.conversion = 'x';
+				spec.alt = true;
+				format_int(&buf, &spec, (uintptr_t)value->p, false, false);
+			}
+			break;
+		case LOG_ARG_STRING:;
+			const char *str = rec->strings + value->offset;
+			size_t len = strlen(str);
+			if (spec.precision >= 0 && (size_t)spec.precision < len) {
+				len = spec.precision;
+			}
+			buf_field(&buf, &spec, false, "", str, len, 0);
+			break;
+		}
+	}
+	if (rec->header.flags & LOG_RECORD_TRUNCATED) {
+		buf_append(&buf, " [~]", 4);
+	}
+	return buf.len;
+}
+
+bool sway_log_recorder_init(sway_log_importance_t verbosity) {
+	init_start_time();
+	if (!recorder.records) {
+		recorder.records = calloc(LOG_RECORD_COUNT, sizeof(struct log_record));
+		if (!recorder.records) {
+			return false;
+		}
+	}
+	recorder.importance = verbosity;
+	return true;
+}
+
+void sway_log_recorder_for_each(sway_log_recorder_func_t func, void *data) {
+	if (!recorder.records) {
+		return;
+	}
+	uint64_t end = __atomic_load_n(&recorder.next, __ATOMIC_ACQUIRE);
+	uint64_t start = end > LOG_RECORD_COUNT ? end - LOG_RECORD_COUNT : 0;
+	struct log_record rec;
+	char line[LOG_LINE_SIZE];
+	for (uint64_t index = start; index < end; ++index) {
+		const struct log_record *slot =
+			&recorder.records[index % LOG_RECORD_COUNT];
+		uint64_t seq = __atomic_load_n(&slot->header.seq, __ATOMIC_ACQUIRE);
+		if (seq != index + 1) {
+			continue;
+		}
+		memcpy(&rec, slot, sizeof(rec));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&slot->header.seq, __ATOMIC_RELAXED) != seq) {
+			continue;
+		}
+		record_format(&rec, line, sizeof(line));
+		func(line, data);
+	}
+}
+
+static void write_line(const char *line, void *data) {
+	int fd = *(int *)data;
+	size_t len = strlen(line);
+	while (len > 0) {
+		ssize_t written = write(fd, line, len);
+		if (written <= 0) {
+			return;
+		}
+		line += written;
+		len -= written;
+	}
+	if (write(fd, "\n", 1) != 1) {
+		return;
+	}
+}
+
+void sway_log_recorder_dump(int fd) {
+	sway_log_recorder_for_each(write_line, &fd);
+}
+
+static void sway_log_dispatch(sway_log_importance_t verbosity, bool copy_fmt,
+		const char *fmt, va_list args) {
+	init_start_time();
+
+	bool to_stderr = verbosity <= log_importance;
+	bool to_recorder = verbosity <= recorder.importance;
+	if (!to_stderr && !to_recorder) {
+		return;
+	}
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	if (to_recorder) {
+		sway_log_record(verbosity, &now, copy_fmt, fmt, args);
+	}
+	if (to_stderr) {
+		sway_log_stderr(verbosity, &now, fmt, args);
+	}
+}
+
 void _sway_vlog(sway_log_importance_t verbosity, const char *fmt, va_list args) {
-	sway_log_stderr(verbosity, fmt, args);
+	// The format string may be a temporary buffer
+	sway_log_dispatch(verbosity, true, fmt, args);
 }
 
 void _sway_log(sway_log_importance_t verbosity, const char *fmt, ...) {
 	va_list args;
 	va_start(args, fmt);
-	sway_log_stderr(verbosity, fmt, args);
+	sway_log_dispatch(verbosity, false, fmt, args);
 	va_end(args);
 }
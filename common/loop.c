@@ -1,19 +1,27 @@
 #define _POSIX_C_SOURCE 200112L
+#include <errno.h>
 #include <limits.h>
 #include <string.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <poll.h>
+#include <sys/epoll.h>
 #include <time.h>
 #include <unistd.h>
 #include "list.h"
 #include "log.h"
 #include "loop.h"
 
+// Events returned by one epoll_wait call
+#define LOOP_MAX_EVENTS 32
+
 struct loop_fd_event {
+	int fd;
+	short mask;
 	void (*callback)(int fd, short mask, void *data);
 	void *data;
+	bool removed;
 };
 
 struct loop_timer {
@@ -23,11 +31,14 @@ struct loop_timer {
 };
 
 struct loop {
-	struct pollfd *fds;
-	int fd_length;
-	int fd_capacity;
+	int epoll_fd;
+
+	// Indexed by fd, for constant time lookup
+	struct loop_fd_event **fd_events;
+	int fd_events_len;
+	list_t *removed_fd_events; // struct loop_fd_event, freed after dispatch
+	int dispatch_depth;
 
-	list_t *fd_events; // struct loop_fd_event
 	list_t *timers; // struct loop_timer
 };
 
@@ -37,53 +48,114 @@ struct loop *loop_create(void) {
 		sway_log(SWAY_ERROR, "Unable to allocate memory for loop");
 		return NULL;
 	}
-	loop->fd_capacity = 10;
-	loop->fds = malloc(sizeof(struct pollfd) * loop->fd_capacity);
-	loop->fd_events = create_list();
+	loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (loop->epoll_fd == -1) {
+		sway_log_errno(SWAY_ERROR, "Unable to create epoll instance");
+		free(loop);
+		return NULL;
+	}
+	loop->removed_fd_events = create_list();
 	loop->timers = create_list();
 	return loop;
 }
 
 void loop_destroy(struct loop *loop) {
-	list_free_items_and_destroy(loop->fd_events);
+	for (int i = 0; i < loop->fd_events_len; ++i) {
+		free(loop->fd_events[i]);
+	}
+	free(loop->fd_events);
+	list_free_items_and_destroy(loop->removed_fd_events);
 	list_free_items_and_destroy(loop->timers);
-	free(loop->fds);
+	close(loop->epoll_fd);
 	free(loop);
 }
 
+static uint32_t poll_to_epoll(short mask) {
+	uint32_t events = 0;
+	if (mask & POLLIN) {
+		events |= EPOLLIN;
+	}
+	if (mask & POLLOUT) {
+		events |= EPOLLOUT;
+	}
+	if (mask & POLLPRI) {
+		events |= EPOLLPRI;
+	}
+	return events;
+}
+
+static short epoll_to_poll(uint32_t events) {
+	short mask = 0;
+	if (events & EPOLLIN) {
+		mask |= POLLIN;
+	}
+	if (events & EPOLLOUT) {
+		mask |= POLLOUT;
+	}
+	if (events & EPOLLPRI) {
+		mask |= POLLPRI;
+	}
+	if (events & EPOLLHUP) {
+		mask |= POLLHUP;
+	}
+	if (events & EPOLLERR) {
+		mask |= POLLERR;
+	}
+	return mask;
+}
+
+static bool timespec_before(const struct timespec *a, const struct timespec *b) {
+	return a->tv_sec < b->tv_sec ||
+		(a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
 void loop_poll(struct loop *loop) {
-	// Calculate next timer in ms
-	int ms = INT_MAX;
+	// Calculate next timer in ms, rounded up so that it has expired on wakeup
+	int ms = -1;
 	if (loop->timers->length) {
 		struct timespec now;
 		clock_gettime(CLOCK_MONOTONIC, &now);
+		long long min_ms = LLONG_MAX;
 		for (int i = 0; i < loop->timers->length; ++i) {
 			struct loop_timer *timer = loop->timers->items[i];
-			int timer_ms = (timer->expiry.tv_sec - now.tv_sec) * 1000;
-			timer_ms += (timer->expiry.tv_nsec - now.tv_nsec) / 1000000;
-			if (timer_ms < ms) {
-				ms = timer_ms;
+			long long timer_ms =
+				(long long)(timer->expiry.tv_sec - now.tv_sec) * 1000 +
+				(timer->expiry.tv_nsec - now.tv_nsec + 999999) / 1000000;
+			if (timer_ms < min_ms) {
+				min_ms = timer_ms;
 			}
 		}
-	}
-	if (ms < 0) {
-		ms = 0;
+		ms = min_ms < 0 ? 0 : min_ms > INT_MAX ? INT_MAX : min_ms;
 	}
 
-	poll(loop->fds, loop->fd_length, ms);
+	struct epoll_event events[LOOP_MAX_EVENTS];
+	int count = epoll_wait(loop->epoll_fd, events, LOOP_MAX_EVENTS, ms);
+	if (count == -1 && errno != EINTR) {
+		sway_log_errno(SWAY_ERROR, "Failed to wait for events");
+	}
 
 	// Dispatch fds
-	for (int i = 0; i < loop->fd_length; ++i) {
-		struct pollfd pfd = loop->fds[i];
-		struct loop_fd_event *event = loop->fd_events->items[i];
+	loop->dispatch_depth++;
+	for (int i = 0; i < count; ++i) {
+		struct loop_fd_event *event = events[i].data.ptr;
+		if (event->removed) {
+			continue;
+		}
+		short revents = epoll_to_poll(events[i].events);
 
 		// Always send these events
-		unsigned events = pfd.events | POLLHUP | POLLERR;
+		short mask = event->mask | POLLHUP | POLLERR;
 
-		if (pfd.revents & events) {
-			event->callback(pfd.fd, pfd.revents, event->data);
+		if (revents & mask) {
+			event->callback(event->fd, revents, event->data);
 		}
 	}
+	if (--loop->dispatch_depth == 0) {
+		for (int i = 0; i < loop->removed_fd_events->length; ++i) {
+			free(loop->removed_fd_events->items[i]);
+		}
+		loop->removed_fd_events->length = 0;
+	}
 
 	// Dispatch timers
 	if (loop->timers->length) {
@@ -91,44 +163,61 @@ void loop_poll(struct loop *loop) {
 		clock_gettime(CLOCK_MONOTONIC, &now);
 		for (int i = 0; i < loop->timers->length; ++i) {
 			struct loop_timer *timer = loop->timers->items[i];
-			bool expired = timer->expiry.tv_sec < now.tv_sec ||
-				(timer->expiry.tv_sec == now.tv_sec &&
-				 timer->expiry.tv_nsec < now.tv_nsec);
-			if (expired) {
-				timer->callback(timer->data);
-				loop_remove_timer(loop, timer);
-				--i;
+			if (timespec_before(&now, &timer->expiry)) {
+				continue;
 			}
+			// The callback may add or remove timers, so start over after it
+			list_del(loop->timers, i);
+			timer->callback(timer->data);
+			free(timer);
+			i = -1;
 		}
 	}
 }
 
 void loop_add_fd(struct loop *loop, int fd, short mask,
 		void (*callback)(int fd, short mask, void *data), void *data) {
+	if (fd < 0) {
+		return;
+	}
+	if (fd >= loop->fd_events_len) {
+		int len = fd + 16;
+		struct loop_fd_event **fd_events = realloc(loop->fd_events,
+				sizeof(*fd_events) * len);
+		if (!fd_events) {
+			sway_log(SWAY_ERROR, "Unable to allocate memory for fd events");
+			return;
+		}
+		memset(&fd_events[loop->fd_events_len], 0,
+				sizeof(*fd_events) * (len - loop->fd_events_len));
+		loop->fd_events = fd_events;
+		loop->fd_events_len = len;
+	}
+	if (loop->fd_events[fd]) {
+		// The fd was closed without being removed, and reused
+		loop_remove_fd(loop, fd);
+	}
+
 	struct loop_fd_event *event = calloc(1, sizeof(struct loop_fd_event));
 	if (!event) {
 		sway_log(SWAY_ERROR, "Unable to allocate memory for event");
 		return;
 	}
+	event->fd = fd;
+	event->mask = mask;
 	event->callback = callback;
 	event->data = data;
-	list_add(loop->fd_events, event);
-
-	struct pollfd pfd = {fd, mask, 0};
 
-	if (loop->fd_length == loop->fd_capacity) {
-		int capacity = loop->fd_capacity + 10;
-		struct pollfd *tmp = realloc(loop->fds,
-				sizeof(struct pollfd) * capacity);
-		if (!tmp) {
-			sway_log(SWAY_ERROR, "Unable to allocate memory for pollfd");
-			return;
-		}
-		loop->fds = tmp;
-		loop->fd_capacity = capacity;
+	struct epoll_event ev = {
+		.events = poll_to_epoll(mask),
+		.data.ptr = event,
+	};
+	if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+		sway_log_errno(SWAY_ERROR, "Unable to add fd %d to the loop", fd);
+		free(event);
+		return;
 	}
-
-	loop->fds[loop->fd_length++] = pfd;
+	loop->fd_events[fd] = event;
 }
 
 struct loop_timer *loop_add_timer(struct loop *loop, int ms,
@@ -156,20 +245,38 @@ struct loop_timer *loop_add_timer(struct loop *loop, int ms,
 	return timer;
 }
 
-bool loop_remove_fd(struct loop *loop, int fd) {
-	for (int i = 0; i < loop->fd_length; ++i) {
-		if (loop->fds[i].fd == fd) {
-			free(loop->fd_events->items[i]);
-			list_del(loop->fd_events, i);
-
-			loop->fd_length--;
-			memmove(&loop->fds[i], &loop->fds[i + 1],
-					sizeof(struct pollfd) * (loop->fd_length - i));
+bool loop_set_fd_mask(struct loop *loop, int fd, short mask) {
+	if (fd < 0 || fd >= loop->fd_events_len || !loop->fd_events[fd]) {
+		return false;
+	}
+	struct loop_fd_event *event = loop->fd_events[fd];
+	if (event->mask == mask) {
+		return true;
+	}
+	struct epoll_event ev = {
+		.events = poll_to_epoll(mask),
+		.data.ptr = event,
+	};
+	if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_MOD, fd, &ev) == -1) {
+		sway_log_errno(SWAY_ERROR, "Unable to change the events of fd %d", fd);
+		return false;
+	}
+	event->mask = mask;
+	return true;
+}
 
-			return true;
-		}
+bool loop_remove_fd(struct loop *loop, int fd) {
+	if (fd < 0 || fd >= loop->fd_events_len || !loop->fd_events[fd]) {
+		return false;
 	}
-	return false;
+	struct loop_fd_event *event = loop->fd_events[fd];
+	loop->fd_events[fd] = NULL;
+	epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+
+	// The event may still be pending in the current dispatch
+	event->removed = true;
+	list_add(loop->removed_fd_events, event);
+	return true;
 }
 
 bool loop_remove_timer(struct loop *loop, struct loop_timer *timer) {
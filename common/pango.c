@@ -82,6 +82,163 @@ PangoLayout *get_pango_layout(cairo_t *cairo, const char *font,
 	return layout;
 }
 
+// Layouts are cached across calls and frames, shaped for a given text, font,
+// markup flag, scale and font options. Measured layouts carry no font options
+// of their own, drawn ones carry the cairo context's.
+#define LAYOUT_CACHE_SIZE 256
+#define LAYOUT_CACHE_BUCKETS 512 // a power of two
+
+struct layout_cache_entry {
+	uint64_t hash;
+	char *text;
+	char *font;
+	double scale;
+	bool markup;
+	cairo_font_options_t *options;
+	PangoLayout *layout;
+	struct layout_cache_entry *bucket_next;
+	struct layout_cache_entry *lru_prev, *lru_next; // most recent first
+};
+
+static struct {
+	struct layout_cache_entry *buckets[LAYOUT_CACHE_BUCKETS];
+	struct layout_cache_entry *lru_head, *lru_tail;
+	size_t length;
+} layout_cache;
+
+static uint64_t hash_bytes(uint64_t hash, const void *data, size_t len) {
+	const unsigned char *bytes = data;
+	for (size_t i = 0; i < len; ++i) {
+		hash ^= bytes[i];
+		hash *= 0x100000001b3;
+	}
+	return hash;
+}
+
+static void lru_unlink(struct layout_cache_entry *entry) {
+	if (entry->lru_prev) {
+		entry->lru_prev->lru_next = entry->lru_next;
+	} else {
+		layout_cache.lru_head = entry->lru_next;
+	}
+	if (entry->lru_next) {
+		entry->lru_next->lru_prev = entry->lru_prev;
+	} else {
+		layout_cache.lru_tail = entry->lru_prev;
+	}
+	entry->lru_prev = entry->lru_next = NULL;
+}
+
+static void lru_push(struct layout_cache_entry *entry) {
+	entry->lru_next = layout_cache.lru_head;
+	if (layout_cache.lru_head) {
+		layout_cache.lru_head->lru_prev = entry;
+	} else {
+		layout_cache.lru_tail = entry;
+	}
+	layout_cache.lru_head = entry;
+}
+
+static void layout_cache_entry_destroy(struct layout_cache_entry *entry) {
+	g_object_unref(entry->layout);
+	if (entry->options) {
+		cairo_font_options_destroy(entry->options);
+	}
+	free(entry->text);
+	free(entry->font);
+	free(entry);
+}
+
+static void layout_cache_evict(void) {
+	struct layout_cache_entry *entry = layout_cache.lru_tail;
+	lru_unlink(entry);
+	struct layout_cache_entry **link =
+		&layout_cache.buckets[entry->hash & (LAYOUT_CACHE_BUCKETS - 1)];
+	while (*link != entry) {
+		link = &(*link)->bucket_next;
+	}
+	*link = entry->bucket_next;
+	layout_cache.length--;
+	layout_cache_entry_destroy(entry);
+}
+
+void pango_layout_cache_finish(void) {
+	struct layout_cache_entry *entry = layout_cache.lru_head;
+	while (entry) {
+		struct layout_cache_entry *next = entry->lru_next;
+		layout_cache_entry_destroy(entry);
+		entry = next;
+	}
+	memset(&layout_cache, 0, sizeof(layout_cache));
+}
+
+static bool font_options_equal(const cairo_font_options_t *a,
+		const cairo_font_options_t *b) {
+	if (!a || !b) {
+		return a == b;
+	}
+	return cairo_font_options_equal(a, b);
+}
+
+/**
+ * Returns a new reference to a layout of the text, from the cache if it was
+ * laid out before. If options is not NULL, the layout's context is given a
+ * copy of them.
+ */
+static PangoLayout *get_cached_layout(cairo_t *cairo, const char *font,
+		const char *text, double scale, bool markup,
+		const cairo_font_options_t *options) {
+	uint64_t hash = hash_bytes(0xcbf29ce484222325, text, strlen(text) + 1);
+	hash = hash_bytes(hash, font, strlen(font) + 1);
+	hash = hash_bytes(hash, &scale, sizeof(scale));
+	hash = hash_bytes(hash, &markup, sizeof(markup));
+	unsigned long options_hash = options ? cairo_font_options_hash(options) : 0;
+	hash = hash_bytes(hash, &options_hash, sizeof(options_hash));
+
+	struct layout_cache_entry **bucket =
+		&layout_cache.buckets[hash & (LAYOUT_CACHE_BUCKETS - 1)];
+	for (struct layout_cache_entry *entry = *bucket; entry;
+			entry = entry->bucket_next) {
+		if (entry->hash == hash && entry->scale == scale &&
+				entry->markup == markup && strcmp(entry->text, text) == 0 &&
+				strcmp(entry->font, font) == 0 &&
+				font_options_equal(entry->options, options)) {
+			lru_unlink(entry);
+			lru_push(entry);
+			return g_object_ref(entry->layout);
+		}
+	}
+
+	PangoLayout *layout = get_pango_layout(cairo, font, text, scale, markup);
+	if (options) {
+		pango_cairo_context_set_font_options(pango_layout_get_context(layout),
+				options);
+	}
+
+	struct layout_cache_entry *entry = calloc(1, sizeof(*entry));
+	if (!entry || !(entry->text = strdup(text)) ||
+			!(entry->font = strdup(font)) ||
+			(options && !(entry->options = cairo_font_options_copy(options)))) {
+		if (entry) {
+			free(entry->text);
+			free(entry->font);
+		}
+		free(entry);
+		return layout;
+	}
+	entry->hash = hash;
+	entry->scale = scale;
+	entry->markup = markup;
+	entry->layout = g_object_ref(layout);
+	entry->bucket_next = *bucket;
+	*bucket = entry;
+	lru_push(entry);
+	if (++layout_cache.length > LAYOUT_CACHE_SIZE) {
+		layout_cache_evict();
+	}
+	return layout;
+}
+
 void get_text_size(cairo_t *cairo, const char *font, int *width, int *height,
 		int *baseline, double scale, bool markup, const char *fmt, ...) {
 	va_list args;
@@ -99,7 +256,8 @@ void get_text_size(cairo_t *cairo, const char *font, int *width, int *height,
 	vsnprintf(buf, length, fmt, args);
 	va_end(args);
 
-	PangoLayout *layout = get_pango_layout(cairo, font, buf, scale, markup);
+	PangoLayout *layout =
+		get_cached_layout(cairo, font, buf, scale, markup, NULL);
 	pango_cairo_update_layout(cairo, layout);
 	pango_layout_get_pixel_size(layout, width, height);
 	if (baseline) {
@@ -126,10 +284,10 @@ void pango_printf(cairo_t *cairo, const char *font,
 	vsnprintf(buf, length, fmt, args);
 	va_end(args);
 
-	PangoLayout *layout = get_pango_layout(cairo, font, buf, scale, markup);
 	cairo_font_options_t *fo = cairo_font_options_create();
 	cairo_get_font_options(cairo, fo);
-	pango_cairo_context_set_font_options(pango_layout_get_context(layout), fo);
+	PangoLayout *layout =
+		get_cached_layout(cairo, font, buf, scale, markup, fo);
 	cairo_font_options_destroy(fo);
 	pango_cairo_update_layout(cairo, layout);
 	pango_cairo_show_layout(cairo, layout);
@@ -8,4 +8,7 @@ complete -c sway -s d -l debug --description "Enables full logging, including de
 complete -c sway -s v -l version --description "Show the version number and quit."
 complete -c sway -s V -l verbose --description "Enables more verbose logging."
 complete -c sway -l get-socketpath --description "Gets the IPC socket path and prints it, then exits."
+complete -c sway -l flight-recorder --description "Keeps recent debug messages in memory, to be dumped on crash, SIGUSR2 or via IPC."
+complete -c sway -l profile-startup --description "Times each config line and prints a startup profile to stderr."
+complete -c sway -l config-cache --description "Replays the commands of an unchanged config from a cache instead of parsing it."
 
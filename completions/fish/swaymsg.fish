@@ -1,6 +1,7 @@
 # swaymsg(1) completion
 
 complete -f -c swaymsg
+complete -c swaymsg -s b -l batch --description "Run the commands read from stdin as one batch."
 complete -c swaymsg -s h -l help --description "Show help message and quit."
 complete -c swaymsg -s m -l monitor --description "Monitor subscribed events until killed."
 complete -c swaymsg -s p -l pretty --description "Use pretty output even when not using a tty."
@@ -10,6 +11,7 @@ complete -c swaymsg -s s -l socket -r --description "Use the specified socket pa
 complete -c swaymsg -s v -l version --description "Print the version (of swaymsg) and quit."
 
 complete -c swaymsg -s t -l type -fr --description "Specify the type of IPC message."
+complete -c swaymsg -s t -l type -fra 'command_batch' --description "Runs a JSON-encoded list of commands as one batch."
 complete -c swaymsg -s t -l type -fra 'get_workspaces' --description "Gets a JSON-encoded list of workspaces and their status."
 complete -c swaymsg -s t -l type -fra 'get_inputs' --description "Gets a JSON-encoded list of current inputs."
 complete -c swaymsg -s t -l type -fra 'get_outputs' --description "Gets a JSON-encoded list of current outputs."
@@ -20,6 +22,9 @@ complete -c swaymsg -s t -l type -fra 'get_version' --description "Get JSON-enco
 complete -c swaymsg -s t -l type -fra 'get_binding_modes' --description "Gets a JSON-encoded list of currently configured binding modes."
 complete -c swaymsg -s t -l type -fra 'get_binding_state' --description "Get JSON-encoded info about the current binding state."
 complete -c swaymsg -s t -l type -fra 'get_config' --description "Gets a JSON-encoded copy of the current configuration."
+complete -c swaymsg -s t -l type -fra 'get_stats' --description "Gets JSON-encoded IPC statistics."
+complete -c swaymsg -s t -l type -fra 'get_log' --description "Gets the messages kept by the flight recorder."
+complete -c swaymsg -s t -l type -fra 'get_profile' --description "Gets the JSON-encoded startup profile."
 complete -c swaymsg -s t -l type -fra 'get_seats' --description "Gets a JSON-encoded list of all seats, its properties and all assigned devices."
 complete -c swaymsg -s t -l type -fra 'send_tick' --description "Sends a tick event to all subscribed clients."
 complete -c swaymsg -s t -l type -fra 'subscribe' --description "Subscribe to a list of event types."
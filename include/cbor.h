@@ -0,0 +1,27 @@
+#ifndef _SWAY_CBOR_H
+#define _SWAY_CBOR_H
+
+#include <json.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Encodes a json-c object tree as CBOR (RFC 8949) using the same schema as
+ * its JSON representation. Integers use the shortest encoding, doubles are
+ * always encoded as 64-bit floats and only definite lengths are emitted.
+ *
+ * Returns a newly allocated buffer and stores its length in len, or returns
+ * NULL on allocation failure.
+ */
+char *cbor_encode_json(json_object *obj, size_t *len);
+
+/**
+ * Decodes a single CBOR data item into a json-c object tree. Byte strings are
+ * decoded as strings, tags are ignored and indefinite lengths are rejected.
+ *
+ * Returns true on success and stores the result in out, which may be NULL
+ * for a CBOR null. Trailing data after the item is an error.
+ */
+bool cbor_decode_json(const char *data, size_t len, json_object **out);
+
+#endif
@@ -2,11 +2,16 @@
 #define _SWAY_IPC_CLIENT_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <sys/time.h>
 
 #include "ipc.h"
 
+struct json_object;
+struct loop;
+struct ipc_client;
+
 /**
  * IPC response including type of IPC response, size of payload and the json
  * encoded payload string.
@@ -42,5 +47,80 @@ void free_ipc_response(struct ipc_response *response);
  * Sets the receive timeout for the IPC socket
  */
 bool ipc_set_recv_timeout(int socketfd, struct timeval tv);
+/**
+ * Selects the encoding of all further replies and events received on the
+ * socket. The socket must still be using the JSON encoding. Returns false if
+ * sway rejected the encoding or does not know the message, in which case the
+ * socket keeps using JSON.
+ */
+bool ipc_set_encoding(int socketfd, enum ipc_encoding encoding);
+/**
+ * Decodes a payload received with the given encoding. Returns NULL if the
+ * payload is malformed.
+ */
+struct json_object *ipc_parse_payload(const char *payload, uint32_t size,
+	enum ipc_encoding encoding);
+
+/**
+ * Called with a reply or an event received by an ipc_client. The payload is
+ * NUL terminated and lives in a receive buffer which is reused for the next
+ * message, so it is only valid during the call. Replies have a NULL payload if
+ * the connection was closed before they arrived.
+ */
+typedef void (*ipc_client_func)(struct ipc_client *client, uint32_t type,
+	const char *payload, uint32_t size, void *data);
+
+/**
+ * Creates a non-blocking client on a socket from ipc_open_socket, taking
+ * ownership of the socket. Any number of requests may be in flight; their
+ * replies are passed to their callbacks in order, and events to event_func.
+ * close_func is called once the connection is lost. Either may be NULL.
+ */
+struct ipc_client *ipc_client_create(int socketfd, ipc_client_func event_func,
+	void (*close_func)(struct ipc_client *client, void *data), void *data);
+/**
+ * Destroys the client and closes its socket, without calling the callbacks of
+ * pending requests. May be called from any of the client's callbacks.
+ */
+void ipc_client_destroy(struct ipc_client *client);
+int ipc_client_get_fd(struct ipc_client *client);
+/**
+ * Returns the events to poll the socket for: POLLIN, and POLLOUT while
+ * requests are waiting to be written.
+ */
+short ipc_client_get_events(struct ipc_client *client);
+/**
+ * Returns the number of requests which did not get their reply yet.
+ */
+size_t ipc_client_get_pending(struct ipc_client *client);
+/**
+ * Limits the number of pending requests; further requests are refused until
+ * replies arrive. 0, the default, means no limit.
+ */
+void ipc_client_set_max_pending(struct ipc_client *client, size_t max);
+/**
+ * Queues a request and writes as much of the queue as the socket accepts.
+ * reply_func may be NULL to ignore the reply. Returns false if the request was
+ * refused, because the connection is closed or too many requests are pending.
+ */
+bool ipc_client_send(struct ipc_client *client, uint32_t type,
+	const char *payload, uint32_t size, ipc_client_func reply_func, void *data);
+/**
+ * Handles the poll events of the socket without blocking: writes queued
+ * requests and passes complete replies and events to their callbacks. Returns
+ * false once the connection is closed.
+ */
+bool ipc_client_dispatch(struct ipc_client *client, short revents);
+/**
+ * Adds the client to a loop, which then dispatches it and polls it for the
+ * events it needs. The client removes itself once the connection is closed.
+ */
+void ipc_client_add_to_loop(struct ipc_client *client, struct loop *loop);
+/**
+ * Blocks until all pending requests got their replies, dispatching events in
+ * the meantime. Must not be called from the client's callbacks. Returns false
+ * if the connection was closed.
+ */
+bool ipc_client_roundtrip(struct ipc_client *client);
 
 #endif
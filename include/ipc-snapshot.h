@@ -0,0 +1,93 @@
+#ifndef _SWAY_IPC_SNAPSHOT_H
+#define _SWAY_IPC_SNAPSHOT_H
+
+#include <stdint.h>
+
+/**
+ * Layout of the shared memory tree snapshot handed out with the reply to
+ * IPC_GET_SNAPSHOT. See sway-ipc(7) for the reading protocol.
+ *
+ * The file starts with a struct ipc_snapshot_header. It describes two
+ * buffers, each of which starts with a struct ipc_snapshot_data followed by
+ * the node array and the string table. All offsets are in bytes; buffer
+ * offsets are relative to the start of the file, all other offsets are
+ * relative to the start of their buffer.
+ */
+
+#define IPC_SNAPSHOT_MAGIC 0x70616e73 // "snap"
+#define IPC_SNAPSHOT_VERSION 1
+
+// Used for node indices and string offsets which are not set
+#define IPC_SNAPSHOT_NONE UINT32_MAX
+
+enum ipc_snapshot_node_type {
+	IPC_SNAPSHOT_ROOT,
+	IPC_SNAPSHOT_OUTPUT,
+	IPC_SNAPSHOT_WORKSPACE,
+	IPC_SNAPSHOT_CON,
+	IPC_SNAPSHOT_FLOATING_CON,
+};
+
+enum ipc_snapshot_node_flags {
+	IPC_SNAPSHOT_FOCUSED = 1 << 0,
+	IPC_SNAPSHOT_VISIBLE = 1 << 1,
+	IPC_SNAPSHOT_URGENT = 1 << 2,
+	IPC_SNAPSHOT_FULLSCREEN = 1 << 3,
+	IPC_SNAPSHOT_STICKY = 1 << 4,
+	IPC_SNAPSHOT_VIEW = 1 << 5,
+};
+
+enum ipc_snapshot_layout {
+	IPC_SNAPSHOT_LAYOUT_NONE,
+	IPC_SNAPSHOT_LAYOUT_SPLITH,
+	IPC_SNAPSHOT_LAYOUT_SPLITV,
+	IPC_SNAPSHOT_LAYOUT_STACKED,
+	IPC_SNAPSHOT_LAYOUT_TABBED,
+};
+
+struct ipc_snapshot_buffer {
+	uint32_t seq; // odd while the buffer is being written
+	uint32_t offset;
+	uint32_t size;
+	uint32_t capacity;
+};
+
+struct ipc_snapshot_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t file_size;
+	uint32_t current; // index of the most recently written buffer
+	struct ipc_snapshot_buffer buffers[2];
+};
+
+struct ipc_snapshot_data {
+	uint64_t serial; // incremented for every snapshot
+	uint32_t node_count;
+	uint32_t node_size; // sizeof(struct ipc_snapshot_node)
+	uint32_t nodes_offset;
+	uint32_t strings_offset;
+	uint32_t strings_size;
+	uint32_t focused; // index of the focused node
+};
+
+/**
+ * Nodes are stored in depth-first order, so a node's parent always precedes
+ * it. Tiling children of a workspace precede its floating children.
+ */
+struct ipc_snapshot_node {
+	uint64_t id;
+	uint32_t type; // enum ipc_snapshot_node_type
+	uint32_t flags; // enum ipc_snapshot_node_flags
+	uint32_t parent; // node index
+	uint32_t output; // node index
+	uint32_t workspace; // node index
+	uint32_t layout; // enum ipc_snapshot_layout
+	int32_t x, y, width, height;
+	int32_t content_x, content_y, content_width, content_height;
+	uint32_t name; // string offset
+	uint32_t app_id; // string offset
+	uint32_t class; // string offset
+	int32_t pid;
+};
+
+#endif
@@ -22,6 +22,12 @@ enum ipc_command_type {
 	// sway-specific command types
 	IPC_GET_INPUTS = 100,
 	IPC_GET_SEATS = 101,
+	IPC_COMMAND_BATCH = 102,
+	IPC_GET_SNAPSHOT = 103,
+	IPC_SET_ENCODING = 104,
+	IPC_GET_STATS = 105,
+	IPC_GET_LOG = 106,
+	IPC_GET_PROFILE = 107,
 
 	// Events sent from sway to clients. Events have the highest bits set.
 	IPC_EVENT_WORKSPACE = ((1<<31) | 0),
@@ -36,6 +42,13 @@ enum ipc_command_type {
 	// sway-specific event types
 	IPC_EVENT_BAR_STATE_UPDATE = ((1<<31) | 20),
 	IPC_EVENT_INPUT = ((1<<31) | 21),
+	IPC_EVENT_OVERFLOW = ((1<<31) | 22),
+};
+
+// Payload encodings selectable with IPC_SET_ENCODING
+enum ipc_encoding {
+	IPC_ENCODING_JSON,
+	IPC_ENCODING_CBOR,
 };
 
 #endif
@@ -28,6 +28,21 @@ typedef void (*terminate_callback_t)(int exit_code);
 // The `terminate` callback is called by `sway_abort`
 void sway_log_init(sway_log_importance_t verbosity, terminate_callback_t terminate);
 
+// Keeps the most recent messages less than or equal to `verbosity` in memory,
+// regardless of the verbosity logged to stderr. Messages are only formatted
+// when they are retrieved, so format strings passed to `_sway_log` must be
+// string literals.
+bool sway_log_recorder_init(sway_log_importance_t verbosity);
+
+typedef void (*sway_log_recorder_func_t)(const char *line, void *data);
+
+// Formats the recorded messages, oldest first, and calls `func` for each
+void sway_log_recorder_for_each(sway_log_recorder_func_t func, void *data);
+
+// Writes the recorded messages to `fd`. This is async-signal-safe, for use
+// in a crash handler.
+void sway_log_recorder_dump(int fd);
+
 void _sway_log(sway_log_importance_t verbosity, const char *format, ...) ATTRIB_PRINTF(2, 3);
 void _sway_vlog(sway_log_importance_t verbosity, const char *format, va_list args) ATTRIB_PRINTF(2, 0);
 void _sway_abort(const char *filename, ...) ATTRIB_PRINTF(1, 2);
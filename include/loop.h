@@ -23,7 +23,8 @@ struct loop *loop_create(void);
 void loop_destroy(struct loop *loop);
 
 /**
- * Poll the event loop. This will block until one of the fds has data.
+ * Poll the event loop. This will block until one of the fds has data or the
+ * next timer expires.
  */
 void loop_poll(struct loop *loop);
 
@@ -41,6 +42,11 @@ void loop_add_fd(struct loop *loop, int fd, short mask,
 struct loop_timer *loop_add_timer(struct loop *loop, int ms,
 		void (*callback)(void *data), void *data);
 
+/**
+ * Change the events a file descriptor in the loop is polled for.
+ */
+bool loop_set_fd_mask(struct loop *loop, int fd, short mask);
+
 /**
  * Remove a file descriptor from the loop.
  */
@@ -19,5 +19,9 @@ void get_text_size(cairo_t *cairo, const char *font, int *width, int *height,
 		int *baseline, double scale, bool markup, const char *fmt, ...);
 void pango_printf(cairo_t *cairo, const char *font,
 		double scale, bool markup, const char *fmt, ...);
+/**
+ * Releases the layouts cached by get_text_size and pango_printf.
+ */
+void pango_layout_cache_finish(void);
 
 #endif
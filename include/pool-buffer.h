@@ -6,6 +6,9 @@
 #include <stdint.h>
 #include <wayland-client.h>
 
+#define POOL_DEFAULT_BUFFERS 3
+#define POOL_MAX_BUFFERS 8
+
 struct pool_buffer {
 	struct wl_buffer *buffer;
 	cairo_surface_t *surface;
@@ -14,11 +17,31 @@ struct pool_buffer {
 	uint32_t width, height;
 	void *data;
 	size_t size;
+	size_t offset; // in the pool
 	bool busy;
 };
 
+/*
+ * A growable wl_shm_pool which buffers are sub-allocated from. The pool only
+ * grows, so buffers are reused across resizes when they fit. A zeroed struct
+ * is an empty pool with POOL_DEFAULT_BUFFERS buffers.
+ */
+struct buffer_pool {
+	struct wl_shm_pool *pool;
+	int fd;
+	void *data;
+	size_t size;
+
+	int max_buffers; // 0 for POOL_DEFAULT_BUFFERS
+	struct pool_buffer buffers[POOL_MAX_BUFFERS];
+};
+
+/*
+ * Returns a buffer of the given size which is not in use by the compositor,
+ * or NULL if all buffers are busy.
+ */
 struct pool_buffer *get_next_buffer(struct wl_shm *shm,
-		struct pool_buffer pool[static 2], uint32_t width, uint32_t height);
-void destroy_buffer(struct pool_buffer *buffer);
+		struct buffer_pool *pool, uint32_t width, uint32_t height);
+void finish_buffer_pool(struct buffer_pool *pool);
 
 #endif
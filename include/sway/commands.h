@@ -4,6 +4,7 @@
 #include <wlr/util/edges.h>
 #include "config.h"
 
+struct json_object;
 struct sway_container;
 
 typedef struct cmd_results *sway_cmd(int argc, char **argv);
@@ -64,6 +65,12 @@ list_t *execute_command(char *command,  struct sway_seat *seat,
  * Do not use this under normal conditions.
  */
 struct cmd_results *config_command(char *command, char **new_block);
+/**
+ * Runs a config command which has already been split, had its variables
+ * replaced and been unescaped by config_command, such as one replayed from
+ * the config cache.
+ */
+struct cmd_results *config_command_argv(int argc, char **argv);
 /**
  * Parse and handle a sub command
  */
@@ -87,6 +94,10 @@ void free_cmd_results(struct cmd_results *results);
  * Free the JSON string later on.
  */
 char *cmd_results_to_json(list_t *res_list);
+/**
+ * Serializes a list of cmd_results to a JSON array object.
+ */
+struct json_object *cmd_results_to_json_array(list_t *res_list);
 
 /**
  * TODO: Move this function and its dependent functions to container.c.
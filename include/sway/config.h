@@ -18,6 +18,8 @@
 
 // TODO: Refactor this shit
 
+struct cmd_results;
+
 /**
  * Describes a variable created via the `set` command.
  */
@@ -26,6 +28,17 @@ struct sway_variable {
 	char *value;
 };
 
+/**
+ * A node of the trie over variable names used by do_var_replacement. Each
+ * node matches one more character of a name.
+ */
+struct sway_variable_node {
+	char c;
+	struct sway_variable *var; // the variable whose name ends here, if any
+	struct sway_variable_node *child;
+	struct sway_variable_node *sibling;
+};
+
 enum binding_input_type {
 	BINDING_KEYCODE,
 	BINDING_KEYSYM,
@@ -462,6 +475,7 @@ struct sway_config {
 	char *swaynag_command;
 	struct swaynag_instance swaynag_config_errors;
 	list_t *symbols;
+	struct sway_variable_node *symbol_trie; // root, NULL without variables
 	list_t *modes;
 	list_t *bars;
 	list_t *cmd_queue;
@@ -471,6 +485,7 @@ struct sway_config {
 	list_t *input_type_configs;
 	list_t *seat_configs;
 	list_t *criteria;
+	struct criteria_index *criteria_index;
 	list_t *no_focus;
 	list_t *active_bar_modifiers;
 	struct sway_mode *current_mode;
@@ -573,11 +588,25 @@ struct sway_config {
 	} handler_context;
 };
 
+/**
+ * What a differential reload found to have changed, besides the inputs,
+ * seats, outputs and bars it already applied.
+ */
+struct config_changes {
+	bool appearance; // fonts, colors and what title and mark textures show
+	bool layout; // borders, gaps and titlebar sizes
+};
+
 /**
  * Loads the main config from the given path. is_active should be true when
  * reloading the config.
+ *
+ * If changes is not NULL, the reload is differential: only the inputs, seats,
+ * outputs and bars whose config changed are reconfigured, swaybg and the
+ * swaybar clients of unchanged bars are kept, and changes is filled in.
  */
-bool load_main_config(const char *path, bool is_active, bool validating);
+bool load_main_config(const char *path, bool is_active, bool validating,
+		struct config_changes *changes);
 
 /**
  * Loads an included config. Can only be used after load_main_config.
@@ -591,6 +620,49 @@ void load_include_configs(const char *path, struct sway_config *config,
 bool read_config(FILE *file, struct sway_config *config,
 		struct swaynag_instance *swaynag);
 
+/**
+ * Handles the result of a config line, read from a file or replayed from the
+ * config cache. stack holds the names of the enclosing blocks. Returns false
+ * if the line failed.
+ */
+bool config_handle_result(struct sway_config *config,
+		struct swaynag_instance *swaynag, list_t *stack,
+		struct cmd_results *res, const char *expanded, const char *new_block);
+
+/**
+ * Enables the config cache, which stores the commands of a loaded config so
+ * that they can be replayed while none of the config files change.
+ */
+void config_cache_enable(void);
+
+/**
+ * Runs the cached commands of the main config at main_path, which must be a
+ * real path. Returns false without running anything if the cache is disabled
+ * or not valid, in which case the config should be read from its files.
+ */
+bool config_cache_replay(const char *main_path, struct sway_config *config,
+		struct swaynag_instance *swaynag);
+
+/**
+ * Records the commands of the main config at main_path while it is read, to
+ * be written to the cache by config_cache_finish unless any of them failed.
+ */
+void config_cache_begin(const char *main_path);
+void config_cache_finish(bool success);
+void config_cache_abort(void);
+
+/**
+ * Hooks for recording the config file being read, each of its lines, the
+ * arguments a line's handler is called with and the line's result. Lines are
+ * referred to by the index config_cache_record_line returns.
+ */
+void config_cache_record_file(const char *path);
+int config_cache_record_line(const char *line, int line_number,
+		const char *expanded, bool commands_block);
+void config_cache_record_argv(int argc, char **argv, bool include);
+void config_cache_record_result(int index, struct cmd_results *res,
+		const char *new_block);
+
 /**
  * Run the commands that were deferred when reading the config file.
  */
@@ -613,6 +685,15 @@ void free_config(struct sway_config *config);
 
 void free_sway_variable(struct sway_variable *var);
 
+/**
+ * Adds a variable to the config, which takes ownership of it.
+ */
+void config_add_variable(struct sway_config *config,
+		struct sway_variable *var);
+
+struct sway_variable *config_find_variable(struct sway_config *config,
+		const char *name);
+
 /**
  * Does variable replacement for a string based on the config's currently loaded variables.
  */
@@ -631,6 +712,9 @@ void input_config_fill_rule_names(struct input_config *ic,
 
 void free_input_config(struct input_config *ic);
 
+bool input_config_equal(const struct input_config *a,
+		const struct input_config *b);
+
 int seat_name_cmp(const void *item, const void *data);
 
 struct seat_config *new_seat_config(const char* name);
@@ -641,6 +725,9 @@ struct seat_config *copy_seat_config(struct seat_config *seat);
 
 void free_seat_config(struct seat_config *ic);
 
+bool seat_config_equal(const struct seat_config *a,
+		const struct seat_config *b);
+
 struct seat_attachment_config *seat_attachment_config_new(void);
 
 struct seat_attachment_config *seat_config_get_attachment(
@@ -671,10 +758,25 @@ void apply_output_config_to_outputs(struct output_config *oc);
 
 void reset_outputs(void);
 
+bool output_config_equal(const struct output_config *a,
+		const struct output_config *b);
+
+/**
+ * Applies the output config of every output whose config differs from the one
+ * old_config would give it.
+ */
+void reset_changed_outputs(struct sway_config *old_config);
+
 void free_output_config(struct output_config *oc);
 
 bool spawn_swaybg(void);
 
+/**
+ * Moves the swaybg client of old_config to the current config if it would be
+ * spawned with the same arguments. Returns false if it has to be respawned.
+ */
+bool keep_swaybg(struct sway_config *old_config);
+
 int workspace_output_cmp_workspace(const void *a, const void *b);
 
 void free_sway_binding(struct sway_binding *sb);
@@ -687,6 +789,12 @@ void load_swaybar(struct bar_config *bar);
 
 void load_swaybars(void);
 
+/**
+ * Moves the swaybar clients of the bars of old_config whose config is
+ * unchanged to the bars of the current config with the same id.
+ */
+void keep_unchanged_swaybars(struct sway_config *old_config);
+
 struct bar_config *default_bar_config(void);
 
 void free_bar_config(struct bar_config *bar);
@@ -6,6 +6,8 @@
 #include "list.h"
 #include "tree/view.h"
 
+struct criteria_index;
+
 enum criteria_type {
 	CT_COMMAND                 = 1 << 0,
 	CT_ASSIGN_OUTPUT           = 1 << 1,
@@ -19,9 +21,37 @@ enum pattern_type {
 	PATTERN_FOCUSED,
 };
 
+/**
+ * The properties of a view a criteria depends on. Properties can be bitwise
+ * ORed.
+ */
+enum criteria_property {
+	CRITERIA_TITLE       = 1 << 0,
+	CRITERIA_SHELL       = 1 << 1,
+	CRITERIA_APP_ID      = 1 << 2,
+	CRITERIA_CON_MARK    = 1 << 3,
+	CRITERIA_CON_ID      = 1 << 4,
+	CRITERIA_CLASS       = 1 << 5,
+	CRITERIA_ID          = 1 << 6,
+	CRITERIA_INSTANCE    = 1 << 7,
+	CRITERIA_WINDOW_ROLE = 1 << 8,
+	CRITERIA_WINDOW_TYPE = 1 << 9,
+	CRITERIA_FLOATING    = 1 << 10, // floating or tiling
+	CRITERIA_URGENT      = 1 << 11,
+	CRITERIA_WORKSPACE   = 1 << 12,
+	CRITERIA_PID         = 1 << 13,
+	CRITERIA_FOCUSED     = 1 << 14, // any __focused__ pattern
+	CRITERIA_ALL         = (1 << 15) - 1,
+};
+
 struct pattern {
 	enum pattern_type match_type;
 	pcre *regex;
+	pcre_extra *regex_extra; // JIT compiled code, may be NULL
+	// The string matched by an anchored literal regex such as ^firefox$ or
+	// ^org\.gnome\., or NULL for any other pattern
+	char *literal;
+	bool literal_prefix; // the regex is not anchored at the end
 };
 
 struct criteria {
@@ -29,6 +59,7 @@ struct criteria {
 	char *raw; // entire criteria string (for logging)
 	char *cmdlist;
 	char *target; // workspace or output name for `assign` criteria
+	uint32_t properties; // enum criteria_property
 
 	struct pattern *title;
 	struct pattern *shell;
@@ -73,6 +104,21 @@ struct criteria *criteria_parse(char *raw, char **error);
  */
 list_t *criteria_for_view(struct sway_view *view, enum criteria_type types);
 
+/**
+ * Compile a list of CT_COMMAND criterias which may have started matching the
+ * view because the given properties changed. Criteria which were evaluated for
+ * the view before and only depend on other properties are skipped, except for
+ * properties changing without notice such as floating or the focus.
+ */
+list_t *criteria_for_view_update(struct sway_view *view,
+		enum criteria_property changed);
+
+/**
+ * Destroy the index used by criteria_for_view to find the criteria that may
+ * match a view. It is built on demand from config->criteria.
+ */
+void criteria_index_destroy(struct criteria_index *index);
+
 /**
  * Compile a list of containers matching the given criteria.
  */
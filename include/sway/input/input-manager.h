@@ -52,6 +52,12 @@ void input_manager_reset_all_inputs(void);
 
 void input_manager_apply_seat_config(struct seat_config *seat_config);
 
+/**
+ * Applies the input and seat configs which differ from those of old_config,
+ * only reconfiguring the devices and seats they affect.
+ */
+void input_manager_apply_changed_configs(struct sway_config *old_config);
+
 struct sway_seat *input_manager_get_default_seat(void);
 
 struct sway_seat *input_manager_get_seat(const char *seat_name, bool create);
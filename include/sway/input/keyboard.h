@@ -83,6 +83,12 @@ struct sway_keyboard_group {
 struct xkb_keymap *sway_keyboard_compile_keymap(struct input_config *ic,
 		char **error);
 
+/**
+ * Releases the keymaps cached by sway_keyboard_compile_keymap and their XKB
+ * context. Keymaps still referenced elsewhere stay valid.
+ */
+void sway_keyboard_keymap_cache_finish(void);
+
 struct sway_keyboard *sway_keyboard_create(struct sway_seat *seat,
 		struct sway_seat_device *device);
 
@@ -0,0 +1,18 @@
+#ifndef _SWAY_IPC_SNAPSHOT_SERVER_H
+#define _SWAY_IPC_SNAPSHOT_SERVER_H
+
+/**
+ * Returns the fd of the shared memory tree snapshot, creating the snapshot on
+ * first use, or -1 on failure. The fd remains owned by the snapshot.
+ */
+int ipc_snapshot_get_fd(void);
+
+/**
+ * Rewrites the snapshot from the current state of the tree once the event loop
+ * is idle. Does nothing until a snapshot has been requested.
+ */
+void ipc_snapshot_schedule_update(void);
+
+void ipc_snapshot_finish(void);
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef _SWAY_IPC_STATS_H
+#define _SWAY_IPC_STATS_H
+
+#include <json.h>
+#include <stddef.h>
+#include <time.h>
+#include "ipc.h"
+
+/**
+ * What happened to an event for one of its subscribers.
+ */
+enum ipc_stats_delivery {
+	IPC_STATS_QUEUED,
+	IPC_STATS_DROPPED, // the client's queue was full
+	IPC_STATS_SUPERSEDED, // replaced an older queued event
+};
+
+/**
+ * Records a handled request of the given type which started at start.
+ */
+void ipc_stats_request(enum ipc_command_type type,
+		const struct timespec *start);
+
+/**
+ * Records an event being emitted, before it is sent to its subscribers.
+ */
+void ipc_stats_event(enum ipc_command_type event);
+
+void ipc_stats_event_delivery(enum ipc_command_type event,
+		enum ipc_stats_delivery delivery);
+
+/**
+ * Records the serialization of a reply or event which started at start and
+ * produced len bytes.
+ */
+void ipc_stats_serialization(const struct timespec *start, size_t len);
+
+/**
+ * Describes the collected request, event and serialization statistics. The
+ * per client statistics are added by the IPC server.
+ */
+json_object *ipc_stats_describe(void);
+
+#endif
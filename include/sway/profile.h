@@ -0,0 +1,91 @@
+#ifndef _SWAY_PROFILE_H
+#define _SWAY_PROFILE_H
+
+#include <json.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * Phases of startup. Phases which run more than once, such as compiling
+ * keymaps, accumulate. Recursive phases, such as loading an included config
+ * file, are only counted at the outermost level.
+ */
+enum profile_phase {
+	PROFILE_BACKEND_CREATE,
+	PROFILE_SERVER_GLOBALS, // renderer, compositor and protocols
+	PROFILE_SERVER_SOCKET,
+	PROFILE_SERVER_BACKENDS, // noop and headless backends
+	PROFILE_INPUT_MANAGER,
+	PROFILE_IPC_INIT,
+	PROFILE_CONFIG_LOAD,
+	PROFILE_CONFIG_VARIABLES, // do_var_replacement
+	PROFILE_CONFIG_HANDLERS, // command handlers run for config lines
+	PROFILE_KEYMAP_COMPILE,
+	PROFILE_OUTPUT_CONFIG,
+	PROFILE_XWAYLAND_CREATE,
+	PROFILE_BACKEND_START,
+	PROFILE_SWAYBARS,
+	PROFILE_DEFERRED_COMMANDS,
+	PROFILE_PHASE_COUNT,
+};
+
+/**
+ * Points in time recorded relative to the start of sway.
+ */
+enum profile_milestone {
+	PROFILE_STARTUP_COMPLETE, // about to run the event loop
+	PROFILE_XWAYLAND_READY,
+	PROFILE_MILESTONE_COUNT,
+};
+
+/**
+ * The state of the profiler at the start of a config line, so the time spent
+ * in variable replacement and command handlers can be attributed to it.
+ */
+struct profile_mark {
+	struct timespec time;
+	uint64_t variables_nsec;
+	uint64_t handlers_nsec;
+};
+
+/**
+ * Starts the profile. Phases and config files are always timed, individual
+ * config lines only if lines is true. Recording stops once startup completes,
+ * except for milestones, and the other functions return immediately from then
+ * on. Every profile_begin must be matched by a profile_end, including on error
+ * paths.
+ */
+void profile_init(bool lines);
+
+void profile_begin(enum profile_phase phase, struct timespec *start);
+void profile_end(enum profile_phase phase, const struct timespec *start);
+
+void profile_milestone(enum profile_milestone milestone);
+
+/**
+ * Records reading the config file at path, which started at start. The time
+ * includes the files it includes.
+ */
+void profile_file(const char *path, const struct timespec *start);
+
+void profile_mark(struct profile_mark *mark);
+
+/**
+ * Records a config line whose processing started at mark. Does nothing unless
+ * line profiling is enabled.
+ */
+void profile_line(const char *path, int line_number, const char *line,
+		const struct profile_mark *mark);
+
+/**
+ * Describes the profile as JSON, with config lines sorted slowest first.
+ */
+json_object *profile_describe(void);
+
+/**
+ * Prints a human readable summary of the profile to stderr.
+ */
+void profile_report(void);
+
+#endif
@@ -106,6 +106,10 @@ struct sway_view {
 	bool destroying;
 
 	list_t *executed_criteria; // struct criteria *
+	// Bitset of the criteria evaluated for the view, by position in
+	// config->criteria, see criteria_for_view_update
+	uint64_t *criteria_evaluated;
+	uint64_t criteria_serial;
 
 	union {
 		struct wlr_xdg_surface *wlr_xdg_surface;
@@ -343,9 +347,11 @@ void view_update_title(struct sway_view *view, bool force);
 
 /**
  * Run any criteria that match the view and haven't been run on this view
- * before.
+ * before. Changed is a mask of enum criteria_property naming the properties
+ * which changed since the last call, criteria only depending on others aren't
+ * evaluated again.
  */
-void view_execute_criteria(struct sway_view *view);
+void view_execute_criteria(struct sway_view *view, uint32_t changed);
 
 /**
  * Returns true if there's a possibility the view may be rendered on screen.
@@ -3,6 +3,8 @@
 #include <wayland-client.h>
 #include "config.h"
 #include "input.h"
+#include "ipc-client.h"
+#include "list.h"
 #include "pool-buffer.h"
 #include "wlr-layer-shell-unstable-v1-client-protocol.h"
 #include "xdg-output-unstable-v1-client-protocol.h"
@@ -13,6 +15,7 @@ struct swaybar_output;
 struct swaybar_tray;
 #endif
 struct swaybar_workspace;
+struct render_element;
 struct loop;
 
 struct swaybar {
@@ -37,13 +40,19 @@ struct swaybar {
 
 	struct loop *eventloop;
 
-	int ipc_event_socketfd;
-	int ipc_socketfd;
+	struct ipc_client *ipc_events;
+	struct ipc_client *ipc;
+	enum ipc_encoding ipc_encoding; // of both sockets
+	bool workspaces_pending; // a get_workspaces request is in flight
+	bool workspaces_stale; // and workspaces changed since it was sent
 
 	struct wl_list outputs; // swaybar_output::link
 	struct wl_list unused_outputs; // swaybar_output::link
 	struct wl_list seats; // swaybar_seat::link
 
+	// Status line renderings shared by outputs, see render.c
+	list_t *status_strips; // struct status_strip *
+
 #if HAVE_TRAY
 	struct swaybar_tray *tray;
 #endif
@@ -71,16 +80,24 @@ struct swaybar_output {
 	uint32_t width, height;
 	int32_t scale;
 	enum wl_output_subpixel subpixel;
-	struct pool_buffer buffers[2];
+	struct buffer_pool buffers;
 	struct pool_buffer *current_buffer;
 	bool dirty;
 	bool frame_scheduled;
 
+	// Damage tracking: the elements drawn in the last frame, and the buffer
+	// holding that frame (NULL to repaint everything in the next frame)
+	struct render_element *elements;
+	size_t elements_len;
+	struct pool_buffer *last_buffer;
+	uint64_t frame_key;
+
 	uint32_t output_height, output_width, output_x, output_y;
 };
 
 struct swaybar_workspace {
 	struct wl_list link; // swaybar_output::workspaces
+	int id;
 	int num;
 	char *name;
 	char *label;
@@ -93,7 +110,13 @@ bool bar_setup(struct swaybar *bar, const char *socket_path);
 void bar_run(struct swaybar *bar);
 void bar_teardown(struct swaybar *bar);
 
+void set_output_dirty(struct swaybar_output *output);
 void set_bar_dirty(struct swaybar *bar);
+/**
+ * Applies the pending i3bar status update, unless every output is waiting for
+ * a frame, and redraws the bar only if a block changed.
+ */
+void apply_status_update(struct swaybar *bar);
 
 /*
  * Determines whether the bar should be visible and changes it to be so.
@@ -108,6 +131,7 @@ void set_bar_dirty(struct swaybar *bar);
  * Returns true if the bar is now visible, otherwise false.
  */
 bool determine_bar_visibility(struct swaybar *bar, bool moving_layer);
+void free_workspace(struct swaybar_workspace *ws);
 void free_workspaces(struct wl_list *list);
 
 void status_in(int fd, short mask, void *data);
@@ -7,6 +7,7 @@
 struct i3bar_block {
 	struct wl_list link; // status_link::blocks
 	int ref_count;
+	uint64_t serial; // changes whenever the contents of the block do
 	char *full_text, *short_text, *align, *min_width_str;
 	bool urgent;
 	uint32_t color;
@@ -26,7 +27,17 @@ struct i3bar_block {
 };
 
 void i3bar_block_unref(struct i3bar_block *block);
+/**
+ * Reads the status command's output and keeps its newest complete array for
+ * i3bar_apply_update, setting update_pending. Returns true only if the status
+ * line fell back to an error message.
+ */
 bool i3bar_handle_readable(struct status_line *status);
+/**
+ * Applies the newest array received by i3bar_handle_readable, if any. Returns
+ * true if the blocks changed.
+ */
+bool i3bar_apply_update(struct status_line *status);
 enum hotspot_event_handling i3bar_block_send_click(struct status_line *status,
 		struct i3bar_block *block, double x, double y, double rx, double ry,
 		double w, double h, int scale, uint32_t button);
@@ -1,8 +1,10 @@
 #ifndef _SWAYBAR_RENDER_H
 #define _SWAYBAR_RENDER_H
 
+struct swaybar;
 struct swaybar_output;
 
 void render_frame(struct swaybar_output *output);
+void free_status_strips(struct swaybar *bar);
 
 #endif
@@ -23,6 +23,7 @@ struct status_line {
 	enum status_protocol protocol;
 	const char *text;
 	struct wl_list blocks; // i3bar_block::link
+	uint64_t block_serial;
 
 	int stop_signal;
 	int cont_signal;
@@ -36,6 +37,11 @@ struct status_line {
 	bool started;
 	bool expecting_comma;
 	json_tokener *tokener;
+	// The newest complete i3bar array, applied with the next frame
+	char *update;
+	size_t update_size;
+	size_t update_len;
+	bool update_pending;
 };
 
 struct status_line *status_line_init(char *cmd);
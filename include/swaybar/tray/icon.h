@@ -31,13 +31,24 @@ struct icon_theme {
 void init_themes(list_t **themes, list_t **basedirs);
 void finish_themes(list_t *themes, list_t *basedirs);
 
+/*
+ * An index of the icon directories that have been searched, kept up to date
+ * with inotify. icon_index_dispatch should be called when its fd is readable.
+ */
+struct icon_index;
+
+struct icon_index *create_icon_index(void);
+void destroy_icon_index(struct icon_index *index);
+int icon_index_get_fd(struct icon_index *index);
+void icon_index_dispatch(struct icon_index *index);
+
 /*
  * Finds an icon of a specified size given a list of themes and base directories.
  * If the icon is found, the pointers min_size & max_size are set to minimum &
  * maximum size that the icon can be scaled to, respectively.
  * Returns: path of icon (which should be freed), or NULL if the icon is not found.
  */
-char *find_icon(list_t *themes, list_t *basedirs, char *name, int size,
-		char *theme, int *min_size, int *max_size);
+char *find_icon(struct icon_index *index, list_t *themes, list_t *basedirs,
+		char *name, int size, char *theme, int *min_size, int *max_size);
 
 #endif
@@ -27,6 +27,8 @@ struct swaybar_sni {
 	// icon properties
 	struct swaybar_tray *tray;
 	cairo_surface_t *icon;
+	uint32_t icon_serial; // changes whenever icon is replaced
+	struct swaybar_icon_source *icon_source; // of icon, in the tray icon cache
 	int min_size;
 	int max_size;
 	int target_size;
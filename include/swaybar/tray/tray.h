@@ -17,6 +17,7 @@
 struct swaybar;
 struct swaybar_output;
 struct swaybar_watcher;
+struct icon_index;
 
 struct swaybar_tray {
 	struct swaybar *bar;
@@ -32,11 +33,50 @@ struct swaybar_tray {
 
 	list_t *basedirs; // char *
 	list_t *themes; // struct swaybar_theme *
+	struct icon_index *icon_index;
+
+	list_t *icon_cache; // struct swaybar_tray_icon *
+	size_t icon_cache_bytes;
+	uint64_t icon_cache_clock;
 };
 
 struct swaybar_tray *create_tray(struct swaybar *bar);
 void destroy_tray(struct swaybar_tray *tray);
 void tray_in(int fd, short mask, void *data);
+void tray_icons_in(int fd, short mask, void *data);
+
+/*
+ * What an icon was loaded from, such as the path and metadata of an icon file
+ * or the pixels of a pixmap. Sources are reference counted, so that an item
+ * and the cached sizes of its icon can share one.
+ */
+struct swaybar_icon_source {
+	int refs;
+	uint64_t hash;
+	size_t len;
+	unsigned char data[];
+};
+
+/*
+ * Creates a source from the concatenation of head and body, with one
+ * reference.
+ */
+struct swaybar_icon_source *tray_icon_source_create(const void *head,
+		size_t head_len, const void *body, size_t body_len);
+void tray_icon_source_unref(struct swaybar_icon_source *source);
+
+/*
+ * Decoded and scaled icons are cached on the tray, keyed by their source and
+ * the size in pixels (0 for the unscaled icon), so that they are shared
+ * between items & outputs. Sources are compared in full, not just by hash.
+ * tray_icon_lookup returns a new reference, or NULL on a cache miss.
+ * tray_icon_insert takes its own references to the source and surface.
+ */
+cairo_surface_t *tray_icon_lookup(struct swaybar_tray *tray,
+		const struct swaybar_icon_source *source, int size);
+void tray_icon_insert(struct swaybar_tray *tray,
+		struct swaybar_icon_source *source, int size, cairo_surface_t *surface);
+void set_tray_dirty(struct swaybar_tray *tray);
 uint32_t render_tray(cairo_t *cairo, struct swaybar_output *output, double *x);
 
 #endif
@@ -11,6 +11,7 @@
 #include "sway/criteria.h"
 #include "sway/input/input-manager.h"
 #include "sway/input/seat.h"
+#include "sway/profile.h"
 #include "sway/tree/view.h"
 #include "stringop.h"
 #include "log.h"
@@ -329,6 +330,15 @@ cleanup:
 	return res_list;
 }
 
+static struct cmd_results *run_config_handler(
+		const struct cmd_handler *handler, int argc, char **argv) {
+	struct timespec start;
+	profile_begin(PROFILE_CONFIG_HANDLERS, &start);
+	struct cmd_results *results = handler->handle(argc - 1, argv + 1);
+	profile_end(PROFILE_CONFIG_HANDLERS, &start);
+	return results;
+}
+
 // this is like execute_command above, except:
 // 1) it ignores empty commands (empty lines)
 // 2) it does variable substitution
@@ -415,13 +425,25 @@ struct cmd_results *config_command(char *exec, char **new_block) {
 	}
 
 	// Run command
-	results = handler->handle(argc - 1, argv + 1);
+	config_cache_record_argv(argc, argv, handler->handle == cmd_include);
+	results = run_config_handler(handler, argc, argv);
 
 cleanup:
 	free_argv(argc, argv);
 	return results;
 }
 
+struct cmd_results *config_command_argv(int argc, char **argv) {
+	const struct cmd_handler *handler = find_core_handler(argv[0]);
+	if (!handler || !handler->handle) {
+		const char *error = handler
+			? "Command '%s' is shimmed, but unimplemented"
+			: "Unknown/invalid command '%s'";
+		return cmd_results_new(CMD_INVALID, error, argv[0]);
+	}
+	return run_config_handler(handler, argc, argv);
+}
+
 struct cmd_results *config_subcommand(char **argv, int argc,
 		const struct cmd_handler *handlers, size_t handlers_size) {
 	char *command = join_args(argv, argc);
@@ -530,7 +552,7 @@ void free_cmd_results(struct cmd_results *results) {
 	free(results);
 }
 
-char *cmd_results_to_json(list_t *res_list) {
+json_object *cmd_results_to_json_array(list_t *res_list) {
 	json_object *result_array = json_object_new_array();
 	for (int i = 0; i < res_list->length; ++i) {
 		struct cmd_results *results = res_list->items[i];
@@ -545,6 +567,11 @@ char *cmd_results_to_json(list_t *res_list) {
 		}
 		json_object_array_add(result_array, root);
 	}
+	return result_array;
+}
+
+char *cmd_results_to_json(list_t *res_list) {
+	json_object *result_array = cmd_results_to_json_array(res_list);
 	const char *json = json_object_to_json_string(result_array);
 	char *res = strdup(json);
 	json_object_put(result_array);
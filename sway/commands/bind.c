@@ -686,6 +686,9 @@ static struct keycode_matches get_keycode_for_keysym(xkb_keysym_t keysym) {
 		.keycode = XKB_KEYCODE_INVALID,
 		.count = 0,
 	};
+	if (!config->keysym_translation_state) {
+		return matches;
+	}
 
 	xkb_keymap_key_for_each(
 			xkb_state_get_keymap(config->keysym_translation_state),
@@ -2,6 +2,7 @@
 #include <string.h>
 #include "sway/commands.h"
 #include "sway/config.h"
+#include "sway/criteria.h"
 #include "sway/tree/view.h"
 #include "list.h"
 #include "log.h"
@@ -61,7 +62,7 @@ struct cmd_results *cmd_mark(int argc, char **argv) {
 	free(mark);
 	container_update_marks_textures(container);
 	if (container->view) {
-		view_execute_criteria(container->view);
+		view_execute_criteria(container->view, CRITERIA_CON_MARK);
 	}
 
 	return cmd_results_new(CMD_SUCCESS, NULL);
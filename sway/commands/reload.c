@@ -1,4 +1,5 @@
 #define _POSIX_C_SOURCE 200809L
+#include <stdint.h>
 #include <string.h>
 #include "sway/commands.h"
 #include "sway/config.h"
@@ -15,6 +16,8 @@ static void rebuild_textures_iterator(struct sway_container *con, void *data) {
 }
 
 static void do_reload(void *data) {
+	bool differential = (uintptr_t)data;
+
 	// store bar ids to check against new bars for barconfig_update events
 	list_t *bar_ids = create_list();
 	for (int i = 0; i < config->bars->length; ++i) {
@@ -27,7 +30,9 @@ static void do_reload(void *data) {
 		path = config->current_config_path;
 	}
 
-	if (!load_main_config(path, true, false)) {
+	struct config_changes changes = {0};
+	if (!load_main_config(path, true, false,
+				differential ? &changes : NULL)) {
 		sway_log(SWAY_ERROR, "Error(s) reloading config");
 		list_free_items_and_destroy(bar_ids);
 		return;
@@ -35,10 +40,13 @@ static void do_reload(void *data) {
 
 	ipc_event_workspace(NULL, NULL, "reload");
 
-	load_swaybars();
-
 	for (int i = 0; i < config->bars->length; ++i) {
 		struct bar_config *bar = config->bars->items[i];
+		if (differential && bar->client) {
+			// Kept running as its config is unchanged
+			continue;
+		}
+		load_swaybar(bar);
 		for (int j = 0; j < bar_ids->length; ++j) {
 			if (strcmp(bar->id, bar_ids->items[j]) == 0) {
 				ipc_event_barconfig_update(bar);
@@ -48,30 +56,43 @@ static void do_reload(void *data) {
 	}
 	list_free_items_and_destroy(bar_ids);
 
-	config_update_font_height(true);
-	root_for_each_container(rebuild_textures_iterator, NULL);
+	if (!differential || changes.appearance) {
+		config_update_font_height(true);
+		root_for_each_container(rebuild_textures_iterator, NULL);
+	}
 
-	arrange_root();
+	if (!differential || changes.layout) {
+		arrange_root();
+	}
 }
 
 struct cmd_results *cmd_reload(int argc, char **argv) {
 	struct cmd_results *error = NULL;
-	if ((error = checkarg(argc, "reload", EXPECTED_EQUAL_TO, 0))) {
+	if ((error = checkarg(argc, "reload", EXPECTED_AT_MOST, 1))) {
 		return error;
 	}
+	bool differential = false;
+	if (argc == 1) {
+		if (strcmp(argv[0], "--diff") != 0) {
+			return cmd_results_new(CMD_INVALID,
+					"Expected 'reload [--diff]'");
+		}
+		differential = true;
+	}
 
 	const char *path = NULL;
 	if (config->user_config_path) {
 		path = config->current_config_path;
 	}
 
-	if (!load_main_config(path, true, true)) {
+	if (!load_main_config(path, true, true, NULL)) {
 		return cmd_results_new(CMD_FAILURE, "Error(s) reloading config.");
 	}
 
 	// The reload command frees a lot of stuff, so to avoid use-after-frees
 	// we schedule the reload to happen using an idle event.
-	wl_event_loop_add_idle(server.wl_event_loop, do_reload, NULL);
+	wl_event_loop_add_idle(server.wl_event_loop, do_reload,
+			(void *)(uintptr_t)differential);
 
 	return cmd_results_new(CMD_SUCCESS, NULL);
 }
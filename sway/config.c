@@ -16,12 +16,14 @@
 #include <linux/input-event-codes.h>
 #include <wlr/types/wlr_output.h>
 #include "sway/input/input-manager.h"
+#include "sway/input/keyboard.h"
 #include "sway/input/seat.h"
 #include "sway/input/switch.h"
 #include "sway/commands.h"
 #include "sway/config.h"
 #include "sway/criteria.h"
 #include "sway/desktop/transaction.h"
+#include "sway/profile.h"
 #include "sway/swaynag.h"
 #include "sway/tree/arrange.h"
 #include "sway/tree/root.h"
@@ -36,23 +38,40 @@
 struct sway_config *config = NULL;
 
 static struct xkb_state *keysym_translation_state_create(
-		struct xkb_rule_names rules) {
-	struct xkb_context *context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
-	struct xkb_keymap *xkb_keymap = xkb_keymap_new_from_names(
-		context,
-		&rules,
-		XKB_KEYMAP_COMPILE_NO_FLAGS);
-
-	xkb_context_unref(context);
-	return xkb_state_new(xkb_keymap);
+		struct input_config *ic) {
+	struct xkb_keymap *xkb_keymap = sway_keyboard_compile_keymap(ic, NULL);
+	if (!xkb_keymap && ic) {
+		xkb_keymap = sway_keyboard_compile_keymap(NULL, NULL);
+	}
+	if (!sway_assert(xkb_keymap, "Unable to compile keysym translation keymap")) {
+		return NULL;
+	}
+	struct xkb_state *state = xkb_state_new(xkb_keymap);
+	if (!state) {
+		sway_log(SWAY_ERROR, "Unable to create keysym translation state");
+		xkb_keymap_unref(xkb_keymap);
+	}
+	return state;
 }
 
 static void keysym_translation_state_destroy(
 		struct xkb_state *state) {
+	if (!state) {
+		return;
+	}
 	xkb_keymap_unref(xkb_state_get_keymap(state));
 	xkb_state_unref(state);
 }
 
+static void free_variable_node(struct sway_variable_node *node) {
+	while (node) {
+		struct sway_variable_node *sibling = node->sibling;
+		free_variable_node(node->child);
+		free(node);
+		node = sibling;
+	}
+}
+
 static void free_mode(struct sway_mode *mode) {
 	if (!mode) {
 		return;
@@ -99,6 +118,7 @@ void free_config(struct sway_config *config) {
 		}
 		list_free(config->symbols);
 	}
+	free_variable_node(config->symbol_trie);
 	if (config->modes) {
 		for (int i = 0; i < config->modes->length; ++i) {
 			free_mode(config->modes->items[i]);
@@ -151,6 +171,7 @@ void free_config(struct sway_config *config) {
 		}
 		list_free(config->criteria);
 	}
+	criteria_index_destroy(config->criteria_index);
 	list_free(config->no_focus);
 	list_free(config->active_bar_modifiers);
 	list_free_items_and_destroy(config->config_chain);
@@ -325,9 +346,7 @@ static void config_defaults(struct sway_config *config) {
 	color_to_rgba(config->border_colors.background, 0xFFFFFFFF);
 
 	// The keysym to keycode translation
-	struct xkb_rule_names rules = {0};
-	config->keysym_translation_state =
-		keysym_translation_state_create(rules);
+	config->keysym_translation_state = keysym_translation_state_create(NULL);
 
 	return;
 cleanup:
@@ -409,23 +428,60 @@ static bool load_config(const char *path, struct sway_config *config,
 		return false;
 	}
 
+	struct timespec start;
+	profile_begin(PROFILE_CONFIG_LOAD, &start);
+	config_cache_record_file(path);
 	FILE *f = fopen(path, "r");
 	if (!f) {
 		sway_log(SWAY_ERROR, "Unable to open %s for reading", path);
+		profile_end(PROFILE_CONFIG_LOAD, &start);
 		return false;
 	}
 
 	bool config_load_success = read_config(f, config, swaynag);
 	fclose(f);
+	profile_file(path, &start);
+	profile_end(PROFILE_CONFIG_LOAD, &start);
 
 	if (!config_load_success) {
 		sway_log(SWAY_ERROR, "Error(s) loading config!");
+		config_cache_abort();
 	}
 
 	return config->active || !config->validating || config_load_success;
 }
 
-bool load_main_config(const char *file, bool is_active, bool validating) {
+static void find_config_changes(struct sway_config *old_config,
+		struct sway_config *new_config, struct config_changes *changes) {
+	changes->appearance =
+		lenient_strcmp(old_config->font, new_config->font) != 0 ||
+		old_config->pango_markup != new_config->pango_markup ||
+		old_config->show_marks != new_config->show_marks ||
+		old_config->title_align != new_config->title_align ||
+		memcmp(&old_config->border_colors, &new_config->border_colors,
+			sizeof(old_config->border_colors)) != 0;
+	changes->layout = changes->appearance ||
+		old_config->titlebar_border_thickness !=
+			new_config->titlebar_border_thickness ||
+		old_config->titlebar_h_padding != new_config->titlebar_h_padding ||
+		old_config->titlebar_v_padding != new_config->titlebar_v_padding ||
+		old_config->border != new_config->border ||
+		old_config->floating_border != new_config->floating_border ||
+		old_config->border_thickness != new_config->border_thickness ||
+		old_config->floating_border_thickness !=
+			new_config->floating_border_thickness ||
+		old_config->hide_edge_borders != new_config->hide_edge_borders ||
+		old_config->hide_edge_borders_smart !=
+			new_config->hide_edge_borders_smart ||
+		old_config->hide_lone_tab != new_config->hide_lone_tab ||
+		old_config->smart_gaps != new_config->smart_gaps ||
+		old_config->gaps_inner != new_config->gaps_inner ||
+		memcmp(&old_config->gaps_outer, &new_config->gaps_outer,
+			sizeof(old_config->gaps_outer)) != 0;
+}
+
+bool load_main_config(const char *file, bool is_active, bool validating,
+		struct config_changes *changes) {
 	char *path;
 	if (file != NULL) {
 		path = strdup(file);
@@ -464,7 +520,9 @@ bool load_main_config(const char *file, bool is_active, bool validating) {
 		config->xwayland = old_config->xwayland;
 
 		if (!config->validating) {
-			if (old_config->swaybg_client != NULL) {
+			// A differential reload decides what to reset once the new config
+			// has been read
+			if (old_config->swaybg_client != NULL && !changes) {
 				wl_client_destroy(old_config->swaybg_client);
 			}
 
@@ -472,7 +530,9 @@ bool load_main_config(const char *file, bool is_active, bool validating) {
 				wl_client_destroy(old_config->swaynag_config_errors.client);
 			}
 
-			input_manager_reset_all_inputs();
+			if (!changes) {
+				input_manager_reset_all_inputs();
+			}
 		}
 	}
 
@@ -530,8 +590,13 @@ bool load_main_config(const char *file, bool is_active, bool validating) {
 	}
 	*/
 
-	success = success && load_config(path, config,
-			&config->swaynag_config_errors);
+	if (!config_cache_replay(real_path, config,
+				&config->swaynag_config_errors)) {
+		config_cache_begin(real_path);
+		success = success && load_config(path, config,
+				&config->swaynag_config_errors);
+		config_cache_finish(success);
+	}
 
 	if (validating) {
 		free_config(config);
@@ -539,7 +604,21 @@ bool load_main_config(const char *file, bool is_active, bool validating) {
 		return success;
 	}
 
-	if (is_active && !validating) {
+	if (is_active && !validating && changes) {
+		input_manager_verify_fallback_seat();
+		input_manager_apply_changed_configs(old_config);
+		sway_switch_retrigger_bindings_for_all();
+
+		reset_changed_outputs(old_config);
+		if (!keep_swaybg(old_config)) {
+			if (old_config->swaybg_client != NULL) {
+				wl_client_destroy(old_config->swaybg_client);
+			}
+			spawn_swaybg();
+		}
+		keep_unchanged_swaybars(old_config);
+		find_config_changes(old_config, config, changes);
+	} else if (is_active && !validating) {
 		input_manager_verify_fallback_seat();
 
 		for (int i = 0; i < config->input_configs->length; i++) {
@@ -558,7 +637,9 @@ bool load_main_config(const char *file, bool is_active, bool validating) {
 
 		reset_outputs();
 		spawn_swaybg();
+	}
 
+	if (is_active && !validating) {
 		config->reloading = false;
 		if (config->swaynag_config_errors.client != NULL) {
 			swaynag_show(&config->swaynag_config_errors);
@@ -753,6 +834,61 @@ static int detect_brace(FILE *file) {
 	return ret;
 }
 
+bool config_handle_result(struct sway_config *config,
+		struct swaynag_instance *swaynag, list_t *stack,
+		struct cmd_results *res, const char *expanded, const char *new_block) {
+	int line_number = config->current_config_line_number;
+	const char *line = config->current_config_line;
+	char *block = stack->length ? stack->items[0] : NULL;
+	switch(res->status) {
+	case CMD_FAILURE:
+	case CMD_INVALID:
+		sway_log(SWAY_ERROR, "Error on line %i '%s': %s (%s)", line_number,
+			line, res->error, config->current_config_path);
+		if (!config->validating) {
+			swaynag_log(config->swaynag_command, swaynag,
+				"Error on line %i (%s) '%s': %s", line_number,
+				config->current_config_path, line, res->error);
+		}
+		return false;
+
+	case CMD_DEFER:
+		sway_log(SWAY_DEBUG, "Deferring command `%s'", line);
+		list_add(config->cmd_queue, strdup(expanded));
+		break;
+
+	case CMD_BLOCK_COMMANDS:
+		sway_log(SWAY_DEBUG, "Entering commands block");
+		list_insert(stack, 0, "<commands>");
+		break;
+
+	case CMD_BLOCK:
+		sway_log(SWAY_DEBUG, "Entering block '%s'", new_block);
+		list_insert(stack, 0, strdup(new_block));
+		if (strcmp(new_block, "bar") == 0) {
+			config->current_bar = NULL;
+		}
+		break;
+
+	case CMD_BLOCK_END:
+		if (!block) {
+			sway_log(SWAY_DEBUG, "Unmatched '}' on line %i", line_number);
+			return false;
+		}
+		if (strcmp(block, "bar") == 0) {
+			config->current_bar = NULL;
+		}
+
+		sway_log(SWAY_DEBUG, "Exiting block '%s'", block);
+		list_del(stack, 0);
+		free(block);
+		memset(&config->handler_context, 0,
+				sizeof(config->handler_context));
+	default:;
+	}
+	return true;
+}
+
 static char *expand_line(const char *block, const char *line, bool add_brace) {
 	int size = (block ? strlen(block) + 1 : 0) + strlen(line)
 		+ (add_brace ? 2 : 0) + 1;
@@ -798,6 +934,8 @@ bool read_config(FILE *file, struct sway_config *config,
 	list_t *stack = create_list();
 	size_t read = 0;
 	int nlines = 0;
+	struct profile_mark mark;
+	profile_mark(&mark);
 	while ((nread = getline_with_cont(&line, &line_size, file, &nlines)) != -1) {
 		if (reading_main_config) {
 			if (read + nread > config_size) {
@@ -819,6 +957,7 @@ bool read_config(FILE *file, struct sway_config *config,
 
 		strip_whitespace(line);
 		if (!*line || line[0] == '#') {
+			profile_mark(&mark);
 			continue;
 		}
 		int brace_detected = 0;
@@ -839,63 +978,25 @@ bool read_config(FILE *file, struct sway_config *config,
 		config->current_config_line = line;
 		struct cmd_results *res;
 		char *new_block = NULL;
-		if (block && strcmp(block, "<commands>") == 0) {
+		bool commands_block = block && strcmp(block, "<commands>") == 0;
+		int cache_entry = config_cache_record_line(line, line_number, expanded,
+				commands_block);
+		if (commands_block) {
 			// Special case
 			res = config_commands_command(expanded);
 		} else {
 			res = config_command(expanded, &new_block);
 		}
-		switch(res->status) {
-		case CMD_FAILURE:
-		case CMD_INVALID:
-			sway_log(SWAY_ERROR, "Error on line %i '%s': %s (%s)", line_number,
-				line, res->error, config->current_config_path);
-			if (!config->validating) {
-				swaynag_log(config->swaynag_command, swaynag,
-					"Error on line %i (%s) '%s': %s", line_number,
-					config->current_config_path, line, res->error);
-			}
+		config_cache_record_result(cache_entry, res, new_block);
+		if (!config_handle_result(config, swaynag, stack, res, expanded,
+					new_block)) {
 			success = false;
-			break;
-
-		case CMD_DEFER:
-			sway_log(SWAY_DEBUG, "Deferring command `%s'", line);
-			list_add(config->cmd_queue, strdup(expanded));
-			break;
-
-		case CMD_BLOCK_COMMANDS:
-			sway_log(SWAY_DEBUG, "Entering commands block");
-			list_insert(stack, 0, "<commands>");
-			break;
-
-		case CMD_BLOCK:
-			sway_log(SWAY_DEBUG, "Entering block '%s'", new_block);
-			list_insert(stack, 0, strdup(new_block));
-			if (strcmp(new_block, "bar") == 0) {
-				config->current_bar = NULL;
-			}
-			break;
-
-		case CMD_BLOCK_END:
-			if (!block) {
-				sway_log(SWAY_DEBUG, "Unmatched '}' on line %i", line_number);
-				success = false;
-				break;
-			}
-			if (strcmp(block, "bar") == 0) {
-				config->current_bar = NULL;
-			}
-
-			sway_log(SWAY_DEBUG, "Exiting block '%s'", block);
-			list_del(stack, 0);
-			free(block);
-			memset(&config->handler_context, 0,
-					sizeof(config->handler_context));
-		default:;
 		}
 		free(new_block);
 		free(expanded);
 		free_cmd_results(res);
+		profile_line(config->current_config_path, line_number, line, &mark);
+		profile_mark(&mark);
 	}
 	free(line);
 	list_free_items_and_destroy(stack);
@@ -929,56 +1030,135 @@ void config_add_swaynag_warning(char *fmt, ...) {
 	}
 }
 
-char *do_var_replacement(char *str) {
-	int i;
-	char *find = str;
-	while ((find = strchr(find, '$'))) {
-		// Skip if escaped.
-		if (find > str && find[-1] == '\\') {
-			if (find == str + 1 || !(find > str + 1 && find[-2] == '\\')) {
-				++find;
-				continue;
-			}
+static struct sway_variable_node *variable_node_child(
+		struct sway_variable_node *node, char c, bool create) {
+	struct sway_variable_node **child = &node->child;
+	while (*child && (*child)->c != c) {
+		child = &(*child)->sibling;
+	}
+	if (!*child && create) {
+		*child = calloc(1, sizeof(struct sway_variable_node));
+		if (*child) {
+			(*child)->c = c;
+		}
+	}
+	return *child;
+}
+
+void config_add_variable(struct sway_config *config,
+		struct sway_variable *var) {
+	list_add(config->symbols, var);
+	if (!config->symbol_trie &&
+			!(config->symbol_trie = calloc(1, sizeof(struct sway_variable_node)))) {
+		sway_log(SWAY_ERROR, "Unable to allocate variable trie");
+		return;
+	}
+	struct sway_variable_node *node = config->symbol_trie;
+	for (const char *c = var->name; node && *c; ++c) {
+		node = variable_node_child(node, *c, true);
+	}
+	if (!node) {
+		sway_log(SWAY_ERROR, "Unable to allocate variable trie");
+		return;
+	}
+	node->var = var;
+}
+
+struct sway_variable *config_find_variable(struct sway_config *config,
+		const char *name) {
+	struct sway_variable_node *node = config->symbol_trie;
+	for (const char *c = name; node && *c; ++c) {
+		node = variable_node_child(node, *c, false);
+	}
+	return node ? node->var : NULL;
+}
+
+/**
+ * Returns the variable with the longest name that str starts with.
+ */
+static struct sway_variable *find_longest_variable(const char *str) {
+	struct sway_variable *var = NULL;
+	struct sway_variable_node *node = config->symbol_trie;
+	for (const char *c = str; node && *c; ++c) {
+		node = variable_node_child(node, *c, false);
+		if (node && node->var) {
+			var = node->var;
+		}
+	}
+	return var;
+}
+
+struct var_replacement {
+	char *buf; // NULL while measuring
+	size_t len;
+	char prev[2]; // the last two characters written
+};
+
+static void var_replacement_append(struct var_replacement *out,
+		const char *str, size_t len) {
+	if (out->buf) {
+		memcpy(out->buf + out->len, str, len);
+	}
+	out->len += len;
+	if (len >= 2) {
+		out->prev[0] = str[len - 2];
+		out->prev[1] = str[len - 1];
+	} else if (len == 1) {
+		out->prev[0] = out->prev[1];
+		out->prev[1] = str[0];
+	}
+}
+
+static void var_replacement_run(struct var_replacement *out, const char *str) {
+	const char *find;
+	while ((find = strchr(str, '$'))) {
+		var_replacement_append(out, str, find - str);
+		str = find + 1;
+		// Skip if escaped, unless the backslash is itself escaped
+		if (out->len > 0 && out->prev[1] == '\\' &&
+				(out->len == 1 || out->prev[0] != '\\')) {
+			var_replacement_append(out, "$", 1);
+			continue;
 		}
 		// Unescape double $ and move on
 		if (find[1] == '$') {
-			size_t length = strlen(find + 1);
-			memmove(find, find + 1, length);
-			find[length] = '\0';
-			++find;
+			var_replacement_append(out, "$", 1);
+			++str;
 			continue;
 		}
-		// Find matching variable
-		for (i = 0; i < config->symbols->length; ++i) {
-			struct sway_variable *var = config->symbols->items[i];
-			int vnlen = strlen(var->name);
-			if (strncmp(find, var->name, vnlen) == 0) {
-				int vvlen = strlen(var->value);
-				char *newstr = malloc(strlen(str) - vnlen + vvlen + 1);
-				if (!newstr) {
-					sway_log(SWAY_ERROR,
-						"Unable to allocate replacement "
-						"during variable expansion");
-					break;
-				}
-				char *newptr = newstr;
-				int offset = find - str;
-				strncpy(newptr, str, offset);
-				newptr += offset;
-				strncpy(newptr, var->value, vvlen);
-				newptr += vvlen;
-				strcpy(newptr, find + vnlen);
-				free(str);
-				str = newstr;
-				find = str + offset + vvlen;
-				break;
-			}
-		}
-		if (i == config->symbols->length) {
-			++find;
+		struct sway_variable *var = find_longest_variable(find);
+		if (var) {
+			var_replacement_append(out, var->value, strlen(var->value));
+			str = find + strlen(var->name);
+		} else {
+			var_replacement_append(out, "$", 1);
 		}
 	}
-	return str;
+	var_replacement_append(out, str, strlen(str));
+}
+
+char *do_var_replacement(char *str) {
+	if (!strchr(str, '$')) {
+		return str;
+	}
+	struct timespec start;
+	profile_begin(PROFILE_CONFIG_VARIABLES, &start);
+	// Measure first, so the result needs a single allocation
+	struct var_replacement out = {0};
+	var_replacement_run(&out, str);
+	size_t len = out.len;
+	out = (struct var_replacement){ .buf = malloc(len + 1) };
+	if (!out.buf) {
+		sway_log(SWAY_ERROR,
+			"Unable to allocate replacement during variable expansion");
+		profile_end(PROFILE_CONFIG_VARIABLES, &start);
+		return str;
+	}
+	var_replacement_run(&out, str);
+	out.buf[len] = '\0';
+	free(str);
+	profile_end(PROFILE_CONFIG_VARIABLES, &start);
+	return out.buf;
 }
 
 // the naming is intentional (albeit long): a workspace_output_cmp function
@@ -1045,10 +1225,8 @@ static void translate_binding_list(list_t *bindings, list_t *bindsyms,
 void translate_keysyms(struct input_config *input_config) {
 	keysym_translation_state_destroy(config->keysym_translation_state);
 
-	struct xkb_rule_names rules = {0};
-	input_config_fill_rule_names(input_config, &rules);
 	config->keysym_translation_state =
-		keysym_translation_state_create(rules);
+		keysym_translation_state_create(input_config);
 
 	for (int i = 0; i < config->modes->length; ++i) {
 		struct sway_mode *mode = config->modes->items[i];
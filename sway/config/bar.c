@@ -12,6 +12,7 @@
 #include <wordexp.h>
 #include "sway/config.h"
 #include "sway/input/keyboard.h"
+#include "sway/ipc-json.h"
 #include "sway/output.h"
 #include "config.h"
 #include "list.h"
@@ -265,6 +266,52 @@ void load_swaybar(struct bar_config *bar) {
 	invoke_swaybar(bar);
 }
 
+/**
+ * Returns whether swaybar would see the same bar config, which includes the
+ * global font and markup settings the bar falls back to.
+ */
+static bool bar_config_unchanged(struct bar_config *bar,
+		struct sway_config *old_config, struct bar_config *old_bar) {
+	if (lenient_strcmp(bar->swaybar_command, old_bar->swaybar_command) != 0) {
+		return false;
+	}
+	json_object *json = ipc_json_describe_bar_config(bar);
+	struct sway_config *new_config = config;
+	config = old_config;
+	json_object *old_json = ipc_json_describe_bar_config(old_bar);
+	config = new_config;
+	bool unchanged = strcmp(json_object_to_json_string(json),
+			json_object_to_json_string(old_json)) == 0;
+	json_object_put(json);
+	json_object_put(old_json);
+	return unchanged;
+}
+
+void keep_unchanged_swaybars(struct sway_config *old_config) {
+	for (int i = 0; i < config->bars->length; ++i) {
+		struct bar_config *bar = config->bars->items[i];
+		for (int j = 0; j < old_config->bars->length; ++j) {
+			struct bar_config *old_bar = old_config->bars->items[j];
+			if (strcmp(bar->id, old_bar->id) != 0) {
+				continue;
+			}
+			if (old_bar->client &&
+					bar_config_unchanged(bar, old_config, old_bar)) {
+				sway_log(SWAY_DEBUG, "Bar %s unchanged, keeping swaybar",
+						bar->id);
+				wl_list_remove(&old_bar->client_destroy.link);
+				wl_list_init(&old_bar->client_destroy.link);
+				bar->client = old_bar->client;
+				old_bar->client = NULL;
+				bar->client_destroy.notify = handle_swaybar_client_destroy;
+				wl_client_add_destroy_listener(bar->client,
+						&bar->client_destroy);
+			}
+			break;
+		}
+	}
+}
+
 void load_swaybars(void) {
 	for (int i = 0; i < config->bars->length; ++i) {
 		struct bar_config *bar = config->bars->items[i];
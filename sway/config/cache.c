@@ -0,0 +1,892 @@
+#define _XOPEN_SOURCE 700 // for realpath
+#include <errno.h>
+#include <libgen.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <wordexp.h>
+#include "sway/commands.h"
+#include "sway/config.h"
+#include "sway/profile.h"
+#include "list.h"
+#include "log.h"
+
+/**
+ * The config cache stores the commands of a successfully loaded config after
+ * variable replacement and argument splitting, together with the size and
+ * hash of every file read and the files each include expanded to. If none of
+ * them changed, the next load replays the commands instead of reading and
+ * parsing the files again. Files whose size, inode and modification time are
+ * unchanged are not hashed again.
+ */
+
+#define CONFIG_CACHE_FORMAT 2
+static const char cache_magic[8] = "swaycfg";
+
+enum cache_entry_type {
+	CACHE_EMPTY, // nothing to run, such as a variable expanding to nothing
+	CACHE_COMMAND,
+	CACHE_INCLUDE, // the included lines follow as their own entries
+	CACHE_BLOCK,
+	CACHE_BLOCK_END,
+	CACHE_COMMANDS, // a line in a commands block, run unparsed
+};
+
+struct cache_file {
+	char *path; // current_config_path while reading the file
+	uint64_t size;
+	uint64_t hash;
+	uint64_t inode;
+	int64_t mtime_sec; // 0 if the file must be hashed to be validated
+	int64_t mtime_nsec;
+};
+
+struct cache_entry {
+	enum cache_entry_type type;
+	uint32_t file;
+	uint32_t line_number;
+	char *line;
+	char *expanded;
+	char *block; // CACHE_BLOCK
+	int argc; // CACHE_COMMAND
+	char **argv;
+	char *pattern; // CACHE_INCLUDE
+	char *parent_dir;
+	list_t *includes; // real paths the pattern expanded to
+};
+
+struct config_cache {
+	char *main_path;
+	char *current_config;
+	list_t *files; // struct cache_file
+	list_t *entries; // struct cache_entry
+	bool failed;
+};
+
+static struct {
+	bool enabled;
+	struct config_cache *recording;
+} cache_state;
+
+static void cache_entry_destroy(struct cache_entry *entry) {
+	free(entry->line);
+	free(entry->expanded);
+	free(entry->block);
+	if (entry->argv) {
+		for (int i = 0; i < entry->argc; ++i) {
+			free(entry->argv[i]);
+		}
+		free(entry->argv);
+	}
+	free(entry->pattern);
+	free(entry->parent_dir);
+	if (entry->includes) {
+		list_free_items_and_destroy(entry->includes);
+	}
+	free(entry);
+}
+
+static void config_cache_destroy(struct config_cache *cache) {
+	if (!cache) {
+		return;
+	}
+	free(cache->main_path);
+	free(cache->current_config);
+	for (int i = 0; cache->files && i < cache->files->length; ++i) {
+		struct cache_file *file = cache->files->items[i];
+		free(file->path);
+		free(file);
+	}
+	list_free(cache->files);
+	for (int i = 0; cache->entries && i < cache->entries->length; ++i) {
+		cache_entry_destroy(cache->entries->items[i]);
+	}
+	list_free(cache->entries);
+	free(cache);
+}
+
+static struct config_cache *config_cache_create(void) {
+	struct config_cache *cache = calloc(1, sizeof(*cache));
+	if (!cache) {
+		return NULL;
+	}
+	cache->files = create_list();
+	cache->entries = create_list();
+	if (!cache->files || !cache->entries) {
+		config_cache_destroy(cache);
+		return NULL;
+	}
+	return cache;
+}
+
+static char *read_file(const char *path, size_t *size) {
+	FILE *f = fopen(path, "r");
+	if (!f) {
+		return NULL;
+	}
+	char *data = NULL;
+	size_t length = 0, capacity = 0;
+	bool failed = false;
+	while (!failed) {
+		if (length == capacity) {
+			capacity = capacity ? capacity * 2 : 4096;
+			char *new_data = realloc(data, capacity + 1);
+			if (!new_data) {
+				failed = true;
+				break;
+			}
+			data = new_data;
+		}
+		size_t nread = fread(data + length, 1, capacity - length, f);
+		length += nread;
+		if (nread == 0) {
+			break;
+		}
+	}
+	failed |= ferror(f) != 0;
+	fclose(f);
+	if (failed) {
+		free(data);
+		return NULL;
+	}
+	data[length] = '\0';
+	*size = length;
+	return data;
+}
+
+static uint64_t hash_data(const char *data, size_t size) {
+	// FNV-1a
+	uint64_t hash = UINT64_C(14695981039346656037);
+	for (size_t i = 0; i < size; ++i) {
+		hash = (hash ^ (unsigned char)data[i]) * UINT64_C(1099511628211);
+	}
+	return hash;
+}
+
+static bool hash_file(const char *path, uint64_t *size, uint64_t *hash) {
+	size_t length;
+	char *data = read_file(path, &length);
+	if (!data) {
+		return false;
+	}
+	*size = length;
+	*hash = hash_data(data, length);
+	free(data);
+	return true;
+}
+
+static void cache_file_set_stat(struct cache_file *file,
+		const struct stat *st) {
+	file->inode = st->st_ino;
+	file->mtime_sec = st->st_mtim.tv_sec;
+	file->mtime_nsec = st->st_mtim.tv_nsec;
+	// A change made within the same timestamp tick right after recording
+	// would go unnoticed, so such recent files are always hashed
+	if (st->st_mtim.tv_sec >= time(NULL) - 1) {
+		file->mtime_sec = file->mtime_nsec = 0;
+	}
+}
+
+static bool cache_file_changed(struct cache_file *file) {
+	struct stat st;
+	if (stat(file->path, &st) != 0 || (uint64_t)st.st_size != file->size) {
+		return true;
+	}
+	if (file->mtime_sec != 0 && st.st_ino == file->inode &&
+			st.st_mtim.tv_sec == file->mtime_sec &&
+			st.st_mtim.tv_nsec == file->mtime_nsec) {
+		return false;
+	}
+	uint64_t size, hash;
+	return !hash_file(file->path, &size, &hash) || size != file->size ||
+		hash != file->hash;
+}
+
+/**
+ * Expands an include pattern the way load_include_configs does, returning the
+ * real paths of the files found.
+ */
+static list_t *expand_include(const char *pattern, const char *parent_dir) {
+	list_t *paths = create_list();
+	char *wd = getcwd(NULL, 0);
+	if (!paths || !wd || chdir(parent_dir) < 0) {
+		list_free(paths);
+		free(wd);
+		return NULL;
+	}
+
+	wordexp_t p;
+	if (wordexp(pattern, &p, 0) == 0) {
+		for (size_t i = 0; i < p.we_wordc; ++i) {
+			const char *word = p.we_wordv[i];
+			char *full_path;
+			if (word[0] != '/') {
+				size_t len = strlen(parent_dir) + strlen(word) + 2;
+				full_path = malloc(len);
+				if (full_path) {
+					snprintf(full_path, len, "%s/%s", parent_dir, word);
+				}
+			} else {
+				full_path = strdup(word);
+			}
+			char *real_path = full_path ? realpath(full_path, NULL) : NULL;
+			free(full_path);
+			if (real_path) {
+				list_add(paths, real_path);
+			}
+		}
+		wordfree(&p);
+	}
+
+	if (chdir(wd) < 0) {
+		sway_log(SWAY_ERROR, "failed to restore working directory");
+	}
+	free(wd);
+	return paths;
+}
+
+static char *get_cache_path(const char *main_path) {
+	const char *cache_home = getenv("XDG_CACHE_HOME");
+	const char *home = getenv("HOME");
+	char *dir;
+	if (cache_home && *cache_home) {
+		size_t len = strlen(cache_home) + strlen("/sway") + 1;
+		if ((dir = malloc(len))) {
+			snprintf(dir, len, "%s/sway", cache_home);
+		}
+	} else if (home && *home) {
+		size_t len = strlen(home) + strlen("/.cache/sway") + 1;
+		if ((dir = malloc(len))) {
+			snprintf(dir, len, "%s/.cache/sway", home);
+		}
+	} else {
+		return NULL;
+	}
+	if (!dir) {
+		return NULL;
+	}
+	size_t len = strlen(dir) + strlen("/config-") + 16 + 1;
+	char *path = malloc(len);
+	if (path) {
+		snprintf(path, len, "%s/config-%016llx", dir, (unsigned long long)
+				hash_data(main_path, strlen(main_path)));
+	}
+	free(dir);
+	return path;
+}
+
+static bool make_parent_dirs(char *path) {
+	for (char *sep = strchr(path + 1, '/'); sep; sep = strchr(sep + 1, '/')) {
+		*sep = '\0';
+		bool failed = mkdir(path, 0700) < 0 && errno != EEXIST;
+		*sep = '/';
+		if (failed) {
+			return false;
+		}
+	}
+	return true;
+}
+
+struct cache_writer {
+	char *data;
+	size_t length, capacity;
+	bool failed;
+};
+
+static void write_data(struct cache_writer *writer, const void *data,
+		size_t size) {
+	if (writer->failed) {
+		return;
+	}
+	if (writer->length + size > writer->capacity) {
+		size_t capacity = writer->capacity ? writer->capacity : 4096;
+		while (capacity < writer->length + size) {
+			capacity *= 2;
+		}
+		char *new_data = realloc(writer->data, capacity);
+		if (!new_data) {
+			writer->failed = true;
+			return;
+		}
+		writer->data = new_data;
+		writer->capacity = capacity;
+	}
+	memcpy(writer->data + writer->length, data, size);
+	writer->length += size;
+}
+
+static void write_u32(struct cache_writer *writer, uint32_t value) {
+	write_data(writer, &value, sizeof(value));
+}
+
+static void write_u64(struct cache_writer *writer, uint64_t value) {
+	write_data(writer, &value, sizeof(value));
+}
+
+static void write_string(struct cache_writer *writer, const char *str) {
+	uint32_t len = str ? strlen(str) : UINT32_MAX;
+	write_u32(writer, len);
+	if (str) {
+		write_data(writer, str, len);
+	}
+}
+
+static void write_strings(struct cache_writer *writer, list_t *strings) {
+	write_u32(writer, strings->length);
+	for (int i = 0; i < strings->length; ++i) {
+		write_string(writer, strings->items[i]);
+	}
+}
+
+struct cache_reader {
+	const char *data;
+	size_t remaining;
+	bool failed;
+};
+
+static bool read_data(struct cache_reader *reader, void *data, size_t size) {
+	if (reader->failed || size > reader->remaining) {
+		reader->failed = true;
+		return false;
+	}
+	memcpy(data, reader->data, size);
+	reader->data += size;
+	reader->remaining -= size;
+	return true;
+}
+
+static uint32_t read_u32(struct cache_reader *reader) {
+	uint32_t value = 0;
+	read_data(reader, &value, sizeof(value));
+	return value;
+}
+
+static uint64_t read_u64(struct cache_reader *reader) {
+	uint64_t value = 0;
+	read_data(reader, &value, sizeof(value));
+	return value;
+}
+
+static char *read_string(struct cache_reader *reader) {
+	uint32_t len = read_u32(reader);
+	if (reader->failed || len == UINT32_MAX) {
+		return NULL;
+	}
+	if (len > reader->remaining) {
+		reader->failed = true;
+		return NULL;
+	}
+	char *str = malloc(len + 1);
+	if (!str) {
+		reader->failed = true;
+		return NULL;
+	}
+	read_data(reader, str, len);
+	str[len] = '\0';
+	return str;
+}
+
+static list_t *read_strings(struct cache_reader *reader) {
+	uint32_t count = read_u32(reader);
+	list_t *strings = create_list();
+	for (uint32_t i = 0; strings && i < count && !reader->failed; ++i) {
+		char *str = read_string(reader);
+		if (str) {
+			list_add(strings, str);
+		} else {
+			reader->failed = true;
+		}
+	}
+	if (!strings) {
+		reader->failed = true;
+	}
+	return strings;
+}
+
+static void config_cache_write(struct config_cache *cache) {
+	struct cache_writer writer = {0};
+	write_data(&writer, cache_magic, sizeof(cache_magic));
+	write_u32(&writer, CONFIG_CACHE_FORMAT);
+	write_string(&writer, SWAY_VERSION);
+	write_string(&writer, cache->main_path);
+	write_string(&writer, cache->current_config);
+
+	write_u32(&writer, cache->files->length);
+	for (int i = 0; i < cache->files->length; ++i) {
+		struct cache_file *file = cache->files->items[i];
+		write_string(&writer, file->path);
+		write_u64(&writer, file->size);
+		write_u64(&writer, file->hash);
+		write_u64(&writer, file->inode);
+		write_u64(&writer, (uint64_t)file->mtime_sec);
+		write_u64(&writer, (uint64_t)file->mtime_nsec);
+	}
+
+	write_u32(&writer, cache->entries->length);
+	for (int i = 0; i < cache->entries->length; ++i) {
+		struct cache_entry *entry = cache->entries->items[i];
+		write_u32(&writer, entry->type);
+		write_u32(&writer, entry->file);
+		write_u32(&writer, entry->line_number);
+		write_string(&writer, entry->line);
+		write_string(&writer, entry->expanded);
+		switch (entry->type) {
+		case CACHE_COMMAND:
+			write_u32(&writer, entry->argc);
+			for (int j = 0; j < entry->argc; ++j) {
+				write_string(&writer, entry->argv[j]);
+			}
+			break;
+		case CACHE_INCLUDE:
+			write_string(&writer, entry->pattern);
+			write_string(&writer, entry->parent_dir);
+			write_strings(&writer, entry->includes);
+			break;
+		case CACHE_BLOCK:
+			write_string(&writer, entry->block);
+			break;
+		default:
+			break;
+		}
+	}
+
+	char *path = get_cache_path(cache->main_path);
+	char *tmp_path = NULL;
+	if (!path || writer.failed || !make_parent_dirs(path)) {
+		goto error;
+	}
+	size_t len = strlen(path) + strlen(".tmp") + 1;
+	if (!(tmp_path = malloc(len))) {
+		goto error;
+	}
+	snprintf(tmp_path, len, "%s.tmp", path);
+	FILE *f = fopen(tmp_path, "w");
+	if (!f) {
+		goto error;
+	}
+	bool written = fwrite(writer.data, 1, writer.length, f) == writer.length;
+	if (fclose(f) != 0 || !written || rename(tmp_path, path) < 0) {
+		unlink(tmp_path);
+		goto error;
+	}
+	sway_log(SWAY_DEBUG, "Wrote config cache %s (%d commands)", path,
+			cache->entries->length);
+	goto cleanup;
+
+error:
+	sway_log(SWAY_ERROR, "Unable to write config cache%s%s",
+			path ? " " : "", path ? path : "");
+cleanup:
+	free(tmp_path);
+	free(path);
+	free(writer.data);
+}
+
+static struct cache_entry *read_entry(struct cache_reader *reader,
+		struct config_cache *cache) {
+	struct cache_entry *entry = calloc(1, sizeof(*entry));
+	if (!entry) {
+		reader->failed = true;
+		return NULL;
+	}
+	entry->type = read_u32(reader);
+	entry->file = read_u32(reader);
+	entry->line_number = read_u32(reader);
+	entry->line = read_string(reader);
+	entry->expanded = read_string(reader);
+	switch (entry->type) {
+	case CACHE_EMPTY:
+	case CACHE_BLOCK_END:
+		break;
+	case CACHE_COMMANDS:
+		reader->failed |= !entry->expanded;
+		break;
+	case CACHE_COMMAND:
+		entry->argc = read_u32(reader);
+		if (entry->argc <= 0 || (size_t)entry->argc > reader->remaining ||
+				!(entry->argv = calloc(entry->argc + 1, sizeof(char *)))) {
+			reader->failed = true;
+			break;
+		}
+		for (int i = 0; i < entry->argc; ++i) {
+			reader->failed |= !(entry->argv[i] = read_string(reader));
+		}
+		break;
+	case CACHE_INCLUDE:
+		entry->pattern = read_string(reader);
+		entry->parent_dir = read_string(reader);
+		entry->includes = read_strings(reader);
+		reader->failed |= !entry->pattern || !entry->parent_dir;
+		break;
+	case CACHE_BLOCK:
+		reader->failed |= !(entry->block = read_string(reader));
+		break;
+	default:
+		reader->failed = true;
+	}
+	if (entry->file >= (uint32_t)cache->files->length || !entry->line) {
+		reader->failed = true;
+	}
+	if (reader->failed) {
+		cache_entry_destroy(entry);
+		return NULL;
+	}
+	return entry;
+}
+
+static bool same_strings(list_t *a, list_t *b) {
+	if (!a || !b || a->length != b->length) {
+		return false;
+	}
+	for (int i = 0; i < a->length; ++i) {
+		if (strcmp(a->items[i], b->items[i]) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Reads the cache for the main config at main_path, returning NULL unless it
+ * is still valid.
+ */
+static struct config_cache *config_cache_read(const char *main_path) {
+	char *path = get_cache_path(main_path);
+	size_t size;
+	char *data = path ? read_file(path, &size) : NULL;
+	if (!data) {
+		sway_log(SWAY_DEBUG, "No config cache for %s", main_path);
+		free(path);
+		return NULL;
+	}
+
+	struct config_cache *cache = config_cache_create();
+	struct cache_reader reader = { .data = data, .remaining = size };
+	char magic[sizeof(cache_magic)];
+	const char *reason = "invalid format";
+	char *version = NULL;
+	if (!cache || !read_data(&reader, magic, sizeof(magic)) ||
+			memcmp(magic, cache_magic, sizeof(magic)) != 0 ||
+			read_u32(&reader) != CONFIG_CACHE_FORMAT) {
+		goto invalid;
+	}
+	version = read_string(&reader);
+	cache->main_path = read_string(&reader);
+	cache->current_config = read_string(&reader);
+	if (reader.failed || strcmp(version, SWAY_VERSION) != 0 ||
+			strcmp(cache->main_path, main_path) != 0) {
+		reason = "written by another version or for another config";
+		goto invalid;
+	}
+
+	uint32_t file_count = read_u32(&reader);
+	for (uint32_t i = 0; i < file_count && !reader.failed; ++i) {
+		struct cache_file *file = calloc(1, sizeof(*file));
+		if (!file) {
+			reader.failed = true;
+			break;
+		}
+		list_add(cache->files, file);
+		file->path = read_string(&reader);
+		file->size = read_u64(&reader);
+		file->hash = read_u64(&reader);
+		file->inode = read_u64(&reader);
+		file->mtime_sec = (int64_t)read_u64(&reader);
+		file->mtime_nsec = (int64_t)read_u64(&reader);
+		reader.failed |= !file->path;
+	}
+	uint32_t entry_count = read_u32(&reader);
+	for (uint32_t i = 0; i < entry_count && !reader.failed; ++i) {
+		struct cache_entry *entry = read_entry(&reader, cache);
+		if (entry) {
+			list_add(cache->entries, entry);
+		}
+	}
+	if (reader.failed || reader.remaining > 0 || cache->files->length == 0) {
+		goto invalid;
+	}
+
+	for (int i = 0; i < cache->files->length; ++i) {
+		struct cache_file *file = cache->files->items[i];
+		if (cache_file_changed(file)) {
+			reason = "a config file changed";
+			goto invalid;
+		}
+	}
+	for (int i = 0; i < cache->entries->length; ++i) {
+		struct cache_entry *entry = cache->entries->items[i];
+		if (entry->type != CACHE_INCLUDE) {
+			continue;
+		}
+		list_t *includes = expand_include(entry->pattern, entry->parent_dir);
+		bool same = same_strings(includes, entry->includes);
+		if (includes) {
+			list_free_items_and_destroy(includes);
+		}
+		if (!same) {
+			reason = "an include matches different files";
+			goto invalid;
+		}
+	}
+
+	free(version);
+	free(data);
+	free(path);
+	return cache;
+
+invalid:
+	sway_log(SWAY_DEBUG, "Ignoring config cache %s: %s", path, reason);
+	config_cache_destroy(cache);
+	free(version);
+	free(data);
+	free(path);
+	return NULL;
+}
+
+void config_cache_enable(void) {
+	cache_state.enabled = true;
+}
+
+bool config_cache_replay(const char *main_path, struct sway_config *config,
+		struct swaynag_instance *swaynag) {
+	if (!cache_state.enabled || config->validating) {
+		return false;
+	}
+	struct timespec start;
+	profile_begin(PROFILE_CONFIG_LOAD, &start);
+	struct config_cache *cache = config_cache_read(main_path);
+	if (!cache) {
+		profile_end(PROFILE_CONFIG_LOAD, &start);
+		return false;
+	}
+	sway_log(SWAY_INFO, "Loading config from cache (%d commands)",
+			cache->entries->length);
+
+	// Restore what reading the files leaves behind besides running commands
+	const char *main_config_path = config->current_config_path;
+	const char **paths = calloc(cache->files->length, sizeof(char *));
+	// Each file is read with its own stack of blocks
+	list_t **stacks = calloc(cache->files->length, sizeof(list_t *));
+	if (!paths || !stacks) {
+		free(paths);
+		free(stacks);
+		sway_log(SWAY_ERROR, "Unable to allocate config cache paths");
+		config_cache_destroy(cache);
+		profile_end(PROFILE_CONFIG_LOAD, &start);
+		return false;
+	}
+	free((char *)config->current_config);
+	config->current_config = cache->current_config;
+	cache->current_config = NULL;
+	paths[0] = main_config_path;
+	for (int i = 1; i < cache->files->length; ++i) {
+		struct cache_file *file = cache->files->items[i];
+		list_add(config->config_chain, file->path);
+		paths[i] = file->path;
+		file->path = NULL;
+	}
+
+	bool success = true;
+	for (int i = 0; i < cache->entries->length; ++i) {
+		struct cache_entry *entry = cache->entries->items[i];
+		list_t *stack = stacks[entry->file];
+		if (!stack && !(stack = stacks[entry->file] = create_list())) {
+			sway_log(SWAY_ERROR, "Unable to allocate config block stack");
+			success = false;
+			break;
+		}
+		config->current_config_path = paths[entry->file];
+		config->current_config_line_number = entry->line_number;
+		config->current_config_line = entry->line;
+		struct cmd_results *res;
+		switch (entry->type) {
+		case CACHE_EMPTY:
+		case CACHE_INCLUDE:
+		default:
+			continue;
+		case CACHE_COMMAND:
+			res = config_command_argv(entry->argc, entry->argv);
+			break;
+		case CACHE_COMMANDS:
+			res = config_commands_command(entry->expanded);
+			break;
+		case CACHE_BLOCK:
+			res = cmd_results_new(CMD_BLOCK, NULL);
+			break;
+		case CACHE_BLOCK_END:
+			res = cmd_results_new(CMD_BLOCK_END, NULL);
+			break;
+		}
+		success &= config_handle_result(config, swaynag, stack, res,
+				entry->expanded, entry->block);
+		free_cmd_results(res);
+	}
+	for (int i = 0; i < cache->files->length; ++i) {
+		if (stacks[i]) {
+			list_free_items_and_destroy(stacks[i]);
+		}
+	}
+	free(stacks);
+	config->current_config_path = main_config_path;
+	config->current_config_line_number = 0;
+	config->current_config_line = NULL;
+	if (!success) {
+		sway_log(SWAY_ERROR, "Error(s) loading config!");
+	}
+
+	free(paths);
+	config_cache_destroy(cache);
+	profile_file(main_config_path, &start);
+	profile_end(PROFILE_CONFIG_LOAD, &start);
+	return true;
+}
+
+void config_cache_begin(const char *main_path) {
+	if (!cache_state.enabled || config->validating) {
+		return;
+	}
+	config_cache_destroy(cache_state.recording);
+	cache_state.recording = config_cache_create();
+	if (cache_state.recording &&
+			!(cache_state.recording->main_path = strdup(main_path))) {
+		config_cache_destroy(cache_state.recording);
+		cache_state.recording = NULL;
+	}
+}
+
+void config_cache_finish(bool success) {
+	struct config_cache *cache = cache_state.recording;
+	if (!cache) {
+		return;
+	}
+	cache_state.recording = NULL;
+	if (success && !cache->failed && config->current_config &&
+			(cache->current_config = strdup(config->current_config))) {
+		config_cache_write(cache);
+	} else {
+		sway_log(SWAY_DEBUG, "Not writing config cache: config has errors");
+	}
+	config_cache_destroy(cache);
+}
+
+void config_cache_abort(void) {
+	if (cache_state.recording) {
+		cache_state.recording->failed = true;
+	}
+}
+
+void config_cache_record_file(const char *path) {
+	struct config_cache *cache = cache_state.recording;
+	if (!cache || cache->failed) {
+		return;
+	}
+	struct cache_file *file = calloc(1, sizeof(*file));
+	struct stat st;
+	// Stat first, so a change while hashing makes the next load hash again
+	if (!file || !(file->path = strdup(path)) || stat(path, &st) != 0 ||
+			!hash_file(path, &file->size, &file->hash)) {
+		if (file) {
+			free(file->path);
+		}
+		free(file);
+		cache->failed = true;
+		return;
+	}
+	cache_file_set_stat(file, &st);
+	list_add(cache->files, file);
+}
+
+int config_cache_record_line(const char *line, int line_number,
+		const char *expanded, bool commands_block) {
+	struct config_cache *cache = cache_state.recording;
+	if (!cache || cache->failed) {
+		return -1;
+	}
+	int file = -1;
+	for (int i = cache->files->length - 1; i >= 0 && file < 0; --i) {
+		struct cache_file *cache_file = cache->files->items[i];
+		if (strcmp(cache_file->path, config->current_config_path) == 0) {
+			file = i;
+		}
+	}
+	struct cache_entry *entry = calloc(1, sizeof(*entry));
+	if (file < 0 || !entry || !(entry->line = strdup(line)) ||
+			!(entry->expanded = strdup(expanded))) {
+		if (entry) {
+			cache_entry_destroy(entry);
+		}
+		cache->failed = true;
+		return -1;
+	}
+	entry->type = commands_block ? CACHE_COMMANDS : CACHE_EMPTY;
+	entry->file = file;
+	entry->line_number = line_number;
+	list_add(cache->entries, entry);
+	return cache->entries->length - 1;
+}
+
+void config_cache_record_argv(int argc, char **argv, bool include) {
+	struct config_cache *cache = cache_state.recording;
+	if (!cache || cache->failed || cache->entries->length == 0) {
+		return;
+	}
+	struct cache_entry *entry =
+		cache->entries->items[cache->entries->length - 1];
+	if (include) {
+		entry->type = CACHE_INCLUDE;
+		char *parent_path = strdup(config->current_config_path);
+		if (argc != 2 || !parent_path ||
+				!(entry->pattern = strdup(argv[1])) ||
+				!(entry->parent_dir = strdup(dirname(parent_path))) ||
+				!(entry->includes = expand_include(argv[1],
+						entry->parent_dir))) {
+			cache->failed = true;
+		}
+		free(parent_path);
+		return;
+	}
+	entry->type = CACHE_COMMAND;
+	entry->argc = argc;
+	if (!(entry->argv = calloc(argc + 1, sizeof(char *)))) {
+		cache->failed = true;
+		return;
+	}
+	for (int i = 0; i < argc; ++i) {
+		if (!(entry->argv[i] = strdup(argv[i]))) {
+			cache->failed = true;
+			return;
+		}
+	}
+}
+
+void config_cache_record_result(int index, struct cmd_results *res,
+		const char *new_block) {
+	struct config_cache *cache = cache_state.recording;
+	if (!cache || cache->failed || index < 0) {
+		return;
+	}
+	struct cache_entry *entry = cache->entries->items[index];
+	switch (res->status) {
+	case CMD_FAILURE:
+	case CMD_INVALID:
+		// Replaying would have to report the error again
+		cache->failed = true;
+		break;
+	case CMD_BLOCK:
+		entry->type = CACHE_BLOCK;
+		cache->failed |= !(entry->block = strdup(new_block));
+		break;
+	case CMD_BLOCK_END:
+		if (entry->type != CACHE_COMMANDS) {
+			entry->type = CACHE_BLOCK_END;
+		}
+		break;
+	default:
+		break;
+	}
+}
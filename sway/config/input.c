@@ -5,6 +5,7 @@
 #include "sway/config.h"
 #include "sway/input/keyboard.h"
 #include "log.h"
+#include "stringop.h"
 
 struct input_config *new_input_config(const char* identifier) {
 	struct input_config *input = calloc(1, sizeof(struct input_config));
@@ -379,6 +380,66 @@ void free_input_config(struct input_config *ic) {
 	free(ic);
 }
 
+static bool regions_equal(const struct wlr_box *a, const struct wlr_box *b) {
+	return a == b || (a && b && memcmp(a, b, sizeof(*a)) == 0);
+}
+
+bool input_config_equal(const struct input_config *a,
+		const struct input_config *b) {
+	if (strcmp(a->identifier, b->identifier) != 0 ||
+			a->accel_profile != b->accel_profile ||
+			a->calibration_matrix.configured !=
+				b->calibration_matrix.configured ||
+			memcmp(a->calibration_matrix.matrix, b->calibration_matrix.matrix,
+				sizeof(a->calibration_matrix.matrix)) != 0 ||
+			a->click_method != b->click_method ||
+			a->drag != b->drag ||
+			a->drag_lock != b->drag_lock ||
+			a->dwt != b->dwt ||
+			a->left_handed != b->left_handed ||
+			a->middle_emulation != b->middle_emulation ||
+			a->natural_scroll != b->natural_scroll ||
+			a->pointer_accel != b->pointer_accel ||
+			a->scroll_factor != b->scroll_factor ||
+			a->repeat_delay != b->repeat_delay ||
+			a->repeat_rate != b->repeat_rate ||
+			a->scroll_button != b->scroll_button ||
+			a->scroll_method != b->scroll_method ||
+			a->send_events != b->send_events ||
+			a->tap != b->tap ||
+			a->tap_button_map != b->tap_button_map ||
+			lenient_strcmp(a->xkb_layout, b->xkb_layout) != 0 ||
+			lenient_strcmp(a->xkb_model, b->xkb_model) != 0 ||
+			lenient_strcmp(a->xkb_options, b->xkb_options) != 0 ||
+			lenient_strcmp(a->xkb_rules, b->xkb_rules) != 0 ||
+			lenient_strcmp(a->xkb_variant, b->xkb_variant) != 0 ||
+			lenient_strcmp(a->xkb_file, b->xkb_file) != 0 ||
+			a->xkb_file_is_set != b->xkb_file_is_set ||
+			a->xkb_numlock != b->xkb_numlock ||
+			a->xkb_capslock != b->xkb_capslock ||
+			a->mapped_to != b->mapped_to ||
+			lenient_strcmp(a->mapped_to_output, b->mapped_to_output) != 0 ||
+			!regions_equal(a->mapped_to_region, b->mapped_to_region) ||
+			a->capturable != b->capturable ||
+			!regions_equal(&a->region, &b->region) ||
+			a->tools->length != b->tools->length) {
+		return false;
+	}
+	if (a->mapped_from_region != b->mapped_from_region &&
+			(!a->mapped_from_region || !b->mapped_from_region ||
+			 memcmp(a->mapped_from_region, b->mapped_from_region,
+				 sizeof(*a->mapped_from_region)) != 0)) {
+		return false;
+	}
+	for (int i = 0; i < a->tools->length; ++i) {
+		if (memcmp(a->tools->items[i], b->tools->items[i],
+					sizeof(struct input_config_tool)) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
 int input_identifier_cmp(const void *item, const void *data) {
 	const struct input_config *ic = item;
 	const char *identifier = data;
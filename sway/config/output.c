@@ -11,8 +11,10 @@
 #include "sway/config.h"
 #include "sway/input/cursor.h"
 #include "sway/output.h"
+#include "sway/profile.h"
 #include "sway/tree/root.h"
 #include "log.h"
+#include "stringop.h"
 #include "util.h"
 
 int output_name_cmp(const void *item, const void *data) {
@@ -403,6 +405,8 @@ bool apply_output_config(struct output_config *oc, struct sway_output *output) {
 	// Flag to prevent the output mode event handler from calling us
 	output->enabling = (!oc || oc->enabled);
 
+	struct timespec start;
+	profile_begin(PROFILE_OUTPUT_CONFIG, &start);
 	queue_output_config(oc, output);
 
 	if (!oc || oc->dpms_state != DPMS_OFF) {
@@ -410,7 +414,9 @@ bool apply_output_config(struct output_config *oc, struct sway_output *output) {
 	}
 
 	sway_log(SWAY_DEBUG, "Committing output %s", wlr_output->name);
-	if (!wlr_output_commit(wlr_output)) {
+	bool committed = wlr_output_commit(wlr_output);
+	profile_end(PROFILE_OUTPUT_CONFIG, &start);
+	if (!committed) {
 		// Failed to commit output changes, maybe the output is missing a CRTC.
 		// Leave the output disabled for now and try again when the output gets
 		// the mode we asked for.
@@ -646,6 +652,64 @@ void apply_output_config_to_outputs(struct output_config *oc) {
 	}
 }
 
+bool output_config_equal(const struct output_config *a,
+		const struct output_config *b) {
+	return a->enabled == b->enabled &&
+		a->width == b->width &&
+		a->height == b->height &&
+		a->refresh_rate == b->refresh_rate &&
+		a->custom_mode == b->custom_mode &&
+		a->x == b->x &&
+		a->y == b->y &&
+		a->scale == b->scale &&
+		a->scale_filter == b->scale_filter &&
+		a->transform == b->transform &&
+		a->subpixel == b->subpixel &&
+		a->max_render_time == b->max_render_time &&
+		a->adaptive_sync == b->adaptive_sync &&
+		lenient_strcmp(a->background, b->background) == 0 &&
+		lenient_strcmp(a->background_option, b->background_option) == 0 &&
+		lenient_strcmp(a->background_fallback, b->background_fallback) == 0 &&
+		a->dpms_state == b->dpms_state;
+}
+
+void reset_changed_outputs(struct sway_config *old_config) {
+	bool applied = false;
+	char id[128];
+	struct sway_output *sway_output, *tmp;
+	wl_list_for_each_safe(sway_output, tmp, &root->all_outputs, link) {
+		output_get_identifier(id, sizeof(id), sway_output);
+		struct output_config *current = get_output_config(id, sway_output);
+
+		// What a full reload of the old config would have applied
+		struct sway_config *new_config = config;
+		bool reloading = old_config->reloading;
+		config = old_config;
+		config->reloading = true;
+		struct output_config *previous = get_output_config(id, sway_output);
+		config->reloading = reloading;
+		config = new_config;
+
+		if (current && (!previous || !output_config_equal(current, previous))) {
+			apply_output_config(current, sway_output);
+			applied = true;
+		} else {
+			sway_log(SWAY_DEBUG, "Output config for %s unchanged",
+					sway_output->wlr_output->name);
+		}
+		free_output_config(current);
+		free_output_config(previous);
+	}
+
+	if (applied) {
+		struct sway_seat *seat;
+		wl_list_for_each(seat, &server.input->seats, link) {
+			wlr_seat_pointer_notify_clear_focus(seat->wlr_seat);
+			cursor_rebase(seat->cursor);
+		}
+	}
+}
+
 void reset_outputs(void) {
 	struct output_config *oc = NULL;
 	int i = list_seq_find(config->output_configs, output_name_cmp, "*");
@@ -737,11 +801,7 @@ static bool _spawn_swaybg(char **command) {
 	return true;
 }
 
-bool spawn_swaybg(void) {
-	if (!config->swaybg_command) {
-		return true;
-	}
-
+static char **create_swaybg_command(struct sway_config *config) {
 	size_t length = 2;
 	for (int i = 0; i < config->output_configs->length; i++) {
 		struct output_config *oc = config->output_configs->items[i];
@@ -760,7 +820,7 @@ bool spawn_swaybg(void) {
 	char **cmd = calloc(length, sizeof(char *));
 	if (!cmd) {
 		sway_log(SWAY_ERROR, "Failed to allocate spawn_swaybg command");
-		return false;
+		return NULL;
 	}
 
 	size_t i = 0;
@@ -789,8 +849,20 @@ bool spawn_swaybg(void) {
 		}
 		assert(i <= length);
 	}
+	return cmd;
+}
+
+bool spawn_swaybg(void) {
+	if (!config->swaybg_command) {
+		return true;
+	}
 
-	for (size_t k = 0; k < i; k++) {
+	char **cmd = create_swaybg_command(config);
+	if (!cmd) {
+		return false;
+	}
+
+	for (size_t k = 0; cmd[k]; k++) {
 		sway_log(SWAY_DEBUG, "spawn_swaybg cmd[%zd] = %s", k, cmd[k]);
 	}
 
@@ -798,3 +870,31 @@ bool spawn_swaybg(void) {
 	free(cmd);
 	return result;
 }
+
+bool keep_swaybg(struct sway_config *old_config) {
+	if (!old_config->swaybg_client || !old_config->swaybg_command ||
+			!config->swaybg_command) {
+		return false;
+	}
+	char **old_cmd = create_swaybg_command(old_config);
+	char **new_cmd = create_swaybg_command(config);
+	bool same = old_cmd && new_cmd;
+	for (size_t i = 0; same && (old_cmd[i] || new_cmd[i]); i++) {
+		same = old_cmd[i] && new_cmd[i] && strcmp(old_cmd[i], new_cmd[i]) == 0;
+	}
+	free(old_cmd);
+	free(new_cmd);
+	if (!same) {
+		return false;
+	}
+
+	sway_log(SWAY_DEBUG, "Backgrounds unchanged, keeping swaybg");
+	wl_list_remove(&old_config->swaybg_client_destroy.link);
+	wl_list_init(&old_config->swaybg_client_destroy.link);
+	config->swaybg_client = old_config->swaybg_client;
+	old_config->swaybg_client = NULL;
+	config->swaybg_client_destroy.notify = handle_swaybg_client_destroy;
+	wl_client_add_destroy_listener(config->swaybg_client,
+		&config->swaybg_client_destroy);
+	return true;
+}
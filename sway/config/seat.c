@@ -4,6 +4,7 @@
 #include <string.h>
 #include "sway/config.h"
 #include "log.h"
+#include "stringop.h"
 
 struct seat_config *new_seat_config(const char* name) {
 	struct seat_config *seat = calloc(1, sizeof(struct seat_config));
@@ -208,6 +209,32 @@ void free_seat_config(struct seat_config *seat) {
 	free(seat);
 }
 
+bool seat_config_equal(const struct seat_config *a,
+		const struct seat_config *b) {
+	if (strcmp(a->name, b->name) != 0 ||
+			a->fallback != b->fallback ||
+			a->hide_cursor_timeout != b->hide_cursor_timeout ||
+			a->hide_cursor_when_typing != b->hide_cursor_when_typing ||
+			a->allow_constrain != b->allow_constrain ||
+			a->shortcuts_inhibit != b->shortcuts_inhibit ||
+			a->keyboard_grouping != b->keyboard_grouping ||
+			a->idle_inhibit_sources != b->idle_inhibit_sources ||
+			a->idle_wake_sources != b->idle_wake_sources ||
+			lenient_strcmp(a->xcursor_theme.name, b->xcursor_theme.name) != 0 ||
+			a->xcursor_theme.size != b->xcursor_theme.size ||
+			a->attachments->length != b->attachments->length) {
+		return false;
+	}
+	for (int i = 0; i < a->attachments->length; ++i) {
+		struct seat_attachment_config *attachment_a = a->attachments->items[i];
+		struct seat_attachment_config *attachment_b = b->attachments->items[i];
+		if (strcmp(attachment_a->identifier, attachment_b->identifier) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
 int seat_name_cmp(const void *item, const void *data) {
 	const struct seat_config *sc = item;
 	const char *name = data;
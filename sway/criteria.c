@@ -1,7 +1,10 @@
 #define _POSIX_C_SOURCE 200809L
+#include <ctype.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
 #include <strings.h>
 #include <pcre.h>
 #include "sway/criteria.h"
@@ -40,7 +43,7 @@ bool criteria_is_empty(struct criteria *criteria) {
 char *error = NULL;
 
 // Returns error string on failure or NULL otherwise.
-static bool generate_regex(pcre **regex, char *value) {
+static bool generate_regex(pcre **regex, pcre_extra **extra, char *value) {
 	const char *reg_err;
 	int offset;
 
@@ -54,9 +57,59 @@ static bool generate_regex(pcre **regex, char *value) {
 		return false;
 	}
 
+	// Criteria are matched against every new view and title change, so JIT
+	// compile them. Without JIT support the regex is interpreted as before.
+	*extra = pcre_study(*regex, PCRE_STUDY_JIT_COMPILE, &reg_err);
+	if (reg_err) {
+		sway_log(SWAY_DEBUG, "Regex study for '%s' failed: %s", value, reg_err);
+	}
+
 	return true;
 }
 
+/**
+ * Extracts the string matched by regexes such as ^foo$ (exactly "foo") or
+ * ^foo\.bar (anything starting with "foo.bar"). Escaped punctuation is
+ * allowed, any other metacharacter makes the regex non-literal.
+ */
+static char *regex_literal(const char *value, bool *prefix) {
+	if (value[0] != '^') {
+		return NULL;
+	}
+	char *literal = malloc(strlen(value));
+	if (!literal) {
+		return NULL;
+	}
+	size_t len = 0;
+	*prefix = true;
+	for (const char *p = value + 1; *p; ++p) {
+		if (*p == '\\') {
+			++p;
+			// Escaped letters and digits are character classes or references
+			if (!*p || isalnum((unsigned char)*p)) {
+				goto non_literal;
+			}
+			literal[len++] = *p;
+		} else if (*p == '$' && p[1] == '\0') {
+			*prefix = false;
+		} else if (strchr(".[]()*+?{}|^$", *p)) {
+			goto non_literal;
+		} else {
+			literal[len++] = *p;
+		}
+	}
+	if (len == 0 && *prefix) {
+		// ^ alone matches everything
+		goto non_literal;
+	}
+	literal[len] = '\0';
+	return literal;
+
+non_literal:
+	free(literal);
+	return NULL;
+}
+
 static bool pattern_create(struct pattern **pattern, char *value) {
 	*pattern = calloc(1, sizeof(struct pattern));
 	if (!*pattern) {
@@ -67,18 +120,25 @@ static bool pattern_create(struct pattern **pattern, char *value) {
 		(*pattern)->match_type = PATTERN_FOCUSED;
 	} else {
 		(*pattern)->match_type = PATTERN_PCRE;
-		if (!generate_regex(&(*pattern)->regex, value)) {
+		if (!generate_regex(&(*pattern)->regex, &(*pattern)->regex_extra,
+					value)) {
 			return false;
 		};
+		(*pattern)->literal =
+			regex_literal(value, &(*pattern)->literal_prefix);
 	}
 	return true;
 }
 
 static void pattern_destroy(struct pattern *pattern) {
 	if (pattern) {
+		if (pattern->regex_extra) {
+			pcre_free_study(pattern->regex_extra);
+		}
 		if (pattern->regex) {
 			pcre_free(pattern->regex);
 		}
+		free(pattern->literal);
 		free(pattern);
 	}
 }
@@ -93,14 +153,15 @@ void criteria_destroy(struct criteria *criteria) {
 	pattern_destroy(criteria->window_role);
 #endif
 	pattern_destroy(criteria->con_mark);
-	free(criteria->workspace);
+	pattern_destroy(criteria->workspace);
 	free(criteria->cmdlist);
 	free(criteria->raw);
 	free(criteria);
 }
 
-static int regex_cmp(const char *item, const pcre *regex) {
-	return pcre_exec(regex, NULL, item, strlen(item), 0, 0, NULL, 0);
+static int regex_cmp(const char *item, const struct pattern *pattern) {
+	return pcre_exec(pattern->regex, pattern->regex_extra,
+			item, strlen(item), 0, 0, NULL, 0);
 }
 
 #if HAVE_XWAYLAND
@@ -155,7 +216,7 @@ static bool criteria_matches_container(struct criteria *criteria,
 		bool exists = false;
 		struct sway_container *con = container;
 		for (int i = 0; i < con->marks->length; ++i) {
-			if (regex_cmp(con->marks->items[i], criteria->con_mark->regex) == 0) {
+			if (regex_cmp(con->marks->items[i], criteria->con_mark) == 0) {
 				exists = true;
 				break;
 			}
@@ -176,9 +237,12 @@ static bool criteria_matches_container(struct criteria *criteria,
 
 static bool criteria_matches_view(struct criteria *criteria,
 		struct sway_view *view) {
-	struct sway_seat *seat = input_manager_current_seat();
-	struct sway_container *focus = seat_get_focused_container(seat);
-	struct sway_view *focused = focus ? focus->view : NULL;
+	struct sway_view *focused = NULL;
+	if (criteria->properties & CRITERIA_FOCUSED) {
+		struct sway_seat *seat = input_manager_current_seat();
+		struct sway_container *focus = seat_get_focused_container(seat);
+		focused = focus ? focus->view : NULL;
+	}
 
 	if (criteria->title) {
 		const char *title = view_get_title(view);
@@ -193,7 +257,7 @@ static bool criteria_matches_view(struct criteria *criteria,
 			}
 			break;
 		case PATTERN_PCRE:
-			if (regex_cmp(title, criteria->title->regex) != 0) {
+			if (regex_cmp(title, criteria->title) != 0) {
 				return false;
 			}
 			break;
@@ -213,7 +277,7 @@ static bool criteria_matches_view(struct criteria *criteria,
 			}
 			break;
 		case PATTERN_PCRE:
-			if (regex_cmp(shell, criteria->shell->regex) != 0) {
+			if (regex_cmp(shell, criteria->shell) != 0) {
 				return false;
 			}
 			break;
@@ -233,7 +297,7 @@ static bool criteria_matches_view(struct criteria *criteria,
 			}
 			break;
 		case PATTERN_PCRE:
-			if (regex_cmp(app_id, criteria->app_id->regex) != 0) {
+			if (regex_cmp(app_id, criteria->app_id) != 0) {
 				return false;
 			}
 			break;
@@ -265,7 +329,7 @@ static bool criteria_matches_view(struct criteria *criteria,
 			}
 			break;
 		case PATTERN_PCRE:
-			if (regex_cmp(class, criteria->class->regex) != 0) {
+			if (regex_cmp(class, criteria->class) != 0) {
 				return false;
 			}
 			break;
@@ -285,7 +349,7 @@ static bool criteria_matches_view(struct criteria *criteria,
 			}
 			break;
 		case PATTERN_PCRE:
-			if (regex_cmp(instance, criteria->instance->regex) != 0) {
+			if (regex_cmp(instance, criteria->instance) != 0) {
 				return false;
 			}
 			break;
@@ -305,7 +369,7 @@ static bool criteria_matches_view(struct criteria *criteria,
 			}
 			break;
 		case PATTERN_PCRE:
-			if (regex_cmp(window_role, criteria->window_role->regex) != 0) {
+			if (regex_cmp(window_role, criteria->window_role) != 0) {
 				return false;
 			}
 			break;
@@ -364,7 +428,7 @@ static bool criteria_matches_view(struct criteria *criteria,
 			}
 			break;
 		case PATTERN_PCRE:
-			if (regex_cmp(ws->name, criteria->workspace->regex) != 0) {
+			if (regex_cmp(ws->name, criteria->workspace) != 0) {
 				return false;
 			}
 			break;
@@ -380,14 +444,349 @@ static bool criteria_matches_view(struct criteria *criteria,
 	return true;
 }
 
+/**
+ * The criteria index maps the literal app_id, class or instance patterns of
+ * criteria to the criteria using them, so that finding the criteria for a
+ * view only evaluates the ones which may match it. Criteria without such a
+ * pattern are kept in a residual list and always evaluated.
+ */
+enum criteria_index_property {
+	INDEX_APP_ID,
+#if HAVE_XWAYLAND
+	INDEX_CLASS,
+	INDEX_INSTANCE,
+#endif
+	INDEX_PROPERTY_COUNT,
+};
+
+struct index_array {
+	int *items;
+	int length, capacity;
+};
+
+struct criteria_index_bucket {
+	enum criteria_index_property property;
+	bool prefix;
+	const char *key; // owned by the pattern
+	size_t key_len;
+	struct index_array criteria; // positions in config->criteria
+	struct criteria_index_bucket *next;
+};
+
+struct criteria_index {
+	int length; // of config->criteria when the index was built
+	size_t bucket_count; // a power of two
+	struct criteria_index_bucket **buckets;
+	struct index_array residual;
+	// Distinct lengths of the prefix patterns of each property
+	struct index_array prefix_lengths[INDEX_PROPERTY_COUNT];
+	uint64_t *candidates; // one bit per criteria
+	uint64_t *commands; // the CT_COMMAND criteria
+	uint64_t serial; // identifies the index in sway_view::criteria_serial
+};
+
+static bool index_array_add(struct index_array *array, int item) {
+	if (array->length == array->capacity) {
+		int capacity = array->capacity ? array->capacity * 2 : 4;
+		int *items = realloc(array->items, capacity * sizeof(int));
+		if (!items) {
+			return false;
+		}
+		array->items = items;
+		array->capacity = capacity;
+	}
+	array->items[array->length++] = item;
+	return true;
+}
+
+static size_t index_hash(enum criteria_index_property property, bool prefix,
+		const char *key, size_t key_len) {
+	// FNV-1a
+	uint32_t hash = 2166136261u;
+	hash = (hash ^ (property * 2 + prefix)) * 16777619u;
+	for (size_t i = 0; i < key_len; ++i) {
+		hash = (hash ^ (unsigned char)key[i]) * 16777619u;
+	}
+	return hash;
+}
+
+static struct criteria_index_bucket *index_lookup(struct criteria_index *index,
+		enum criteria_index_property property, bool prefix,
+		const char *key, size_t key_len) {
+	size_t hash = index_hash(property, prefix, key, key_len);
+	struct criteria_index_bucket *bucket =
+		index->buckets[hash & (index->bucket_count - 1)];
+	for (; bucket; bucket = bucket->next) {
+		if (bucket->property == property && bucket->prefix == prefix &&
+				bucket->key_len == key_len &&
+				memcmp(bucket->key, key, key_len) == 0) {
+			return bucket;
+		}
+	}
+	return NULL;
+}
+
+static bool index_insert(struct criteria_index *index,
+		enum criteria_index_property property, struct pattern *pattern,
+		int position) {
+	size_t key_len = strlen(pattern->literal);
+	struct criteria_index_bucket *bucket = index_lookup(index, property,
+			pattern->literal_prefix, pattern->literal, key_len);
+	if (!bucket) {
+		if (!(bucket = calloc(1, sizeof(*bucket)))) {
+			return false;
+		}
+		bucket->property = property;
+		bucket->prefix = pattern->literal_prefix;
+		bucket->key = pattern->literal;
+		bucket->key_len = key_len;
+		size_t hash = index_hash(property, bucket->prefix, bucket->key, key_len);
+		struct criteria_index_bucket **head =
+			&index->buckets[hash & (index->bucket_count - 1)];
+		bucket->next = *head;
+		*head = bucket;
+
+		struct index_array *lengths = &index->prefix_lengths[property];
+		if (bucket->prefix) {
+			bool found = false;
+			for (int i = 0; i < lengths->length && !found; ++i) {
+				found = lengths->items[i] == (int)key_len;
+			}
+			if (!found && !index_array_add(lengths, key_len)) {
+				return false;
+			}
+		}
+	}
+	return index_array_add(&bucket->criteria, position);
+}
+
+void criteria_index_destroy(struct criteria_index *index) {
+	if (!index) {
+		return;
+	}
+	for (size_t i = 0; index->buckets && i < index->bucket_count; ++i) {
+		struct criteria_index_bucket *bucket = index->buckets[i];
+		while (bucket) {
+			struct criteria_index_bucket *next = bucket->next;
+			free(bucket->criteria.items);
+			free(bucket);
+			bucket = next;
+		}
+	}
+	for (int i = 0; i < INDEX_PROPERTY_COUNT; ++i) {
+		free(index->prefix_lengths[i].items);
+	}
+	free(index->buckets);
+	free(index->residual.items);
+	free(index->candidates);
+	free(index->commands);
+	free(index);
+}
+
+/**
+ * Returns the pattern a criteria is indexed under, preferring exact matches.
+ */
+static struct pattern *criteria_index_key(struct criteria *criteria,
+		enum criteria_index_property *property) {
+	struct pattern *patterns[INDEX_PROPERTY_COUNT] = {
+		[INDEX_APP_ID] = criteria->app_id,
+#if HAVE_XWAYLAND
+		[INDEX_CLASS] = criteria->class,
+		[INDEX_INSTANCE] = criteria->instance,
+#endif
+	};
+	struct pattern *key = NULL;
+	for (int i = 0; i < INDEX_PROPERTY_COUNT; ++i) {
+		struct pattern *pattern = patterns[i];
+		if (!pattern || !pattern->literal) {
+			continue;
+		}
+		if (!key || (key->literal_prefix && !pattern->literal_prefix)) {
+			key = pattern;
+			*property = i;
+		}
+	}
+	return key;
+}
+
+static struct criteria_index *criteria_index_create(list_t *criterias) {
+	struct criteria_index *index = calloc(1, sizeof(*index));
+	if (!index) {
+		return NULL;
+	}
+	index->length = criterias->length;
+	index->bucket_count = 16;
+	while (index->bucket_count < (size_t)criterias->length * 2) {
+		index->bucket_count *= 2;
+	}
+	index->buckets = calloc(index->bucket_count, sizeof(*index->buckets));
+	index->candidates = calloc(criterias->length / 64 + 1, sizeof(uint64_t));
+	index->commands = calloc(criterias->length / 64 + 1, sizeof(uint64_t));
+	if (!index->buckets || !index->candidates || !index->commands) {
+		goto error;
+	}
+
+	for (int i = 0; i < criterias->length; ++i) {
+		struct criteria *criteria = criterias->items[i];
+		enum criteria_index_property property;
+		struct pattern *key = criteria_index_key(criteria, &property);
+		if (key ? !index_insert(index, property, key, i) :
+				!index_array_add(&index->residual, i)) {
+			goto error;
+		}
+		if (criteria->type & CT_COMMAND) {
+			index->commands[i / 64] |= UINT64_C(1) << (i % 64);
+		}
+	}
+	static uint64_t serial = 0;
+	index->serial = ++serial;
+	return index;
+
+error:
+	sway_log(SWAY_ERROR, "Failed to allocate criteria index");
+	criteria_index_destroy(index);
+	return NULL;
+}
+
+static void index_mark_candidates(struct criteria_index *index,
+		struct criteria_index_bucket *bucket) {
+	for (int i = 0; bucket && i < bucket->criteria.length; ++i) {
+		int position = bucket->criteria.items[i];
+		index->candidates[position / 64] |= UINT64_C(1) << (position % 64);
+	}
+}
+
+static void index_find_candidates(struct criteria_index *index,
+		enum criteria_index_property property, const char *value) {
+	if (!value) {
+		return;
+	}
+	size_t len = strlen(value);
+	index_mark_candidates(index, index_lookup(index, property, false,
+				value, len));
+	if (len > 0 && value[len - 1] == '\n') {
+		// $ also matches before a trailing newline
+		index_mark_candidates(index, index_lookup(index, property, false,
+					value, len - 1));
+	}
+	struct index_array *lengths = &index->prefix_lengths[property];
+	for (int i = 0; i < lengths->length; ++i) {
+		if ((size_t)lengths->items[i] <= len) {
+			index_mark_candidates(index, index_lookup(index, property, true,
+						value, lengths->items[i]));
+		}
+	}
+}
+
+static struct criteria_index *criteria_get_index(void) {
+	// Criteria are only ever appended, so a change in length means the index
+	// is out of date
+	struct criteria_index *index = config->criteria_index;
+	if (!index || index->length != config->criteria->length) {
+		criteria_index_destroy(index);
+		index = config->criteria_index =
+			criteria_index_create(config->criteria);
+	}
+	return index;
+}
+
+static int index_words(struct criteria_index *index) {
+	return index->length / 64 + 1;
+}
+
+static void index_collect_candidates(struct criteria_index *index,
+		struct sway_view *view) {
+	memset(index->candidates, 0, index_words(index) * sizeof(uint64_t));
+	for (int i = 0; i < index->residual.length; ++i) {
+		int position = index->residual.items[i];
+		index->candidates[position / 64] |= UINT64_C(1) << (position % 64);
+	}
+	index_find_candidates(index, INDEX_APP_ID, view_get_app_id(view));
+#if HAVE_XWAYLAND
+	index_find_candidates(index, INDEX_CLASS, view_get_class(view));
+	index_find_candidates(index, INDEX_INSTANCE, view_get_instance(view));
+#endif
+}
+
 list_t *criteria_for_view(struct sway_view *view, enum criteria_type types) {
 	list_t *criterias = config->criteria;
 	list_t *matches = create_list();
-	for (int i = 0; i < criterias->length; ++i) {
-		struct criteria *criteria = criterias->items[i];
-		if ((criteria->type & types) && criteria_matches_view(criteria, view)) {
-			list_add(matches, criteria);
+
+	struct criteria_index *index = criteria_get_index();
+	if (!index) {
+		for (int i = 0; i < criterias->length; ++i) {
+			struct criteria *criteria = criterias->items[i];
+			if ((criteria->type & types) &&
+					criteria_matches_view(criteria, view)) {
+				list_add(matches, criteria);
+			}
+		}
+		return matches;
+	}
+
+	// Evaluate the candidates in config order, which is the order their
+	// commands are run in
+	index_collect_candidates(index, view);
+	for (int word = 0; word < index_words(index); ++word) {
+		uint64_t bits = index->candidates[word];
+		while (bits) {
+			int position = word * 64 + __builtin_ctzll(bits);
+			bits &= bits - 1;
+			struct criteria *criteria = criterias->items[position];
+			if ((criteria->type & types) &&
+					criteria_matches_view(criteria, view)) {
+				list_add(matches, criteria);
+			}
+		}
+	}
+	return matches;
+}
+
+// Properties which change without the criteria being re-evaluated, so a
+// previous result can't be relied on
+#define CRITERIA_VOLATILE (CRITERIA_FLOATING | CRITERIA_URGENT | \
+		CRITERIA_WORKSPACE | CRITERIA_FOCUSED)
+
+list_t *criteria_for_view_update(struct sway_view *view,
+		enum criteria_property changed) {
+	struct criteria_index *index = criteria_get_index();
+	if (!index) {
+		return criteria_for_view(view, CT_COMMAND);
+	}
+	int words = index_words(index);
+	if (view->criteria_serial != index->serial) {
+		uint64_t *evaluated = realloc(view->criteria_evaluated,
+				words * sizeof(uint64_t));
+		if (!evaluated) {
+			sway_log(SWAY_ERROR, "Failed to allocate criteria bitset");
+			return criteria_for_view(view, CT_COMMAND);
+		}
+		memset(evaluated, 0, words * sizeof(uint64_t));
+		view->criteria_evaluated = evaluated;
+		view->criteria_serial = index->serial;
+	}
+
+	list_t *criterias = config->criteria;
+	list_t *matches = create_list();
+	index_collect_candidates(index, view);
+	for (int word = 0; word < words; ++word) {
+		uint64_t bits = index->candidates[word] & index->commands[word];
+		while (bits) {
+			int bit = __builtin_ctzll(bits);
+			bits &= bits - 1;
+			struct criteria *criteria = criterias->items[word * 64 + bit];
+			// The result of a criteria evaluated before can only change if
+			// a property it depends on did
+			if ((view->criteria_evaluated[word] & (UINT64_C(1) << bit)) &&
+					!(criteria->properties & (changed | CRITERIA_VOLATILE))) {
+				continue;
+			}
+			if (criteria_matches_view(criteria, view)) {
+				list_add(matches, criteria);
+			}
 		}
+		// Criteria which aren't candidates don't match either
+		view->criteria_evaluated[word] |= index->commands[word];
 	}
 	return matches;
 }
@@ -641,6 +1040,48 @@ static void unescape(char *value) {
 	free(copy);
 }
 
+static uint32_t pattern_properties(struct pattern *pattern,
+		enum criteria_property property) {
+	if (!pattern) {
+		return 0;
+	}
+	return pattern->match_type == PATTERN_FOCUSED ?
+		property | CRITERIA_FOCUSED : property;
+}
+
+static uint32_t criteria_get_properties(struct criteria *criteria) {
+	uint32_t properties =
+		pattern_properties(criteria->title, CRITERIA_TITLE) |
+		pattern_properties(criteria->shell, CRITERIA_SHELL) |
+		pattern_properties(criteria->app_id, CRITERIA_APP_ID) |
+		pattern_properties(criteria->con_mark, CRITERIA_CON_MARK) |
+		pattern_properties(criteria->workspace, CRITERIA_WORKSPACE);
+#if HAVE_XWAYLAND
+	properties |= pattern_properties(criteria->class, CRITERIA_CLASS) |
+		pattern_properties(criteria->instance, CRITERIA_INSTANCE) |
+		pattern_properties(criteria->window_role, CRITERIA_WINDOW_ROLE);
+	if (criteria->id) {
+		properties |= CRITERIA_ID;
+	}
+	if (criteria->window_type != ATOM_LAST) {
+		properties |= CRITERIA_WINDOW_TYPE;
+	}
+#endif
+	if (criteria->con_id) {
+		properties |= CRITERIA_CON_ID;
+	}
+	if (criteria->floating || criteria->tiling) {
+		properties |= CRITERIA_FLOATING;
+	}
+	if (criteria->urgent) {
+		properties |= CRITERIA_URGENT;
+	}
+	if (criteria->pid) {
+		properties |= CRITERIA_PID;
+	}
+	return properties;
+}
+
 /**
  * Parse a raw criteria string such as [class="foo" instance="bar"] into a
  * criteria struct.
@@ -730,6 +1171,7 @@ struct criteria *criteria_parse(char *raw, char **error_arg) {
 		*error_arg = strdup("Criteria is empty");
 		goto cleanup;
 	}
+	criteria->properties = criteria_get_properties(criteria);
 
 	++head;
 	int len = head - raw;
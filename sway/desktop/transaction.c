@@ -8,6 +8,7 @@
 #include "sway/desktop.h"
 #include "sway/desktop/idle_inhibit_v1.h"
 #include "sway/desktop/transaction.h"
+#include "sway/ipc-snapshot.h"
 #include "sway/input/cursor.h"
 #include "sway/input/input-manager.h"
 #include "sway/output.h"
@@ -328,6 +329,7 @@ static void transaction_apply(struct sway_transaction *transaction) {
 	}
 
 	cursor_rebase_all();
+	ipc_snapshot_schedule_update();
 }
 
 static void transaction_commit_pending(void);
@@ -7,12 +7,14 @@
 #include <wlr/types/wlr_output.h>
 #include <wlr/xwayland.h>
 #include "log.h"
+#include "sway/criteria.h"
 #include "sway/desktop.h"
 #include "sway/desktop/transaction.h"
 #include "sway/input/cursor.h"
 #include "sway/input/input-manager.h"
 #include "sway/input/seat.h"
 #include "sway/output.h"
+#include "sway/profile.h"
 #include "sway/tree/arrange.h"
 #include "sway/tree/container.h"
 #include "sway/tree/view.h"
@@ -619,7 +621,7 @@ static void handle_set_title(struct wl_listener *listener, void *data) {
 		return;
 	}
 	view_update_title(view, false);
-	view_execute_criteria(view);
+	view_execute_criteria(view, CRITERIA_TITLE);
 }
 
 static void handle_set_class(struct wl_listener *listener, void *data) {
@@ -630,7 +632,7 @@ static void handle_set_class(struct wl_listener *listener, void *data) {
 	if (!xsurface->mapped) {
 		return;
 	}
-	view_execute_criteria(view);
+	view_execute_criteria(view, CRITERIA_CLASS | CRITERIA_INSTANCE);
 }
 
 static void handle_set_role(struct wl_listener *listener, void *data) {
@@ -641,7 +643,7 @@ static void handle_set_role(struct wl_listener *listener, void *data) {
 	if (!xsurface->mapped) {
 		return;
 	}
-	view_execute_criteria(view);
+	view_execute_criteria(view, CRITERIA_WINDOW_ROLE);
 }
 
 static void handle_set_window_type(struct wl_listener *listener, void *data) {
@@ -652,7 +654,7 @@ static void handle_set_window_type(struct wl_listener *listener, void *data) {
 	if (!xsurface->mapped) {
 		return;
 	}
-	view_execute_criteria(view);
+	view_execute_criteria(view, CRITERIA_WINDOW_TYPE);
 }
 
 static void handle_set_hints(struct wl_listener *listener, void *data) {
@@ -770,6 +772,7 @@ void handle_xwayland_ready(struct wl_listener *listener, void *data) {
 	struct sway_server *server =
 		wl_container_of(listener, server, xwayland_ready);
 	struct sway_xwayland *xwayland = &server->xwayland;
+	profile_milestone(PROFILE_XWAYLAND_READY);
 
 	xcb_connection_t *xcb_conn = xcb_connect(NULL, NULL);
 	int err = xcb_connection_has_error(xcb_conn);
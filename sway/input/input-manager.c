@@ -555,20 +555,7 @@ void input_manager_apply_input_config(struct input_config *input_config) {
 	retranslate_keysyms(input_config);
 }
 
-void input_manager_reset_input(struct sway_input_device *input_device) {
-	sway_input_reset_libinput_device(input_device);
-	struct sway_seat *seat = NULL;
-	wl_list_for_each(seat, &server.input->seats, link) {
-		seat_reset_device(seat, input_device);
-	}
-}
-
-void input_manager_reset_all_inputs(void) {
-	struct sway_input_device *input_device = NULL;
-	wl_list_for_each(input_device, &server.input->devices, link) {
-		input_manager_reset_input(input_device);
-	}
-
+static void disarm_keyboard_groups(void) {
 	// If there is at least one keyboard using the default keymap, repeat delay,
 	// and repeat rate, then it is possible that there is a keyboard group that
 	// need their keyboard disarmed.
@@ -581,28 +568,7 @@ void input_manager_reset_all_inputs(void) {
 	}
 }
 
-void input_manager_apply_seat_config(struct seat_config *seat_config) {
-	sway_log(SWAY_DEBUG, "applying seat config for seat %s", seat_config->name);
-	if (strcmp(seat_config->name, "*") == 0) {
-		struct sway_seat *seat = NULL;
-		wl_list_for_each(seat, &server.input->seats, link) {
-			// Only apply the wildcard config directly if there is no seat
-			// specific config
-			struct seat_config *sc = seat_get_config(seat);
-			if (!sc) {
-				sc = seat_config;
-			}
-			seat_apply_config(seat, sc);
-		}
-	} else {
-		struct sway_seat *seat =
-			input_manager_get_seat(seat_config->name, true);
-		if (!seat) {
-			return;
-		}
-		seat_apply_config(seat, seat_config);
-	}
-
+static void attach_all_devices(void) {
 	// for every device, try to add it to a seat and if no seat has it
 	// attached, add it to the fallback seats.
 	struct sway_input_device *input_device = NULL;
@@ -650,6 +616,156 @@ void input_manager_apply_seat_config(struct seat_config *seat_config) {
 	}
 }
 
+static void reset_removed_seat_configs(struct sway_config *old_config) {
+	bool removed = false;
+	for (int i = 0; i < old_config->seat_configs->length; ++i) {
+		struct seat_config *sc = old_config->seat_configs->items[i];
+		if (list_seq_find(config->seat_configs, seat_name_cmp, sc->name) >= 0) {
+			continue;
+		}
+		sway_log(SWAY_DEBUG, "seat config for seat %s removed", sc->name);
+		removed = true;
+
+		bool wildcard = strcmp(sc->name, "*") == 0;
+		struct sway_seat *seat = NULL;
+		wl_list_for_each(seat, &server.input->seats, link) {
+			if (wildcard ? seat_get_config(seat) != NULL :
+					strcmp(seat->wlr_seat->name, sc->name) != 0) {
+				continue;
+			}
+			struct sway_seat_device *seat_device = NULL;
+			wl_list_for_each(seat_device, &seat->devices, link) {
+				seat_reset_device(seat, seat_device->input_device);
+			}
+			seat_apply_config(seat, seat_get_config_by_name("*"));
+		}
+	}
+
+	// Devices attached by a removed config move to the fallback seat, and
+	// the ones which stay are configured again
+	if (removed) {
+		attach_all_devices();
+		disarm_keyboard_groups();
+	}
+}
+
+static void find_changed_input_configs(list_t *changed, list_t *configs,
+		list_t *old_configs) {
+	for (int i = 0; i < configs->length; ++i) {
+		struct input_config *ic = configs->items[i];
+		int j = list_seq_find(old_configs, input_identifier_cmp,
+				ic->identifier);
+		if (j < 0 || !input_config_equal(ic, old_configs->items[j])) {
+			list_add(changed, ic->identifier);
+		}
+	}
+	for (int i = 0; i < old_configs->length; ++i) {
+		struct input_config *ic = old_configs->items[i];
+		if (list_seq_find(configs, input_identifier_cmp, ic->identifier) < 0) {
+			list_add(changed, ic->identifier);
+		}
+	}
+}
+
+static bool input_device_matches(struct sway_input_device *input_device,
+		const char *identifier) {
+	if (strcmp(identifier, "*") == 0 ||
+			strcmp(input_device->identifier, identifier) == 0) {
+		return true;
+	}
+	return strncmp(identifier, "type:", 5) == 0 &&
+		strcmp(input_device_get_type(input_device), identifier + 5) == 0;
+}
+
+void input_manager_apply_changed_configs(struct sway_config *old_config) {
+	list_t *changed = create_list();
+	find_changed_input_configs(changed, config->input_configs,
+			old_config->input_configs);
+	find_changed_input_configs(changed, config->input_type_configs,
+			old_config->input_type_configs);
+
+	bool reset = false;
+	struct sway_input_device *input_device = NULL;
+	wl_list_for_each(input_device, &server.input->devices, link) {
+		bool affected = false;
+		for (int i = 0; i < changed->length && !affected; ++i) {
+			affected = input_device_matches(input_device, changed->items[i]);
+		}
+		if (affected) {
+			input_manager_reset_input(input_device);
+			input_manager_configure_input(input_device);
+			reset = true;
+		} else {
+			sway_log(SWAY_DEBUG, "Input config for %s unchanged",
+					input_device->identifier);
+		}
+	}
+	list_free(changed);
+	if (reset) {
+		disarm_keyboard_groups();
+	}
+
+	// The keysym translation state belongs to the new config
+	for (int i = 0; i < config->input_configs->length; ++i) {
+		struct input_config *ic = config->input_configs->items[i];
+		if (ic->xkb_layout || ic->xkb_file) {
+			translate_keysyms(ic);
+			break;
+		}
+	}
+
+	for (int i = 0; i < config->seat_configs->length; ++i) {
+		struct seat_config *sc = config->seat_configs->items[i];
+		int j = list_seq_find(old_config->seat_configs, seat_name_cmp,
+				sc->name);
+		if (j < 0 || !seat_config_equal(sc, old_config->seat_configs->items[j])) {
+			input_manager_apply_seat_config(sc);
+		}
+	}
+	reset_removed_seat_configs(old_config);
+}
+
+void input_manager_reset_input(struct sway_input_device *input_device) {
+	sway_input_reset_libinput_device(input_device);
+	struct sway_seat *seat = NULL;
+	wl_list_for_each(seat, &server.input->seats, link) {
+		seat_reset_device(seat, input_device);
+	}
+}
+
+void input_manager_reset_all_inputs(void) {
+	struct sway_input_device *input_device = NULL;
+	wl_list_for_each(input_device, &server.input->devices, link) {
+		input_manager_reset_input(input_device);
+	}
+	disarm_keyboard_groups();
+}
+
+void input_manager_apply_seat_config(struct seat_config *seat_config) {
+	sway_log(SWAY_DEBUG, "applying seat config for seat %s", seat_config->name);
+	if (strcmp(seat_config->name, "*") == 0) {
+		struct sway_seat *seat = NULL;
+		wl_list_for_each(seat, &server.input->seats, link) {
+			// Only apply the wildcard config directly if there is no seat
+			// specific config
+			struct seat_config *sc = seat_get_config(seat);
+			if (!sc) {
+				sc = seat_config;
+			}
+			seat_apply_config(seat, sc);
+		}
+	} else {
+		struct sway_seat *seat =
+			input_manager_get_seat(seat_config->name, true);
+		if (!seat) {
+			return;
+		}
+		seat_apply_config(seat, seat_config);
+	}
+
+	attach_all_devices();
+}
+
 void input_manager_configure_xcursor(void) {
 	struct sway_seat *seat = NULL;
 	wl_list_for_each(seat, &server.input->seats, link) {
@@ -1,6 +1,9 @@
+#define _POSIX_C_SOURCE 200809L
 #include <assert.h>
 #include <limits.h>
+#include <string.h>
 #include <strings.h>
+#include <sys/stat.h>
 #include <wlr/backend/multi.h>
 #include <wlr/backend/session.h>
 #include <wlr/interfaces/wlr_keyboard.h>
@@ -14,7 +17,10 @@
 #include "sway/input/seat.h"
 #include "sway/input/cursor.h"
 #include "sway/ipc-server.h"
+#include "sway/profile.h"
+#include "list.h"
 #include "log.h"
+#include "stringop.h"
 
 static struct modifier_key {
 	char *name;
@@ -759,14 +765,145 @@ static void handle_xkb_context_log(struct xkb_context *context,
 	}
 }
 
+// Compiled keymaps are shared by all keyboards and kept across reloads
+#define KEYMAP_CACHE_SIZE 16
+
+struct keymap_cache_entry {
+	char *file; // NULL for keymaps compiled from rule names
+	struct stat file_stat;
+	char *rules, *model, *layout, *variant, *options;
+	struct xkb_keymap *keymap;
+	uint64_t last_used;
+};
+
+static struct {
+	struct xkb_context *context;
+	list_t *entries; // struct keymap_cache_entry
+	uint64_t clock;
+} keymap_cache;
+
+static bool keymap_cache_entry_matches(struct keymap_cache_entry *entry,
+		const char *file, const struct stat *st,
+		const struct xkb_rule_names *rules) {
+	if (file) {
+		return entry->file && strcmp(entry->file, file) == 0 &&
+			entry->file_stat.st_dev == st->st_dev &&
+			entry->file_stat.st_ino == st->st_ino &&
+			entry->file_stat.st_size == st->st_size &&
+			entry->file_stat.st_mtim.tv_sec == st->st_mtim.tv_sec &&
+			entry->file_stat.st_mtim.tv_nsec == st->st_mtim.tv_nsec;
+	}
+	return !entry->file &&
+		lenient_strcmp(entry->rules, rules->rules) == 0 &&
+		lenient_strcmp(entry->model, rules->model) == 0 &&
+		lenient_strcmp(entry->layout, rules->layout) == 0 &&
+		lenient_strcmp(entry->variant, rules->variant) == 0 &&
+		lenient_strcmp(entry->options, rules->options) == 0;
+}
+
+static void keymap_cache_entry_destroy(struct keymap_cache_entry *entry) {
+	free(entry->file);
+	free(entry->rules);
+	free(entry->model);
+	free(entry->layout);
+	free(entry->variant);
+	free(entry->options);
+	xkb_keymap_unref(entry->keymap);
+	free(entry);
+}
+
+void sway_keyboard_keymap_cache_finish(void) {
+	if (!keymap_cache.context) {
+		return;
+	}
+	for (int i = 0; i < keymap_cache.entries->length; ++i) {
+		keymap_cache_entry_destroy(keymap_cache.entries->items[i]);
+	}
+	list_free(keymap_cache.entries);
+	xkb_context_unref(keymap_cache.context);
+	memset(&keymap_cache, 0, sizeof(keymap_cache));
+}
+
+/**
+ * Returns a new reference to the cached keymap for the file, identified by
+ * its stat, or for the rule names if file is NULL.
+ */
+static struct xkb_keymap *keymap_cache_get(const char *file,
+		const struct stat *st, const struct xkb_rule_names *rules) {
+	for (int i = 0; i < keymap_cache.entries->length; ++i) {
+		struct keymap_cache_entry *entry = keymap_cache.entries->items[i];
+		if (keymap_cache_entry_matches(entry, file, st, rules)) {
+			entry->last_used = ++keymap_cache.clock;
+			return xkb_keymap_ref(entry->keymap);
+		}
+	}
+	return NULL;
+}
+
+static void keymap_cache_add(const char *file, const struct stat *st,
+		const struct xkb_rule_names *rules, struct xkb_keymap *keymap) {
+	struct keymap_cache_entry *entry = calloc(1, sizeof(*entry));
+	if (!entry) {
+		sway_log(SWAY_ERROR, "Unable to allocate keymap cache entry");
+		return;
+	}
+	entry->keymap = xkb_keymap_ref(keymap);
+	// A missing copy would make the entry match other keys, so it must not
+	// be inserted
+	bool complete;
+	if (file) {
+		entry->file = strdup(file);
+		entry->file_stat = *st;
+		complete = entry->file != NULL;
+	} else {
+		entry->rules = rules->rules ? strdup(rules->rules) : NULL;
+		entry->model = rules->model ? strdup(rules->model) : NULL;
+		entry->layout = rules->layout ? strdup(rules->layout) : NULL;
+		entry->variant = rules->variant ? strdup(rules->variant) : NULL;
+		entry->options = rules->options ? strdup(rules->options) : NULL;
+		complete = !rules->rules == !entry->rules &&
+			!rules->model == !entry->model &&
+			!rules->layout == !entry->layout &&
+			!rules->variant == !entry->variant &&
+			!rules->options == !entry->options;
+	}
+	if (!complete) {
+		sway_log(SWAY_ERROR, "Unable to allocate keymap cache entry");
+		keymap_cache_entry_destroy(entry);
+		return;
+	}
+	entry->last_used = ++keymap_cache.clock;
+
+	if (keymap_cache.entries->length >= KEYMAP_CACHE_SIZE) {
+		int lru = 0;
+		for (int i = 1; i < keymap_cache.entries->length; ++i) {
+			struct keymap_cache_entry *other = keymap_cache.entries->items[i];
+			struct keymap_cache_entry *oldest =
+				keymap_cache.entries->items[lru];
+			if (other->last_used < oldest->last_used) {
+				lru = i;
+			}
+		}
+		keymap_cache_entry_destroy(keymap_cache.entries->items[lru]);
+		list_del(keymap_cache.entries, lru);
+	}
+	list_add(keymap_cache.entries, entry);
+}
+
 struct xkb_keymap *sway_keyboard_compile_keymap(struct input_config *ic,
 		char **error) {
-	struct xkb_context *context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
-	if (!sway_assert(context, "cannot create XKB context")) {
-		return NULL;
+	if (!keymap_cache.context) {
+		keymap_cache.context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+		if (!sway_assert(keymap_cache.context, "cannot create XKB context")) {
+			return NULL;
+		}
+		xkb_context_set_log_fn(keymap_cache.context, handle_xkb_context_log);
+		keymap_cache.entries = create_list();
 	}
+	struct xkb_context *context = keymap_cache.context;
+	struct timespec start;
+	profile_begin(PROFILE_KEYMAP_COMPILE, &start);
 	xkb_context_set_user_data(context, error);
-	xkb_context_set_log_fn(context, handle_xkb_context_log);
 
 	struct xkb_keymap *keymap = NULL;
 
@@ -786,8 +923,18 @@ struct xkb_keymap *sway_keyboard_compile_keymap(struct input_config *ic,
 			goto cleanup;
 		}
 
-		keymap = xkb_keymap_new_from_file(context, keymap_file,
-					XKB_KEYMAP_FORMAT_TEXT_V1, XKB_KEYMAP_COMPILE_NO_FLAGS);
+		struct stat st;
+		bool cacheable = fstat(fileno(keymap_file), &st) == 0;
+		if (cacheable) {
+			keymap = keymap_cache_get(ic->xkb_file, &st, NULL);
+		}
+		if (!keymap) {
+			keymap = xkb_keymap_new_from_file(context, keymap_file,
+						XKB_KEYMAP_FORMAT_TEXT_V1, XKB_KEYMAP_COMPILE_NO_FLAGS);
+			if (keymap && cacheable) {
+				keymap_cache_add(ic->xkb_file, &st, NULL, keymap);
+			}
+		}
 
 		if (fclose(keymap_file) != 0) {
 			sway_log_errno(SWAY_ERROR, "Failed to close xkb file %s",
@@ -798,16 +945,30 @@ struct xkb_keymap *sway_keyboard_compile_keymap(struct input_config *ic,
 		if (ic) {
 			input_config_fill_rule_names(ic, &rules);
 		}
-		keymap = xkb_keymap_new_from_names(context, &rules,
-			XKB_KEYMAP_COMPILE_NO_FLAGS);
+		keymap = keymap_cache_get(NULL, NULL, &rules);
+		if (!keymap) {
+			keymap = xkb_keymap_new_from_names(context, &rules,
+				XKB_KEYMAP_COMPILE_NO_FLAGS);
+			if (keymap) {
+				keymap_cache_add(NULL, NULL, &rules, keymap);
+			}
+		}
 	}
 
 cleanup:
 	xkb_context_set_user_data(context, NULL);
-	xkb_context_unref(context);
+	profile_end(PROFILE_KEYMAP_COMPILE, &start);
 	return keymap;
 }
 
+/**
+ * Keymaps from the cache are shared, so identical ones are usually the same
+ * object and don't need to be serialized to be compared.
+ */
+static bool keymaps_match(struct xkb_keymap *km1, struct xkb_keymap *km2) {
+	return km1 == km2 || wlr_keyboard_keymaps_match(km1, km2);
+}
+
 static bool repeat_info_match(struct sway_keyboard *a, struct wlr_keyboard *b) {
 	return a->repeat_rate == b->repeat_info.rate &&
 		a->repeat_delay == b->repeat_info.delay;
@@ -869,7 +1030,7 @@ static void sway_keyboard_group_remove_invalid(struct sway_keyboard *keyboard) {
 	case KEYBOARD_GROUP_DEFAULT: /* fallthrough */
 	case KEYBOARD_GROUP_SMART:;
 		struct wlr_keyboard_group *group = wlr_keyboard->group;
-		if (!wlr_keyboard_keymaps_match(keyboard->keymap, group->keyboard.keymap) ||
+		if (!keymaps_match(keyboard->keymap, group->keyboard.keymap) ||
 				!repeat_info_match(keyboard, &group->keyboard)) {
 			sway_keyboard_group_remove(keyboard);
 		}
@@ -906,7 +1067,7 @@ static void sway_keyboard_group_add(struct sway_keyboard *keyboard) {
 		case KEYBOARD_GROUP_DEFAULT: /* fallthrough */
 		case KEYBOARD_GROUP_SMART:;
 			struct wlr_keyboard_group *wlr_group = group->wlr_group;
-			if (wlr_keyboard_keymaps_match(keyboard->keymap,
+			if (keymaps_match(keyboard->keymap,
 						wlr_group->keyboard.keymap) &&
 					repeat_info_match(keyboard, &wlr_group->keyboard)) {
 				sway_log(SWAY_DEBUG, "Adding keyboard %s to group %p",
@@ -1012,7 +1173,7 @@ void sway_keyboard_configure(struct sway_keyboard *keyboard) {
 	}
 
 	bool keymap_changed = keyboard->keymap ?
-		!wlr_keyboard_keymaps_match(keyboard->keymap, keymap) : true;
+		!keymaps_match(keyboard->keymap, keymap) : true;
 	bool effective_layout_changed = keyboard->effective_layout != 0;
 
 	int repeat_rate = 25;
@@ -1028,6 +1189,7 @@ void sway_keyboard_configure(struct sway_keyboard *keyboard) {
 		keyboard->repeat_delay != repeat_delay;
 
 	if (keymap_changed || repeat_info_changed || config->reloading) {
+		bool same_keymap = keyboard->keymap == keymap;
 		xkb_keymap_unref(keyboard->keymap);
 		keyboard->keymap = keymap;
 		keyboard->effective_layout = 0;
@@ -1036,7 +1198,14 @@ void sway_keyboard_configure(struct sway_keyboard *keyboard) {
 
 		sway_keyboard_group_remove_invalid(keyboard);
 
-		wlr_keyboard_set_keymap(wlr_device->keyboard, keyboard->keymap);
+		if (same_keymap) {
+			// Keep the keymap fd already sent to clients and only reset the
+			// layout and modifiers, as setting the keymap again would
+			// serialize it into a new fd and resend it to every client
+			wlr_keyboard_notify_modifiers(wlr_device->keyboard, 0, 0, 0, 0);
+		} else {
+			wlr_keyboard_set_keymap(wlr_device->keyboard, keyboard->keymap);
+		}
 		wlr_keyboard_set_repeat_info(wlr_device->keyboard,
 				keyboard->repeat_rate, keyboard->repeat_delay);
 
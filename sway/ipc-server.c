@@ -1,9 +1,10 @@
 // See https://i3wm.org/docs/ipc.html for protocol information
-#define _POSIX_C_SOURCE 200112L
+#define _GNU_SOURCE
 #include <linux/input-event-codes.h>
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <json.h>
 #include <stdbool.h>
 #include <stdint.h>
@@ -11,7 +12,6 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
-#include <sys/ioctl.h>
 #include <sys/un.h>
 #include <unistd.h>
 #include <wayland-server-core.h>
@@ -20,7 +20,10 @@
 #include "sway/desktop/transaction.h"
 #include "sway/ipc-json.h"
 #include "sway/ipc-server.h"
+#include "sway/ipc-snapshot.h"
+#include "sway/ipc-stats.h"
 #include "sway/output.h"
+#include "sway/profile.h"
 #include "sway/server.h"
 #include "sway/input/input-manager.h"
 #include "sway/input/keyboard.h"
@@ -28,6 +31,8 @@
 #include "sway/tree/root.h"
 #include "sway/tree/view.h"
 #include "sway/tree/workspace.h"
+#include "cbor.h"
+#include "ipc-snapshot.h"
 #include "list.h"
 #include "log.h"
 #include "util.h"
@@ -42,18 +47,64 @@ static const char ipc_magic[] = {'i', '3', '-', 'i', 'p', 'c'};
 
 #define IPC_HEADER_SIZE (sizeof(ipc_magic) + 8)
 
+// Maximum number of bytes queued for a client before events are dropped and
+// no further requests are read from it
+#define IPC_CLIENT_QUEUE_LIMIT (4 * 1024 * 1024)
+// Maximum number of queued messages handed to a single writev call
+#define IPC_WRITEV_MAX 16
+// Maximum number of requests handled for a client per event loop iteration
+#define IPC_MAX_REQUESTS_PER_DISPATCH 64
+// Minimum free space in the read buffer before receiving from a client
+#define IPC_READ_CHUNK_SIZE 4096
+// Maximum payload length of a request; clients sending larger ones are
+// disconnected before any room is made for them
+#define IPC_MAX_PAYLOAD_SIZE (16 * 1024 * 1024)
+
+/**
+ * Events which are superseded by a later event with the same class and id.
+ * Only the most recent of those is kept in a client's queue, so only events
+ * which carry the complete state they describe can be superseded.
+ */
+enum ipc_supersede_class {
+	IPC_SUPERSEDE_NONE,
+	IPC_SUPERSEDE_WINDOW_TITLE, // keyed by container id
+	IPC_SUPERSEDE_MODE,
+};
+
+struct ipc_message {
+	enum ipc_supersede_class supersede;
+	size_t id;
+	int fd; // sent along with the message, or -1
+	size_t len;
+	char data[]; // header followed by payload
+};
+
 struct ipc_client {
 	struct wl_event_source *event_source;
 	struct wl_event_source *writable_event_source;
+	struct wl_event_source *idle_source;
 	struct sway_server *server;
 	int fd;
+	pid_t pid; // from SO_PEERCRED, or -1
 	enum ipc_command_type subscribed_events;
-	size_t write_buffer_len;
-	size_t write_buffer_size;
-	char *write_buffer;
-	// The following are for storing data between event_loop calls
-	uint32_t pending_length;
-	enum ipc_command_type pending_type;
+	enum ipc_encoding encoding; // of replies and events sent to the client
+	list_t *write_queue; // struct ipc_message
+	size_t write_queue_size; // total length of queued messages
+	size_t write_offset; // bytes of the first queued message already sent
+	uint32_t dropped_events;
+	bool read_paused;
+	// Requests received from the client which have not been handled yet
+	size_t read_buffer_len;
+	size_t read_buffer_size;
+	char *read_buffer;
+	// Set while requests are being handled, disconnecting is deferred
+	bool dispatching;
+	bool disconnect_pending;
+	// Statistics reported by IPC_GET_STATS
+	uint64_t requests;
+	uint64_t bytes_received;
+	uint64_t bytes_sent;
+	uint64_t events_dropped;
 };
 
 struct sockaddr_un *ipc_user_sockaddr(void);
@@ -61,10 +112,14 @@ int ipc_handle_connection(int fd, uint32_t mask, void *data);
 int ipc_client_handle_readable(int client_fd, uint32_t mask, void *data);
 int ipc_client_handle_writable(int client_fd, uint32_t mask, void *data);
 void ipc_client_disconnect(struct ipc_client *client);
-void ipc_client_handle_command(struct ipc_client *client, uint32_t payload_length,
-	enum ipc_command_type payload_type);
-bool ipc_send_reply(struct ipc_client *client, enum ipc_command_type payload_type,
-	const char *payload, uint32_t payload_length);
+void ipc_client_handle_command(struct ipc_client *client,
+	enum ipc_command_type payload_type, char *buf, uint32_t payload_length);
+static bool ipc_send_reply_success(struct ipc_client *client,
+	enum ipc_command_type payload_type, bool success, const char *error);
+static bool ipc_send_reply_json(struct ipc_client *client,
+	enum ipc_command_type payload_type, json_object *json);
+static bool ipc_send_reply_with_fd(struct ipc_client *client,
+	enum ipc_command_type payload_type, json_object *json, int fd);
 
 static void handle_display_destroy(struct wl_listener *listener, void *data) {
 	if (ipc_event_source) {
@@ -77,6 +132,7 @@ static void handle_display_destroy(struct wl_listener *listener, void *data) {
 		ipc_client_disconnect(ipc_client_list->items[ipc_client_list->length-1]);
 	}
 	list_free(ipc_client_list);
+	ipc_snapshot_finish();
 
 	free(ipc_sockaddr);
 
@@ -180,27 +236,138 @@ int ipc_handle_connection(int fd, uint32_t mask, void *data) {
 		return 0;
 	}
 	client->server = server;
-	client->pending_length = 0;
 	client->fd = client_fd;
+	client->pid = -1;
+	struct ucred ucred;
+	socklen_t ucred_size = sizeof(ucred);
+	if (getsockopt(client_fd, SOL_SOCKET, SO_PEERCRED,
+			&ucred, &ucred_size) == 0) {
+		client->pid = ucred.pid;
+	}
 	client->subscribed_events = 0;
+	client->encoding = IPC_ENCODING_JSON;
 	client->event_source = wl_event_loop_add_fd(server->wl_event_loop,
 			client_fd, WL_EVENT_READABLE, ipc_client_handle_readable, client);
 	client->writable_event_source = NULL;
-
-	client->write_buffer_size = 128;
-	client->write_buffer_len = 0;
-	client->write_buffer = malloc(client->write_buffer_size);
-	if (!client->write_buffer) {
-		sway_log(SWAY_ERROR, "Unable to allocate ipc client write buffer");
+	client->idle_source = NULL;
+
+	client->read_buffer_size = IPC_READ_CHUNK_SIZE;
+	client->read_buffer_len = 0;
+	client->read_buffer = malloc(client->read_buffer_size);
+	if (!client->read_buffer) {
+		sway_log(SWAY_ERROR, "Unable to allocate ipc client read buffer");
+		wl_event_source_remove(client->event_source);
 		close(client_fd);
+		free(client);
 		return 0;
 	}
+	client->dispatching = false;
+	client->disconnect_pending = false;
+
+	client->write_queue = create_list();
+	client->write_queue_size = 0;
+	client->write_offset = 0;
+	client->dropped_events = 0;
+	client->read_paused = false;
 
-	sway_log(SWAY_DEBUG, "New client: fd %d", client_fd);
+	client->requests = 0;
+	client->bytes_received = 0;
+	client->bytes_sent = 0;
+	client->events_dropped = 0;
+
+	sway_log(SWAY_DEBUG, "New client: fd %d (pid %d)", client_fd,
+			(int)client->pid);
 	list_add(ipc_client_list, client);
 	return 0;
 }
 
+static void ipc_client_handle_buffered(struct ipc_client *client);
+
+static void handle_client_idle(void *data) {
+	struct ipc_client *client = data;
+	client->idle_source = NULL;
+	ipc_client_handle_buffered(client);
+}
+
+static void ipc_client_schedule_buffered(struct ipc_client *client) {
+	if (!client->idle_source) {
+		client->idle_source = wl_event_loop_add_idle(server.wl_event_loop,
+				handle_client_idle, client);
+	}
+}
+
+/**
+ * Handles the complete requests in the client's read buffer, at most
+ * IPC_MAX_REQUESTS_PER_DISPATCH at a time. Remaining requests are handled in
+ * the next event loop iteration so other clients get their turn.
+ */
+static void ipc_client_handle_buffered(struct ipc_client *client) {
+	size_t offset = 0;
+	int handled = 0;
+	client->dispatching = true;
+	while (!client->read_paused && !client->disconnect_pending) {
+		size_t available = client->read_buffer_len - offset;
+		if (available < IPC_HEADER_SIZE) {
+			break;
+		}
+		char *header = client->read_buffer + offset;
+		if (memcmp(header, ipc_magic, sizeof(ipc_magic)) != 0) {
+			sway_log(SWAY_DEBUG, "IPC header check failed");
+			client->disconnect_pending = true;
+			break;
+		}
+
+		uint32_t payload_length;
+		enum ipc_command_type payload_type;
+		memcpy(&payload_length, header + sizeof(ipc_magic), sizeof(uint32_t));
+		memcpy(&payload_type, header + sizeof(ipc_magic) + sizeof(uint32_t),
+				sizeof(uint32_t));
+		if (payload_length > IPC_MAX_PAYLOAD_SIZE) {
+			sway_log(SWAY_INFO, "Client %d sent a request of %" PRIu32
+					" bytes, disconnecting", client->fd, payload_length);
+			client->disconnect_pending = true;
+			break;
+		}
+		if (available - IPC_HEADER_SIZE < payload_length) {
+			break;
+		}
+
+		if (handled == IPC_MAX_REQUESTS_PER_DISPATCH) {
+			ipc_client_schedule_buffered(client);
+			break;
+		}
+
+		// The read buffer always has room for one more byte, so the payload
+		// can be terminated in place while it is handled
+		char *payload = header + IPC_HEADER_SIZE;
+		char next = payload[payload_length];
+		payload[payload_length] = '\0';
+		struct timespec start;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		ipc_client_handle_command(client, payload_type, payload, payload_length);
+		ipc_stats_request(payload_type, &start);
+		client->requests++;
+		payload[payload_length] = next;
+
+		offset += IPC_HEADER_SIZE + payload_length;
+		++handled;
+	}
+	client->dispatching = false;
+
+	if (handled > 0) {
+		transaction_commit_dirty();
+	}
+
+	if (client->disconnect_pending) {
+		ipc_client_disconnect(client);
+		return;
+	}
+
+	client->read_buffer_len -= offset;
+	memmove(client->read_buffer, client->read_buffer + offset,
+			client->read_buffer_len);
+}
+
 int ipc_client_handle_readable(int client_fd, uint32_t mask, void *data) {
 	struct ipc_client *client = data;
 
@@ -218,55 +385,59 @@ int ipc_client_handle_readable(int client_fd, uint32_t mask, void *data) {
 
 	sway_log(SWAY_DEBUG, "Client %d readable", client->fd);
 
-	int read_available;
-	if (ioctl(client_fd, FIONREAD, &read_available) == -1) {
-		sway_log_errno(SWAY_INFO, "Unable to read IPC socket buffer size");
-		ipc_client_disconnect(client);
-		return 0;
+	// Make room for at least the pending request, plus one byte to terminate
+	// its payload
+	size_t needed = client->read_buffer_len + IPC_READ_CHUNK_SIZE;
+	if (client->read_buffer_len >= IPC_HEADER_SIZE) {
+		uint32_t payload_length;
+		memcpy(&payload_length, client->read_buffer + sizeof(ipc_magic),
+				sizeof(uint32_t));
+		if (payload_length > IPC_MAX_PAYLOAD_SIZE) {
+			sway_log(SWAY_INFO, "Client %d sent a request of %" PRIu32
+					" bytes, disconnecting", client->fd, payload_length);
+			ipc_client_disconnect(client);
+			return 0;
+		}
+		size_t message_length = IPC_HEADER_SIZE + (size_t)payload_length + 1;
+		if (message_length > needed) {
+			needed = message_length;
+		}
 	}
-
-	// Wait for the rest of the command payload in case the header has already been read
-	if (client->pending_length > 0) {
-		if ((uint32_t)read_available >= client->pending_length) {
-			// Reset pending values.
-			uint32_t pending_length = client->pending_length;
-			enum ipc_command_type pending_type = client->pending_type;
-			client->pending_length = 0;
-			ipc_client_handle_command(client, pending_length, pending_type);
+	if (needed > client->read_buffer_size) {
+		size_t size = client->read_buffer_size;
+		while (size < needed) {
+			size *= 2;
 		}
-		return 0;
+		char *new_buffer = realloc(client->read_buffer, size);
+		if (!new_buffer) {
+			sway_log(SWAY_ERROR, "Unable to reallocate ipc client read buffer");
+			ipc_client_disconnect(client);
+			return 0;
+		}
+		client->read_buffer = new_buffer;
+		client->read_buffer_size = size;
 	}
 
-	if (read_available < (int) IPC_HEADER_SIZE) {
+	ssize_t received = recv(client_fd,
+			client->read_buffer + client->read_buffer_len,
+			client->read_buffer_size - client->read_buffer_len - 1, 0);
+	if (received == -1 && (errno == EAGAIN || errno == EINTR)) {
 		return 0;
-	}
-
-	uint8_t buf[IPC_HEADER_SIZE];
-	// Should be fully available, because read_available >= IPC_HEADER_SIZE
-	ssize_t received = recv(client_fd, buf, IPC_HEADER_SIZE, 0);
-	if (received == -1) {
-		sway_log_errno(SWAY_INFO, "Unable to receive header from IPC client");
+	} else if (received == -1) {
+		sway_log_errno(SWAY_INFO, "Unable to receive data from IPC client");
 		ipc_client_disconnect(client);
 		return 0;
-	}
-
-	if (memcmp(buf, ipc_magic, sizeof(ipc_magic)) != 0) {
-		sway_log(SWAY_DEBUG, "IPC header check failed");
+	} else if (received == 0) {
+		sway_log(SWAY_DEBUG, "Client %d hung up", client->fd);
 		ipc_client_disconnect(client);
 		return 0;
 	}
+	client->read_buffer_len += received;
+	client->bytes_received += received;
 
-	memcpy(&client->pending_length, buf + sizeof(ipc_magic), sizeof(uint32_t));
-	memcpy(&client->pending_type, buf + sizeof(ipc_magic) + sizeof(uint32_t), sizeof(uint32_t));
-
-	if (read_available - received >= (long)client->pending_length) {
-		// Reset pending values.
-		uint32_t pending_length = client->pending_length;
-		enum ipc_command_type pending_type = client->pending_type;
-		client->pending_length = 0;
-		ipc_client_handle_command(client, pending_length, pending_type);
+	if (!client->idle_source) {
+		ipc_client_handle_buffered(client);
 	}
-
 	return 0;
 }
 
@@ -280,22 +451,189 @@ static bool ipc_has_event_listeners(enum ipc_command_type event) {
 	return false;
 }
 
-static void ipc_send_event(const char *json_string, enum ipc_command_type event) {
+static enum ipc_supersede_class ipc_event_supersede_class(
+		enum ipc_command_type event, const char *change) {
+	switch (event) {
+	case IPC_EVENT_WINDOW:
+		return strcmp(change, "title") == 0 ?
+			IPC_SUPERSEDE_WINDOW_TITLE : IPC_SUPERSEDE_NONE;
+	case IPC_EVENT_MODE:
+		return IPC_SUPERSEDE_MODE;
+	default:
+		return IPC_SUPERSEDE_NONE;
+	}
+}
+
+static void ipc_message_destroy(struct ipc_message *msg) {
+	if (msg->fd != -1) {
+		close(msg->fd);
+	}
+	free(msg);
+}
+
+static bool ipc_client_queue_message(struct ipc_client *client,
+		enum ipc_command_type payload_type, const char *payload,
+		uint32_t payload_length, enum ipc_supersede_class supersede,
+		size_t id) {
+	struct ipc_message *msg =
+		malloc(sizeof(struct ipc_message) + IPC_HEADER_SIZE + payload_length);
+	if (!msg) {
+		sway_log(SWAY_ERROR, "Unable to allocate ipc client message");
+		ipc_client_disconnect(client);
+		return false;
+	}
+	msg->supersede = supersede;
+	msg->id = id;
+	msg->fd = -1;
+	msg->len = IPC_HEADER_SIZE + payload_length;
+
+	memcpy(msg->data, ipc_magic, sizeof(ipc_magic));
+	memcpy(msg->data + sizeof(ipc_magic), &payload_length, sizeof(payload_length));
+	memcpy(msg->data + sizeof(ipc_magic) + sizeof(payload_length),
+		&payload_type, sizeof(payload_type));
+	memcpy(msg->data + IPC_HEADER_SIZE, payload, payload_length);
+
+	list_add(client->write_queue, msg);
+	client->write_queue_size += msg->len;
+
+	if (!client->writable_event_source) {
+		client->writable_event_source = wl_event_loop_add_fd(
+				server.wl_event_loop, client->fd, WL_EVENT_WRITABLE,
+				ipc_client_handle_writable, client);
+	}
+	return true;
+}
+
+static bool ipc_send_event_to_client(struct ipc_client *client,
+		enum ipc_command_type event, const char *payload,
+		uint32_t payload_length, enum ipc_supersede_class supersede,
+		size_t id) {
+	// Find the queued event this one supersedes, if any. It is only removed
+	// once this one is known to fit, so a dropped event never takes the
+	// state it replaces with it.
+	int superseded = -1;
+	size_t freed = 0;
+	if (supersede != IPC_SUPERSEDE_NONE) {
+		// The first message may already be partially sent
+		int start = client->write_offset > 0 ? 1 : 0;
+		for (int i = start; i < client->write_queue->length; ++i) {
+			struct ipc_message *msg = client->write_queue->items[i];
+			if (msg->supersede == supersede && msg->id == id) {
+				superseded = i;
+				freed = msg->len;
+				break;
+			}
+		}
+	}
+
+	// Once the queue has overflowed, every event is dropped until the
+	// client has read half of it and been told how many it missed
+	if (client->dropped_events > 0 || client->write_queue_size - freed +
+			IPC_HEADER_SIZE + payload_length > IPC_CLIENT_QUEUE_LIMIT) {
+		if (client->dropped_events++ == 0) {
+			sway_log(SWAY_INFO, "Client %d write queue full (%zu), "
+					"dropping events", client->fd, client->write_queue_size);
+		}
+		client->events_dropped++;
+		ipc_stats_event_delivery(event, IPC_STATS_DROPPED);
+		return true;
+	}
+
+	if (superseded != -1) {
+		struct ipc_message *msg = client->write_queue->items[superseded];
+		client->write_queue_size -= msg->len;
+		list_del(client->write_queue, superseded);
+		ipc_message_destroy(msg);
+		ipc_stats_event_delivery(event, IPC_STATS_SUPERSEDED);
+	}
+
+	if (!ipc_client_queue_message(client, event, payload, payload_length,
+			supersede, id)) {
+		return false;
+	}
+	ipc_stats_event_delivery(event, IPC_STATS_QUEUED);
+	return true;
+}
+
+static bool ipc_client_queue_json(struct ipc_client *client,
+		enum ipc_command_type payload_type, json_object *json,
+		enum ipc_supersede_class supersede, size_t id) {
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (client->encoding == IPC_ENCODING_CBOR) {
+		size_t length;
+		char *cbor = cbor_encode_json(json, &length);
+		if (!cbor) {
+			sway_log(SWAY_ERROR, "Unable to encode ipc client message");
+			ipc_client_disconnect(client);
+			return false;
+		}
+		ipc_stats_serialization(&start, length);
+		bool queued = ipc_client_queue_message(client, payload_type, cbor,
+				(uint32_t)length, supersede, id);
+		free(cbor);
+		return queued;
+	}
+	const char *json_string = json_object_to_json_string(json);
+	size_t length = strlen(json_string);
+	ipc_stats_serialization(&start, length);
+	return ipc_client_queue_message(client, payload_type, json_string,
+			(uint32_t)length, supersede, id);
+}
+
+static void ipc_send_event(json_object *json, enum ipc_command_type event,
+		const char *change, size_t id) {
+	enum ipc_supersede_class supersede = change ?
+		ipc_event_supersede_class(event, change) : IPC_SUPERSEDE_NONE;
+	ipc_stats_event(event);
+	// Each encoding is generated at most once and shared by all clients
+	const char *json_string = NULL;
+	uint32_t json_length = 0;
+	char *cbor = NULL;
+	size_t cbor_length = 0;
 	struct ipc_client *client;
 	for (int i = 0; i < ipc_client_list->length; i++) {
 		client = ipc_client_list->items[i];
 		if ((client->subscribed_events & event_mask(event)) == 0) {
 			continue;
 		}
-		if (!ipc_send_reply(client, event, json_string,
-				(uint32_t)strlen(json_string))) {
+		const char *payload;
+		uint32_t length;
+		struct timespec start;
+		if (client->encoding == IPC_ENCODING_CBOR) {
+			if (!cbor) {
+				clock_gettime(CLOCK_MONOTONIC, &start);
+				if (!(cbor = cbor_encode_json(json, &cbor_length))) {
+					sway_log(SWAY_ERROR, "Unable to encode ipc event");
+					continue;
+				}
+				ipc_stats_serialization(&start, cbor_length);
+			}
+			payload = cbor;
+			length = (uint32_t)cbor_length;
+		} else {
+			if (!json_string) {
+				clock_gettime(CLOCK_MONOTONIC, &start);
+				json_string = json_object_to_json_string(json);
+				json_length = (uint32_t)strlen(json_string);
+				ipc_stats_serialization(&start, json_length);
+			}
+			payload = json_string;
+			length = json_length;
+		}
+		if (!ipc_send_event_to_client(client, event, payload, length,
+				supersede, id)) {
 			sway_log_errno(SWAY_INFO, "Unable to send reply to IPC client");
-			/* ipc_send_reply destroys client on error, which also
+			/* ipc_send_event_to_client destroys client on error, which also
 			 * removes it from the list, so we need to process
-			 * current index again */
-			i--;
+			 * current index again, unless the disconnect was deferred */
+			if (i >= ipc_client_list->length ||
+					ipc_client_list->items[i] != client) {
+				i--;
+			}
 		}
 	}
+	free(cbor);
 }
 
 void ipc_event_workspace(struct sway_workspace *old,
@@ -320,8 +658,7 @@ void ipc_event_workspace(struct sway_workspace *old,
 		json_object_object_add(obj, "current", NULL);
 	}
 
-	const char *json_string = json_object_to_json_string(obj);
-	ipc_send_event(json_string, IPC_EVENT_WORKSPACE);
+	ipc_send_event(obj, IPC_EVENT_WORKSPACE, change, 0);
 	json_object_put(obj);
 }
 
@@ -335,8 +672,7 @@ void ipc_event_window(struct sway_container *window, const char *change) {
 	json_object_object_add(obj, "container",
 			ipc_json_describe_node_recursive(&window->node));
 
-	const char *json_string = json_object_to_json_string(obj);
-	ipc_send_event(json_string, IPC_EVENT_WINDOW);
+	ipc_send_event(obj, IPC_EVENT_WINDOW, change, window->node.id);
 	json_object_put(obj);
 }
 
@@ -347,8 +683,7 @@ void ipc_event_barconfig_update(struct bar_config *bar) {
 	sway_log(SWAY_DEBUG, "Sending barconfig_update event");
 	json_object *json = ipc_json_describe_bar_config(bar);
 
-	const char *json_string = json_object_to_json_string(json);
-	ipc_send_event(json_string, IPC_EVENT_BARCONFIG_UPDATE);
+	ipc_send_event(json, IPC_EVENT_BARCONFIG_UPDATE, NULL, 0);
 	json_object_put(json);
 }
 
@@ -363,8 +698,7 @@ void ipc_event_bar_state_update(struct bar_config *bar) {
 	json_object_object_add(json, "visible_by_modifier",
 			json_object_new_boolean(bar->visible_by_modifier));
 
-	const char *json_string = json_object_to_json_string(json);
-	ipc_send_event(json_string, IPC_EVENT_BAR_STATE_UPDATE);
+	ipc_send_event(json, IPC_EVENT_BAR_STATE_UPDATE, NULL, 0);
 	json_object_put(json);
 }
 
@@ -378,8 +712,7 @@ void ipc_event_mode(const char *mode, bool pango) {
 	json_object_object_add(obj, "pango_markup",
 			json_object_new_boolean(pango));
 
-	const char *json_string = json_object_to_json_string(obj);
-	ipc_send_event(json_string, IPC_EVENT_MODE);
+	ipc_send_event(obj, IPC_EVENT_MODE, mode, 0);
 	json_object_put(obj);
 }
 
@@ -392,8 +725,7 @@ void ipc_event_shutdown(const char *reason) {
 	json_object *json = json_object_new_object();
 	json_object_object_add(json, "change", json_object_new_string(reason));
 
-	const char *json_string = json_object_to_json_string(json);
-	ipc_send_event(json_string, IPC_EVENT_SHUTDOWN);
+	ipc_send_event(json, IPC_EVENT_SHUTDOWN, NULL, 0);
 	json_object_put(json);
 }
 
@@ -478,8 +810,7 @@ void ipc_event_binding(struct sway_binding *binding) {
 	json_object *json = json_object_new_object();
 	json_object_object_add(json, "change", json_object_new_string("run"));
 	json_object_object_add(json, "binding", json_binding);
-	const char *json_string = json_object_to_json_string(json);
-	ipc_send_event(json_string, IPC_EVENT_BINDING);
+	ipc_send_event(json, IPC_EVENT_BINDING, NULL, 0);
 	json_object_put(json);
 }
 
@@ -493,8 +824,7 @@ static void ipc_event_tick(const char *payload) {
 	json_object_object_add(json, "first", json_object_new_boolean(false));
 	json_object_object_add(json, "payload", json_object_new_string(payload));
 
-	const char *json_string = json_object_to_json_string(json);
-	ipc_send_event(json_string, IPC_EVENT_TICK);
+	ipc_send_event(json, IPC_EVENT_TICK, NULL, 0);
 	json_object_put(json);
 }
 
@@ -508,11 +838,33 @@ void ipc_event_input(const char *change, struct sway_input_device *device) {
 	json_object_object_add(json, "change", json_object_new_string(change));
 	json_object_object_add(json, "input", ipc_json_describe_input(device));
 
-	const char *json_string = json_object_to_json_string(json);
-	ipc_send_event(json_string, IPC_EVENT_INPUT);
+	ipc_send_event(json, IPC_EVENT_INPUT, NULL, 0);
 	json_object_put(json);
 }
 
+static bool ipc_client_flush_dropped_events(struct ipc_client *client) {
+	sway_log(SWAY_INFO, "Client %d dropped %u events", client->fd,
+			client->dropped_events);
+	uint32_t dropped_events = client->dropped_events;
+	client->dropped_events = 0;
+	if ((client->subscribed_events & event_mask(IPC_EVENT_OVERFLOW)) == 0) {
+		return true;
+	}
+
+	json_object *json = json_object_new_object();
+	json_object_object_add(json, "change", json_object_new_string("dropped"));
+	json_object_object_add(json, "dropped_events",
+			json_object_new_int64(dropped_events));
+	ipc_stats_event(IPC_EVENT_OVERFLOW);
+	bool queued = ipc_client_queue_json(client, IPC_EVENT_OVERFLOW, json,
+			IPC_SUPERSEDE_NONE, 0);
+	if (queued) {
+		ipc_stats_event_delivery(IPC_EVENT_OVERFLOW, IPC_STATS_QUEUED);
+	}
+	json_object_put(json);
+	return queued;
+}
+
 int ipc_client_handle_writable(int client_fd, uint32_t mask, void *data) {
 	struct ipc_client *client = data;
 
@@ -528,13 +880,47 @@ int ipc_client_handle_writable(int client_fd, uint32_t mask, void *data) {
 		return 0;
 	}
 
-	if (client->write_buffer_len <= 0) {
+	if (client->write_queue->length == 0) {
 		return 0;
 	}
 
 	sway_log(SWAY_DEBUG, "Client %d writable", client->fd);
 
-	ssize_t written = write(client->fd, client->write_buffer, client->write_buffer_len);
+	struct iovec iov[IPC_WRITEV_MAX];
+	int iovcnt = 0;
+	int fd = -1;
+	while (iovcnt < client->write_queue->length && iovcnt < IPC_WRITEV_MAX) {
+		struct ipc_message *msg = client->write_queue->items[iovcnt];
+		if (msg->fd != -1) {
+			// The fd is sent along with the first byte of its message
+			if (iovcnt > 0) {
+				break;
+			}
+			fd = msg->fd;
+		}
+		size_t offset = iovcnt == 0 ? client->write_offset : 0;
+		iov[iovcnt].iov_base = msg->data + offset;
+		iov[iovcnt].iov_len = msg->len - offset;
+		++iovcnt;
+	}
+
+	struct msghdr msghdr = {
+		.msg_iov = iov,
+		.msg_iovlen = iovcnt,
+	};
+	char control[CMSG_SPACE(sizeof(int))];
+	if (fd != -1) {
+		memset(control, 0, sizeof(control));
+		msghdr.msg_control = control;
+		msghdr.msg_controllen = sizeof(control);
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msghdr);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+	}
+
+	ssize_t written = sendmsg(client->fd, &msghdr, 0);
 
 	if (written == -1 && errno == EAGAIN) {
 		return 0;
@@ -544,10 +930,42 @@ int ipc_client_handle_writable(int client_fd, uint32_t mask, void *data) {
 		return 0;
 	}
 
-	memmove(client->write_buffer, client->write_buffer + written, client->write_buffer_len - written);
-	client->write_buffer_len -= written;
+	client->bytes_sent += written;
 
-	if (client->write_buffer_len == 0 && client->writable_event_source) {
+	if (fd != -1) {
+		struct ipc_message *msg = client->write_queue->items[0];
+		close(msg->fd);
+		msg->fd = -1;
+	}
+
+	size_t sent = client->write_offset + written;
+	client->write_offset = 0;
+	while (client->write_queue->length > 0) {
+		struct ipc_message *msg = client->write_queue->items[0];
+		if (sent < msg->len) {
+			client->write_offset = sent;
+			break;
+		}
+		sent -= msg->len;
+		client->write_queue_size -= msg->len;
+		list_del(client->write_queue, 0);
+		ipc_message_destroy(msg);
+	}
+
+	if (client->write_queue_size <= IPC_CLIENT_QUEUE_LIMIT / 2) {
+		if (client->dropped_events > 0 &&
+				!ipc_client_flush_dropped_events(client)) {
+			return 0;
+		}
+		if (client->read_paused) {
+			sway_log(SWAY_DEBUG, "Resuming reads from client %d", client->fd);
+			wl_event_source_fd_update(client->event_source, WL_EVENT_READABLE);
+			client->read_paused = false;
+			ipc_client_schedule_buffered(client);
+		}
+	}
+
+	if (client->write_queue->length == 0 && client->writable_event_source) {
 		wl_event_source_remove(client->writable_event_source);
 		client->writable_event_source = NULL;
 	}
@@ -560,6 +978,11 @@ void ipc_client_disconnect(struct ipc_client *client) {
 		return;
 	}
 
+	if (client->dispatching) {
+		client->disconnect_pending = true;
+		return;
+	}
+
 	shutdown(client->fd, SHUT_RDWR);
 
 	sway_log(SWAY_INFO, "IPC Client %d disconnected", client->fd);
@@ -567,12 +990,19 @@ void ipc_client_disconnect(struct ipc_client *client) {
 	if (client->writable_event_source) {
 		wl_event_source_remove(client->writable_event_source);
 	}
+	if (client->idle_source) {
+		wl_event_source_remove(client->idle_source);
+	}
 	int i = 0;
 	while (i < ipc_client_list->length && ipc_client_list->items[i] != client) {
 		i++;
 	}
 	list_del(ipc_client_list, i);
-	free(client->write_buffer);
+	for (int i = 0; i < client->write_queue->length; ++i) {
+		ipc_message_destroy(client->write_queue->items[i]);
+	}
+	list_free(client->write_queue);
+	free(client->read_buffer);
 	close(client->fd);
 	free(client);
 }
@@ -604,31 +1034,16 @@ static void ipc_get_marks_callback(struct sway_container *con, void *data) {
 	}
 }
 
-void ipc_client_handle_command(struct ipc_client *client, uint32_t payload_length,
-		enum ipc_command_type payload_type) {
+static void ipc_get_log_callback(const char *line, void *data) {
+	json_object_array_add((json_object *)data, json_object_new_string(line));
+}
+
+void ipc_client_handle_command(struct ipc_client *client,
+		enum ipc_command_type payload_type, char *buf, uint32_t payload_length) {
 	if (!sway_assert(client != NULL, "client != NULL")) {
 		return;
 	}
 
-	char *buf = malloc(payload_length + 1);
-	if (!buf) {
-		sway_log_errno(SWAY_INFO, "Unable to allocate IPC payload");
-		ipc_client_disconnect(client);
-		return;
-	}
-	if (payload_length > 0) {
-		// Payload should be fully available
-		ssize_t received = recv(client->fd, buf, payload_length, 0);
-		if (received == -1)
-		{
-			sway_log_errno(SWAY_INFO, "Unable to receive payload from IPC client");
-			ipc_client_disconnect(client);
-			free(buf);
-			return;
-		}
-	}
-	buf[payload_length] = '\0';
-
 	switch (payload_type) {
 	case IPC_COMMAND:
 	{
@@ -642,12 +1057,11 @@ void ipc_client_handle_command(struct ipc_client *client, uint32_t payload_lengt
 			line = strtok(NULL, "\n");
 		}
 
+		// The transaction is committed once all buffered requests are handled
 		list_t *res_list = execute_command(buf, NULL, NULL);
-		transaction_commit_dirty();
-		char *json = cmd_results_to_json(res_list);
-		int length = strlen(json);
-		ipc_send_reply(client, payload_type, json, (uint32_t)length);
-		free(json);
+		json_object *json = cmd_results_to_json_array(res_list);
+		ipc_send_reply_json(client, payload_type, json);
+		json_object_put(json);
 		while (res_list->length) {
 			struct cmd_results *results = res_list->items[0];
 			free_cmd_results(results);
@@ -657,10 +1071,148 @@ void ipc_client_handle_command(struct ipc_client *client, uint32_t payload_lengt
 		goto exit_cleanup;
 	}
 
+	case IPC_COMMAND_BATCH:
+	{
+		// Each command is run on its own, but the resulting changes are
+		// committed together with the rest of this batch of requests
+		json_object *request = json_tokener_parse(buf);
+		if (request == NULL || !json_object_is_type(request, json_type_array)) {
+			json_object *json = json_object_new_object();
+			json_object_object_add(json, "success",
+					json_object_new_boolean(false));
+			json_object_object_add(json, "parse_error",
+					json_object_new_boolean(true));
+			json_object_object_add(json, "error", json_object_new_string(
+					"Expected a JSON array of commands"));
+			ipc_send_reply_json(client, payload_type, json);
+			json_object_put(json);
+			json_object_put(request);
+			goto exit_cleanup;
+		}
+
+		json_object *replies = json_object_new_array();
+		for (size_t i = 0; i < json_object_array_length(request); i++) {
+			json_object *command = json_object_array_get_idx(request, i);
+			list_t *res_list = create_list();
+			if (json_object_is_type(command, json_type_string)) {
+				list_t *command_results = execute_command(
+						(char *)json_object_get_string(command), NULL, NULL);
+				if (command_results) {
+					list_free(res_list);
+					res_list = command_results;
+				}
+			} else {
+				list_add(res_list, cmd_results_new(CMD_INVALID,
+						"Expected a command string"));
+			}
+			json_object_array_add(replies, cmd_results_to_json_array(res_list));
+			while (res_list->length) {
+				struct cmd_results *results = res_list->items[0];
+				free_cmd_results(results);
+				list_del(res_list, 0);
+			}
+			list_free(res_list);
+		}
+		json_object_put(request);
+
+		ipc_send_reply_json(client, payload_type, replies);
+		json_object_put(replies);
+		goto exit_cleanup;
+	}
+
+	case IPC_GET_SNAPSHOT:
+	{
+		int snapshot_fd = ipc_snapshot_get_fd();
+		int fd = snapshot_fd == -1 ? -1 :
+			fcntl(snapshot_fd, F_DUPFD_CLOEXEC, 0);
+		if (fd == -1) {
+			ipc_send_reply_success(client, payload_type, false,
+					"Unable to create snapshot");
+			goto exit_cleanup;
+		}
+		json_object *json = json_object_new_object();
+		json_object_object_add(json, "success", json_object_new_boolean(true));
+		json_object_object_add(json, "version",
+				json_object_new_int(IPC_SNAPSHOT_VERSION));
+		ipc_send_reply_with_fd(client, payload_type, json, fd);
+		json_object_put(json);
+		goto exit_cleanup;
+	}
+
+	case IPC_SET_ENCODING:
+	{
+		enum ipc_encoding encoding;
+		if (strcmp(buf, "json") == 0) {
+			encoding = IPC_ENCODING_JSON;
+		} else if (strcmp(buf, "cbor") == 0) {
+			encoding = IPC_ENCODING_CBOR;
+		} else {
+			ipc_send_reply_success(client, payload_type, false,
+					"Unknown encoding");
+			goto exit_cleanup;
+		}
+		// The reply still uses the previous encoding
+		if (ipc_send_reply_success(client, payload_type, true, NULL)) {
+			client->encoding = encoding;
+		}
+		goto exit_cleanup;
+	}
+
+	case IPC_GET_STATS:
+	{
+		json_object *stats = ipc_stats_describe();
+		json_object *clients = json_object_new_array();
+		for (int i = 0; i < ipc_client_list->length; ++i) {
+			struct ipc_client *c = ipc_client_list->items[i];
+			json_object *client_json = json_object_new_object();
+			json_object_object_add(client_json, "fd",
+					json_object_new_int(c->fd));
+			json_object_object_add(client_json, "pid",
+					json_object_new_int(c->pid));
+			json_object_object_add(client_json, "encoding",
+					json_object_new_string(c->encoding == IPC_ENCODING_CBOR ?
+						"cbor" : "json"));
+			json_object_object_add(client_json, "requests",
+					json_object_new_int64(c->requests));
+			json_object_object_add(client_json, "bytes_received",
+					json_object_new_int64(c->bytes_received));
+			json_object_object_add(client_json, "bytes_sent",
+					json_object_new_int64(c->bytes_sent));
+			json_object_object_add(client_json, "bytes_queued",
+					json_object_new_int64(c->write_queue_size));
+			json_object_object_add(client_json, "messages_queued",
+					json_object_new_int(c->write_queue->length));
+			json_object_object_add(client_json, "events_dropped",
+					json_object_new_int64(c->events_dropped));
+			json_object_array_add(clients, client_json);
+		}
+		json_object_object_add(stats, "clients", clients);
+		ipc_send_reply_json(client, payload_type, stats);
+		json_object_put(stats);
+		goto exit_cleanup;
+	}
+
+	case IPC_GET_LOG:
+	{
+		json_object *lines = json_object_new_array();
+		sway_log_recorder_for_each(ipc_get_log_callback, lines);
+		ipc_send_reply_json(client, payload_type, lines);
+		json_object_put(lines);
+		goto exit_cleanup;
+	}
+
+	case IPC_GET_PROFILE:
+	{
+		json_object *profile = profile_describe();
+		ipc_send_reply_json(client, payload_type, profile);
+		json_object_put(profile);
+		goto exit_cleanup;
+	}
+
 	case IPC_SEND_TICK:
 	{
 		ipc_event_tick(buf);
-		ipc_send_reply(client, payload_type, "{\"success\": true}", 17);
+		ipc_send_reply_success(client, payload_type, true, NULL);
 		goto exit_cleanup;
 	}
 
@@ -692,9 +1244,7 @@ void ipc_client_handle_command(struct ipc_client *client, uint32_t payload_lengt
 						ipc_json_describe_disabled_output(output));
 			}
 		}
-		const char *json_string = json_object_to_json_string(outputs);
-		ipc_send_reply(client, payload_type, json_string,
-			(uint32_t)strlen(json_string));
+		ipc_send_reply_json(client, payload_type, outputs);
 		json_object_put(outputs); // free
 		goto exit_cleanup;
 	}
@@ -703,9 +1253,7 @@ void ipc_client_handle_command(struct ipc_client *client, uint32_t payload_lengt
 	{
 		json_object *workspaces = json_object_new_array();
 		root_for_each_workspace(ipc_get_workspaces_callback, workspaces);
-		const char *json_string = json_object_to_json_string(workspaces);
-		ipc_send_reply(client, payload_type, json_string,
-			(uint32_t)strlen(json_string));
+		ipc_send_reply_json(client, payload_type, workspaces);
 		json_object_put(workspaces); // free
 		goto exit_cleanup;
 	}
@@ -715,8 +1263,7 @@ void ipc_client_handle_command(struct ipc_client *client, uint32_t payload_lengt
 		// TODO: Check if they're permitted to use these events
 		struct json_object *request = json_tokener_parse(buf);
 		if (request == NULL || !json_object_is_type(request, json_type_array)) {
-			const char msg[] = "{\"success\": false}";
-			ipc_send_reply(client, payload_type, msg, strlen(msg));
+			ipc_send_reply_success(client, payload_type, false, NULL);
 			sway_log(SWAY_INFO, "Failed to parse subscribe request");
 			goto exit_cleanup;
 		}
@@ -744,9 +1291,10 @@ void ipc_client_handle_command(struct ipc_client *client, uint32_t payload_lengt
 				is_tick = true;
 			} else if (strcmp(event_type, "input") == 0) {
 				client->subscribed_events |= event_mask(IPC_EVENT_INPUT);
+			} else if (strcmp(event_type, "overflow") == 0) {
+				client->subscribed_events |= event_mask(IPC_EVENT_OVERFLOW);
 			} else {
-				const char msg[] = "{\"success\": false}";
-				ipc_send_reply(client, payload_type, msg, strlen(msg));
+				ipc_send_reply_success(client, payload_type, false, NULL);
 				json_object_put(request);
 				sway_log(SWAY_INFO, "Unsupported event type in subscribe request");
 				goto exit_cleanup;
@@ -754,12 +1302,13 @@ void ipc_client_handle_command(struct ipc_client *client, uint32_t payload_lengt
 		}
 
 		json_object_put(request);
-		const char msg[] = "{\"success\": true}";
-		ipc_send_reply(client, payload_type, msg, strlen(msg));
+		ipc_send_reply_success(client, payload_type, true, NULL);
 		if (is_tick) {
-			const char tickmsg[] = "{\"first\": true, \"payload\": \"\"}";
-			ipc_send_reply(client, IPC_EVENT_TICK, tickmsg,
-				strlen(tickmsg));
+			json_object *tick = json_object_new_object();
+			json_object_object_add(tick, "first", json_object_new_boolean(true));
+			json_object_object_add(tick, "payload", json_object_new_string(""));
+			ipc_send_reply_json(client, IPC_EVENT_TICK, tick);
+			json_object_put(tick);
 		}
 		goto exit_cleanup;
 	}
@@ -771,9 +1320,7 @@ void ipc_client_handle_command(struct ipc_client *client, uint32_t payload_lengt
 		wl_list_for_each(device, &server.input->devices, link) {
 			json_object_array_add(inputs, ipc_json_describe_input(device));
 		}
-		const char *json_string = json_object_to_json_string(inputs);
-		ipc_send_reply(client, payload_type, json_string,
-			(uint32_t)strlen(json_string));
+		ipc_send_reply_json(client, payload_type, inputs);
 		json_object_put(inputs); // free
 		goto exit_cleanup;
 	}
@@ -785,9 +1332,7 @@ void ipc_client_handle_command(struct ipc_client *client, uint32_t payload_lengt
 		wl_list_for_each(seat, &server.input->seats, link) {
 			json_object_array_add(seats, ipc_json_describe_seat(seat));
 		}
-		const char *json_string = json_object_to_json_string(seats);
-		ipc_send_reply(client, payload_type, json_string,
-			(uint32_t)strlen(json_string));
+		ipc_send_reply_json(client, payload_type, seats);
 		json_object_put(seats); // free
 		goto exit_cleanup;
 	}
@@ -795,9 +1340,7 @@ void ipc_client_handle_command(struct ipc_client *client, uint32_t payload_lengt
 	case IPC_GET_TREE:
 	{
 		json_object *tree = ipc_json_describe_node_recursive(&root->node);
-		const char *json_string = json_object_to_json_string(tree);
-		ipc_send_reply(client, payload_type, json_string,
-			(uint32_t)strlen(json_string));
+		ipc_send_reply_json(client, payload_type, tree);
 		json_object_put(tree);
 		goto exit_cleanup;
 	}
@@ -806,9 +1349,7 @@ void ipc_client_handle_command(struct ipc_client *client, uint32_t payload_lengt
 	{
 		json_object *marks = json_object_new_array();
 		root_for_each_container(ipc_get_marks_callback, marks);
-		const char *json_string = json_object_to_json_string(marks);
-		ipc_send_reply(client, payload_type, json_string,
-			(uint32_t)strlen(json_string));
+		ipc_send_reply_json(client, payload_type, marks);
 		json_object_put(marks);
 		goto exit_cleanup;
 	}
@@ -816,9 +1357,7 @@ void ipc_client_handle_command(struct ipc_client *client, uint32_t payload_lengt
 	case IPC_GET_VERSION:
 	{
 		json_object *version = ipc_json_get_version();
-		const char *json_string = json_object_to_json_string(version);
-		ipc_send_reply(client, payload_type, json_string,
-			(uint32_t)strlen(json_string));
+		ipc_send_reply_json(client, payload_type, version);
 		json_object_put(version); // free
 		goto exit_cleanup;
 	}
@@ -832,9 +1371,7 @@ void ipc_client_handle_command(struct ipc_client *client, uint32_t payload_lengt
 				struct bar_config *bar = config->bars->items[i];
 				json_object_array_add(bars, json_object_new_string(bar->id));
 			}
-			const char *json_string = json_object_to_json_string(bars);
-			ipc_send_reply(client, payload_type, json_string,
-				(uint32_t)strlen(json_string));
+			ipc_send_reply_json(client, payload_type, bars);
 			json_object_put(bars); // free
 		} else {
 			// Send particular bar's details
@@ -847,15 +1384,12 @@ void ipc_client_handle_command(struct ipc_client *client, uint32_t payload_lengt
 				bar = NULL;
 			}
 			if (!bar) {
-				const char *error = "{ \"success\": false, \"error\": \"No bar with that ID\" }";
-				ipc_send_reply(client, payload_type, error,
-					(uint32_t)strlen(error));
+				ipc_send_reply_success(client, payload_type, false,
+						"No bar with that ID");
 				goto exit_cleanup;
 			}
 			json_object *json = ipc_json_describe_bar_config(bar);
-			const char *json_string = json_object_to_json_string(json);
-			ipc_send_reply(client, payload_type, json_string,
-				(uint32_t)strlen(json_string));
+			ipc_send_reply_json(client, payload_type, json);
 			json_object_put(json); // free
 		}
 		goto exit_cleanup;
@@ -868,9 +1402,7 @@ void ipc_client_handle_command(struct ipc_client *client, uint32_t payload_lengt
 			struct sway_mode *mode = config->modes->items[i];
 			json_object_array_add(modes, json_object_new_string(mode->name));
 		}
-		const char *json_string = json_object_to_json_string(modes);
-		ipc_send_reply(client, payload_type, json_string,
-			(uint32_t)strlen(json_string));
+		ipc_send_reply_json(client, payload_type, modes);
 		json_object_put(modes); // free
 		goto exit_cleanup;
 	}
@@ -878,9 +1410,7 @@ void ipc_client_handle_command(struct ipc_client *client, uint32_t payload_lengt
 	case IPC_GET_BINDING_STATE:
 	{
 		json_object *current_mode = ipc_json_get_binding_mode();
-		const char *json_string = json_object_to_json_string(current_mode);
-		ipc_send_reply(client, payload_type, json_string,
-			(uint32_t)strlen(json_string));
+		ipc_send_reply_json(client, payload_type, current_mode);
 		json_object_put(current_mode); // free
 		goto exit_cleanup;
 	}
@@ -889,9 +1419,7 @@ void ipc_client_handle_command(struct ipc_client *client, uint32_t payload_lengt
 	{
 		json_object *json = json_object_new_object();
 		json_object_object_add(json, "config", json_object_new_string(config->current_config));
-		const char *json_string = json_object_to_json_string(json);
-		ipc_send_reply(client, payload_type, json_string,
-			(uint32_t)strlen(json_string));
+		ipc_send_reply_json(client, payload_type, json);
 		json_object_put(json); // free
 		goto exit_cleanup;
 	}
@@ -899,8 +1427,7 @@ void ipc_client_handle_command(struct ipc_client *client, uint32_t payload_lengt
 	case IPC_SYNC:
 	{
 		// It was decided sway will not support this, just return success:false
-		const char msg[] = "{\"success\": false}";
-		ipc_send_reply(client, payload_type, msg, strlen(msg));
+		ipc_send_reply_success(client, payload_type, false, NULL);
 		goto exit_cleanup;
 	}
 
@@ -910,52 +1437,56 @@ void ipc_client_handle_command(struct ipc_client *client, uint32_t payload_lengt
 	}
 
 exit_cleanup:
-	free(buf);
 	return;
 }
 
-bool ipc_send_reply(struct ipc_client *client, enum ipc_command_type payload_type,
-		const char *payload, uint32_t payload_length) {
-	assert(payload);
-
-	char data[IPC_HEADER_SIZE];
-
-	memcpy(data, ipc_magic, sizeof(ipc_magic));
-	memcpy(data + sizeof(ipc_magic), &payload_length, sizeof(payload_length));
-	memcpy(data + sizeof(ipc_magic) + sizeof(payload_length), &payload_type, sizeof(payload_type));
-
-	while (client->write_buffer_len + IPC_HEADER_SIZE + payload_length >=
-				 client->write_buffer_size) {
-		client->write_buffer_size *= 2;
+static void ipc_client_check_queue_limit(struct ipc_client *client) {
+	// Replies are never dropped. Instead, stop reading requests from the
+	// client until it has caught up with the queue.
+	if (client->write_queue_size > IPC_CLIENT_QUEUE_LIMIT && !client->read_paused) {
+		sway_log(SWAY_DEBUG, "Client %d write queue full (%zu), pausing reads",
+				client->fd, client->write_queue_size);
+		wl_event_source_fd_update(client->event_source, 0);
+		client->read_paused = true;
 	}
+}
 
-	if (client->write_buffer_size > 4e6) { // 4 MB
-		sway_log(SWAY_ERROR, "Client write buffer too big (%zu), disconnecting client",
-				client->write_buffer_size);
-		ipc_client_disconnect(client);
+static bool ipc_send_reply_json(struct ipc_client *client,
+		enum ipc_command_type payload_type, json_object *json) {
+	if (!ipc_client_queue_json(client, payload_type, json,
+			IPC_SUPERSEDE_NONE, 0)) {
 		return false;
 	}
+	ipc_client_check_queue_limit(client);
 
-	char *new_buffer = realloc(client->write_buffer, client->write_buffer_size);
-	if (!new_buffer) {
-		sway_log(SWAY_ERROR, "Unable to reallocate ipc client write buffer");
-		ipc_client_disconnect(client);
-		return false;
-	}
-	client->write_buffer = new_buffer;
-
-	memcpy(client->write_buffer + client->write_buffer_len, data, IPC_HEADER_SIZE);
-	client->write_buffer_len += IPC_HEADER_SIZE;
-	memcpy(client->write_buffer + client->write_buffer_len, payload, payload_length);
-	client->write_buffer_len += payload_length;
+	sway_log(SWAY_DEBUG, "Added IPC reply of type 0x%x to client %d queue",
+		payload_type, client->fd);
+	return true;
+}
 
-	if (!client->writable_event_source) {
-		client->writable_event_source = wl_event_loop_add_fd(
-				server.wl_event_loop, client->fd, WL_EVENT_WRITABLE,
-				ipc_client_handle_writable, client);
+/**
+ * Sends a {"success": ...} reply, with an error message if one is given.
+ */
+static bool ipc_send_reply_success(struct ipc_client *client,
+		enum ipc_command_type payload_type, bool success, const char *error) {
+	json_object *json = json_object_new_object();
+	json_object_object_add(json, "success", json_object_new_boolean(success));
+	if (error) {
+		json_object_object_add(json, "error", json_object_new_string(error));
 	}
+	bool sent = ipc_send_reply_json(client, payload_type, json);
+	json_object_put(json);
+	return sent;
+}
 
-	sway_log(SWAY_DEBUG, "Added IPC reply of type 0x%x to client %d queue: %s",
-		payload_type, client->fd, payload);
+static bool ipc_send_reply_with_fd(struct ipc_client *client,
+		enum ipc_command_type payload_type, json_object *json, int fd) {
+	if (!ipc_send_reply_json(client, payload_type, json)) {
+		close(fd);
+		return false;
+	}
+	struct ipc_message *msg =
+		client->write_queue->items[client->write_queue->length - 1];
+	msg->fd = fd;
 	return true;
 }
@@ -0,0 +1,497 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <wayland-server-core.h>
+#include "sway/ipc-snapshot.h"
+#include "sway/output.h"
+#include "sway/server.h"
+#include "sway/tree/container.h"
+#include "sway/tree/root.h"
+#include "sway/tree/view.h"
+#include "sway/tree/workspace.h"
+#include "ipc-snapshot.h"
+#include "log.h"
+
+#define SNAPSHOT_MIN_CAPACITY 4096
+
+#ifndef F_SEAL_FUTURE_WRITE
+#define F_SEAL_FUTURE_WRITE 0x0010
+#endif
+
+/**
+ * The snapshot is first serialized into these arrays, which are kept around
+ * between updates, and then copied into the shared buffer in one go. Only the
+ * current (committed) state of the tree is serialized.
+ */
+struct snapshot_builder {
+	struct ipc_snapshot_node *nodes;
+	uint32_t nodes_len, nodes_cap;
+	char *strings;
+	uint32_t strings_len, strings_cap;
+	uint32_t focused;
+	// The fullscreen container of the workspace being serialized
+	struct sway_container *fullscreen;
+	bool failed; // an allocation failed, so the snapshot is incomplete
+};
+
+/**
+ * Where each buffer lives in the file. This is only ever written to the shared
+ * header, never read back from it, so readers cannot steer sway's writes.
+ */
+struct snapshot_buffer {
+	uint32_t seq;
+	uint32_t offset;
+	uint32_t capacity;
+};
+
+static struct {
+	int fd;
+	uint8_t *data;
+	size_t size;
+	uint64_t serial;
+	struct snapshot_buffer buffers[2];
+	uint32_t current;
+	struct snapshot_builder builder;
+	struct wl_event_source *idle_source;
+} snapshot = { .fd = -1 };
+
+static uint32_t builder_add_string(struct snapshot_builder *builder,
+		const char *str) {
+	if (!str) {
+		return IPC_SNAPSHOT_NONE;
+	}
+	size_t len = strlen(str) + 1;
+	if (builder->strings_len + len > builder->strings_cap) {
+		size_t cap = builder->strings_cap ? builder->strings_cap : 1024;
+		while (cap < builder->strings_len + len) {
+			cap *= 2;
+		}
+		char *strings = realloc(builder->strings, cap);
+		if (!strings) {
+			builder->failed = true;
+			return IPC_SNAPSHOT_NONE;
+		}
+		builder->strings = strings;
+		builder->strings_cap = cap;
+	}
+	uint32_t offset = builder->strings_len;
+	memcpy(builder->strings + offset, str, len);
+	builder->strings_len += len;
+	return offset;
+}
+
+static struct ipc_snapshot_node *builder_add_node(
+		struct snapshot_builder *builder, struct sway_node *node,
+		enum ipc_snapshot_node_type type, uint32_t parent, uint32_t *index) {
+	if (builder->nodes_len == builder->nodes_cap) {
+		size_t cap = builder->nodes_cap ? builder->nodes_cap * 2 : 64;
+		struct ipc_snapshot_node *nodes =
+			realloc(builder->nodes, cap * sizeof(struct ipc_snapshot_node));
+		if (!nodes) {
+			builder->failed = true;
+			return NULL;
+		}
+		builder->nodes = nodes;
+		builder->nodes_cap = cap;
+	}
+	*index = builder->nodes_len++;
+	struct ipc_snapshot_node *snap = &builder->nodes[*index];
+	memset(snap, 0, sizeof(struct ipc_snapshot_node));
+	snap->id = node->id;
+	snap->type = type;
+	snap->parent = parent;
+	snap->output = IPC_SNAPSHOT_NONE;
+	snap->workspace = IPC_SNAPSHOT_NONE;
+	snap->name = IPC_SNAPSHOT_NONE;
+	snap->app_id = IPC_SNAPSHOT_NONE;
+	snap->class = IPC_SNAPSHOT_NONE;
+	return snap;
+}
+
+static bool is_current_descendant(struct sway_container *con,
+		struct sway_container *ancestor) {
+	for (; con; con = con->current.parent) {
+		if (con == ancestor) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Returns whether the container or any of its descendants is urgent. Visibility
+ * and urgency are derived from the current state while walking it, rather than
+ * with the tree helpers, which look at the pending state.
+ */
+static bool add_container(struct snapshot_builder *builder,
+		struct sway_container *con, enum ipc_snapshot_node_type type,
+		uint32_t parent, uint32_t output, uint32_t workspace, bool visible) {
+	uint32_t index;
+	struct ipc_snapshot_node *snap =
+		builder_add_node(builder, &con->node, type, parent, &index);
+	if (!snap) {
+		return false;
+	}
+	struct sway_container_state *state = &con->current;
+	snap->output = output;
+	snap->workspace = workspace;
+	snap->layout = state->layout;
+	snap->x = state->x;
+	snap->y = state->y;
+	snap->width = state->width;
+	snap->height = state->height;
+	snap->content_x = state->content_x;
+	snap->content_y = state->content_y;
+	snap->content_width = state->content_width;
+	snap->content_height = state->content_height;
+	if (state->focused) {
+		snap->flags |= IPC_SNAPSHOT_FOCUSED;
+		builder->focused = index;
+	}
+	if (state->fullscreen_mode != FULLSCREEN_NONE) {
+		snap->flags |= IPC_SNAPSHOT_FULLSCREEN;
+	}
+	if (con->is_sticky && type == IPC_SNAPSHOT_FLOATING_CON) {
+		snap->flags |= IPC_SNAPSHOT_STICKY;
+	}
+
+	bool urgent = false;
+	struct sway_view *view = con->view;
+	if (view) {
+		snap->flags |= IPC_SNAPSHOT_VIEW;
+		if (visible && (!builder->fullscreen ||
+					is_current_descendant(con, builder->fullscreen))) {
+			snap->flags |= IPC_SNAPSHOT_VISIBLE;
+		}
+		urgent = view_is_urgent(view);
+		snap->pid = view->pid;
+	}
+
+	snap->name = builder_add_string(builder, con->title);
+	if (view) {
+		snap->app_id = builder_add_string(builder, view_get_app_id(view));
+		snap->class = builder_add_string(builder, view_get_class(view));
+	}
+
+	// Adding children may move the node array, so snap is invalid from here
+	if (state->children) {
+		// Only the focused tab or stack entry is shown
+		bool tabbed = state->layout == L_TABBED || state->layout == L_STACKED;
+		for (int i = 0; i < state->children->length; ++i) {
+			struct sway_container *child = state->children->items[i];
+			urgent |= add_container(builder, child, IPC_SNAPSHOT_CON, index,
+					output, workspace, visible &&
+					(!tabbed || child == state->focused_inactive_child));
+		}
+	}
+	if (urgent && !builder->failed) {
+		builder->nodes[index].flags |= IPC_SNAPSHOT_URGENT;
+	}
+	return urgent;
+}
+
+static void add_workspace(struct snapshot_builder *builder,
+		struct sway_workspace *ws, uint32_t parent, bool visible) {
+	uint32_t index;
+	struct ipc_snapshot_node *snap = builder_add_node(builder, &ws->node,
+			IPC_SNAPSHOT_WORKSPACE, parent, &index);
+	if (!snap) {
+		return;
+	}
+	struct sway_workspace_state *state = &ws->current;
+	snap->output = parent;
+	snap->workspace = index;
+	snap->layout = state->layout;
+	snap->x = snap->content_x = state->x;
+	snap->y = snap->content_y = state->y;
+	snap->width = snap->content_width = state->width;
+	snap->height = snap->content_height = state->height;
+	if (state->focused) {
+		snap->flags |= IPC_SNAPSHOT_FOCUSED;
+		builder->focused = index;
+	}
+	if (state->fullscreen) {
+		snap->flags |= IPC_SNAPSHOT_FULLSCREEN;
+	}
+	if (visible) {
+		snap->flags |= IPC_SNAPSHOT_VISIBLE;
+	}
+	snap->name = builder_add_string(builder, ws->name);
+
+	if (!state->tiling || !state->floating) {
+		return;
+	}
+	bool urgent = false;
+	bool tabbed = state->layout == L_TABBED || state->layout == L_STACKED;
+	builder->fullscreen = state->fullscreen;
+	for (int i = 0; i < state->tiling->length; ++i) {
+		struct sway_container *con = state->tiling->items[i];
+		urgent |= add_container(builder, con, IPC_SNAPSHOT_CON, index,
+				parent, index, visible &&
+				(!tabbed || con == state->focused_inactive_child));
+	}
+	for (int i = 0; i < state->floating->length; ++i) {
+		urgent |= add_container(builder, state->floating->items[i],
+				IPC_SNAPSHOT_FLOATING_CON, index, parent, index, visible);
+	}
+	builder->fullscreen = NULL;
+	if (urgent && !builder->failed) {
+		builder->nodes[index].flags |= IPC_SNAPSHOT_URGENT;
+	}
+}
+
+static void add_output(struct snapshot_builder *builder,
+		struct sway_output *output, uint32_t parent) {
+	uint32_t index;
+	struct ipc_snapshot_node *snap = builder_add_node(builder, &output->node,
+			IPC_SNAPSHOT_OUTPUT, parent, &index);
+	if (!snap) {
+		return;
+	}
+	snap->output = index;
+	snap->x = snap->content_x = output->lx;
+	snap->y = snap->content_y = output->ly;
+	snap->width = snap->content_width = output->width;
+	snap->height = snap->content_height = output->height;
+	snap->flags |= IPC_SNAPSHOT_VISIBLE;
+	snap->name = builder_add_string(builder, output->wlr_output->name);
+
+	struct sway_output_state *state = &output->current;
+	if (!state->workspaces) {
+		return;
+	}
+	for (int i = 0; i < state->workspaces->length; ++i) {
+		struct sway_workspace *ws = state->workspaces->items[i];
+		add_workspace(builder, ws, index, ws == state->active_workspace);
+	}
+}
+
+static void build_snapshot(struct snapshot_builder *builder) {
+	builder->nodes_len = 0;
+	builder->strings_len = 0;
+	builder->focused = IPC_SNAPSHOT_NONE;
+	builder->failed = false;
+
+	uint32_t index;
+	struct ipc_snapshot_node *snap = builder_add_node(builder, &root->node,
+			IPC_SNAPSHOT_ROOT, IPC_SNAPSHOT_NONE, &index);
+	if (!snap) {
+		return;
+	}
+	snap->x = snap->content_x = root->x;
+	snap->y = snap->content_y = root->y;
+	snap->width = snap->content_width = root->width;
+	snap->height = snap->content_height = root->height;
+	snap->name = builder_add_string(builder, "root");
+
+	for (int i = 0; i < root->outputs->length; ++i) {
+		add_output(builder, root->outputs->items[i], index);
+	}
+}
+
+static uint32_t align_up(uint32_t value, uint32_t alignment) {
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+/**
+ * Finds room for the buffer being written. Readers only use the other buffer,
+ * so the new one may go anywhere else in the file. Space left by earlier
+ * buffers is reused before the file is grown, which keeps the file within a
+ * few times the size of the largest snapshot even though it never shrinks.
+ */
+static bool snapshot_reserve(uint32_t index, uint32_t needed) {
+	struct snapshot_buffer *other = &snapshot.buffers[!index];
+	uint32_t start = align_up(sizeof(struct ipc_snapshot_header), 64);
+	uint32_t other_start = start, other_end = start;
+	if (other->capacity) {
+		other_start = other->offset;
+		other_end = align_up(other->offset + other->capacity, 64);
+	}
+
+	uint32_t offset, capacity;
+	if (other_start >= start + needed) {
+		offset = start;
+		capacity = other_start - start;
+	} else if (snapshot.size >= other_end + needed) {
+		offset = other_end;
+		capacity = snapshot.size - other_end;
+	} else {
+		offset = other_end;
+		capacity = align_up(needed * 2, SNAPSHOT_MIN_CAPACITY);
+		size_t size = offset + capacity;
+		if (ftruncate(snapshot.fd, size) == -1) {
+			sway_log_errno(SWAY_ERROR, "Unable to grow IPC snapshot");
+			return false;
+		}
+		// The write seal forbids new writable mappings, so grow ours in place
+		void *data = mremap(snapshot.data, snapshot.size, size,
+				MREMAP_MAYMOVE);
+		if (data == MAP_FAILED) {
+			sway_log_errno(SWAY_ERROR, "Unable to map IPC snapshot");
+			return false;
+		}
+		snapshot.data = data;
+		snapshot.size = size;
+		struct ipc_snapshot_header *header = (void *)snapshot.data;
+		header->file_size = size;
+	}
+
+	snapshot.buffers[index].offset = offset;
+	snapshot.buffers[index].capacity = capacity;
+	return true;
+}
+
+static void publish_buffer(struct ipc_snapshot_header *header,
+		uint32_t index) {
+	struct snapshot_buffer *buffer = &snapshot.buffers[index];
+	struct ipc_snapshot_buffer *shared = &header->buffers[index];
+	shared->offset = buffer->offset;
+	shared->capacity = buffer->capacity;
+}
+
+static bool snapshot_write(void) {
+	struct snapshot_builder *builder = &snapshot.builder;
+	build_snapshot(builder);
+	if (builder->failed) {
+		// Keep the previous snapshot rather than publishing a partial one
+		sway_log(SWAY_ERROR, "Unable to allocate memory for IPC snapshot");
+		return false;
+	}
+
+	uint32_t nodes_size = builder->nodes_len * sizeof(struct ipc_snapshot_node);
+	uint32_t nodes_offset = align_up(sizeof(struct ipc_snapshot_data), 8);
+	uint32_t strings_offset = nodes_offset + nodes_size;
+	uint32_t size = strings_offset + builder->strings_len;
+
+	uint32_t index = !snapshot.current;
+	struct snapshot_buffer *buffer = &snapshot.buffers[index];
+	struct ipc_snapshot_header *header = (void *)snapshot.data;
+
+	uint32_t seq = buffer->seq;
+	__atomic_store_n(&header->buffers[index].seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	if (size > buffer->capacity) {
+		if (!snapshot_reserve(index, size)) {
+			// The buffer is unchanged, readers keep using the other one
+			__atomic_store_n(&header->buffers[index].seq, seq,
+					__ATOMIC_RELEASE);
+			return false;
+		}
+		header = (void *)snapshot.data;
+	}
+	publish_buffer(header, index);
+
+	uint8_t *data = snapshot.data + buffer->offset;
+	struct ipc_snapshot_data *snap = (void *)data;
+	snap->serial = ++snapshot.serial;
+	snap->node_count = builder->nodes_len;
+	snap->node_size = sizeof(struct ipc_snapshot_node);
+	snap->nodes_offset = nodes_offset;
+	snap->strings_offset = strings_offset;
+	snap->strings_size = builder->strings_len;
+	snap->focused = builder->focused;
+	memcpy(data + nodes_offset, builder->nodes, nodes_size);
+	memcpy(data + strings_offset, builder->strings, builder->strings_len);
+	header->buffers[index].size = size;
+
+	buffer->seq = seq + 2;
+	snapshot.current = index;
+	__atomic_store_n(&header->buffers[index].seq, seq + 2, __ATOMIC_RELEASE);
+	__atomic_store_n(&header->current, index, __ATOMIC_RELEASE);
+	return true;
+}
+
+static bool snapshot_create(void) {
+	int fd = memfd_create("sway-snapshot", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd == -1) {
+		sway_log_errno(SWAY_ERROR, "Unable to create IPC snapshot");
+		return false;
+	}
+	size_t size = SNAPSHOT_MIN_CAPACITY;
+	if (ftruncate(fd, size) == -1) {
+		sway_log_errno(SWAY_ERROR, "Unable to size IPC snapshot");
+		close(fd);
+		return false;
+	}
+	void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (data == MAP_FAILED) {
+		sway_log_errno(SWAY_ERROR, "Unable to map IPC snapshot");
+		close(fd);
+		return false;
+	}
+	// Readers must not be able to shrink the file from under us or write to
+	// it, even by reopening it through /proc. Our own mapping stays writable.
+	if (fcntl(fd, F_ADD_SEALS,
+			F_SEAL_SHRINK | F_SEAL_FUTURE_WRITE | F_SEAL_SEAL) == -1) {
+		sway_log_errno(SWAY_ERROR, "Unable to seal IPC snapshot");
+		munmap(data, size);
+		close(fd);
+		return false;
+	}
+
+	snapshot.fd = fd;
+	snapshot.data = data;
+	snapshot.size = size;
+
+	struct ipc_snapshot_header *header = data;
+	header->magic = IPC_SNAPSHOT_MAGIC;
+	header->version = IPC_SNAPSHOT_VERSION;
+	header->file_size = size;
+	header->current = 1;
+	memset(snapshot.buffers, 0, sizeof(snapshot.buffers));
+	snapshot.current = 1;
+	uint32_t offset = align_up(sizeof(struct ipc_snapshot_header), 64);
+	snapshot.buffers[0].offset = offset;
+	snapshot.buffers[0].capacity = size - offset;
+
+	// Write the first buffer now so readers always find a valid one
+	if (!snapshot_write()) {
+		munmap(snapshot.data, snapshot.size);
+		close(snapshot.fd);
+		snapshot.fd = -1;
+		return false;
+	}
+	return true;
+}
+
+int ipc_snapshot_get_fd(void) {
+	if (snapshot.fd == -1 && !snapshot_create()) {
+		return -1;
+	}
+	return snapshot.fd;
+}
+
+static void handle_idle(void *data) {
+	snapshot.idle_source = NULL;
+	snapshot_write();
+}
+
+void ipc_snapshot_schedule_update(void) {
+	if (snapshot.fd == -1 || snapshot.idle_source) {
+		return;
+	}
+	snapshot.idle_source =
+		wl_event_loop_add_idle(server.wl_event_loop, handle_idle, NULL);
+}
+
+void ipc_snapshot_finish(void) {
+	if (snapshot.idle_source) {
+		wl_event_source_remove(snapshot.idle_source);
+		snapshot.idle_source = NULL;
+	}
+	if (snapshot.fd != -1) {
+		munmap(snapshot.data, snapshot.size);
+		close(snapshot.fd);
+		snapshot.fd = -1;
+	}
+	free(snapshot.builder.nodes);
+	free(snapshot.builder.strings);
+	memset(&snapshot.builder, 0, sizeof(snapshot.builder));
+}
@@ -0,0 +1,212 @@
+#define _POSIX_C_SOURCE 200809L
+#include <json.h>
+#include <stdint.h>
+#include <time.h>
+#include "sway/ipc-stats.h"
+#include "ipc.h"
+
+// Request latencies are counted in power of two buckets of microseconds:
+// bucket 0 holds durations below 1us, bucket i durations below 2^i us and the
+// last bucket everything above.
+#define IPC_STATS_HISTOGRAM_BUCKETS 20
+// Request types are numbered below this, events below it after masking
+#define IPC_STATS_MAX_REQUEST_TYPE 128
+#define IPC_STATS_MAX_EVENT_TYPE 32
+
+struct ipc_request_stats {
+	uint64_t count;
+	uint64_t total_nsec;
+	uint64_t max_nsec;
+	uint64_t histogram[IPC_STATS_HISTOGRAM_BUCKETS];
+};
+
+struct ipc_event_stats {
+	uint64_t emitted;
+	uint64_t delivered[IPC_STATS_SUPERSEDED + 1];
+};
+
+static struct {
+	struct ipc_request_stats requests[IPC_STATS_MAX_REQUEST_TYPE];
+	struct ipc_event_stats events[IPC_STATS_MAX_EVENT_TYPE];
+	uint64_t serialization_count;
+	uint64_t serialization_nsec;
+	uint64_t serialization_bytes;
+} stats;
+
+static const char *ipc_request_name(int type) {
+	switch (type) {
+	case IPC_COMMAND:
+		return "command";
+	case IPC_GET_WORKSPACES:
+		return "get_workspaces";
+	case IPC_SUBSCRIBE:
+		return "subscribe";
+	case IPC_GET_OUTPUTS:
+		return "get_outputs";
+	case IPC_GET_TREE:
+		return "get_tree";
+	case IPC_GET_MARKS:
+		return "get_marks";
+	case IPC_GET_BAR_CONFIG:
+		return "get_bar_config";
+	case IPC_GET_VERSION:
+		return "get_version";
+	case IPC_GET_BINDING_MODES:
+		return "get_binding_modes";
+	case IPC_GET_CONFIG:
+		return "get_config";
+	case IPC_SEND_TICK:
+		return "send_tick";
+	case IPC_SYNC:
+		return "sync";
+	case IPC_GET_BINDING_STATE:
+		return "get_binding_state";
+	case IPC_GET_INPUTS:
+		return "get_inputs";
+	case IPC_GET_SEATS:
+		return "get_seats";
+	case IPC_COMMAND_BATCH:
+		return "command_batch";
+	case IPC_GET_SNAPSHOT:
+		return "get_snapshot";
+	case IPC_SET_ENCODING:
+		return "set_encoding";
+	case IPC_GET_STATS:
+		return "get_stats";
+	case IPC_GET_LOG:
+		return "get_log";
+	case IPC_GET_PROFILE:
+		return "get_profile";
+	}
+	return NULL;
+}
+
+static const char *ipc_event_name(enum ipc_command_type event) {
+	switch (event) {
+	case IPC_EVENT_WORKSPACE:
+		return "workspace";
+	case IPC_EVENT_OUTPUT:
+		return "output";
+	case IPC_EVENT_MODE:
+		return "mode";
+	case IPC_EVENT_WINDOW:
+		return "window";
+	case IPC_EVENT_BARCONFIG_UPDATE:
+		return "barconfig_update";
+	case IPC_EVENT_BINDING:
+		return "binding";
+	case IPC_EVENT_SHUTDOWN:
+		return "shutdown";
+	case IPC_EVENT_TICK:
+		return "tick";
+	case IPC_EVENT_BAR_STATE_UPDATE:
+		return "bar_state_update";
+	case IPC_EVENT_INPUT:
+		return "input";
+	case IPC_EVENT_OVERFLOW:
+		return "overflow";
+	default:
+		return NULL;
+	}
+}
+
+static uint64_t nsec_since(const struct timespec *start) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)(now.tv_sec - start->tv_sec) * 1000000000 +
+		now.tv_nsec - start->tv_nsec;
+}
+
+void ipc_stats_request(enum ipc_command_type type,
+		const struct timespec *start) {
+	if ((uint32_t)type >= IPC_STATS_MAX_REQUEST_TYPE) {
+		return;
+	}
+	uint64_t nsec = nsec_since(start);
+	struct ipc_request_stats *request = &stats.requests[type];
+	request->count++;
+	request->total_nsec += nsec;
+	if (nsec > request->max_nsec) {
+		request->max_nsec = nsec;
+	}
+	int bucket = 0;
+	for (uint64_t usec = nsec / 1000; usec > 0 &&
+			bucket < IPC_STATS_HISTOGRAM_BUCKETS - 1; usec >>= 1) {
+		bucket++;
+	}
+	request->histogram[bucket]++;
+}
+
+void ipc_stats_event(enum ipc_command_type event) {
+	stats.events[event & (IPC_STATS_MAX_EVENT_TYPE - 1)].emitted++;
+}
+
+void ipc_stats_event_delivery(enum ipc_command_type event,
+		enum ipc_stats_delivery delivery) {
+	stats.events[event & (IPC_STATS_MAX_EVENT_TYPE - 1)].delivered[delivery]++;
+}
+
+void ipc_stats_serialization(const struct timespec *start, size_t len) {
+	stats.serialization_count++;
+	stats.serialization_nsec += nsec_since(start);
+	stats.serialization_bytes += len;
+}
+
+json_object *ipc_stats_describe(void) {
+	json_object *requests = json_object_new_object();
+	for (int i = 0; i < IPC_STATS_MAX_REQUEST_TYPE; ++i) {
+		struct ipc_request_stats *request = &stats.requests[i];
+		const char *name = ipc_request_name(i);
+		if (request->count == 0 || !name) {
+			continue;
+		}
+		json_object *histogram = json_object_new_array();
+		for (int j = 0; j < IPC_STATS_HISTOGRAM_BUCKETS; ++j) {
+			json_object_array_add(histogram,
+					json_object_new_int64(request->histogram[j]));
+		}
+		json_object *obj = json_object_new_object();
+		json_object_object_add(obj, "count",
+				json_object_new_int64(request->count));
+		json_object_object_add(obj, "total_usec",
+				json_object_new_int64(request->total_nsec / 1000));
+		json_object_object_add(obj, "max_usec",
+				json_object_new_int64(request->max_nsec / 1000));
+		json_object_object_add(obj, "histogram", histogram);
+		json_object_object_add(requests, name, obj);
+	}
+
+	json_object *events = json_object_new_object();
+	for (int i = 0; i < IPC_STATS_MAX_EVENT_TYPE; ++i) {
+		struct ipc_event_stats *event = &stats.events[i];
+		const char *name = ipc_event_name(
+				(enum ipc_command_type)((1u << 31) | i));
+		if (event->emitted == 0 || !name) {
+			continue;
+		}
+		json_object *obj = json_object_new_object();
+		json_object_object_add(obj, "emitted",
+				json_object_new_int64(event->emitted));
+		json_object_object_add(obj, "queued",
+				json_object_new_int64(event->delivered[IPC_STATS_QUEUED]));
+		json_object_object_add(obj, "dropped",
+				json_object_new_int64(event->delivered[IPC_STATS_DROPPED]));
+		json_object_object_add(obj, "superseded",
+				json_object_new_int64(event->delivered[IPC_STATS_SUPERSEDED]));
+		json_object_object_add(events, name, obj);
+	}
+
+	json_object *serialization = json_object_new_object();
+	json_object_object_add(serialization, "count",
+			json_object_new_int64(stats.serialization_count));
+	json_object_object_add(serialization, "total_usec",
+			json_object_new_int64(stats.serialization_nsec / 1000));
+	json_object_object_add(serialization, "bytes",
+			json_object_new_int64(stats.serialization_bytes));
+
+	json_object *json = json_object_new_object();
+	json_object_object_add(json, "requests", requests);
+	json_object_object_add(json, "events", events);
+	json_object_object_add(json, "serialization", serialization);
+	return json;
+}
@@ -1,4 +1,5 @@
 #define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
 #include <getopt.h>
 #include <pango/pangocairo.h>
 #include <signal.h>
@@ -18,10 +19,13 @@
 #include "sway/server.h"
 #include "sway/swaynag.h"
 #include "sway/desktop/transaction.h"
+#include "sway/input/keyboard.h"
 #include "sway/tree/root.h"
 #include "sway/ipc-server.h"
+#include "sway/profile.h"
 #include "ipc-client.h"
 #include "log.h"
+#include "pango.h"
 #include "stringop.h"
 #include "util.h"
 
@@ -47,6 +51,68 @@ void sig_handler(int signal) {
 	sway_terminate(EXIT_SUCCESS);
 }
 
+static char *flight_recorder_path = NULL;
+// Opened in advance, since the crash handler may only use signal-safe calls
+static int flight_recorder_fd = -1;
+
+static void flight_recorder_dump(void) {
+	if (ftruncate(flight_recorder_fd, 0) == -1 ||
+			lseek(flight_recorder_fd, 0, SEEK_SET) == -1) {
+		return;
+	}
+	sway_log_recorder_dump(flight_recorder_fd);
+}
+
+static void flight_recorder_crash_handler(int signal) {
+	// The handler is reset on entry, so raising the signal again terminates
+	flight_recorder_dump();
+	raise(signal);
+}
+
+static int flight_recorder_handle_sigusr2(int signal, void *data) {
+	flight_recorder_dump();
+	sway_log(SWAY_INFO, "Wrote flight recorder log to %s",
+			flight_recorder_path);
+	return 0;
+}
+
+static bool flight_recorder_init(void) {
+	if (!sway_log_recorder_init(SWAY_DEBUG)) {
+		sway_log(SWAY_ERROR, "Unable to allocate the flight recorder");
+		return false;
+	}
+	const char *dir = getenv("XDG_RUNTIME_DIR");
+	size_t len = snprintf(NULL, 0, "%s/sway-flight-recorder.%d.log",
+			dir, (int)getpid()) + 1;
+	flight_recorder_path = malloc(len);
+	if (!flight_recorder_path) {
+		return false;
+	}
+	snprintf(flight_recorder_path, len, "%s/sway-flight-recorder.%d.log",
+			dir, (int)getpid());
+	flight_recorder_fd = open(flight_recorder_path,
+			O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (flight_recorder_fd == -1) {
+		sway_log_errno(SWAY_ERROR, "Unable to open %s", flight_recorder_path);
+		free(flight_recorder_path);
+		flight_recorder_path = NULL;
+		return false;
+	}
+
+	struct sigaction action = {
+		.sa_handler = flight_recorder_crash_handler,
+		.sa_flags = SA_RESETHAND,
+	};
+	sigemptyset(&action.sa_mask);
+	int signals[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+	for (size_t i = 0; i < sizeof(signals) / sizeof(signals[0]); ++i) {
+		sigaction(signals[i], &action, NULL);
+	}
+	sway_log(SWAY_INFO, "Flight recorder enabled, dumping to %s on crash "
+			"or SIGUSR2", flight_recorder_path);
+	return true;
+}
+
 void detect_proprietary(int allow_unsupported_gpu) {
 	FILE *f = fopen("/proc/modules", "r");
 	if (!f) {
@@ -207,7 +273,8 @@ static void handle_wlr_log(enum wlr_log_importance importance,
 }
 
 int main(int argc, char **argv) {
-	static int verbose = 0, debug = 0, validate = 0, allow_unsupported_gpu = 0;
+	static int verbose = 0, debug = 0, validate = 0, allow_unsupported_gpu = 0,
+		flight_recorder = 0, profile_startup = 0, config_cache = 0;
 
 	static const struct option long_options[] = {
 		{"help", no_argument, NULL, 'h'},
@@ -219,6 +286,9 @@ int main(int argc, char **argv) {
 		{"get-socketpath", no_argument, NULL, 'p'},
 		{"unsupported-gpu", no_argument, NULL, 'u'},
 		{"my-next-gpu-wont-be-nvidia", no_argument, NULL, 'u'},
+		{"flight-recorder", no_argument, NULL, 'R'},
+		{"profile-startup", no_argument, NULL, 'P'},
+		{"config-cache", no_argument, NULL, 'K'},
 		{0, 0, 0, 0}
 	};
 
@@ -234,6 +304,12 @@ int main(int argc, char **argv) {
 		"  -v, --version          Show the version number and quit.\n"
 		"  -V, --verbose          Enables more verbose logging.\n"
 		"      --get-socketpath   Gets the IPC socket path and prints it, then exits.\n"
+		"      --flight-recorder  Keeps recent debug messages in memory, to be\n"
+		"                         dumped on crash, SIGUSR2 or via IPC.\n"
+		"      --profile-startup  Times each config line and prints a startup\n"
+		"                         profile to stderr.\n"
+		"      --config-cache     Replays the commands of an unchanged config\n"
+		"                         from a cache instead of parsing it.\n"
 		"\n";
 
 	int c;
@@ -271,6 +347,15 @@ int main(int argc, char **argv) {
 		case 'V': // verbose
 			verbose = 1;
 			break;
+		case 'R': // flight-recorder
+			flight_recorder = 1;
+			break;
+		case 'P': // profile-startup
+			profile_startup = 1;
+			break;
+		case 'K': // config-cache
+			config_cache = 1;
+			break;
 		case 'p': ; // --get-socketpath
 			if (getenv("SWAYSOCK")) {
 				printf("%s\n", getenv("SWAYSOCK"));
@@ -306,6 +391,9 @@ int main(int argc, char **argv) {
 		sway_log_init(SWAY_ERROR, sway_terminate);
 		wlr_log_init(WLR_ERROR, handle_wlr_log);
 	}
+	if (flight_recorder && optind == argc) {
+		flight_recorder_init();
+	}
 
 	sway_log(SWAY_INFO, "Sway version " SWAY_VERSION);
 	sway_log(SWAY_INFO, "wlroots version " WLR_VERSION_STR);
@@ -339,7 +427,13 @@ int main(int argc, char **argv) {
 		return 0;
 	}
 
-	if (!server_privileged_prepare(&server)) {
+	profile_init(profile_startup);
+
+	struct timespec start;
+	profile_begin(PROFILE_BACKEND_CREATE, &start);
+	bool prepared = server_privileged_prepare(&server);
+	profile_end(PROFILE_BACKEND_CREATE, &start);
+	if (!prepared) {
 		return 1;
 	}
 
@@ -363,16 +457,26 @@ int main(int argc, char **argv) {
 		return 1;
 	}
 
+	if (flight_recorder_path) {
+		wl_event_loop_add_signal(server.wl_event_loop, SIGUSR2,
+				flight_recorder_handle_sigusr2, NULL);
+	}
+
 	if (validate) {
-		bool valid = load_main_config(config_path, false, true);
+		bool valid = load_main_config(config_path, false, true, NULL);
 		free(config_path);
 		return valid ? 0 : 1;
 	}
 
+	profile_begin(PROFILE_IPC_INIT, &start);
 	ipc_init(&server);
+	profile_end(PROFILE_IPC_INIT, &start);
 
 	setenv("WAYLAND_DISPLAY", server.socket, true);
-	if (!load_main_config(config_path, false, false)) {
+	if (config_cache) {
+		config_cache_enable();
+	}
+	if (!load_main_config(config_path, false, false, NULL)) {
 		sway_terminate(EXIT_FAILURE);
 		goto shutdown;
 	}
@@ -383,15 +487,24 @@ int main(int argc, char **argv) {
 	}
 
 	config->active = true;
+	profile_begin(PROFILE_SWAYBARS, &start);
 	load_swaybars();
+	profile_end(PROFILE_SWAYBARS, &start);
+	profile_begin(PROFILE_DEFERRED_COMMANDS, &start);
 	run_deferred_commands();
 	run_deferred_bindings();
+	profile_end(PROFILE_DEFERRED_COMMANDS, &start);
 	transaction_commit_dirty();
 
 	if (config->swaynag_config_errors.client != NULL) {
 		swaynag_show(&config->swaynag_config_errors);
 	}
 
+	profile_milestone(PROFILE_STARTUP_COMPLETE);
+	if (profile_startup) {
+		profile_report();
+	}
+
 	server_run(&server);
 
 shutdown:
@@ -403,7 +516,10 @@ shutdown:
 
 	free(config_path);
 	free_config(config);
+	free(flight_recorder_path);
 
+	sway_keyboard_keymap_cache_finish();
+	pango_layout_cache_finish();
 	pango_cairo_font_map_set_default(NULL);
 
 	return exit_value;
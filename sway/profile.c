@@ -0,0 +1,309 @@
+#define _POSIX_C_SOURCE 200809L
+#include <json.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "sway/profile.h"
+#include "list.h"
+#include "log.h"
+
+// Slowest config lines listed by profile_describe and profile_report
+#define PROFILE_MAX_LINES 100
+#define PROFILE_REPORT_LINES 20
+
+struct profile_phase_stats {
+	int depth;
+	uint64_t count;
+	uint64_t total_nsec;
+	uint64_t first_nsec; // since the start of the profile
+};
+
+struct profile_file {
+	char *path;
+	uint64_t count;
+	uint64_t total_nsec;
+};
+
+struct profile_line {
+	struct profile_file *file;
+	int line_number;
+	char *line;
+	uint64_t total_nsec;
+	uint64_t variables_nsec;
+	uint64_t handlers_nsec;
+};
+
+static struct {
+	struct timespec start;
+	bool lines_enabled;
+	bool done;
+	struct profile_phase_stats phases[PROFILE_PHASE_COUNT];
+	uint64_t milestones[PROFILE_MILESTONE_COUNT]; // 0 if not reached
+	list_t *files; // struct profile_file
+	list_t *lines; // struct profile_line
+} profile;
+
+static const char *phase_names[PROFILE_PHASE_COUNT] = {
+	[PROFILE_BACKEND_CREATE] = "backend_create",
+	[PROFILE_SERVER_GLOBALS] = "server_globals",
+	[PROFILE_SERVER_SOCKET] = "server_socket",
+	[PROFILE_SERVER_BACKENDS] = "server_backends",
+	[PROFILE_INPUT_MANAGER] = "input_manager",
+	[PROFILE_IPC_INIT] = "ipc_init",
+	[PROFILE_CONFIG_LOAD] = "config_load",
+	[PROFILE_CONFIG_VARIABLES] = "config_variables",
+	[PROFILE_CONFIG_HANDLERS] = "config_handlers",
+	[PROFILE_KEYMAP_COMPILE] = "keymap_compile",
+	[PROFILE_OUTPUT_CONFIG] = "output_config",
+	[PROFILE_XWAYLAND_CREATE] = "xwayland_create",
+	[PROFILE_BACKEND_START] = "backend_start",
+	[PROFILE_SWAYBARS] = "swaybars",
+	[PROFILE_DEFERRED_COMMANDS] = "deferred_commands",
+};
+
+static const char *milestone_names[PROFILE_MILESTONE_COUNT] = {
+	[PROFILE_STARTUP_COMPLETE] = "startup_complete",
+	[PROFILE_XWAYLAND_READY] = "xwayland_ready",
+};
+
+static uint64_t nsec_between(const struct timespec *start,
+		const struct timespec *end) {
+	return (uint64_t)(end->tv_sec - start->tv_sec) * 1000000000 +
+		end->tv_nsec - start->tv_nsec;
+}
+
+static uint64_t nsec_since(const struct timespec *start) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return nsec_between(start, &now);
+}
+
+void profile_init(bool lines) {
+	clock_gettime(CLOCK_MONOTONIC, &profile.start);
+	profile.lines_enabled = lines;
+	profile.files = create_list();
+	profile.lines = create_list();
+}
+
+// Once startup has completed, runtime commands and reloads skip the profiler
+void profile_begin(enum profile_phase phase, struct timespec *start) {
+	if (profile.done) {
+		return;
+	}
+	profile.phases[phase].depth++;
+	clock_gettime(CLOCK_MONOTONIC, start);
+}
+
+void profile_end(enum profile_phase phase, const struct timespec *start) {
+	if (profile.done) {
+		return;
+	}
+	struct profile_phase_stats *stats = &profile.phases[phase];
+	if (--stats->depth > 0) {
+		return;
+	}
+	if (stats->count++ == 0) {
+		stats->first_nsec = nsec_between(&profile.start, start);
+	}
+	stats->total_nsec += nsec_since(start);
+}
+
+void profile_milestone(enum profile_milestone milestone) {
+	if (profile.milestones[milestone] == 0) {
+		profile.milestones[milestone] = nsec_since(&profile.start);
+	}
+	if (milestone == PROFILE_STARTUP_COMPLETE) {
+		profile.done = true;
+	}
+}
+
+static struct profile_file *get_file(const char *path) {
+	for (int i = 0; i < profile.files->length; ++i) {
+		struct profile_file *file = profile.files->items[i];
+		if (strcmp(file->path, path) == 0) {
+			return file;
+		}
+	}
+	struct profile_file *file = calloc(1, sizeof(*file));
+	if (!file || !(file->path = strdup(path))) {
+		sway_log(SWAY_ERROR, "Unable to allocate profile file");
+		free(file);
+		return NULL;
+	}
+	list_add(profile.files, file);
+	return file;
+}
+
+void profile_file(const char *path, const struct timespec *start) {
+	if (profile.done) {
+		return;
+	}
+	struct profile_file *file = get_file(path);
+	if (file) {
+		file->count++;
+		file->total_nsec += nsec_since(start);
+	}
+}
+
+void profile_mark(struct profile_mark *mark) {
+	if (profile.done) {
+		return;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &mark->time);
+	mark->variables_nsec = profile.phases[PROFILE_CONFIG_VARIABLES].total_nsec;
+	mark->handlers_nsec = profile.phases[PROFILE_CONFIG_HANDLERS].total_nsec;
+}
+
+void profile_line(const char *path, int line_number, const char *line,
+		const struct profile_mark *mark) {
+	if (!profile.lines_enabled || profile.done) {
+		return;
+	}
+	struct profile_file *file = get_file(path);
+	struct profile_line *record = calloc(1, sizeof(*record));
+	if (!file || !record || !(record->line = strdup(line))) {
+		sway_log(SWAY_ERROR, "Unable to allocate profile line");
+		free(record);
+		return;
+	}
+	record->file = file;
+	record->line_number = line_number;
+	record->total_nsec = nsec_since(&mark->time);
+	// Lines within an include are also attributed to the include line
+	record->variables_nsec =
+		profile.phases[PROFILE_CONFIG_VARIABLES].total_nsec -
+		mark->variables_nsec;
+	record->handlers_nsec =
+		profile.phases[PROFILE_CONFIG_HANDLERS].total_nsec -
+		mark->handlers_nsec;
+	list_add(profile.lines, record);
+}
+
+static int cmp_line_total(const void *_a, const void *_b) {
+	const struct profile_line *a = *(void **)_a;
+	const struct profile_line *b = *(void **)_b;
+	return a->total_nsec < b->total_nsec ? 1 :
+		a->total_nsec > b->total_nsec ? -1 : 0;
+}
+
+static int cmp_file_total(const void *_a, const void *_b) {
+	const struct profile_file *a = *(void **)_a;
+	const struct profile_file *b = *(void **)_b;
+	return a->total_nsec < b->total_nsec ? 1 :
+		a->total_nsec > b->total_nsec ? -1 : 0;
+}
+
+json_object *profile_describe(void) {
+	json_object *phases = json_object_new_object();
+	for (int i = 0; i < PROFILE_PHASE_COUNT; ++i) {
+		struct profile_phase_stats *stats = &profile.phases[i];
+		if (stats->count == 0) {
+			continue;
+		}
+		json_object *obj = json_object_new_object();
+		json_object_object_add(obj, "count",
+				json_object_new_int64(stats->count));
+		json_object_object_add(obj, "start_usec",
+				json_object_new_int64(stats->first_nsec / 1000));
+		json_object_object_add(obj, "total_usec",
+				json_object_new_int64(stats->total_nsec / 1000));
+		json_object_object_add(phases, phase_names[i], obj);
+	}
+
+	json_object *milestones = json_object_new_object();
+	for (int i = 0; i < PROFILE_MILESTONE_COUNT; ++i) {
+		if (profile.milestones[i]) {
+			json_object_object_add(milestones, milestone_names[i],
+					json_object_new_int64(profile.milestones[i] / 1000));
+		}
+	}
+
+	json_object *files = json_object_new_array();
+	json_object *lines = json_object_new_array();
+	list_qsort(profile.files, cmp_file_total);
+	list_qsort(profile.lines, cmp_line_total);
+	for (int i = 0; i < profile.files->length; ++i) {
+		struct profile_file *file = profile.files->items[i];
+		json_object *obj = json_object_new_object();
+		json_object_object_add(obj, "path",
+				json_object_new_string(file->path));
+		json_object_object_add(obj, "count",
+				json_object_new_int64(file->count));
+		json_object_object_add(obj, "total_usec",
+				json_object_new_int64(file->total_nsec / 1000));
+		json_object_array_add(files, obj);
+	}
+
+	for (int i = 0; i < profile.lines->length && i < PROFILE_MAX_LINES; ++i) {
+		struct profile_line *line = profile.lines->items[i];
+		json_object *obj = json_object_new_object();
+		json_object_object_add(obj, "path",
+				json_object_new_string(line->file->path));
+		json_object_object_add(obj, "line",
+				json_object_new_int(line->line_number));
+		json_object_object_add(obj, "command",
+				json_object_new_string(line->line));
+		json_object_object_add(obj, "total_usec",
+				json_object_new_int64(line->total_nsec / 1000));
+		json_object_object_add(obj, "variables_usec",
+				json_object_new_int64(line->variables_nsec / 1000));
+		json_object_object_add(obj, "handler_usec",
+				json_object_new_int64(line->handlers_nsec / 1000));
+		json_object_array_add(lines, obj);
+	}
+
+	json_object *json = json_object_new_object();
+	json_object_object_add(json, "line_profiling",
+			json_object_new_boolean(profile.lines_enabled));
+	json_object_object_add(json, "phases", phases);
+	json_object_object_add(json, "milestones", milestones);
+	json_object_object_add(json, "files", files);
+	json_object_object_add(json, "lines", lines);
+	return json;
+}
+
+static double msec(uint64_t nsec) {
+	return nsec / 1e6;
+}
+
+void profile_report(void) {
+	fprintf(stderr, "Startup profile (ms):\n");
+	fprintf(stderr, "  %-20s %6s %10s %10s\n", "phase", "count", "start",
+			"total");
+	for (int i = 0; i < PROFILE_PHASE_COUNT; ++i) {
+		struct profile_phase_stats *stats = &profile.phases[i];
+		if (stats->count > 0) {
+			fprintf(stderr, "  %-20s %6lu %10.3f %10.3f\n", phase_names[i],
+					(unsigned long)stats->count, msec(stats->first_nsec),
+					msec(stats->total_nsec));
+		}
+	}
+	for (int i = 0; i < PROFILE_MILESTONE_COUNT; ++i) {
+		if (profile.milestones[i]) {
+			fprintf(stderr, "  %-20s %6s %10.3f\n", milestone_names[i], "",
+					msec(profile.milestones[i]));
+		}
+	}
+
+	list_qsort(profile.files, cmp_file_total);
+	fprintf(stderr, "Config files (ms, including the files they include):\n");
+	for (int i = 0; i < profile.files->length; ++i) {
+		struct profile_file *file = profile.files->items[i];
+		fprintf(stderr, "  %10.3f  %s\n", msec(file->total_nsec), file->path);
+	}
+
+	if (profile.lines->length == 0) {
+		return;
+	}
+	list_qsort(profile.lines, cmp_line_total);
+	fprintf(stderr, "Slowest config lines (ms: total, variables, handler):\n");
+	for (int i = 0; i < profile.lines->length && i < PROFILE_REPORT_LINES;
+			++i) {
+		struct profile_line *line = profile.lines->items[i];
+		fprintf(stderr, "  %10.3f %8.3f %10.3f  %s:%d: %s\n",
+				msec(line->total_nsec), msec(line->variables_nsec),
+				msec(line->handlers_nsec), line->file->path,
+				line->line_number, line->line);
+	}
+}
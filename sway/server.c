@@ -38,6 +38,7 @@
 #include "sway/desktop/idle_inhibit_v1.h"
 #include "sway/input/input-manager.h"
 #include "sway/output.h"
+#include "sway/profile.h"
 #include "sway/server.h"
 #include "sway/tree/root.h"
 #if HAVE_XWAYLAND
@@ -60,6 +61,8 @@ bool server_privileged_prepare(struct sway_server *server) {
 bool server_init(struct sway_server *server) {
 	sway_log(SWAY_DEBUG, "Initializing Wayland server");
 
+	struct timespec start;
+	profile_begin(PROFILE_SERVER_GLOBALS, &start);
 	struct wlr_renderer *renderer = wlr_backend_get_renderer(server->backend);
 	assert(renderer);
 
@@ -166,7 +169,10 @@ bool server_init(struct sway_server *server) {
 	wl_signal_add(&server->xdg_activation_v1->events.request_activate,
 		&server->xdg_activation_v1_request_activate);
 
+	profile_end(PROFILE_SERVER_GLOBALS, &start);
+
 	// Avoid using "wayland-0" as display socket
+	profile_begin(PROFILE_SERVER_SOCKET, &start);
 	char name_candidate[16];
 	for (int i = 1; i <= 32; ++i) {
 		sprintf(name_candidate, "wayland-%d", i);
@@ -178,10 +184,13 @@ bool server_init(struct sway_server *server) {
 
 	if (!server->socket) {
 		sway_log(SWAY_ERROR, "Unable to open wayland socket");
+		profile_end(PROFILE_SERVER_SOCKET, &start);
 		wlr_backend_destroy(server->backend);
 		return false;
 	}
+	profile_end(PROFILE_SERVER_SOCKET, &start);
 
+	profile_begin(PROFILE_SERVER_BACKENDS, &start);
 	server->noop_backend = wlr_noop_backend_create(server->wl_display);
 
 	struct wlr_output *wlr_output = wlr_noop_add_output(server->noop_backend);
@@ -195,6 +204,7 @@ bool server_init(struct sway_server *server) {
 	} else {
 		wlr_multi_backend_add(server->backend, server->headless_backend);
 	}
+	profile_end(PROFILE_SERVER_BACKENDS, &start);
 
 	// This may have been set already via -Dtxn-timeout
 	if (!server->txn_timeout_ms) {
@@ -203,8 +213,10 @@ bool server_init(struct sway_server *server) {
 
 	server->dirty_nodes = create_list();
 
+	profile_begin(PROFILE_INPUT_MANAGER, &start);
 	server->input = input_manager_create(server);
 	input_manager_get_default_seat(); // create seat0
+	profile_end(PROFILE_INPUT_MANAGER, &start);
 
 	return true;
 }
@@ -220,13 +232,16 @@ void server_fini(struct sway_server *server) {
 }
 
 bool server_start(struct sway_server *server) {
+	struct timespec start;
 #if HAVE_XWAYLAND
 	if (config->xwayland != XWAYLAND_MODE_DISABLED) {
 		sway_log(SWAY_DEBUG, "Initializing Xwayland (lazy=%d)",
 				config->xwayland == XWAYLAND_MODE_LAZY);
+		profile_begin(PROFILE_XWAYLAND_CREATE, &start);
 		server->xwayland.wlr_xwayland =
 			wlr_xwayland_create(server->wl_display, server->compositor,
 					config->xwayland == XWAYLAND_MODE_LAZY);
+		profile_end(PROFILE_XWAYLAND_CREATE, &start);
 		if (!server->xwayland.wlr_xwayland) {
 			sway_log(SWAY_ERROR, "Failed to start Xwayland");
 			unsetenv("DISPLAY");
@@ -247,11 +262,14 @@ bool server_start(struct sway_server *server) {
 
 	sway_log(SWAY_INFO, "Starting backend on wayland display '%s'",
 			server->socket);
+	profile_begin(PROFILE_BACKEND_START, &start);
 	if (!wlr_backend_start(server->backend)) {
 		sway_log(SWAY_ERROR, "Failed to start backend");
+		profile_end(PROFILE_BACKEND_START, &start);
 		wlr_backend_destroy(server->backend);
 		return false;
 	}
+	profile_end(PROFILE_BACKEND_START, &start);
 	return true;
 }
 
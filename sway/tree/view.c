@@ -20,6 +20,7 @@
 #include "sway/desktop/idle_inhibit_v1.h"
 #include "sway/input/cursor.h"
 #include "sway/ipc-server.h"
+#include "sway/ipc-snapshot.h"
 #include "sway/output.h"
 #include "sway/input/seat.h"
 #include "sway/server.h"
@@ -61,6 +62,7 @@ void view_destroy(struct sway_view *view) {
 		view_remove_saved_buffer(view);
 	}
 	list_free(view->executed_criteria);
+	free(view->criteria_evaluated);
 
 	free(view->title_format);
 
@@ -489,8 +491,8 @@ static bool view_has_executed_criteria(struct sway_view *view,
 	return false;
 }
 
-void view_execute_criteria(struct sway_view *view) {
-	list_t *criterias = criteria_for_view(view, CT_COMMAND);
+void view_execute_criteria(struct sway_view *view, uint32_t changed) {
+	list_t *criterias = criteria_for_view_update(view, changed);
 	for (int i = 0; i < criterias->length; i++) {
 		struct criteria *criteria = criterias->items[i];
 		sway_log(SWAY_DEBUG, "Checking criteria %s", criteria->raw);
@@ -807,7 +809,7 @@ void view_map(struct sway_view *view, struct wlr_surface *wlr_surface,
 		}
 	}
 
-	view_execute_criteria(view);
+	view_execute_criteria(view, CRITERIA_ALL);
 
 	bool set_focus = should_focus(view);
 
@@ -1292,6 +1294,7 @@ void view_update_title(struct sway_view *view, bool force) {
 	container_update_title_textures(view->container);
 
 	ipc_event_window(view->container, "title");
+	ipc_snapshot_schedule_update();
 
 	if (view->foreign_toplevel && title) {
 		wlr_foreign_toplevel_handle_v1_set_title(view->foreign_toplevel, title);
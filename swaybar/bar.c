@@ -20,23 +20,29 @@
 #include "swaybar/status_line.h"
 #include "swaybar/render.h"
 #if HAVE_TRAY
+#include "swaybar/tray/icon.h"
 #include "swaybar/tray/tray.h"
 #endif
 #include "ipc-client.h"
 #include "list.h"
 #include "log.h"
 #include "loop.h"
+#include "pango.h"
 #include "pool-buffer.h"
 #include "wlr-layer-shell-unstable-v1-client-protocol.h"
 #include "xdg-output-unstable-v1-client-protocol.h"
 
+void free_workspace(struct swaybar_workspace *ws) {
+	wl_list_remove(&ws->link);
+	free(ws->name);
+	free(ws->label);
+	free(ws);
+}
+
 void free_workspaces(struct wl_list *list) {
 	struct swaybar_workspace *ws, *tmp;
 	wl_list_for_each_safe(ws, tmp, list, link) {
-		wl_list_remove(&ws->link);
-		free(ws->name);
-		free(ws->label);
-		free(ws);
+		free_workspace(ws);
 	}
 }
 
@@ -56,8 +62,8 @@ static void swaybar_output_free(struct swaybar_output *output) {
 	}
 	zxdg_output_v1_destroy(output->xdg_output);
 	wl_output_destroy(output->output);
-	destroy_buffer(&output->buffers[0]);
-	destroy_buffer(&output->buffers[1]);
+	finish_buffer_pool(&output->buffers);
+	free(output->elements);
 	free_hotspots(&output->hotspots);
 	free_workspaces(&output->workspaces);
 	wl_list_remove(&output->link);
@@ -66,7 +72,7 @@ static void swaybar_output_free(struct swaybar_output *output) {
 	free(output);
 }
 
-static void set_output_dirty(struct swaybar_output *output) {
+void set_output_dirty(struct swaybar_output *output) {
 	if (output->frame_scheduled) {
 		output->dirty = true;
 	} else if (output->surface) {
@@ -144,6 +150,26 @@ void set_bar_dirty(struct swaybar *bar) {
 	}
 }
 
+void apply_status_update(struct swaybar *bar) {
+	// Wait for the next frame if every output is still waiting for one, so
+	// that updates superseded before then are never parsed
+	bool waiting = false;
+	struct swaybar_output *output;
+	wl_list_for_each(output, &bar->outputs, link) {
+		if (!output->surface) {
+			continue;
+		}
+		if (!output->frame_scheduled) {
+			waiting = false;
+			break;
+		}
+		waiting = true;
+	}
+	if (!waiting && i3bar_apply_update(bar->status)) {
+		set_bar_dirty(bar);
+	}
+}
+
 bool determine_bar_visibility(struct swaybar *bar, bool moving_layer) {
 	struct swaybar_config *config = bar->config;
 	bool visible = !(strcmp(config->mode, "invisible") == 0 ||
@@ -164,7 +190,6 @@ bool determine_bar_visibility(struct swaybar *bar, bool moving_layer) {
 			add_layer_surface(output);
 		}
 	}
-	set_bar_dirty(bar);
 
 	if (visible != bar->visible) {
 		bar->visible = visible;
@@ -408,9 +433,9 @@ bool bar_setup(struct swaybar *bar, const char *socket_path) {
 	wl_list_init(&bar->seats);
 	bar->eventloop = loop_create();
 
-	bar->ipc_socketfd = ipc_open_socket(socket_path);
-	bar->ipc_event_socketfd = ipc_open_socket(socket_path);
-	if (!ipc_initialize(bar)) {
+	int socketfd = ipc_open_socket(socket_path);
+	int event_socketfd = ipc_open_socket(socket_path);
+	if (!ipc_initialize(bar, socketfd, event_socketfd)) {
 		return false;
 	}
 
@@ -454,6 +479,8 @@ bool bar_setup(struct swaybar *bar, const char *socket_path) {
 
 	if (bar->config->workspace_buttons) {
 		ipc_get_workspaces(bar);
+		// Have the workspaces for the first frame
+		ipc_client_roundtrip(bar->ipc);
 	}
 	determine_bar_visibility(bar, false);
 	return true;
@@ -466,13 +493,6 @@ static void display_in(int fd, short mask, void *data) {
 	}
 }
 
-static void ipc_in(int fd, short mask, void *data) {
-	struct swaybar *bar = data;
-	if (handle_ipc_readable(bar)) {
-		set_bar_dirty(bar);
-	}
-}
-
 void status_in(int fd, short mask, void *data) {
 	struct swaybar *bar = data;
 	if (mask & (POLLHUP | POLLERR)) {
@@ -481,13 +501,16 @@ void status_in(int fd, short mask, void *data) {
 		loop_remove_fd(bar->eventloop, fd);
 	} else if (status_handle_readable(bar->status)) {
 		set_bar_dirty(bar);
+	} else if (bar->status->update_pending) {
+		apply_status_update(bar);
 	}
 }
 
 void bar_run(struct swaybar *bar) {
 	loop_add_fd(bar->eventloop, wl_display_get_fd(bar->display), POLLIN,
 			display_in, bar);
-	loop_add_fd(bar->eventloop, bar->ipc_event_socketfd, POLLIN, ipc_in, bar);
+	ipc_client_add_to_loop(bar->ipc, bar->eventloop);
+	ipc_client_add_to_loop(bar->ipc_events, bar->eventloop);
 	if (bar->status) {
 		loop_add_fd(bar->eventloop, bar->status->read_fd, POLLIN,
 				status_in, bar);
@@ -495,6 +518,11 @@ void bar_run(struct swaybar *bar) {
 #if HAVE_TRAY
 	if (bar->tray) {
 		loop_add_fd(bar->eventloop, bar->tray->fd, POLLIN, tray_in, bar->tray->bus);
+		if (bar->tray->icon_index) {
+			loop_add_fd(bar->eventloop,
+					icon_index_get_fd(bar->tray->icon_index), POLLIN,
+					tray_icons_in, bar->tray->icon_index);
+		}
 	}
 #endif
 	while (bar->running) {
@@ -527,14 +555,17 @@ void bar_teardown(struct swaybar *bar) {
 	free_outputs(&bar->outputs);
 	free_outputs(&bar->unused_outputs);
 	free_seats(&bar->seats);
+	free_status_strips(bar);
+	list_free(bar->status_strips);
 	if (bar->config) {
 		free_config(bar->config);
 	}
-	close(bar->ipc_event_socketfd);
-	close(bar->ipc_socketfd);
+	ipc_client_destroy(bar->ipc_events);
+	ipc_client_destroy(bar->ipc);
 	if (bar->status) {
 		status_line_free(bar->status);
 	}
 	free(bar->id);
 	free(bar->mode);
+	pango_layout_cache_finish();
 }
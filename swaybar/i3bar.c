@@ -6,12 +6,17 @@
 #include <string.h>
 #include <unistd.h>
 #include "log.h"
+#include "stringop.h"
 #include "swaybar/bar.h"
 #include "swaybar/config.h"
 #include "swaybar/i3bar.h"
 #include "swaybar/input.h"
 #include "swaybar/status_line.h"
 
+// Reads of the status command output per call, so that a command writing
+// faster than it is read cannot keep the bar from handling anything else
+#define I3BAR_MAX_READS 16
+
 void i3bar_block_unref(struct i3bar_block *block) {
 	if (block == NULL) {
 		return;
@@ -28,94 +33,255 @@ void i3bar_block_unref(struct i3bar_block *block) {
 	}
 }
 
-static void i3bar_parse_json(struct status_line *status,
+static const char *json_string_or_null(json_object *json) {
+	return json ? json_object_get_string(json) : NULL;
+}
+
+/**
+ * Parses a block of the status array into `block`. The strings of the parsed
+ * block are borrowed from the json object; see i3bar_block_create.
+ */
+static void i3bar_block_parse(json_object *json, struct i3bar_block *block) {
+	json_object *full_text, *short_text, *color, *min_width, *align, *urgent;
+	json_object *name, *instance, *separator, *separator_block_width;
+	json_object *background, *border, *border_top, *border_bottom;
+	json_object *border_left, *border_right, *markup;
+	json_object_object_get_ex(json, "full_text", &full_text);
+	json_object_object_get_ex(json, "short_text", &short_text);
+	json_object_object_get_ex(json, "color", &color);
+	json_object_object_get_ex(json, "min_width", &min_width);
+	json_object_object_get_ex(json, "align", &align);
+	json_object_object_get_ex(json, "urgent", &urgent);
+	json_object_object_get_ex(json, "name", &name);
+	json_object_object_get_ex(json, "instance", &instance);
+	json_object_object_get_ex(json, "markup", &markup);
+	json_object_object_get_ex(json, "separator", &separator);
+	json_object_object_get_ex(json, "separator_block_width", &separator_block_width);
+	json_object_object_get_ex(json, "background", &background);
+	json_object_object_get_ex(json, "border", &border);
+	json_object_object_get_ex(json, "border_top", &border_top);
+	json_object_object_get_ex(json, "border_bottom", &border_bottom);
+	json_object_object_get_ex(json, "border_left", &border_left);
+	json_object_object_get_ex(json, "border_right", &border_right);
+
+	*block = (struct i3bar_block){0};
+	block->full_text = (char *)json_string_or_null(full_text);
+	block->short_text = (char *)json_string_or_null(short_text);
+	if (color) {
+		const char *hexstring = json_object_get_string(color);
+		block->color_set = parse_color(hexstring, &block->color);
+		if (!block->color_set) {
+			sway_log(SWAY_ERROR, "Invalid block color: %s", hexstring);
+		}
+	}
+	if (min_width) {
+		json_type type = json_object_get_type(min_width);
+		if (type == json_type_int) {
+			block->min_width = json_object_get_int(min_width);
+		} else if (type == json_type_string) {
+			/* the width will be calculated when rendering */
+			block->min_width_str = (char *)json_object_get_string(min_width);
+		}
+	}
+	block->align = (char *)(align ? json_object_get_string(align) : "left");
+	block->urgent = urgent ? json_object_get_int(urgent) : false;
+	block->name = (char *)json_string_or_null(name);
+	block->instance = (char *)json_string_or_null(instance);
+	if (markup) {
+		block->markup = false;
+		const char *markup_str = json_object_get_string(markup);
+		if (strcmp(markup_str, "pango") == 0) {
+			block->markup = true;
+		}
+	}
+	block->separator = separator ? json_object_get_int(separator) : true;
+	block->separator_block_width = separator_block_width ?
+		json_object_get_int(separator_block_width) : 9;
+	// Airblader features
+	const char *hex = background ? json_object_get_string(background) : NULL;
+	if (hex && !parse_color(hex, &block->background)) {
+		sway_log(SWAY_ERROR, "Ignoring invalid block background: %s", hex);
+	}
+	hex = border ? json_object_get_string(border) : NULL;
+	if (hex && !parse_color(hex, &block->border)) {
+		sway_log(SWAY_ERROR, "Ignoring invalid block border: %s", hex);
+	}
+	block->border_top = border_top ? json_object_get_int(border_top) : 1;
+	block->border_bottom = border_bottom ?
+		json_object_get_int(border_bottom) : 1;
+	block->border_left = border_left ? json_object_get_int(border_left) : 1;
+	block->border_right = border_right ?
+		json_object_get_int(border_right) : 1;
+}
+
+static bool i3bar_block_equal(struct i3bar_block *a, struct i3bar_block *b) {
+	return lenient_strcmp(a->full_text, b->full_text) == 0 &&
+		lenient_strcmp(a->short_text, b->short_text) == 0 &&
+		lenient_strcmp(a->align, b->align) == 0 &&
+		lenient_strcmp(a->min_width_str, b->min_width_str) == 0 &&
+		lenient_strcmp(a->name, b->name) == 0 &&
+		lenient_strcmp(a->instance, b->instance) == 0 &&
+		a->urgent == b->urgent &&
+		a->color_set == b->color_set &&
+		(!a->color_set || a->color == b->color) &&
+		a->min_width == b->min_width &&
+		a->separator == b->separator &&
+		a->separator_block_width == b->separator_block_width &&
+		a->markup == b->markup &&
+		a->background == b->background &&
+		a->border == b->border &&
+		a->border_top == b->border_top &&
+		a->border_bottom == b->border_bottom &&
+		a->border_left == b->border_left &&
+		a->border_right == b->border_right;
+}
+
+static char *strdup_or_null(const char *str) {
+	return str ? strdup(str) : NULL;
+}
+
+/**
+ * Creates a block owning copies of the borrowed strings of a parsed block.
+ */
+static struct i3bar_block *i3bar_block_create(struct status_line *status,
+		struct i3bar_block *parsed) {
+	struct i3bar_block *block = malloc(sizeof(struct i3bar_block));
+	if (!block) {
+		return NULL;
+	}
+	*block = *parsed;
+	block->ref_count = 1;
+	block->serial = ++status->block_serial;
+	block->full_text = strdup_or_null(parsed->full_text);
+	block->short_text = strdup_or_null(parsed->short_text);
+	block->align = strdup_or_null(parsed->align);
+	block->min_width_str = strdup_or_null(parsed->min_width_str);
+	block->name = strdup_or_null(parsed->name);
+	block->instance = strdup_or_null(parsed->instance);
+	return block;
+}
+
+/**
+ * Replaces the blocks of the status line with those of the json array. Blocks
+ * whose contents did not change are kept, so their serial stays the same; a
+ * block is matched by its position first, then by its name and instance.
+ * Returns true if any block was added, removed, changed or moved.
+ */
+static bool i3bar_parse_json(struct status_line *status,
 		struct json_object *json_array) {
+	// status->blocks is kept in reverse order, for rendering right to left
+	size_t old_len = wl_list_length(&status->blocks);
+	struct i3bar_block **old = calloc(old_len ? old_len : 1, sizeof(*old));
+	if (!old) {
+		sway_log(SWAY_ERROR, "Failed to allocate block array");
+		return false;
+	}
+	size_t i = old_len;
 	struct i3bar_block *block, *tmp;
 	wl_list_for_each_safe(block, tmp, &status->blocks, link) {
 		wl_list_remove(&block->link);
-		i3bar_block_unref(block);
+		old[--i] = block;
 	}
-	for (size_t i = 0; i < json_object_array_length(json_array); ++i) {
-		json_object *full_text, *short_text, *color, *min_width, *align, *urgent;
-		json_object *name, *instance, *separator, *separator_block_width;
-		json_object *background, *border, *border_top, *border_bottom;
-		json_object *border_left, *border_right, *markup;
+	wl_list_init(&status->blocks);
+
+	bool changed = false;
+	size_t len = 0;
+	for (i = 0; i < json_object_array_length(json_array); ++i) {
 		json_object *json = json_object_array_get_idx(json_array, i);
 		if (!json) {
 			continue;
 		}
-		json_object_object_get_ex(json, "full_text", &full_text);
-		json_object_object_get_ex(json, "short_text", &short_text);
-		json_object_object_get_ex(json, "color", &color);
-		json_object_object_get_ex(json, "min_width", &min_width);
-		json_object_object_get_ex(json, "align", &align);
-		json_object_object_get_ex(json, "urgent", &urgent);
-		json_object_object_get_ex(json, "name", &name);
-		json_object_object_get_ex(json, "instance", &instance);
-		json_object_object_get_ex(json, "markup", &markup);
-		json_object_object_get_ex(json, "separator", &separator);
-		json_object_object_get_ex(json, "separator_block_width", &separator_block_width);
-		json_object_object_get_ex(json, "background", &background);
-		json_object_object_get_ex(json, "border", &border);
-		json_object_object_get_ex(json, "border_top", &border_top);
-		json_object_object_get_ex(json, "border_bottom", &border_bottom);
-		json_object_object_get_ex(json, "border_left", &border_left);
-		json_object_object_get_ex(json, "border_right", &border_right);
+		struct i3bar_block parsed;
+		i3bar_block_parse(json, &parsed);
 
-		struct i3bar_block *block = calloc(1, sizeof(struct i3bar_block));
-		block->ref_count = 1;
-		block->full_text = full_text ?
-			strdup(json_object_get_string(full_text)) : NULL;
-		block->short_text = short_text ?
-			strdup(json_object_get_string(short_text)) : NULL;
-		if (color) {
-			const char *hexstring = json_object_get_string(color);
-			block->color_set = parse_color(hexstring, &block->color);
-			if (!block->color_set) {
-				sway_log(SWAY_ERROR, "Invalid block color: %s", hexstring);
+		size_t pos = len++;
+		block = NULL;
+		if (pos < old_len && old[pos] && i3bar_block_equal(old[pos], &parsed)) {
+			block = old[pos];
+			old[pos] = NULL;
+		} else if (parsed.name) {
+			for (size_t j = 0; j < old_len; ++j) {
+				if (old[j] && i3bar_block_equal(old[j], &parsed)) {
+					block = old[j];
+					old[j] = NULL;
+					break;
+				}
 			}
+			changed = true;
+		} else {
+			changed = true;
 		}
-		if (min_width) {
-			json_type type = json_object_get_type(min_width);
-			if (type == json_type_int) {
-				block->min_width = json_object_get_int(min_width);
-			} else if (type == json_type_string) {
-				/* the width will be calculated when rendering */
-				block->min_width_str = strdup(json_object_get_string(min_width));
-			}
+		if (!block && !(block = i3bar_block_create(status, &parsed))) {
+			sway_log(SWAY_ERROR, "Failed to allocate block");
+			continue;
 		}
-		block->align = strdup(align ? json_object_get_string(align) : "left");
-		block->urgent = urgent ? json_object_get_int(urgent) : false;
-		block->name = name ? strdup(json_object_get_string(name)) : NULL;
-		block->instance = instance ?
-			strdup(json_object_get_string(instance)) : NULL;
-		if (markup) {
-			block->markup = false;
-			const char *markup_str = json_object_get_string(markup);
-			if (strcmp(markup_str, "pango") == 0) {
-				block->markup = true;
-			}
+		wl_list_insert(&status->blocks, &block->link);
+	}
+
+	for (i = 0; i < old_len; ++i) {
+		if (old[i]) {
+			changed = true;
+			i3bar_block_unref(old[i]);
 		}
-		block->separator = separator ? json_object_get_int(separator) : true;
-		block->separator_block_width = separator_block_width ?
-			json_object_get_int(separator_block_width) : 9;
-		// Airblader features
-		const char *hex = background ? json_object_get_string(background) : NULL;
-		if (hex && !parse_color(hex, &block->background)) {
-			sway_log(SWAY_ERROR, "Ignoring invalid block background: %s", hex);
+	}
+	free(old);
+	return changed;
+}
+
+/**
+ * Finds the end of the json value at the start of `str` without parsing it, so
+ * that updates superseded by a later one never need to be parsed. Returns the
+ * length of the value, or 0 if it is incomplete.
+ */
+static size_t json_value_length(const char *str, size_t len) {
+	size_t depth = 0;
+	bool in_string = false;
+	for (size_t i = 0; i < len; ++i) {
+		char c = str[i];
+		if (in_string) {
+			if (c == '\\') {
+				++i;
+			} else if (c == '"') {
+				in_string = false;
+				if (depth == 0) {
+					return i + 1;
+				}
+			}
+		} else if (c == '"') {
+			in_string = true;
+		} else if (c == '[' || c == '{') {
+			++depth;
+		} else if (c == ']' || c == '}') {
+			if (depth == 0) {
+				// a scalar followed by the end of the stream
+				return i;
+			}
+			if (--depth == 0) {
+				return i + 1;
+			}
+		} else if (depth == 0 && (c == ',' || isspace(c))) {
+			return i; // end of a scalar
 		}
-		hex = border ? json_object_get_string(border) : NULL;
-		if (hex && !parse_color(hex, &block->border)) {
-			sway_log(SWAY_ERROR, "Ignoring invalid block border: %s", hex);
+	}
+	return 0;
+}
+
+/**
+ * Keeps a copy of the newest complete array until it is applied.
+ */
+static bool i3bar_store_update(struct status_line *status, const char *json,
+		size_t len) {
+	if (len > status->update_size) {
+		char *update = realloc(status->update, len);
+		if (!update) {
+			return false;
 		}
-		block->border_top = border_top ? json_object_get_int(border_top) : 1;
-		block->border_bottom = border_bottom ?
-			json_object_get_int(border_bottom) : 1;
-		block->border_left = border_left ? json_object_get_int(border_left) : 1;
-		block->border_right = border_right ?
-			json_object_get_int(border_right) : 1;
-		wl_list_insert(&status->blocks, &block->link);
+		status->update = update;
+		status->update_size = len;
 	}
+	memcpy(status->update, json, len);
+	status->update_len = len;
+	return true;
 }
 
 bool i3bar_handle_readable(struct status_line *status) {
@@ -149,15 +315,15 @@ bool i3bar_handle_readable(struct status_line *status) {
 		}
 	}
 
-	struct json_object *last_object = NULL;
-	struct json_object *test_object;
+	bool updated = false;
 	size_t buffer_pos = 0;
+	int reads = 0;
 	while (true) {
 		// since the incoming stream is an infinite array
-		// parsing is split into two parts
-		// first, attempt to parse the current object, reading more if the
-		// parser indicates that the current object is incomplete, and failing
-		// if the parser fails
+		// scanning is split into two parts
+		// first, find the end of the current object, reading more if it is
+		// incomplete; only the last complete array is kept, to be parsed
+		// when it is applied
 		// second, look for separating comma, ignoring whitespace, failing if
 		// any other characters are encountered
 		if (status->expecting_comma) {
@@ -178,71 +344,63 @@ bool i3bar_handle_readable(struct status_line *status) {
 			}
 			buffer_pos = status->buffer_index = 0;
 		} else {
-			test_object = json_tokener_parse_ex(status->tokener,
-					&status->buffer[buffer_pos], status->buffer_index - buffer_pos);
-			enum json_tokener_error err = json_tokener_get_error(status->tokener);
-			if (err == json_tokener_success) {
-				if (json_object_get_type(test_object) == json_type_array) {
-					if (last_object) {
-						json_object_put(last_object);
+			while (buffer_pos < status->buffer_index &&
+					isspace(status->buffer[buffer_pos])) {
+				++buffer_pos;
+			}
+			const char *object = &status->buffer[buffer_pos];
+			if (buffer_pos < status->buffer_index && strchr(",]}", object[0])) {
+				sway_log(SWAY_DEBUG, "Invalid i3bar json: expected a value but encountered '%c'",
+						object[0]);
+				status_error(status, "[invalid i3bar json]");
+				return true;
+			}
+			size_t length = buffer_pos < status->buffer_index ?
+				json_value_length(object, status->buffer_index - buffer_pos) : 0;
+			if (length > 0) {
+				sway_log(SWAY_DEBUG, "Received i3bar json: '%.*s'",
+						(int)length, object);
+				if (object[0] == '[') {
+					if (!i3bar_store_update(status, object, length)) {
+						status_error(status, "[failed to allocate buffer]");
+						return true;
 					}
-					last_object = test_object;
-				} else {
-					json_object_put(test_object);
+					updated = true;
 				}
 
-				// in order to print the json for debugging purposes
-				// the last character is temporarily replaced with a null character
-				// (the last character is used in case the buffer is full)
-				char *last_char_pos =
-					&status->buffer[buffer_pos + status->tokener->char_offset - 1];
-				char last_char = *last_char_pos;
-				while (isspace(last_char)) {
-					last_char = *--last_char_pos;
-				}
-				*last_char_pos = '\0';
-				size_t offset = strspn(&status->buffer[buffer_pos], " \f\n\r\t\v");
-				sway_log(SWAY_DEBUG, "Received i3bar json: '%s%c'",
-						&status->buffer[buffer_pos + offset], last_char);
-				*last_char_pos = last_char;
-
-				buffer_pos += status->tokener->char_offset;
+				buffer_pos += length;
 				status->expecting_comma = true;
 
 				if (buffer_pos < status->buffer_index) {
 					continue; // look for comma without reading more input
 				}
 				buffer_pos = status->buffer_index = 0;
-			} else if (err == json_tokener_continue) {
-				json_tokener_reset(status->tokener);
-				if (status->buffer_index < status->buffer_size) {
-					// move the object to the start of the buffer
-					status->buffer_index -= buffer_pos;
-					memmove(status->buffer, &status->buffer[buffer_pos],
-							status->buffer_index);
-					buffer_pos = 0;
+			} else if (buffer_pos > 0) {
+				// move the object to the start of the buffer
+				status->buffer_index -= buffer_pos;
+				memmove(status->buffer, &status->buffer[buffer_pos],
+						status->buffer_index);
+				buffer_pos = 0;
+			} else if (status->buffer_index == status->buffer_size) {
+				// expand buffer
+				status->buffer_size *= 2;
+				char *new_buffer = realloc(status->buffer, status->buffer_size);
+				if (new_buffer) {
+					status->buffer = new_buffer;
 				} else {
-					// expand buffer
-					status->buffer_size *= 2;
-					char *new_buffer = realloc(status->buffer, status->buffer_size);
-					if (new_buffer) {
-						status->buffer = new_buffer;
-					} else {
-						free(status->buffer);
-						status_error(status, "[failed to allocate buffer]");
-						return true;
-					}
+					free(status->buffer);
+					status->buffer = NULL;
+					status_error(status, "[failed to allocate buffer]");
+					return true;
 				}
-			} else {
-				char last_char = status->buffer[status->buffer_index - 1];
-				status->buffer[status->buffer_index - 1] = '\0';
-				sway_log(SWAY_DEBUG, "Failed to parse i3bar json - %s: '%s%c'",
-						json_tokener_error_desc(err), &status->buffer[buffer_pos], last_char);
-				status_error(status, "[failed to parse i3bar json]");
-				return true;
 			}
 		}
 
+		if (reads >= I3BAR_MAX_READS) {
+			// let other sources be handled, the fd is still readable
+			break;
+		}
+		++reads;
 		errno = 0;
 		ssize_t read_bytes = read(status->read_fd, &status->buffer[status->buffer_index],
 				status->buffer_size - status->buffer_index);
@@ -256,14 +414,37 @@ bool i3bar_handle_readable(struct status_line *status) {
 		}
 	}
 
-	if (last_object) {
-		sway_log(SWAY_DEBUG, "Rendering last received json");
-		i3bar_parse_json(status, last_object);
-		json_object_put(last_object);
-		return true;
-	} else {
+	if (updated) {
+		// Whether the blocks changed is only known once the update is applied
+		status->update_pending = true;
+	}
+	return false;
+}
+
+bool i3bar_apply_update(struct status_line *status) {
+	if (!status->update_pending) {
 		return false;
 	}
+	status->update_pending = false;
+
+	json_tokener_reset(status->tokener);
+	json_object *json = json_tokener_parse_ex(status->tokener,
+			status->update, status->update_len);
+	enum json_tokener_error err = json_tokener_get_error(status->tokener);
+	if (err != json_tokener_success) {
+		sway_log(SWAY_DEBUG, "Failed to parse i3bar json - %s: '%.*s'",
+				json_tokener_error_desc(err), (int)status->update_len,
+				status->update);
+		json_object_put(json);
+		status_error(status, "[failed to parse i3bar json]");
+		return true;
+	}
+
+	bool changed = i3bar_parse_json(status, json);
+	sway_log(SWAY_DEBUG, changed ? "Rendering last received json" :
+			"Last received json did not change any block");
+	json_object_put(json);
+	return changed;
 }
 
 enum hotspot_event_handling i3bar_block_send_click(struct status_line *status,
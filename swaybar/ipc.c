@@ -1,12 +1,16 @@
 #define _POSIX_C_SOURCE 200809
+#include <ctype.h>
 #include <limits.h>
 #include <poll.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <unistd.h>
 #include <json.h>
 #include "swaybar/config.h"
 #include "swaybar/ipc.h"
+#include "swaybar/render.h"
 #include "swaybar/status_line.h"
 #if HAVE_TRAY
 #include "swaybar/tray/tray.h"
@@ -40,7 +44,7 @@ void ipc_send_workspace_command(struct swaybar *bar, const char *ws) {
 		command[d++] = ws[i];
 	}
 
-	free(ipc_single_command(bar->ipc_socketfd, IPC_COMMAND, command, &size));
+	ipc_client_send(bar->ipc, IPC_COMMAND, command, size, NULL, NULL);
 	free(command);
 }
 
@@ -95,14 +99,12 @@ static void ipc_parse_colors(
 }
 
 static bool ipc_parse_config(
-		struct swaybar_config *config, const char *payload) {
-	json_object *bar_config = json_tokener_parse(payload);
+		struct swaybar_config *config, json_object *bar_config) {
 	json_object *success;
 	if (json_object_object_get_ex(bar_config, "success", &success)
 			&& !json_object_get_boolean(success)) {
 		sway_log(SWAY_ERROR, "No bar with that ID. Use 'swaymsg -t "
 				"get_bar_config' to get the available bar configs.");
-		json_object_put(bar_config);
 		return false;
 	}
 
@@ -331,107 +333,375 @@ static bool ipc_parse_config(
 	}
 #endif
 
-	json_object_put(bar_config);
 	return true;
 }
 
-bool ipc_get_workspaces(struct swaybar *bar) {
-	struct swaybar_output *output;
-	wl_list_for_each(output, &bar->outputs, link) {
-		free_workspaces(&output->workspaces);
-		output->focused = false;
+static void workspace_set_name(struct swaybar *bar,
+		struct swaybar_workspace *ws, json_object *json) {
+	json_object *num, *name;
+	json_object_object_get_ex(json, "num", &num);
+	json_object_object_get_ex(json, "name", &name);
+
+	free(ws->name);
+	free(ws->label);
+	ws->num = json_object_get_int(num);
+	ws->name = strdup(json_object_get_string(name));
+	ws->label = strdup(ws->name);
+	// ws->num will be -1 if workspace name doesn't begin with int.
+	if (ws->num != -1) {
+		size_t len_offset = snprintf(NULL, 0, "%d", ws->num);
+		if (bar->config->strip_workspace_name) {
+			free(ws->label);
+			ws->label = malloc(len_offset + 1);
+			snprintf(ws->label, len_offset + 1, "%d", ws->num);
+		} else if (bar->config->strip_workspace_numbers) {
+			len_offset += ws->label[len_offset] == ':';
+			if (ws->name[len_offset] != '\0') {
+				free(ws->label);
+				// Strip number prefix [1-?:] using len_offset.
+				ws->label = strdup(ws->name + len_offset);
+			}
+		}
+	}
+}
+
+static struct swaybar_workspace *workspace_create(struct swaybar *bar,
+		json_object *json) {
+	json_object *id, *urgent;
+	json_object_object_get_ex(json, "id", &id);
+	json_object_object_get_ex(json, "urgent", &urgent);
+
+	struct swaybar_workspace *ws = calloc(1, sizeof(struct swaybar_workspace));
+	ws->id = json_object_get_int(id);
+	workspace_set_name(bar, ws, json);
+	ws->urgent = json_object_get_boolean(urgent);
+	return ws;
+}
+
+// The order of the workspaces of an output in sway
+static int workspace_cmp(struct swaybar_workspace *a,
+		struct swaybar_workspace *b) {
+	if (isdigit(a->name[0]) && isdigit(b->name[0])) {
+		int a_num = strtol(a->name, NULL, 10);
+		int b_num = strtol(b->name, NULL, 10);
+		return (a_num < b_num) ? -1 : (a_num > b_num);
+	} else if (isdigit(a->name[0])) {
+		return -1;
+	} else if (isdigit(b->name[0])) {
+		return 1;
+	}
+	return 0;
+}
+
+static void sort_workspaces(struct swaybar_output *output) {
+	// Insertion sort, as stable as the sort in sway
+	struct wl_list sorted;
+	wl_list_init(&sorted);
+	struct swaybar_workspace *ws, *tmp;
+	wl_list_for_each_safe(ws, tmp, &output->workspaces, link) {
+		wl_list_remove(&ws->link);
+		struct wl_list *pos = sorted.prev;
+		while (pos != &sorted) {
+			struct swaybar_workspace *other = wl_container_of(pos, other, link);
+			if (workspace_cmp(other, ws) <= 0) {
+				break;
+			}
+			pos = pos->prev;
+		}
+		wl_list_insert(pos, &ws->link);
+	}
+	wl_list_insert_list(&output->workspaces, &sorted);
+}
+
+static bool workspaces_equal(struct wl_list *a, struct wl_list *b) {
+	struct wl_list *pos_a = a->next, *pos_b = b->next;
+	for (; pos_a != a && pos_b != b; pos_a = pos_a->next, pos_b = pos_b->next) {
+		struct swaybar_workspace *ws_a = wl_container_of(pos_a, ws_a, link);
+		struct swaybar_workspace *ws_b = wl_container_of(pos_b, ws_b, link);
+		if (ws_a->id != ws_b->id || ws_a->focused != ws_b->focused ||
+				ws_a->visible != ws_b->visible ||
+				ws_a->urgent != ws_b->urgent ||
+				strcmp(ws_a->name, ws_b->name) != 0 ||
+				strcmp(ws_a->label, ws_b->label) != 0) {
+			return false;
+		}
+	}
+	return pos_a == a && pos_b == b;
+}
+
+/**
+ * Marks the outputs of the list dirty, once all of them are up to date, and
+ * frees the list.
+ */
+static void set_outputs_dirty(list_t *outputs) {
+	for (int i = 0; i < outputs->length; ++i) {
+		set_output_dirty(outputs->items[i]);
+	}
+	list_free(outputs);
+}
+
+static void handle_workspaces_reply(struct ipc_client *client, uint32_t type,
+		const char *payload, uint32_t size, void *data) {
+	struct swaybar *bar = data;
+	bar->workspaces_pending = false;
+	if (!payload) {
+		return;
 	}
-	uint32_t len = 0;
-	char *res = ipc_single_command(bar->ipc_socketfd,
-			IPC_GET_WORKSPACES, NULL, &len);
-	json_object *results = json_tokener_parse(res);
+	if (bar->workspaces_stale) {
+		// Skip the outdated reply and ask again
+		bar->workspaces_stale = false;
+		ipc_get_workspaces(bar);
+		return;
+	}
+	json_object *results = ipc_parse_payload(payload, size, bar->ipc_encoding);
 	if (!results) {
-		free(res);
-		return false;
+		return;
 	}
 
 	bar->visible_by_urgency = false;
+	list_t *changed = create_list();
 	size_t length = json_object_array_length(results);
-	json_object *ws_json;
-	json_object *num, *name, *visible, *focused, *out, *urgent;
-	for (size_t i = 0; i < length; ++i) {
-		ws_json = json_object_array_get_idx(results, i);
-
-		json_object_object_get_ex(ws_json, "num", &num);
-		json_object_object_get_ex(ws_json, "name", &name);
-		json_object_object_get_ex(ws_json, "visible", &visible);
-		json_object_object_get_ex(ws_json, "focused", &focused);
-		json_object_object_get_ex(ws_json, "output", &out);
-		json_object_object_get_ex(ws_json, "urgent", &urgent);
-
-		wl_list_for_each(output, &bar->outputs, link) {
+	struct swaybar_output *output;
+	wl_list_for_each(output, &bar->outputs, link) {
+		struct wl_list workspaces;
+		wl_list_init(&workspaces);
+		bool focused = false;
+
+		json_object *ws_json;
+		json_object *visible, *focused_json, *out;
+		for (size_t i = 0; i < length; ++i) {
+			ws_json = json_object_array_get_idx(results, i);
+
+			json_object_object_get_ex(ws_json, "visible", &visible);
+			json_object_object_get_ex(ws_json, "focused", &focused_json);
+			json_object_object_get_ex(ws_json, "output", &out);
+
 			const char *ws_output = json_object_get_string(out);
 			if (ws_output != NULL && strcmp(ws_output, output->name) == 0) {
-				struct swaybar_workspace *ws =
-					calloc(1, sizeof(struct swaybar_workspace));
-				ws->num = json_object_get_int(num);
-				ws->name = strdup(json_object_get_string(name));
-				ws->label = strdup(ws->name);
-				// ws->num will be -1 if workspace name doesn't begin with int.
-				if (ws->num != -1) {
-					size_t len_offset = snprintf(NULL, 0, "%d", ws->num);
-					if (bar->config->strip_workspace_name) {
-						free(ws->label);
-						ws->label = malloc(len_offset + 1);
-						snprintf(ws->label, len_offset + 1, "%d", ws->num);
-					} else if (bar->config->strip_workspace_numbers) {
-						len_offset += ws->label[len_offset] == ':';
-						if (ws->name[len_offset] != '\0') {
-							free(ws->label);
-							// Strip number prefix [1-?:] using len_offset.
-							ws->label = strdup(ws->name + len_offset);
-						}
-					}
-				}
+				struct swaybar_workspace *ws = workspace_create(bar, ws_json);
 				ws->visible = json_object_get_boolean(visible);
-				ws->focused = json_object_get_boolean(focused);
+				ws->focused = json_object_get_boolean(focused_json);
 				if (ws->focused) {
-					output->focused = true;
+					focused = true;
 				}
-				ws->urgent = json_object_get_boolean(urgent);
 				if (ws->urgent) {
 					bar->visible_by_urgency = true;
 				}
-				wl_list_insert(output->workspaces.prev, &ws->link);
+				wl_list_insert(workspaces.prev, &ws->link);
 			}
 		}
+
+		// Only outputs whose workspaces changed need to be rendered again
+		if (focused != output->focused ||
+				!workspaces_equal(&workspaces, &output->workspaces)) {
+			list_add(changed, output);
+		}
+		free_workspaces(&output->workspaces);
+		wl_list_insert_list(&output->workspaces, &workspaces);
+		output->focused = focused;
 	}
 	json_object_put(results);
-	free(res);
-	return determine_bar_visibility(bar, false);
+	determine_bar_visibility(bar, false);
+	set_outputs_dirty(changed);
+}
+
+/**
+ * Applies a workspace event to the workspaces of the bar, without querying
+ * them all again. The workspaces in the event are described as nodes, which
+ * carry neither the "visible" flag nor the "focused" flag of the workspace
+ * query; these are derived from the change instead. Returns false if the
+ * workspaces have to be queried, for changes that cannot be derived (a reload,
+ * a moved workspace or focus moving to another output) or events that do not
+ * match the workspaces of the bar.
+ * Only the outputs whose workspaces changed are marked dirty.
+ */
+static bool handle_workspace_event(struct swaybar *bar, json_object *event) {
+	if (bar->workspaces_pending) {
+		// The reply may or may not include this change already
+		return false;
+	}
+	json_object *change_json, *current, *id_json, *out_json;
+	if (!json_object_object_get_ex(event, "change", &change_json) ||
+			!json_object_object_get_ex(event, "current", &current) ||
+			!json_object_object_get_ex(current, "id", &id_json) ||
+			!json_object_object_get_ex(current, "output", &out_json)) {
+		return false;
+	}
+	const char *change = json_object_get_string(change_json);
+	int id = json_object_get_int(id_json);
+	const char *out = json_object_get_string(out_json);
+
+	// The output is NULL if the workspace is not on an output of this bar
+	struct swaybar_output *output = NULL, *ws_output = NULL;
+	struct swaybar_workspace *ws = NULL;
+	struct swaybar_output *o;
+	wl_list_for_each(o, &bar->outputs, link) {
+		if (out && strcmp(o->name, out) == 0) {
+			output = o;
+		}
+		struct swaybar_workspace *w;
+		wl_list_for_each(w, &o->workspaces, link) {
+			if (w->id == id) {
+				ws = w;
+				ws_output = o;
+			}
+		}
+	}
+	if (ws_output != output) {
+		return false;
+	}
+
+	list_t *changed = create_list();
+	if (strcmp(change, "focus") == 0) {
+		if (output && !ws) {
+			list_free(changed);
+			return false;
+		}
+		// The workspace shown on the previously focused output is only known
+		// from the workspace query
+		wl_list_for_each(o, &bar->outputs, link) {
+			if (o->focused && o != output) {
+				list_free(changed);
+				return false;
+			}
+		}
+		wl_list_for_each(o, &bar->outputs, link) {
+			bool output_changed = o->focused != (o == output);
+			o->focused = o == output;
+			struct swaybar_workspace *w;
+			wl_list_for_each(w, &o->workspaces, link) {
+				output_changed |= w->focused != (w == ws);
+				w->focused = w == ws;
+				if (o == output) {
+					output_changed |= w->visible != (w == ws);
+					w->visible = w == ws;
+				}
+			}
+			if (output_changed) {
+				list_add(changed, o);
+			}
+		}
+	} else if (strcmp(change, "init") == 0) {
+		if (ws) {
+			list_free(changed);
+			return false;
+		} else if (output) {
+			ws = workspace_create(bar, current);
+			// The first workspace of an output is created to be shown
+			ws->visible = wl_list_empty(&output->workspaces);
+			wl_list_insert(output->workspaces.prev, &ws->link);
+			sort_workspaces(output);
+			list_add(changed, output);
+		}
+	} else if (strcmp(change, "empty") == 0 ||
+			strcmp(change, "rename") == 0 ||
+			strcmp(change, "urgent") == 0) {
+		if (!ws) {
+			list_free(changed);
+			return !output;
+		}
+		list_add(changed, output);
+		if (strcmp(change, "empty") == 0) {
+			free_workspace(ws);
+		} else if (strcmp(change, "rename") == 0) {
+			workspace_set_name(bar, ws, current);
+			sort_workspaces(output);
+		} else {
+			json_object *urgent;
+			json_object_object_get_ex(current, "urgent", &urgent);
+			ws->urgent = json_object_get_boolean(urgent);
+		}
+	} else {
+		list_free(changed);
+		return false;
+	}
+
+	bar->visible_by_urgency = false;
+	wl_list_for_each(o, &bar->outputs, link) {
+		struct swaybar_workspace *w;
+		wl_list_for_each(w, &o->workspaces, link) {
+			bar->visible_by_urgency |= w->urgent;
+		}
+	}
+	determine_bar_visibility(bar, false);
+	set_outputs_dirty(changed);
+	return true;
+}
+
+void ipc_get_workspaces(struct swaybar *bar) {
+	// Bursts of workspace events only need one more request once the
+	// pending one is answered
+	if (bar->workspaces_pending) {
+		bar->workspaces_stale = true;
+		return;
+	}
+	bar->workspaces_pending = ipc_client_send(bar->ipc, IPC_GET_WORKSPACES,
+			NULL, 0, handle_workspaces_reply, bar);
 }
 
 void ipc_execute_binding(struct swaybar *bar, struct swaybar_binding *bind) {
 	sway_log(SWAY_DEBUG, "Executing binding for button %u (release=%d): `%s`",
 			bind->button, bind->release, bind->command);
-	uint32_t len = strlen(bind->command);
-	free(ipc_single_command(bar->ipc_socketfd,
-			IPC_COMMAND, bind->command, &len));
+	ipc_client_send(bar->ipc, IPC_COMMAND, bind->command,
+			strlen(bind->command), NULL, NULL);
 }
 
-bool ipc_initialize(struct swaybar *bar) {
+static void handle_ipc_event(struct ipc_client *client, uint32_t type,
+		const char *payload, uint32_t size, void *data);
+
+static void handle_ipc_close(struct ipc_client *client, void *data) {
+	struct swaybar *bar = data;
+	sway_log(SWAY_ERROR, "Lost the IPC connection to sway");
+	bar->running = false;
+}
+
+bool ipc_initialize(struct swaybar *bar, int socketfd, int event_socketfd) {
+	// Use the binary encoding to avoid generating and parsing JSON text
+	bar->ipc_encoding = IPC_ENCODING_JSON;
+	if (ipc_set_encoding(socketfd, IPC_ENCODING_CBOR)) {
+		if (ipc_set_encoding(event_socketfd, IPC_ENCODING_CBOR)) {
+			bar->ipc_encoding = IPC_ENCODING_CBOR;
+		} else {
+			ipc_set_encoding(socketfd, IPC_ENCODING_JSON);
+		}
+	}
+
 	uint32_t len = strlen(bar->id);
-	char *res = ipc_single_command(bar->ipc_socketfd,
+	char *res = ipc_single_command(socketfd,
 			IPC_GET_BAR_CONFIG, bar->id, &len);
-	if (!ipc_parse_config(bar->config, res)) {
-		free(res);
+	json_object *bar_config = ipc_parse_payload(res, len, bar->ipc_encoding);
+	free(res);
+	if (!bar_config || !ipc_parse_config(bar->config, bar_config)) {
+		json_object_put(bar_config);
+		close(socketfd);
+		close(event_socketfd);
 		return false;
 	}
-	free(res);
+	json_object_put(bar_config);
 
 	struct swaybar_config *config = bar->config;
 	char subscribe[128]; // suitably large buffer
 	len = snprintf(subscribe, 128,
 			"[ \"barconfig_update\" , \"bar_state_update\" %s %s ]",
 			config->binding_mode_indicator ? ", \"mode\"" : "",
-			config->workspace_buttons ? ", \"workspace\"" : "");
-	free(ipc_single_command(bar->ipc_event_socketfd,
+			config->workspace_buttons ?
+				", \"workspace\" , \"overflow\"" : "");
+	free(ipc_single_command(event_socketfd,
 			IPC_SUBSCRIBE, subscribe, &len));
+
+	// Everything from here on is sent and received without blocking
+	bar->ipc = ipc_client_create(socketfd, NULL, handle_ipc_close, bar);
+	bar->ipc_events = ipc_client_create(event_socketfd,
+			handle_ipc_event, handle_ipc_close, bar);
+	if (!bar->ipc || !bar->ipc_events) {
+		if (!bar->ipc) {
+			close(socketfd);
+		}
+		if (!bar->ipc_events) {
+			close(event_socketfd);
+		}
+		return false;
+	}
 	return true;
 }
 
@@ -456,7 +726,7 @@ static bool handle_bar_state_update(struct swaybar *bar, json_object *event) {
 	return determine_bar_visibility(bar, false);
 }
 
-static bool handle_barconfig_update(struct swaybar *bar, const char *payload,
+static bool handle_barconfig_update(struct swaybar *bar,
 		json_object *json_config) {
 	json_object *json_id = json_object_object_get(json_config, "id");
 	const char *id = json_object_get_string(json_id);
@@ -465,13 +735,16 @@ static bool handle_barconfig_update(struct swaybar *bar, const char *payload,
 	}
 
 	struct swaybar_config *newcfg = init_config();
-	ipc_parse_config(newcfg, payload);
+	ipc_parse_config(newcfg, json_config);
 
 	struct swaybar_config *oldcfg = bar->config;
 	bar->config = newcfg;
+	free_status_strips(bar);
 
 	struct swaybar_output *output, *tmp_output;
 	wl_list_for_each_safe(output, tmp_output, &bar->outputs, link) {
+		output->last_buffer = NULL; // repaint everything
+
 		bool found = wl_list_empty(&newcfg->outputs);
 		struct config_output *coutput;
 		wl_list_for_each(coutput, &newcfg->outputs, link) {
@@ -491,6 +764,8 @@ static bool handle_barconfig_update(struct swaybar *bar, const char *payload,
 		}
 	}
 	wl_list_for_each_safe(output, tmp_output, &bar->unused_outputs, link) {
+		output->last_buffer = NULL;
+
 		bool found = wl_list_empty(&newcfg->outputs);
 		struct config_output *coutput;
 		wl_list_for_each(coutput, &newcfg->outputs, link) {
@@ -541,37 +816,30 @@ static bool handle_barconfig_update(struct swaybar *bar, const char *payload,
 	return true;
 }
 
-bool handle_ipc_readable(struct swaybar *bar) {
-	struct ipc_response *resp = ipc_recv_response(bar->ipc_event_socketfd);
-	if (!resp) {
-		return false;
-	}
-
-	// The default depth of 32 is too small to represent some nested layouts, but
-	// we can't pass INT_MAX here because json-c (as of this writing) prefaults
-	// all the memory for its stack.
-	json_tokener *tok = json_tokener_new_ex(256);
-	if (!tok) {
-		sway_log_errno(SWAY_ERROR, "failed to create tokener");
-		free_ipc_response(resp);
-		return false;
-	}
-
-	json_object *result = json_tokener_parse_ex(tok, resp->payload, -1);
-	enum json_tokener_error err = json_tokener_get_error(tok);
-	json_tokener_free(tok);
-
-	if (err != json_tokener_success) {
-		sway_log(SWAY_ERROR, "failed to parse payload as json: %s",
-				json_tokener_error_desc(err));
-		free_ipc_response(resp);
-		return false;
+static void handle_ipc_event(struct ipc_client *client, uint32_t type,
+		const char *payload, uint32_t size, void *data) {
+	struct swaybar *bar = data;
+	json_object *result = ipc_parse_payload(payload, size, bar->ipc_encoding);
+	if (!result) {
+		return;
 	}
 
 	bool bar_is_dirty = true;
-	switch (resp->type) {
+	switch (type) {
 	case IPC_EVENT_WORKSPACE:
-		bar_is_dirty = ipc_get_workspaces(bar);
+		// The outputs which changed are redrawn by the handler, or once the
+		// reply arrives
+		if (!handle_workspace_event(bar, result)) {
+			ipc_get_workspaces(bar);
+		}
+		bar_is_dirty = false;
+		break;
+	case IPC_EVENT_OVERFLOW:
+		// Workspace events were dropped, so the workspaces may be out of date
+		if (bar->config->workspace_buttons) {
+			ipc_get_workspaces(bar);
+		}
+		bar_is_dirty = false;
 		break;
 	case IPC_EVENT_MODE: {
 		json_object *json_change, *json_pango_markup;
@@ -593,7 +861,7 @@ bool handle_ipc_readable(struct swaybar *bar) {
 		break;
 	}
 	case IPC_EVENT_BARCONFIG_UPDATE:
-		bar_is_dirty = handle_barconfig_update(bar, resp->payload, result);
+		bar_is_dirty = handle_barconfig_update(bar, result);
 		break;
 	case IPC_EVENT_BAR_STATE_UPDATE:
 		bar_is_dirty = handle_bar_state_update(bar, result);
@@ -603,6 +871,7 @@ bool handle_ipc_readable(struct swaybar *bar) {
 		break;
 	}
 	json_object_put(result);
-	free_ipc_response(resp);
-	return bar_is_dirty;
+	if (bar_is_dirty) {
+		set_bar_dirty(bar);
+	}
 }
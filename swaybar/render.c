@@ -6,6 +6,7 @@
 #include <stdint.h>
 #include <string.h>
 #include "cairo_util.h"
+#include "list.h"
 #include "pango.h"
 #include "pool-buffer.h"
 #include "swaybar/bar.h"
@@ -15,6 +16,7 @@
 #include "swaybar/render.h"
 #include "swaybar/status_line.h"
 #if HAVE_TRAY
+#include "swaybar/tray/item.h"
 #include "swaybar/tray/tray.h"
 #endif
 #include "wlr-layer-shell-unstable-v1-client-protocol.h"
@@ -22,6 +24,42 @@
 static const int WS_HORIZONTAL_PADDING = 5;
 static const double WS_VERTICAL_PADDING = 1.5;
 static const double BORDER_WIDTH = 1;
+// Damaged spans are widened by this, in surface coordinates, to cover text
+// which overhangs its element
+static const int DAMAGE_MARGIN = 2;
+
+/**
+ * Something drawn across the whole height of the bar between x and x + width,
+ * in buffer coordinates. The key identifies everything it was drawn from.
+ */
+struct render_element {
+	double x, width;
+	uint64_t key;
+};
+
+struct damage_span {
+	int x0, x1;
+};
+
+// Status line renderings kept for outputs with the same parameters
+#define STATUS_STRIP_CACHE_SIZE 4
+
+struct status_strip_hotspot {
+	int x, y, width, height;
+	struct i3bar_block *block;
+};
+
+struct status_strip {
+	uint64_t key;
+	cairo_surface_t *recording;
+	double x0, x1;
+	uint32_t height;
+	uint32_t background_color; // after the status line
+	struct render_element *elements;
+	size_t elements_len;
+	struct status_strip_hotspot *hotspots;
+	size_t hotspots_len;
+};
 
 struct render_context {
 	cairo_t *cairo;
@@ -29,8 +67,65 @@ struct render_context {
 	cairo_font_options_t *textaa_sharp;
 	cairo_font_options_t *textaa_safe;
 	uint32_t background_color;
+
+	struct render_element *elements;
+	size_t elements_len, elements_cap;
 };
 
+static uint64_t hash_bytes(uint64_t hash, const void *data, size_t len) {
+	const unsigned char *bytes = data;
+	for (size_t i = 0; i < len; ++i) {
+		hash ^= bytes[i];
+		hash *= 0x100000001b3;
+	}
+	return hash;
+}
+
+static uint64_t hash_u64(uint64_t hash, uint64_t value) {
+	return hash_bytes(hash, &value, sizeof(value));
+}
+
+static uint64_t hash_str(uint64_t hash, const char *str) {
+	return str ? hash_bytes(hash, str, strlen(str) + 1) : hash_u64(hash, 0);
+}
+
+/**
+ * Starts the key of an element. Text antialiasing depends on the background
+ * left by the previous element.
+ */
+static uint64_t element_key(struct render_context *ctx) {
+	return hash_u64(0xcbf29ce484222325, ctx->background_color);
+}
+
+static void add_element(struct render_context *ctx, double x0, double x1,
+		uint64_t key) {
+	if (x0 > x1) {
+		double tmp = x0;
+		x0 = x1;
+		x1 = tmp;
+	}
+	if (x1 - x0 <= 0) {
+		return;
+	}
+	if (ctx->elements_len == ctx->elements_cap) {
+		size_t cap = ctx->elements_cap ? ctx->elements_cap * 2 : 32;
+		struct render_element *elements =
+			realloc(ctx->elements, cap * sizeof(*elements));
+		if (!elements) {
+			// Without the element, repaint the whole frame
+			ctx->output->last_buffer = NULL;
+			return;
+		}
+		ctx->elements = elements;
+		ctx->elements_cap = cap;
+	}
+	ctx->elements[ctx->elements_len++] = (struct render_element){
+		.x = x0,
+		.width = x1 - x0,
+		.key = key,
+	};
+}
+
 static void choose_text_aa_mode(struct render_context *ctx, uint32_t fontcolor) {
 	uint32_t salpha = fontcolor & 0xFF;
 	uint32_t balpha = ctx->background_color & 0xFF;
@@ -494,13 +589,16 @@ static uint32_t predict_binding_mode_indicator_length(cairo_t *cairo,
 	return width;
 }
 
-static uint32_t render_status_line_i3bar(struct render_context *ctx, double *x) {
-	struct swaybar_output *output = ctx->output;
-	uint32_t max_height = 0;
-	bool edge = *x == output->width * output->scale;
-	struct i3bar_block *block;
-	bool use_short_text = false;
+static uint64_t status_block_key(struct render_context *ctx,
+		struct i3bar_block *block, bool edge, bool use_short_text) {
+	// The serial of a block only stays the same while its contents do
+	uint64_t key = hash_u64(element_key(ctx), block->serial);
+	key = hash_u64(key, use_short_text);
+	return hash_u64(key, edge);
+}
 
+static bool status_line_use_short_text(struct render_context *ctx, double x) {
+	struct swaybar_output *output = ctx->output;
 	cairo_t *cairo = ctx->cairo;
 	double reserved_width =
 			predict_workspace_buttons_length(cairo, output) +
@@ -508,36 +606,232 @@ static uint32_t render_status_line_i3bar(struct render_context *ctx, double *x)
 			3 * output->scale; // require a bit of space for margin
 
 	double predicted_full_pos =
-			predict_status_line_pos(cairo, output, *x);
+			predict_status_line_pos(cairo, output, x);
 
-	if (predicted_full_pos < reserved_width) {
-		use_short_text = true;
-	}
+	return predicted_full_pos < reserved_width;
+}
+
+static uint32_t render_status_line_i3bar(struct render_context *ctx, double *x,
+		bool use_short_text) {
+	struct swaybar_output *output = ctx->output;
+	uint32_t max_height = 0;
+	bool edge = *x == output->width * output->scale;
+	struct i3bar_block *block;
 
 	wl_list_for_each(block, &output->bar->status->blocks, link) {
+		double start = *x;
+		uint64_t key = status_block_key(ctx, block, edge, use_short_text);
 		uint32_t h = render_status_block(ctx, block, x, edge,
 					use_short_text);
+		add_element(ctx, *x, start, key);
 		max_height = h > max_height ? h : max_height;
 		edge = false;
 	}
 	return max_height;
 }
 
-static uint32_t render_status_line(struct render_context *ctx, double *x) {
+static uint32_t render_status_line_protocol(struct render_context *ctx,
+		double *x, bool use_short_text) {
 	struct status_line *status = ctx->output->bar->status;
+	double start = *x;
+	uint64_t key = hash_str(hash_u64(element_key(ctx), status->protocol),
+			status->text);
+	uint32_t height;
 	switch (status->protocol) {
 	case PROTOCOL_ERROR:
-		return render_status_line_error(ctx, x);
+		height = render_status_line_error(ctx, x);
+		add_element(ctx, *x, start, key);
+		return height;
 	case PROTOCOL_TEXT:
-		return render_status_line_text(ctx, x);
+		height = render_status_line_text(ctx, x);
+		add_element(ctx, *x, start, key);
+		return height;
 	case PROTOCOL_I3BAR:
-		return render_status_line_i3bar(ctx, x);
+		return render_status_line_i3bar(ctx, x, use_short_text);
 	case PROTOCOL_UNDEF:
 		return 0;
 	}
 	return 0;
 }
 
+static void status_strip_destroy(struct status_strip *strip) {
+	cairo_surface_destroy(strip->recording);
+	for (size_t i = 0; i < strip->hotspots_len; ++i) {
+		i3bar_block_unref(strip->hotspots[i].block);
+	}
+	free(strip->hotspots);
+	free(strip->elements);
+	free(strip);
+}
+
+void free_status_strips(struct swaybar *bar) {
+	if (!bar->status_strips) {
+		return;
+	}
+	for (int i = 0; i < bar->status_strips->length; ++i) {
+		status_strip_destroy(bar->status_strips->items[i]);
+	}
+	bar->status_strips->length = 0;
+}
+
+static void status_strip_paint(struct render_context *ctx,
+		struct status_strip *strip) {
+	struct swaybar_output *output = ctx->output;
+	cairo_t *cairo = ctx->cairo;
+	cairo_save(cairo);
+	cairo_rectangle(cairo, strip->x0, 0, strip->x1 - strip->x0,
+			output->height * output->scale);
+	cairo_clip(cairo);
+	cairo_set_operator(cairo, CAIRO_OPERATOR_SOURCE);
+	cairo_set_source_surface(cairo, strip->recording, 0, 0);
+	cairo_paint(cairo);
+	cairo_restore(cairo);
+	ctx->background_color = strip->background_color;
+}
+
+/**
+ * Renders the status line into its own recording and paints it. The strip is
+ * cached along with what else the rendering produced, the hotspots of the
+ * blocks and the damage elements, for other outputs to reuse.
+ */
+static uint32_t render_status_strip(struct render_context *ctx, double *x,
+		bool use_short_text, uint64_t key) {
+	struct swaybar_output *output = ctx->output;
+	struct status_strip *strip = calloc(1, sizeof(struct status_strip));
+	if (!strip) {
+		return render_status_line_protocol(ctx, x, use_short_text);
+	}
+	strip->key = key;
+	strip->x1 = *x;
+	strip->recording = cairo_recording_surface_create(
+			CAIRO_CONTENT_COLOR_ALPHA, NULL);
+	cairo_t *cairo = cairo_create(strip->recording);
+	cairo_set_antialias(cairo, CAIRO_ANTIALIAS_BEST);
+	cairo_set_operator(cairo, CAIRO_OPERATOR_SOURCE);
+	cairo_set_source_u32(cairo, ctx->background_color);
+	cairo_paint(cairo);
+
+	cairo_t *output_cairo = ctx->cairo;
+	struct wl_list *first_hotspot = output->hotspots.next;
+	size_t first_element = ctx->elements_len;
+	ctx->cairo = cairo;
+	strip->height = render_status_line_protocol(ctx, x, use_short_text);
+	ctx->cairo = output_cairo;
+	cairo_destroy(cairo);
+	strip->x0 = *x;
+	strip->background_color = ctx->background_color;
+	status_strip_paint(ctx, strip);
+
+	strip->elements_len = ctx->elements_len - first_element;
+	strip->elements = calloc(strip->elements_len + 1, sizeof(*strip->elements));
+	size_t hotspots_len = 0;
+	for (struct wl_list *pos = output->hotspots.next; pos != first_hotspot;
+			pos = pos->next) {
+		++hotspots_len;
+	}
+	strip->hotspots = calloc(hotspots_len + 1, sizeof(*strip->hotspots));
+	struct swaybar *bar = output->bar;
+	if (!bar->status_strips) {
+		bar->status_strips = create_list();
+	}
+	if (!strip->elements || !strip->hotspots || !bar->status_strips) {
+		uint32_t height = strip->height;
+		status_strip_destroy(strip);
+		return height;
+	}
+	memcpy(strip->elements, &ctx->elements[first_element],
+			strip->elements_len * sizeof(*strip->elements));
+	// Hotspots are inserted at the front, keep them oldest first
+	for (struct wl_list *pos = first_hotspot->prev; pos != &output->hotspots;
+			pos = pos->prev) {
+		struct swaybar_hotspot *hotspot = wl_container_of(pos, hotspot, link);
+		struct i3bar_block *block = hotspot->data;
+		block->ref_count++;
+		strip->hotspots[strip->hotspots_len++] = (struct status_strip_hotspot){
+			.x = hotspot->x,
+			.y = hotspot->y,
+			.width = hotspot->width,
+			.height = hotspot->height,
+			.block = block,
+		};
+	}
+
+	if (bar->status_strips->length == STATUS_STRIP_CACHE_SIZE) {
+		status_strip_destroy(bar->status_strips->items[0]);
+		list_del(bar->status_strips, 0);
+	}
+	list_add(bar->status_strips, strip);
+	return strip->height;
+}
+
+static void status_strip_replay(struct render_context *ctx,
+		struct status_strip *strip) {
+	struct swaybar_output *output = ctx->output;
+	status_strip_paint(ctx, strip);
+	for (size_t i = 0; i < strip->elements_len; ++i) {
+		struct render_element *element = &strip->elements[i];
+		add_element(ctx, element->x, element->x + element->width,
+				element->key);
+	}
+	for (size_t i = 0; i < strip->hotspots_len; ++i) {
+		struct status_strip_hotspot *spot = &strip->hotspots[i];
+		struct swaybar_hotspot *hotspot =
+			calloc(1, sizeof(struct swaybar_hotspot));
+		if (!hotspot) {
+			break;
+		}
+		hotspot->x = spot->x;
+		hotspot->y = spot->y;
+		hotspot->width = spot->width;
+		hotspot->height = spot->height;
+		hotspot->callback = block_hotspot_callback;
+		hotspot->destroy = i3bar_block_unref_callback;
+		hotspot->data = spot->block;
+		spot->block->ref_count++;
+		wl_list_insert(&output->hotspots, &hotspot->link);
+	}
+}
+
+/**
+ * Renders the status line, reusing the rendering of another output when the
+ * status line would come out the same on this one.
+ */
+static uint32_t render_status_line(struct render_context *ctx, double *x) {
+	struct swaybar_output *output = ctx->output;
+	struct swaybar *bar = output->bar;
+	struct status_line *status = bar->status;
+	bool use_short_text = status->protocol == PROTOCOL_I3BAR &&
+		status_line_use_short_text(ctx, *x);
+
+	uint64_t key = hash_u64(element_key(ctx), output->scale);
+	key = hash_u64(key, output->width);
+	key = hash_u64(key, output->height);
+	key = hash_u64(key, output->subpixel);
+	key = hash_u64(key, output->focused);
+	key = hash_bytes(key, x, sizeof(*x));
+	key = hash_u64(key, use_short_text);
+	key = hash_u64(key, status->protocol);
+	key = hash_str(key, status->text);
+	if (status->protocol == PROTOCOL_I3BAR) {
+		struct i3bar_block *block;
+		wl_list_for_each(block, &status->blocks, link) {
+			key = hash_u64(key, block->serial);
+		}
+	}
+
+	if (bar->status_strips) {
+		for (int i = 0; i < bar->status_strips->length; ++i) {
+			struct status_strip *strip = bar->status_strips->items[i];
+			if (strip->key == key) {
+				status_strip_replay(ctx, strip);
+				*x = strip->x0;
+				return strip->height;
+			}
+		}
+	}
+	return render_status_strip(ctx, x, use_short_text, key);
+}
+
 static uint32_t render_binding_mode_indicator(struct render_context *ctx,
 		double x) {
 	struct swaybar_output *output = ctx->output;
@@ -545,6 +839,8 @@ static uint32_t render_binding_mode_indicator(struct render_context *ctx,
 	if (!mode) {
 		return 0;
 	}
+	uint64_t key = hash_u64(hash_str(element_key(ctx), mode),
+			output->bar->mode_pango_markup);
 
 	cairo_t *cairo = ctx->cairo;
 	struct swaybar_config *config = output->bar->config;
@@ -592,6 +888,7 @@ static uint32_t render_binding_mode_indicator(struct render_context *ctx,
 	choose_text_aa_mode(ctx, config->colors.binding_mode.text);
 	pango_printf(cairo, config->font, output->scale,
 			output->bar->mode_pango_markup, "%s", mode);
+	add_element(ctx, x, x + width, key);
 	return output->height;
 }
 
@@ -709,7 +1006,16 @@ static uint32_t render_to_cairo(struct render_context *ctx) {
 	double x = output->width * output->scale;
 #if HAVE_TRAY
 	if (bar->tray) {
+		double start = x;
+		uint64_t key = element_key(ctx);
+		for (int i = 0; i < bar->tray->items->length; ++i) {
+			struct swaybar_sni *sni = bar->tray->items->items[i];
+			key = hash_u64(key, (uintptr_t)sni);
+			key = hash_u64(key, sni->icon_serial);
+			key = hash_u64(key, sni->icon != NULL);
+		}
 		uint32_t h = render_tray(cairo, output, &x);
+		add_element(ctx, x, start, key);
 		max_height = h > max_height ? h : max_height;
 	}
 #endif
@@ -721,7 +1027,14 @@ static uint32_t render_to_cairo(struct render_context *ctx) {
 	if (config->workspace_buttons) {
 		struct swaybar_workspace *ws;
 		wl_list_for_each(ws, &output->workspaces, link) {
+			double start = x;
+			uint64_t key = hash_str(element_key(ctx), ws->label);
+			key = hash_str(key, ws->name);
+			key = hash_u64(key, ws->focused);
+			key = hash_u64(key, ws->visible);
+			key = hash_u64(key, ws->urgent);
 			uint32_t h = render_workspace_button(ctx, ws, &x);
+			add_element(ctx, start, x, key);
 			max_height = h > max_height ? h : max_height;
 		}
 	}
@@ -741,6 +1054,8 @@ static void output_frame_handle_done(void *data, struct wl_callback *callback,
 	if (output->dirty) {
 		render_frame(output);
 		output->dirty = false;
+	} else if (output->bar->status && output->bar->status->update_pending) {
+		apply_status_update(output->bar);
 	}
 }
 
@@ -748,12 +1063,179 @@ static const struct wl_callback_listener output_frame_listener = {
 	.done = output_frame_handle_done
 };
 
+static int cmp_damage_span(const void *_a, const void *_b) {
+	const struct damage_span *a = _a, *b = _b;
+	return a->x0 - b->x0;
+}
+
+static bool element_in(struct render_element *element,
+		struct render_element *elements, size_t len) {
+	for (size_t i = 0; i < len; ++i) {
+		if (elements[i].key == element->key &&
+				elements[i].x == element->x &&
+				elements[i].width == element->width) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void add_damage(struct damage_span *spans, size_t *len,
+		struct render_element *element, int margin, int width) {
+	int x0 = floor(element->x) - margin;
+	int x1 = ceil(element->x + element->width) + margin;
+	spans[(*len)++] = (struct damage_span){
+		.x0 = x0 < 0 ? 0 : x0,
+		.x1 = x1 > width ? width : x1,
+	};
+}
+
+/**
+ * Finds the spans of the buffer which changed since the last frame: where
+ * elements were added, changed, moved or removed. Returns the number of
+ * spans, sorted and disjoint.
+ */
+static size_t compute_damage(struct swaybar_output *output,
+		struct render_context *ctx, int width, struct damage_span *spans) {
+	int margin = DAMAGE_MARGIN * output->scale;
+	size_t len = 0;
+	for (size_t i = 0; i < ctx->elements_len; ++i) {
+		struct render_element *element = &ctx->elements[i];
+		if (!element_in(element, output->elements, output->elements_len)) {
+			add_damage(spans, &len, element, margin, width);
+		}
+	}
+	for (size_t i = 0; i < output->elements_len; ++i) {
+		struct render_element *element = &output->elements[i];
+		if (!element_in(element, ctx->elements, ctx->elements_len)) {
+			add_damage(spans, &len, element, margin, width);
+		}
+	}
+	if (len == 0) {
+		return 0;
+	}
+	qsort(spans, len, sizeof(*spans), cmp_damage_span);
+	size_t merged = 0;
+	for (size_t i = 1; i < len; ++i) {
+		if (spans[i].x0 <= spans[merged].x1) {
+			if (spans[i].x1 > spans[merged].x1) {
+				spans[merged].x1 = spans[i].x1;
+			}
+		} else {
+			spans[++merged] = spans[i];
+		}
+	}
+	return merged + 1;
+}
+
+static void present_frame(struct swaybar_output *output,
+		struct render_context *ctx, cairo_surface_t *recorder) {
+	struct pool_buffer *buffer = output->current_buffer;
+	struct pool_buffer *last = output->last_buffer;
+	cairo_t *shm = buffer->cairo;
+	int width = buffer->width, height = buffer->height;
+
+	uint64_t frame_key = hash_u64(0xcbf29ce484222325, output->focused);
+	frame_key = hash_u64(frame_key, width);
+	frame_key = hash_u64(frame_key, height);
+	frame_key = hash_u64(frame_key, output->subpixel);
+
+	struct damage_span *spans =
+		calloc(ctx->elements_len + output->elements_len + 1, sizeof(*spans));
+	size_t spans_len;
+	if (!spans || !last || !last->buffer || last->width != buffer->width ||
+			last->height != buffer->height || frame_key != output->frame_key) {
+		free(spans);
+		spans = calloc(1, sizeof(*spans));
+		if (!spans) {
+			buffer->busy = false;
+			return;
+		}
+		spans[0] = (struct damage_span){ .x0 = 0, .x1 = width };
+		spans_len = 1;
+		last = NULL;
+	} else {
+		spans_len = compute_damage(output, ctx, width, spans);
+	}
+
+	if (spans_len == 0) {
+		// Nothing changed, keep showing the last buffer
+		buffer->busy = false;
+		free(spans);
+		return;
+	}
+
+	if (last && last != buffer) {
+		// Bring the buffer up to date with the last frame outside the damage
+		cairo_save(shm);
+		cairo_set_fill_rule(shm, CAIRO_FILL_RULE_EVEN_ODD);
+		cairo_rectangle(shm, 0, 0, width, height);
+		for (size_t i = 0; i < spans_len; ++i) {
+			cairo_rectangle(shm, spans[i].x0, 0,
+					spans[i].x1 - spans[i].x0, height);
+		}
+		cairo_clip(shm);
+		cairo_set_operator(shm, CAIRO_OPERATOR_SOURCE);
+		cairo_set_source_surface(shm, last->surface, 0.0, 0.0);
+		cairo_paint(shm);
+		cairo_restore(shm);
+	}
+
+	cairo_save(shm);
+	for (size_t i = 0; i < spans_len; ++i) {
+		cairo_rectangle(shm, spans[i].x0, 0, spans[i].x1 - spans[i].x0, height);
+	}
+	cairo_clip(shm);
+	cairo_save(shm);
+	cairo_set_operator(shm, CAIRO_OPERATOR_CLEAR);
+	cairo_paint(shm);
+	cairo_restore(shm);
+	cairo_set_source_surface(shm, recorder, 0.0, 0.0);
+	cairo_paint(shm);
+	cairo_restore(shm);
+
+	wl_surface_set_buffer_scale(output->surface, output->scale);
+	wl_surface_attach(output->surface, buffer->buffer, 0, 0);
+	for (size_t i = 0; i < spans_len; ++i) {
+		wl_surface_damage_buffer(output->surface, spans[i].x0, 0,
+				spans[i].x1 - spans[i].x0, height);
+	}
+	free(spans);
+
+	struct wl_callback *frame_callback = wl_surface_frame(output->surface);
+	wl_callback_add_listener(frame_callback, &output_frame_listener, output);
+	output->frame_scheduled = true;
+
+	wl_surface_commit(output->surface);
+
+	free(output->elements);
+	output->elements = ctx->elements;
+	output->elements_len = ctx->elements_len;
+	ctx->elements = NULL;
+	output->last_buffer = buffer;
+	output->frame_key = frame_key;
+}
+
 void render_frame(struct swaybar_output *output) {
 	assert(output->surface != NULL);
 	if (!output->layer_surface) {
 		return;
 	}
 
+	struct status_line *status = output->bar->status;
+	if (status && status->protocol == PROTOCOL_I3BAR) {
+		// Status updates received since the last frame only take effect now.
+		// The status line is shared, so outputs showing it must be redrawn.
+		if (i3bar_apply_update(status)) {
+			struct swaybar_output *other;
+			wl_list_for_each(other, &output->bar->outputs, link) {
+				if (other != output) {
+					set_output_dirty(other);
+				}
+			}
+		}
+	}
+
 	free_hotspots(&output->hotspots);
 
 	struct render_context ctx = { 0 };
@@ -803,40 +1285,19 @@ void render_frame(struct swaybar_output *output) {
 		// TODO: this could infinite loop if the compositor assigns us a
 		// different height than what we asked for
 		wl_surface_commit(output->surface);
+		output->last_buffer = NULL;
 	} else if (height > 0) {
-		// Replay recording into shm and send it off
+		// Replay the damaged parts of the recording into shm and send it off
 		output->current_buffer = get_next_buffer(output->bar->shm,
-				output->buffers,
+				&output->buffers,
 				output->width * output->scale,
 				output->height * output->scale);
-		if (!output->current_buffer) {
-			cairo_surface_destroy(recorder);
-			cairo_destroy(cairo);
-			return;
+		if (output->current_buffer) {
+			present_frame(output, &ctx, recorder);
 		}
-		cairo_t *shm = output->current_buffer->cairo;
-
-		cairo_save(shm);
-		cairo_set_operator(shm, CAIRO_OPERATOR_CLEAR);
-		cairo_paint(shm);
-		cairo_restore(shm);
-
-		cairo_set_source_surface(shm, recorder, 0.0, 0.0);
-		cairo_paint(shm);
-
-		wl_surface_set_buffer_scale(output->surface, output->scale);
-		wl_surface_attach(output->surface,
-				output->current_buffer->buffer, 0, 0);
-		wl_surface_damage(output->surface, 0, 0,
-				output->width, output->height);
-
-		struct wl_callback *frame_callback = wl_surface_frame(output->surface);
-		wl_callback_add_listener(frame_callback, &output_frame_listener, output);
-		output->frame_scheduled = true;
-
-		wl_surface_commit(output->surface);
 	}
 
+	free(ctx.elements);
 	if (ctx.textaa_sharp != ctx.textaa_safe) {
 		cairo_font_options_destroy(ctx.textaa_sharp);
 	}
@@ -196,6 +196,7 @@ void status_line_free(struct status_line *status) {
 		}
 		json_tokener_free(status->tokener);
 	}
+	free(status->update);
 	free(status->buffer);
 	free(status);
 }
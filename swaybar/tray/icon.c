@@ -2,9 +2,11 @@
 #include <ctype.h>
 #include <dirent.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/inotify.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <wordexp.h>
@@ -404,45 +406,546 @@ void finish_themes(list_t *themes, list_t *basedirs) {
 	list_free_items_and_destroy(basedirs);
 }
 
-static char *find_icon_in_subdir(char *name, char *basedir, char *theme,
-		char *subdir) {
-	static const char *extensions[] = {
-#if HAVE_GDK_PIXBUF
-		"svg",
-#endif
-		"png",
-#if HAVE_GDK_PIXBUF
-		"xpm" // deprecated
-#endif
-	};
+#define ICON_SVG (1 << 0)
+#define ICON_PNG (1 << 1)
+#define ICON_XPM (1 << 2)
+#define ICON_DIR (1 << 3)
 
-	size_t path_len = snprintf(NULL, 0, "%s/%s/%s/%s.EXT", basedir, theme,
-			subdir, name) + 1;
-	char *path = malloc(path_len);
+#define ICON_DIR_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+		IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+struct icon_dir_entry {
+	char *name; // file name without the icon extension
+	uint8_t flags; // ICON_*
+};
+
+/*
+ * The listing of a directory that has been searched for icons, so that lookups
+ * do not have to probe the file system. Listings are dropped when inotify
+ * reports a change, and rebuilt the next time the directory is searched.
+ */
+struct icon_dir {
+	char *path;
+	int wd; // inotify watch, or -1
+	bool listed;
+
+	// An open addressing hash table of the icons & subdirectories
+	struct icon_dir_entry *entries;
+	size_t entries_cap;
+	size_t entries_len;
+};
+
+/*
+ * An inotify watch. Paths which lead to the same directory, such as through
+ * symlinks, share a watch, so it is only removed once none of them use it.
+ */
+struct icon_watch {
+	int wd;
+	dev_t dev; // of the watched directory
+	ino_t ino;
+	list_t *dirs; // struct icon_dir
+};
+
+struct icon_index {
+	int fd; // inotify
+	// An open addressing hash table of the directories, by path
+	struct icon_dir **dirs;
+	size_t dirs_cap;
+	size_t dirs_len;
+	// An open addressing hash table of the watches, by watch descriptor
+	struct icon_watch **watches;
+	size_t watches_cap;
+	size_t watches_len;
+};
+
+static uint32_t hash_name(const char *name, size_t len) {
+	uint32_t hash = 2166136261u; // FNV-1a
+	for (size_t i = 0; i < len; ++i) {
+		hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+	}
+	return hash;
+}
 
-	for (size_t i = 0; i < sizeof(extensions) / sizeof(*extensions); ++i) {
-		snprintf(path, path_len, "%s/%s/%s/%s.%s", basedir, theme, subdir,
-				name, extensions[i]);
-		if (access(path, R_OK) == 0) {
-			return path;
+static struct icon_dir_entry *icon_dir_find(struct icon_dir *dir,
+		const char *name, size_t len) {
+	if (!dir->entries_cap) {
+		return NULL;
+	}
+	size_t mask = dir->entries_cap - 1;
+	for (size_t i = hash_name(name, len) & mask; dir->entries[i].name;
+			i = (i + 1) & mask) {
+		struct icon_dir_entry *entry = &dir->entries[i];
+		if (strncmp(entry->name, name, len) == 0 && !entry->name[len]) {
+			return entry;
 		}
 	}
+	return NULL;
+}
 
-	free(path);
+static bool icon_dir_grow(struct icon_dir *dir) {
+	size_t cap = dir->entries_cap ? dir->entries_cap * 2 : 64;
+	struct icon_dir_entry *entries = calloc(cap, sizeof(*entries));
+	if (!entries) {
+		return false;
+	}
+	for (size_t i = 0; i < dir->entries_cap; ++i) {
+		struct icon_dir_entry *entry = &dir->entries[i];
+		if (!entry->name) {
+			continue;
+		}
+		size_t j = hash_name(entry->name, strlen(entry->name)) & (cap - 1);
+		while (entries[j].name) {
+			j = (j + 1) & (cap - 1);
+		}
+		entries[j] = *entry;
+	}
+	free(dir->entries);
+	dir->entries = entries;
+	dir->entries_cap = cap;
+	return true;
+}
+
+static void icon_dir_add(struct icon_dir *dir, const char *name, size_t len,
+		uint8_t flags) {
+	struct icon_dir_entry *entry = icon_dir_find(dir, name, len);
+	if (entry) {
+		entry->flags |= flags;
+		return;
+	}
+	if ((dir->entries_len + 1) * 2 > dir->entries_cap && !icon_dir_grow(dir)) {
+		return;
+	}
+	size_t mask = dir->entries_cap - 1;
+	size_t i = hash_name(name, len) & mask;
+	while (dir->entries[i].name) {
+		i = (i + 1) & mask;
+	}
+	if (!(dir->entries[i].name = strndup(name, len))) {
+		return;
+	}
+	dir->entries[i].flags = flags;
+	dir->entries_len++;
+}
+
+static void icon_dir_invalidate(struct icon_dir *dir) {
+	for (size_t i = 0; i < dir->entries_cap; ++i) {
+		free(dir->entries[i].name);
+	}
+	free(dir->entries);
+	dir->entries = NULL;
+	dir->entries_cap = dir->entries_len = 0;
+	dir->listed = false;
+}
+
+static uint8_t icon_extension_flag(const char *ext) {
+	if (strcmp(ext, "svg") == 0) {
+		return ICON_SVG;
+	} else if (strcmp(ext, "png") == 0) {
+		return ICON_PNG;
+	} else if (strcmp(ext, "xpm") == 0) {
+		return ICON_XPM;
+	}
+	return 0;
+}
+
+static size_t hash_wd(int wd, size_t mask) {
+	return ((uint32_t)wd * 2654435761u) & mask;
+}
+
+static struct icon_watch **icon_index_find_watch(struct icon_index *index,
+		int wd) {
+	if (!index->watches_cap) {
+		return NULL;
+	}
+	size_t mask = index->watches_cap - 1;
+	for (size_t i = hash_wd(wd, mask); index->watches[i]; i = (i + 1) & mask) {
+		if (index->watches[i]->wd == wd) {
+			return &index->watches[i];
+		}
+	}
 	return NULL;
 }
 
-static bool theme_exists_in_basedir(char *theme, char *basedir) {
-	size_t path_len = snprintf(NULL, 0, "%s/%s", basedir, theme) + 1;
+static bool icon_index_grow_watches(struct icon_index *index) {
+	size_t cap = index->watches_cap ? index->watches_cap * 2 : 64;
+	struct icon_watch **watches = calloc(cap, sizeof(*watches));
+	if (!watches) {
+		return false;
+	}
+	for (size_t i = 0; i < index->watches_cap; ++i) {
+		struct icon_watch *watch = index->watches[i];
+		if (!watch) {
+			continue;
+		}
+		size_t j = hash_wd(watch->wd, cap - 1);
+		while (watches[j]) {
+			j = (j + 1) & (cap - 1);
+		}
+		watches[j] = watch;
+	}
+	free(index->watches);
+	index->watches = watches;
+	index->watches_cap = cap;
+	return true;
+}
+
+static void icon_index_remove_watch(struct icon_index *index,
+		struct icon_watch **slot) {
+	struct icon_watch *watch = *slot;
+	list_free(watch->dirs);
+	free(watch);
+
+	// Shift back the entries which probed past the freed slot
+	size_t mask = index->watches_cap - 1;
+	size_t i = slot - index->watches;
+	index->watches[i] = NULL;
+	for (size_t j = (i + 1) & mask; index->watches[j]; j = (j + 1) & mask) {
+		size_t home = hash_wd(index->watches[j]->wd, mask);
+		bool in_place = i <= j ? (i < home && home <= j) :
+			(i < home || home <= j);
+		if (!in_place) {
+			index->watches[i] = index->watches[j];
+			index->watches[j] = NULL;
+			i = j;
+		}
+	}
+	index->watches_len--;
+}
+
+static void icon_index_watch(struct icon_index *index, struct icon_dir *dir) {
+	int wd = inotify_add_watch(index->fd, dir->path, ICON_DIR_EVENTS);
+	if (wd == -1) {
+		sway_log_errno(SWAY_DEBUG, "Unable to watch '%s'", dir->path);
+		return;
+	}
+	struct icon_watch **slot = icon_index_find_watch(index, wd);
+	struct icon_watch *watch = slot ? *slot : NULL;
+	if (!watch) {
+		struct stat sb;
+		if (((index->watches_len + 1) * 2 > index->watches_cap &&
+					!icon_index_grow_watches(index)) ||
+				stat(dir->path, &sb) != 0 ||
+				!(watch = calloc(1, sizeof(struct icon_watch)))) {
+			inotify_rm_watch(index->fd, wd);
+			return;
+		}
+		if (!(watch->dirs = create_list())) {
+			free(watch);
+			inotify_rm_watch(index->fd, wd);
+			return;
+		}
+		watch->wd = wd;
+		watch->dev = sb.st_dev;
+		watch->ino = sb.st_ino;
+
+		size_t mask = index->watches_cap - 1;
+		size_t i = hash_wd(wd, mask);
+		while (index->watches[i]) {
+			i = (i + 1) & mask;
+		}
+		index->watches[i] = watch;
+		index->watches_len++;
+	}
+	list_add(watch->dirs, dir);
+	dir->wd = wd;
+}
+
+static void icon_dir_list(struct icon_index *index, struct icon_dir *dir) {
+	if (dir->wd == -1 && index->fd != -1) {
+		icon_index_watch(index, dir);
+	}
+
+	DIR *d = opendir(dir->path);
+	if (!d) {
+		return;
+	}
+	dir->listed = true;
+	struct dirent *entry;
+	while ((entry = readdir(d))) {
+		const char *name = entry->d_name;
+		if (name[0] == '.') continue;
+
+		size_t len = strlen(name);
+		const char *ext = strrchr(name, '.');
+		uint8_t flags = ext ? icon_extension_flag(ext + 1) : 0;
+		if (flags) {
+			len = ext - name;
+		} else {
+			// Only entries which can't be icons need to be checked
+			struct stat sb;
+			if (fstatat(dirfd(d), name, &sb, 0) != 0 || !S_ISDIR(sb.st_mode)) {
+				continue;
+			}
+			flags = ICON_DIR;
+		}
+		icon_dir_add(dir, name, len, flags);
+	}
+	closedir(d);
+}
+
+static bool icon_index_grow(struct icon_index *index) {
+	size_t cap = index->dirs_cap ? index->dirs_cap * 2 : 256;
+	struct icon_dir **dirs = calloc(cap, sizeof(*dirs));
+	if (!dirs) {
+		return false;
+	}
+	for (size_t i = 0; i < index->dirs_cap; ++i) {
+		struct icon_dir *dir = index->dirs[i];
+		if (!dir) {
+			continue;
+		}
+		size_t j = hash_name(dir->path, strlen(dir->path)) & (cap - 1);
+		while (dirs[j]) {
+			j = (j + 1) & (cap - 1);
+		}
+		dirs[j] = dir;
+	}
+	free(index->dirs);
+	index->dirs = dirs;
+	index->dirs_cap = cap;
+	return true;
+}
+
+/*
+ * Returns the listing of the directory at path, listing it if needed. The
+ * caller is responsible for checking that the directory exists.
+ */
+static struct icon_dir *icon_index_get_dir(struct icon_index *index,
+		const char *path) {
+	size_t len = strlen(path);
+	size_t mask = index->dirs_cap - 1;
+	struct icon_dir *dir = NULL;
+	if (index->dirs_cap) {
+		for (size_t i = hash_name(path, len) & mask; index->dirs[i];
+				i = (i + 1) & mask) {
+			if (strcmp(index->dirs[i]->path, path) == 0) {
+				dir = index->dirs[i];
+				break;
+			}
+		}
+	}
+
+	if (!dir) {
+		if ((index->dirs_len + 1) * 2 > index->dirs_cap &&
+				!icon_index_grow(index)) {
+			return NULL;
+		}
+		dir = calloc(1, sizeof(struct icon_dir));
+		if (!dir || !(dir->path = strdup(path))) {
+			free(dir);
+			return NULL;
+		}
+		dir->wd = -1;
+
+		mask = index->dirs_cap - 1;
+		size_t i = hash_name(path, len) & mask;
+		while (index->dirs[i]) {
+			i = (i + 1) & mask;
+		}
+		index->dirs[i] = dir;
+		index->dirs_len++;
+	}
+
+	if (!dir->listed) {
+		icon_dir_list(index, dir);
+	}
+	return dir;
+}
+
+/*
+ * Walks from basedir down to basedir/theme/subdir through the listings of each
+ * directory on the way, so that missing directories are never opened.
+ * Returns NULL if the directory does not exist.
+ */
+static struct icon_dir *icon_index_find_dir(struct icon_index *index,
+		char *basedir, char *theme, char *subdir) {
+	size_t path_len = snprintf(NULL, 0, "%s/%s/%s", basedir, theme, subdir) + 1;
 	char *path = malloc(path_len);
-	snprintf(path, path_len, "%s/%s", basedir, theme);
-	bool ret = dir_exists(path);
+	if (!path) {
+		return NULL;
+	}
+	snprintf(path, path_len, "%s/%s/%s", basedir, theme, subdir);
+
+	size_t len = strlen(basedir);
+	struct icon_dir *dir = icon_index_get_dir(index, basedir);
+	while (dir && path[len]) {
+		char *component = &path[len + 1];
+		size_t component_len = strcspn(component, "/");
+		if (component_len == 0) { // empty theme or subdir
+			len++;
+			continue;
+		}
+		struct icon_dir_entry *entry =
+			icon_dir_find(dir, component, component_len);
+		if (!entry || !(entry->flags & ICON_DIR)) {
+			dir = NULL;
+			break;
+		}
+		len += component_len + 1;
+		char c = path[len];
+		path[len] = '\0';
+		dir = icon_index_get_dir(index, path);
+		path[len] = c;
+	}
 	free(path);
-	return ret;
+	return dir;
+}
+
+struct icon_index *create_icon_index(void) {
+	struct icon_index *index = calloc(1, sizeof(struct icon_index));
+	if (!index) {
+		return NULL;
+	}
+	index->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (index->fd == -1) {
+		sway_log_errno(SWAY_ERROR, "Unable to watch icon directories, "
+				"changes to icon themes will not be picked up");
+	}
+	return index;
 }
 
-static char *find_icon_with_theme(list_t *basedirs, list_t *themes, char *name,
-		int size, char *theme_name, int *min_size, int *max_size) {
+void destroy_icon_index(struct icon_index *index) {
+	if (!index) {
+		return;
+	}
+	for (size_t i = 0; i < index->dirs_cap; ++i) {
+		struct icon_dir *dir = index->dirs[i];
+		if (dir) {
+			icon_dir_invalidate(dir);
+			free(dir->path);
+			free(dir);
+		}
+	}
+	free(index->dirs);
+	for (size_t i = 0; i < index->watches_cap; ++i) {
+		struct icon_watch *watch = index->watches[i];
+		if (watch) {
+			list_free(watch->dirs);
+			free(watch);
+		}
+	}
+	free(index->watches);
+	if (index->fd != -1) {
+		close(index->fd);
+	}
+	free(index);
+}
+
+int icon_index_get_fd(struct icon_index *index) {
+	return index->fd;
+}
+
+static void icon_index_handle_event(struct icon_index *index,
+		const struct inotify_event *event) {
+	if (event->mask & IN_Q_OVERFLOW) {
+		// Events were lost, so any listing may be stale
+		for (size_t i = 0; i < index->dirs_cap; ++i) {
+			if (index->dirs[i]) {
+				icon_dir_invalidate(index->dirs[i]);
+			}
+		}
+		return;
+	}
+
+	struct icon_watch **slot = icon_index_find_watch(index, event->wd);
+	if (!slot) {
+		return;
+	}
+	struct icon_watch *watch = *slot;
+	for (int i = 0; i < watch->dirs->length; ++i) {
+		icon_dir_invalidate(watch->dirs->items[i]);
+	}
+
+	if (event->mask & IN_IGNORED) {
+		// The kernel removed the watch
+		for (int i = 0; i < watch->dirs->length; ++i) {
+			struct icon_dir *dir = watch->dirs->items[i];
+			dir->wd = -1;
+		}
+		icon_index_remove_watch(index, slot);
+	} else if (event->mask & IN_MOVE_SELF) {
+		// The watch follows the directory to its new path, so it no longer
+		// applies to the paths which don't lead there any more
+		for (int i = 0; i < watch->dirs->length; ++i) {
+			struct icon_dir *dir = watch->dirs->items[i];
+			struct stat sb;
+			if (stat(dir->path, &sb) == 0 && sb.st_dev == watch->dev &&
+					sb.st_ino == watch->ino) {
+				continue;
+			}
+			dir->wd = -1;
+			list_del(watch->dirs, i--);
+		}
+		if (watch->dirs->length == 0) {
+			inotify_rm_watch(index->fd, watch->wd);
+			icon_index_remove_watch(index, slot);
+		}
+	}
+}
+
+void icon_index_dispatch(struct icon_index *index) {
+	char buf[4096]
+		__attribute__((aligned(__alignof__(struct inotify_event))));
+	ssize_t len;
+	while ((len = read(index->fd, buf, sizeof(buf))) > 0) {
+		char *ptr = buf;
+		while (ptr < buf + len) {
+			const struct inotify_event *event =
+				(const struct inotify_event *)ptr;
+			icon_index_handle_event(index, event);
+			ptr += sizeof(struct inotify_event) + event->len;
+		}
+	}
+}
+
+static char *find_icon_in_subdir(struct icon_index *index, char *name,
+		char *basedir, char *theme, char *subdir) {
+	struct icon_dir *dir = icon_index_find_dir(index, basedir, theme, subdir);
+	struct icon_dir_entry *entry = dir ?
+		icon_dir_find(dir, name, strlen(name)) : NULL;
+	if (!entry) {
+		return NULL;
+	}
+
+	const char *extension;
+#if HAVE_GDK_PIXBUF
+	if (entry->flags & ICON_SVG) {
+		extension = "svg";
+	} else if (entry->flags & ICON_PNG) {
+		extension = "png";
+	} else if (entry->flags & ICON_XPM) { // deprecated
+		extension = "xpm";
+	} else {
+		return NULL;
+	}
+#else
+	if (entry->flags & ICON_PNG) {
+		extension = "png";
+	} else {
+		return NULL;
+	}
+#endif
+
+	size_t path_len = snprintf(NULL, 0, "%s/%s.%s", dir->path, name,
+			extension) + 1;
+	char *path = malloc(path_len);
+	if (path) {
+		snprintf(path, path_len, "%s/%s.%s", dir->path, name, extension);
+	}
+	return path;
+}
+
+static bool theme_exists_in_basedir(struct icon_index *index, char *theme,
+		char *basedir) {
+	struct icon_dir *dir = icon_index_get_dir(index, basedir);
+	struct icon_dir_entry *entry = dir ?
+		icon_dir_find(dir, theme, strlen(theme)) : NULL;
+	return entry && (entry->flags & ICON_DIR);
+}
+
+static char *find_icon_with_theme(struct icon_index *index, list_t *basedirs,
+		list_t *themes, char *name, int size, char *theme_name, int *min_size,
+		int *max_size) {
 	struct icon_theme *theme = NULL;
 	for (int i = 0; i < themes->length; ++i) {
 		theme = themes->items[i];
@@ -455,15 +958,15 @@ static char *find_icon_with_theme(list_t *basedirs, list_t *themes, char *name,
 
 	char *icon = NULL;
 	for (int i = 0; i < basedirs->length; ++i) {
-		if (!theme_exists_in_basedir(theme->dir, basedirs->items[i])) {
+		if (!theme_exists_in_basedir(index, theme->dir, basedirs->items[i])) {
 			continue;
 		}
 		// search backwards to hopefully hit scalable/larger icons first
 		for (int j = theme->subdirs->length - 1; j >= 0; --j) {
 			struct icon_theme_subdir *subdir = theme->subdirs->items[j];
 			if (size >= subdir->min_size && size <= subdir->max_size) {
-				if ((icon = find_icon_in_subdir(name, basedirs->items[i],
-								theme->dir, subdir->name))) {
+				if ((icon = find_icon_in_subdir(index, name,
+								basedirs->items[i], theme->dir, subdir->name))) {
 					*min_size = subdir->min_size;
 					*max_size = subdir->max_size;
 					return icon;
@@ -475,7 +978,7 @@ static char *find_icon_with_theme(list_t *basedirs, list_t *themes, char *name,
 	// inexact match
 	unsigned smallest_error = -1; // UINT_MAX
 	for (int i = 0; i < basedirs->length; ++i) {
-		if (!theme_exists_in_basedir(theme->dir, basedirs->items[i])) {
+		if (!theme_exists_in_basedir(index, theme->dir, basedirs->items[i])) {
 			continue;
 		}
 		for (int j = theme->subdirs->length - 1; j >= 0; --j) {
@@ -483,9 +986,10 @@ static char *find_icon_with_theme(list_t *basedirs, list_t *themes, char *name,
 			unsigned error = (size > subdir->max_size ? size - subdir->max_size : 0)
 				+ (size < subdir->min_size ? subdir->min_size - size : 0);
 			if (error < smallest_error) {
-				char *test_icon = find_icon_in_subdir(name, basedirs->items[i],
-						theme->dir, subdir->name);
+				char *test_icon = find_icon_in_subdir(index, name,
+						basedirs->items[i], theme->dir, subdir->name);
 				if (test_icon) {
+					free(icon);
 					icon = test_icon;
 					smallest_error = error;
 					*min_size = subdir->min_size;
@@ -497,7 +1001,7 @@ static char *find_icon_with_theme(list_t *basedirs, list_t *themes, char *name,
 
 	if (!icon && theme->inherits) {
 		for (int i = 0; i < theme->inherits->length; ++i) {
-			icon = find_icon_with_theme(basedirs, themes, name, size,
+			icon = find_icon_with_theme(index, basedirs, themes, name, size,
 					theme->inherits->items[i], min_size, max_size);
 			if (icon) {
 				break;
@@ -508,10 +1012,10 @@ static char *find_icon_with_theme(list_t *basedirs, list_t *themes, char *name,
 	return icon;
 }
 
-static char *find_fallback_icon(list_t *basedirs, char *name, int *min_size,
-		int *max_size) {
+static char *find_fallback_icon(struct icon_index *index, list_t *basedirs,
+		char *name, int *min_size, int *max_size) {
 	for (int i = 0; i < basedirs->length; ++i) {
-		char *icon = find_icon_in_subdir(name, basedirs->items[i], "", "");
+		char *icon = find_icon_in_subdir(index, name, basedirs->items[i], "", "");
 		if (icon) {
 			*min_size = 1;
 			*max_size = 512;
@@ -521,20 +1025,20 @@ static char *find_fallback_icon(list_t *basedirs, char *name, int *min_size,
 	return NULL;
 }
 
-char *find_icon(list_t *themes, list_t *basedirs, char *name, int size,
-		char *theme, int *min_size, int *max_size) {
+char *find_icon(struct icon_index *index, list_t *themes, list_t *basedirs,
+		char *name, int size, char *theme, int *min_size, int *max_size) {
 	// TODO https://specifications.freedesktop.org/icon-theme-spec/icon-theme-spec-latest.html#implementation_notes
 	char *icon = NULL;
 	if (theme) {
-		icon = find_icon_with_theme(basedirs, themes, name, size, theme,
+		icon = find_icon_with_theme(index, basedirs, themes, name, size, theme,
 				min_size, max_size);
 	}
 	if (!icon && !(theme && strcmp(theme, "Hicolor") == 0)) {
-		icon = find_icon_with_theme(basedirs, themes, name, size, "Hicolor",
-				min_size, max_size);
+		icon = find_icon_with_theme(index, basedirs, themes, name, size,
+				"Hicolor", min_size, max_size);
 	}
 	if (!icon) {
-		icon = find_fallback_icon(basedirs, name, min_size, max_size);
+		icon = find_fallback_icon(index, basedirs, name, min_size, max_size);
 	}
 	return icon;
 }
@@ -5,6 +5,7 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include "swaybar/bar.h"
 #include "swaybar/config.h"
 #include "swaybar/input.h"
@@ -29,7 +30,7 @@ static bool sni_ready(struct swaybar_sni *sni) {
 static void set_sni_dirty(struct swaybar_sni *sni) {
 	if (sni_ready(sni)) {
 		sni->target_size = sni->min_size = sni->max_size = 0; // invalidate previous icon
-		set_bar_dirty(sni->tray->bar);
+		set_tray_dirty(sni->tray);
 	}
 }
 
@@ -313,6 +314,7 @@ void destroy_sni(struct swaybar_sni *sni) {
 	}
 
 	cairo_surface_destroy(sni->icon);
+	tray_icon_source_unref(sni->icon_source);
 	free(sni->watcher_id);
 	free(sni->service);
 	free(sni->path);
@@ -410,23 +412,85 @@ static enum hotspot_event_handling icon_hotspot_callback(
 	return HOTSPOT_PROCESS;
 }
 
+enum icon_source_type {
+	ICON_SOURCE_FILE,
+	ICON_SOURCE_PIXMAP,
+};
+
+/*
+ * Icon files are identified by their path, inode and modification time, so
+ * that an icon which is overwritten or replaced is loaded again.
+ */
+static struct swaybar_icon_source *icon_file_source(const char *path) {
+	struct {
+		enum icon_source_type type;
+		dev_t dev;
+		ino_t ino;
+		off_t size;
+		struct timespec mtim;
+	} head;
+	memset(&head, 0, sizeof(head)); // so that the padding compares equal
+	head.type = ICON_SOURCE_FILE;
+	struct stat sb;
+	if (stat(path, &sb) == 0) {
+		head.dev = sb.st_dev;
+		head.ino = sb.st_ino;
+		head.size = sb.st_size;
+		head.mtim = sb.st_mtim;
+	}
+	return tray_icon_source_create(&head, sizeof(head), path, strlen(path) + 1);
+}
+
+static struct swaybar_icon_source *icon_pixmap_source(
+		struct swaybar_pixmap *pixmap) {
+	struct {
+		enum icon_source_type type;
+		int size;
+	} head = { ICON_SOURCE_PIXMAP, pixmap->size };
+	return tray_icon_source_create(&head, sizeof(head), pixmap->pixels,
+			(size_t)pixmap->size * pixmap->size * 4);
+}
+
+// Takes the reference to source
+static void set_sni_icon(struct swaybar_sni *sni, cairo_surface_t *icon,
+		struct swaybar_icon_source *source) {
+	if (icon != sni->icon) { // a cache hit may return the same icon
+		sni->icon_serial++;
+	}
+	cairo_surface_destroy(sni->icon);
+	sni->icon = icon;
+	tray_icon_source_unref(sni->icon_source);
+	sni->icon_source = icon ? source : NULL;
+	if (!icon) {
+		tray_icon_source_unref(source);
+	}
+}
+
 static void reload_sni(struct swaybar_sni *sni, char *icon_theme,
 		int target_size) {
+	struct swaybar_tray *tray = sni->tray;
 	char *icon_name = sni->status[0] == 'N' ?
 		sni->attention_icon_name : sni->icon_name;
 	if (icon_name) {
 		list_t *icon_search_paths = create_list();
-		list_cat(icon_search_paths, sni->tray->basedirs);
+		list_cat(icon_search_paths, tray->basedirs);
 		if (sni->icon_theme_path) {
 			list_add(icon_search_paths, sni->icon_theme_path);
 		}
-		char *icon_path = find_icon(sni->tray->themes, icon_search_paths,
-				icon_name, target_size, icon_theme,
+		char *icon_path = find_icon(tray->icon_index, tray->themes,
+				icon_search_paths, icon_name, target_size, icon_theme,
 				&sni->min_size, &sni->max_size);
 		list_free(icon_search_paths);
 		if (icon_path) {
-			cairo_surface_destroy(sni->icon);
-			sni->icon = load_background_image(icon_path);
+			struct swaybar_icon_source *source = icon_file_source(icon_path);
+			cairo_surface_t *icon = NULL;
+			if (source) {
+				icon = tray_icon_lookup(tray, source, 0);
+				if (!icon && (icon = load_background_image(icon_path))) {
+					tray_icon_insert(tray, source, 0, icon);
+				}
+			}
+			set_sni_icon(sni, icon, source);
 			free(icon_path);
 			return;
 		}
@@ -445,10 +509,31 @@ static void reload_sni(struct swaybar_sni *sni, char *icon_theme,
 				min_error = e;
 			}
 		}
-		cairo_surface_destroy(sni->icon);
-		sni->icon = cairo_image_surface_create_for_data(pixmap->pixels,
-				CAIRO_FORMAT_ARGB32, pixmap->size, pixmap->size,
-				cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, pixmap->size));
+		struct swaybar_icon_source *source = icon_pixmap_source(pixmap);
+		if (!source) {
+			return;
+		}
+		cairo_surface_t *icon = tray_icon_lookup(tray, source, 0);
+		if (!icon) {
+			// Copy the pixels, since the cached icon may outlive the pixmap
+			icon = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+					pixmap->size, pixmap->size);
+			if (cairo_surface_status(icon) != CAIRO_STATUS_SUCCESS) {
+				cairo_surface_destroy(icon);
+				tray_icon_source_unref(source);
+				return;
+			}
+			unsigned char *data = cairo_image_surface_get_data(icon);
+			int stride = cairo_image_surface_get_stride(icon);
+			cairo_surface_flush(icon);
+			for (int y = 0; y < pixmap->size; ++y) {
+				memcpy(data + y * stride, pixmap->pixels + y * pixmap->size * 4,
+						pixmap->size * 4);
+			}
+			cairo_surface_mark_dirty(icon);
+			tray_icon_insert(tray, source, 0, icon);
+		}
+		set_sni_icon(sni, icon, source);
 	}
 }
 
@@ -472,7 +557,14 @@ uint32_t render_sni(cairo_t *cairo, struct swaybar_output *output, double *x,
 		int actual_size = cairo_image_surface_get_height(sni->icon);
 		icon_size = actual_size < target_size ?
 			actual_size*(target_size/actual_size) : target_size;
-		icon = cairo_image_surface_scale(sni->icon, icon_size, icon_size);
+		if (icon_size == actual_size &&
+				cairo_image_surface_get_width(sni->icon) == actual_size) {
+			icon = cairo_surface_reference(sni->icon);
+		} else if (!(icon = tray_icon_lookup(sni->tray, sni->icon_source,
+						icon_size))) {
+			icon = cairo_image_surface_scale(sni->icon, icon_size, icon_size);
+			tray_icon_insert(sni->tray, sni->icon_source, icon_size, icon);
+		}
 	} else { // draw a :(
 		icon_size = target_size*0.8;
 		icon = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, icon_size, icon_size);
@@ -1,4 +1,5 @@
 #include <cairo.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,6 +13,17 @@
 #include "list.h"
 #include "log.h"
 
+// The memory used by cached icons, before the least recently used are evicted
+#define TRAY_ICON_CACHE_BYTES (8 * 1024 * 1024)
+
+struct swaybar_tray_icon {
+	struct swaybar_icon_source *source;
+	int size;
+	cairo_surface_t *surface;
+	size_t bytes;
+	uint64_t last_used;
+};
+
 static int handle_lost_watcher(sd_bus_message *msg,
 		void *data, sd_bus_error *error) {
 	char *service, *old_owner, *new_owner;
@@ -68,6 +80,8 @@ struct swaybar_tray *create_tray(struct swaybar *bar) {
 	init_host(&tray->host_kde, "kde", tray);
 
 	init_themes(&tray->themes, &tray->basedirs);
+	tray->icon_index = create_icon_index();
+	tray->icon_cache = create_list();
 
 	return tray;
 }
@@ -86,9 +100,21 @@ void destroy_tray(struct swaybar_tray *tray) {
 	destroy_watcher(tray->watcher_kde);
 	sd_bus_flush_close_unref(tray->bus);
 	finish_themes(tray->themes, tray->basedirs);
+	destroy_icon_index(tray->icon_index);
+	for (int i = 0; i < tray->icon_cache->length; ++i) {
+		struct swaybar_tray_icon *icon = tray->icon_cache->items[i];
+		tray_icon_source_unref(icon->source);
+		cairo_surface_destroy(icon->surface);
+		free(icon);
+	}
+	list_free(tray->icon_cache);
 	free(tray);
 }
 
+void tray_icons_in(int fd, short mask, void *data) {
+	icon_index_dispatch(data);
+}
+
 void tray_in(int fd, short mask, void *data) {
 	sd_bus *bus = data;
 	int ret;
@@ -100,6 +126,92 @@ void tray_in(int fd, short mask, void *data) {
 	}
 }
 
+static uint64_t hash_bytes(uint64_t hash, const void *data, size_t len) {
+	const unsigned char *bytes = data;
+	for (size_t i = 0; i < len; ++i) {
+		hash = (hash ^ bytes[i]) * 1099511628211u; // FNV-1a
+	}
+	return hash;
+}
+
+struct swaybar_icon_source *tray_icon_source_create(const void *head,
+		size_t head_len, const void *body, size_t body_len) {
+	struct swaybar_icon_source *source =
+		malloc(sizeof(struct swaybar_icon_source) + head_len + body_len);
+	if (!source) {
+		return NULL;
+	}
+	source->refs = 1;
+	source->len = head_len + body_len;
+	memcpy(source->data, head, head_len);
+	memcpy(source->data + head_len, body, body_len);
+	source->hash = hash_bytes(14695981039346656037u, source->data, source->len);
+	return source;
+}
+
+void tray_icon_source_unref(struct swaybar_icon_source *source) {
+	if (source && --source->refs == 0) {
+		free(source);
+	}
+}
+
+static bool icon_source_equal(const struct swaybar_icon_source *a,
+		const struct swaybar_icon_source *b) {
+	return a == b || (a->hash == b->hash && a->len == b->len &&
+			memcmp(a->data, b->data, a->len) == 0);
+}
+
+cairo_surface_t *tray_icon_lookup(struct swaybar_tray *tray,
+		const struct swaybar_icon_source *source, int size) {
+	for (int i = 0; i < tray->icon_cache->length; ++i) {
+		struct swaybar_tray_icon *icon = tray->icon_cache->items[i];
+		if (icon->size == size && icon_source_equal(icon->source, source)) {
+			icon->last_used = ++tray->icon_cache_clock;
+			return cairo_surface_reference(icon->surface);
+		}
+	}
+	return NULL;
+}
+
+static void tray_icon_evict(struct swaybar_tray *tray) {
+	// Always keep the most recently inserted icon
+	while (tray->icon_cache_bytes > TRAY_ICON_CACHE_BYTES &&
+			tray->icon_cache->length > 1) {
+		int lru = 0;
+		for (int i = 1; i < tray->icon_cache->length; ++i) {
+			struct swaybar_tray_icon *icon = tray->icon_cache->items[i];
+			struct swaybar_tray_icon *lru_icon = tray->icon_cache->items[lru];
+			if (icon->last_used < lru_icon->last_used) {
+				lru = i;
+			}
+		}
+		struct swaybar_tray_icon *icon = tray->icon_cache->items[lru];
+		tray->icon_cache_bytes -= icon->bytes;
+		tray_icon_source_unref(icon->source);
+		cairo_surface_destroy(icon->surface);
+		free(icon);
+		list_del(tray->icon_cache, lru);
+	}
+}
+
+void tray_icon_insert(struct swaybar_tray *tray,
+		struct swaybar_icon_source *source, int size, cairo_surface_t *surface) {
+	struct swaybar_tray_icon *icon = calloc(1, sizeof(struct swaybar_tray_icon));
+	if (!icon) {
+		return;
+	}
+	icon->source = source;
+	source->refs++;
+	icon->size = size;
+	icon->surface = cairo_surface_reference(surface);
+	icon->bytes = (size_t)cairo_image_surface_get_stride(surface) *
+		cairo_image_surface_get_height(surface);
+	icon->last_used = ++tray->icon_cache_clock;
+	list_add(tray->icon_cache, icon);
+	tray->icon_cache_bytes += icon->bytes;
+	tray_icon_evict(tray);
+}
+
 static int cmp_output(const void *item, const void *cmp_to) {
 	const struct swaybar_output *output = cmp_to;
 	if (output->identifier && strcmp(item, output->identifier) == 0) {
@@ -108,13 +220,26 @@ static int cmp_output(const void *item, const void *cmp_to) {
 	return strcmp(item, output->name);
 }
 
+static bool tray_uses_output(struct swaybar_output *output) {
+	list_t *tray_outputs = output->bar->config->tray_outputs;
+	return !tray_outputs || // display on all
+		list_seq_find(tray_outputs, cmp_output, output) != -1;
+}
+
+void set_tray_dirty(struct swaybar_tray *tray) {
+	struct swaybar_output *output;
+	wl_list_for_each(output, &tray->bar->outputs, link) {
+		if (tray_uses_output(output)) {
+			set_output_dirty(output);
+		}
+	}
+}
+
 uint32_t render_tray(cairo_t *cairo, struct swaybar_output *output, double *x) {
 	struct swaybar_config *config = output->bar->config;
-	if (config->tray_outputs) {
-		if (list_seq_find(config->tray_outputs, cmp_output, output) == -1) {
-			return 0;
-		}
-	} // else display on all
+	if (!tray_uses_output(output)) {
+		return 0;
+	}
 
 	if ((int) output->height*output->scale <= 2*config->tray_padding) {
 		return 2*config->tray_padding + 1;
@@ -9,6 +9,8 @@
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <ctype.h>
+#include <errno.h>
+#include <poll.h>
 #include <unistd.h>
 #include <json.h>
 #include "stringop.h"
@@ -46,7 +48,12 @@ static bool success(json_object *r, bool fallback) {
 	for (size_t i = 0; i < results_len; ++i) {
 		json_object *result = json_object_array_get_idx(r, i);
 
-		if (!success_object(result)) {
+		// Replies to command_batch contain an array of results per command
+		if (json_object_is_type(result, json_type_array)) {
+			if (!success(result, true)) {
+				return false;
+			}
+		} else if (!success_object(result)) {
 			return false;
 		}
 	}
@@ -287,10 +294,12 @@ static void pretty_print_config(json_object *c) {
 }
 
 static void pretty_print(int type, json_object *resp) {
-	if (type != IPC_COMMAND && type != IPC_GET_WORKSPACES &&
+	if (type != IPC_COMMAND && type != IPC_COMMAND_BATCH &&
+			type != IPC_GET_WORKSPACES &&
 			type != IPC_GET_INPUTS && type != IPC_GET_OUTPUTS &&
 			type != IPC_GET_VERSION && type != IPC_GET_SEATS &&
-			type != IPC_GET_CONFIG && type != IPC_SEND_TICK) {
+			type != IPC_GET_CONFIG && type != IPC_SEND_TICK &&
+			type != IPC_GET_LOG) {
 		printf("%s\n", json_object_to_json_string_ext(resp,
 			JSON_C_TO_STRING_PRETTY | JSON_C_TO_STRING_SPACED));
 		return;
@@ -318,6 +327,9 @@ static void pretty_print(int type, json_object *resp) {
 		case IPC_COMMAND:
 			pretty_print_cmd(obj);
 			break;
+		case IPC_COMMAND_BATCH:
+			pretty_print(IPC_COMMAND, obj);
+			break;
 		case IPC_GET_WORKSPACES:
 			pretty_print_workspace(obj);
 			break;
@@ -330,20 +342,82 @@ static void pretty_print(int type, json_object *resp) {
 		case IPC_GET_SEATS:
 			pretty_print_seat(obj);
 			break;
+		case IPC_GET_LOG:
+			printf("%s\n", json_object_get_string(obj));
+			break;
+		}
+	}
+}
+
+struct event_state {
+	bool quiet, raw, monitor;
+	bool done;
+	int ret;
+};
+
+static void handle_event(struct ipc_client *client, uint32_t type,
+		const char *payload, uint32_t size, void *data) {
+	struct event_state *state = data;
+	if (state->done) {
+		return;
+	}
+	state->done = !state->monitor;
+
+	json_object *obj = json_tokener_parse(payload);
+	if (obj == NULL) {
+		if (!state->quiet) {
+			fprintf(stderr, "ERROR: Could not parse json response from"
+					" ipc. This is a bug in sway.");
+			state->ret = 1;
+		}
+		state->done = true;
+		return;
+	}
+	if (!state->quiet) {
+		if (state->raw) {
+			printf("%s\n", json_object_to_json_string(obj));
+		} else {
+			printf("%s\n", json_object_to_json_string_ext(obj,
+				JSON_C_TO_STRING_PRETTY | JSON_C_TO_STRING_SPACED));
+		}
+		fflush(stdout);
+	}
+	json_object_put(obj);
+}
+
+// Reads one command per line and returns them as a JSON array
+static char *read_batch(FILE *file) {
+	json_object *commands = json_object_new_array();
+	char *line = NULL;
+	size_t line_size = 0;
+	ssize_t nread;
+	while ((nread = getline(&line, &line_size, file)) != -1) {
+		if (nread > 0 && line[nread - 1] == '\n') {
+			line[nread - 1] = '\0';
 		}
+		if (line[0] == '\0' || line[0] == '#') {
+			continue;
+		}
+		json_object_array_add(commands, json_object_new_string(line));
 	}
+	free(line);
+	char *json = strdup(json_object_to_json_string(commands));
+	json_object_put(commands);
+	return json;
 }
 
 int main(int argc, char **argv) {
 	static bool quiet = false;
 	static bool raw = false;
 	static bool monitor = false;
+	static bool batch = false;
 	char *socket_path = NULL;
 	char *cmdtype = NULL;
 
 	sway_log_init(SWAY_INFO, NULL);
 
 	static const struct option long_options[] = {
+		{"batch", no_argument, NULL, 'b'},
 		{"help", no_argument, NULL, 'h'},
 		{"monitor", no_argument, NULL, 'm'},
 		{"pretty", no_argument, NULL, 'p'},
@@ -358,6 +432,7 @@ int main(int argc, char **argv) {
 	const char *usage =
 		"Usage: swaymsg [options] [message]\n"
 		"\n"
+		"  -b, --batch            Run the commands read from stdin as one batch.\n"
 		"  -h, --help             Show help message and quit.\n"
 		"  -m, --monitor          Monitor until killed (-t SUBSCRIBE only)\n"
 		"  -p, --pretty           Use pretty output even when not using a tty\n"
@@ -372,11 +447,14 @@ int main(int argc, char **argv) {
 	int c;
 	while (1) {
 		int option_index = 0;
-		c = getopt_long(argc, argv, "hmpqrs:t:v", long_options, &option_index);
+		c = getopt_long(argc, argv, "bhmpqrs:t:v", long_options, &option_index);
 		if (c == -1) {
 			break;
 		}
 		switch (c) {
+		case 'b': // Batch
+			batch = true;
+			break;
 		case 'm': // Monitor
 			monitor = true;
 			break;
@@ -406,7 +484,7 @@ int main(int argc, char **argv) {
 	}
 
 	if (!cmdtype) {
-		cmdtype = strdup("command");
+		cmdtype = strdup(batch ? "command_batch" : "command");
 	}
 	if (!socket_path) {
 		socket_path = get_socketpath();
@@ -422,6 +500,8 @@ int main(int argc, char **argv) {
 
 	if (strcasecmp(cmdtype, "command") == 0) {
 		type = IPC_COMMAND;
+	} else if (strcasecmp(cmdtype, "command_batch") == 0) {
+		type = IPC_COMMAND_BATCH;
 	} else if (strcasecmp(cmdtype, "get_workspaces") == 0) {
 		type = IPC_GET_WORKSPACES;
 	} else if (strcasecmp(cmdtype, "get_seats") == 0) {
@@ -444,6 +524,12 @@ int main(int argc, char **argv) {
 		type = IPC_GET_BINDING_STATE;
 	} else if (strcasecmp(cmdtype, "get_config") == 0) {
 		type = IPC_GET_CONFIG;
+	} else if (strcasecmp(cmdtype, "get_stats") == 0) {
+		type = IPC_GET_STATS;
+	} else if (strcasecmp(cmdtype, "get_log") == 0) {
+		type = IPC_GET_LOG;
+	} else if (strcasecmp(cmdtype, "get_profile") == 0) {
+		type = IPC_GET_PROFILE;
 	} else if (strcasecmp(cmdtype, "send_tick") == 0) {
 		type = IPC_SEND_TICK;
 	} else if (strcasecmp(cmdtype, "subscribe") == 0) {
@@ -457,6 +543,14 @@ int main(int argc, char **argv) {
 
 	free(cmdtype);
 
+	if (batch && type != IPC_COMMAND_BATCH) {
+		if (!quiet) {
+			sway_log(SWAY_ERROR, "Batch can only be used with -t COMMAND_BATCH");
+		}
+		free(socket_path);
+		return 1;
+	}
+
 	if (monitor && type != IPC_SUBSCRIBE) {
 		if (!quiet) {
 			sway_log(SWAY_ERROR, "Monitor can only be used with -t SUBSCRIBE");
@@ -466,7 +560,9 @@ int main(int argc, char **argv) {
 	}
 
 	char *command = NULL;
-	if (optind < argc) {
+	if (batch) {
+		command = read_batch(stdin);
+	} else if (optind < argc) {
 		command = join_args(argv + optind, argc - optind);
 	} else {
 		command = strdup("");
@@ -511,38 +607,35 @@ int main(int argc, char **argv) {
 		timeout.tv_usec = 0;
 		ipc_set_recv_timeout(socketfd, timeout);
 
-		do {
-			struct ipc_response *reply = ipc_recv_response(socketfd);
-			if (!reply) {
-				break;
+		// Events are read into one reused buffer
+		struct event_state state = {
+			.quiet = quiet,
+			.raw = raw,
+			.monitor = monitor,
+		};
+		struct ipc_client *client =
+			ipc_client_create(socketfd, handle_event, NULL, &state);
+		if (!client) {
+			sway_abort("Unable to receive IPC response");
+		}
+		while (!state.done) {
+			struct pollfd pfd = {
+				.fd = ipc_client_get_fd(client),
+				.events = ipc_client_get_events(client),
+			};
+			if (poll(&pfd, 1, -1) == -1 && errno != EINTR) {
+				sway_abort("Unable to receive IPC response");
 			}
-
-			json_object *obj = json_tokener_parse(reply->payload);
-			if (obj == NULL) {
-				if (!quiet) {
-					fprintf(stderr, "ERROR: Could not parse json response from"
-							" ipc. This is a bug in sway.");
-					ret = 1;
-				}
-				break;
-			} else if (quiet) {
-				json_object_put(obj);
-			} else {
-				if (raw) {
-					printf("%s\n", json_object_to_json_string(obj));
-				} else {
-					printf("%s\n", json_object_to_json_string_ext(obj,
-						JSON_C_TO_STRING_PRETTY | JSON_C_TO_STRING_SPACED));
-				}
-				fflush(stdout);
-				json_object_put(obj);
+			if (!ipc_client_dispatch(client, pfd.revents) && !state.done) {
+				sway_abort("Unable to receive IPC response");
 			}
-
-			free_ipc_response(reply);
-		} while (monitor);
+		}
+		ret = state.ret;
+		ipc_client_destroy(client);
+	} else {
+		close(socketfd);
 	}
 
-	close(socketfd);
 	free(socket_path);
 	return ret;
 }
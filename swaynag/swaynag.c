@@ -8,6 +8,7 @@
 #include <wayland-cursor.h>
 #include "log.h"
 #include "list.h"
+#include "pango.h"
 #include "swaynag/render.h"
 #include "swaynag/swaynag.h"
 #include "swaynag/types.h"
@@ -532,13 +533,7 @@ void swaynag_destroy(struct swaynag *swaynag) {
 		swaynag_seat_destroy(seat);
 	}
 
-	if (&swaynag->buffers[0]) {
-		destroy_buffer(&swaynag->buffers[0]);
-	}
-
-	if (&swaynag->buffers[1]) {
-		destroy_buffer(&swaynag->buffers[1]);
-	}
+	finish_buffer_pool(&swaynag->buffers);
 
 	if (swaynag->outputs.prev || swaynag->outputs.next) {
 		struct swaynag_output *output, *temp;
@@ -557,4 +552,6 @@ void swaynag_destroy(struct swaynag *swaynag) {
 	if (swaynag->shm) {
 		wl_shm_destroy(swaynag->shm);
 	}
+
+	pango_layout_cache_finish();
 }